@@ -62,6 +62,17 @@ public class ContextSizePolicy
     /// </summary>
     public int MaxTokens { get; set; }
 
+    /// <summary>
+    /// Build context from per-command digests (head, tail and counts) instead of
+    /// truncating the flat output buffer, when a digest source is set
+    /// </summary>
+    public bool UseCommandDigests { get; set; }
+
+    /// <summary>
+    /// Most recent commands considered for digest context
+    /// </summary>
+    public int DigestCommandCount { get; set; }
+
     /// <summary>
     /// Model-specific default limits
     /// </summary>
@@ -87,6 +98,8 @@ public class ContextSizePolicy
         MaxLines = 500;
         MinTokens = 100;
         MaxTokens = 128000;
+        UseCommandDigests = false;
+        DigestCommandCount = 20;
     }
 
     /// <summary>
@@ -203,6 +216,12 @@ public class ContextSizePolicy
             return false;
         }
 
+        if (UseCommandDigests && DigestCommandCount <= 0)
+        {
+            errorMessage = "DigestCommandCount must be positive";
+            return false;
+        }
+
         return true;
     }
 
@@ -219,7 +238,9 @@ public class ContextSizePolicy
             MinLines = MinLines,
             MaxLines = MaxLines,
             MinTokens = MinTokens,
-            MaxTokens = MaxTokens
+            MaxTokens = MaxTokens,
+            UseCommandDigests = UseCommandDigests,
+            DigestCommandCount = DigestCommandCount
         };
     }
 }
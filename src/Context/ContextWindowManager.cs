@@ -1,4 +1,5 @@
 using Microsoft.Extensions.Logging;
+using PairAdmin.DataStructures;
 
 namespace PairAdmin.Context;
 
@@ -104,6 +105,7 @@ public class ContextWindowManager
     private readonly ContextSizePolicy _policy;
     private readonly ILogger<ContextWindowManager> _logger;
     private int _modelMaxContext;
+    private Func<int, IReadOnlyList<CommandDigest>>? _digestSource;
 
     /// <summary>
     /// Event raised when context is truncated
@@ -156,6 +158,16 @@ public class ContextWindowManager
         _logger.LogInformation($"Model max context set to {maxContext}");
     }
 
+    /// <summary>
+    /// Sets where per-command digests come from, such as
+    /// IOInterceptor.GetRecentCommandDigests; null goes back to the flat buffer
+    /// </summary>
+    /// <param name="source">Returns up to the given number of newest digests, oldest first</param>
+    public void SetCommandDigestSource(Func<int, IReadOnlyList<CommandDigest>>? source)
+    {
+        _digestSource = source;
+    }
+
     /// <summary>
     /// Gets truncated context based on policy
     /// </summary>
@@ -166,6 +178,11 @@ public class ContextWindowManager
         var targetSize = _policy.GetTargetSize(_modelMaxContext);
         var effectiveMax = Math.Min(targetSize, maxTokens);
 
+        if (_policy.UseCommandDigests && _digestSource != null)
+        {
+            return GetDigestContext(effectiveMax);
+        }
+
         var context = _contextProvider.GetContext();
         var estimatedTokens = EstimateTokenCount(context);
 
@@ -244,6 +261,88 @@ public class ContextWindowManager
         return targetSize;
     }
 
+    /// <summary>
+    /// Gets context made of the newest command digests that fit in the budget;
+    /// a newest digest too large on its own is cut down to the budget
+    /// </summary>
+    /// <param name="maxTokens">Maximum tokens allowed</param>
+    /// <returns>TruncationResult with digest context</returns>
+    public TruncationResult GetDigestContext(int maxTokens)
+    {
+        var digests = _digestSource?.Invoke(_policy.DigestCommandCount) ?? Array.Empty<CommandDigest>();
+        var parts = new List<string>();
+        var originalTokens = 0;
+        var keptTokens = 0;
+
+        // Newest first, so older commands give way before the last one does;
+        // smaller older ones still fill what a skipped one leaves
+        for (var i = digests.Count - 1; i >= 0; i--)
+        {
+            var text = digests[i].ToContextString();
+            var tokens = EstimateTokenCount(text);
+
+            originalTokens += tokens;
+            if (keptTokens + tokens > maxTokens)
+            {
+                if (i != digests.Count - 1)
+                {
+                    continue;
+                }
+
+                text = TruncateDigest(text, maxTokens);
+                tokens = EstimateTokenCount(text);
+                if (text.Length == 0)
+                {
+                    continue;
+                }
+            }
+
+            parts.Insert(0, text);
+            keptTokens += tokens;
+        }
+
+        var result = new TruncationResult
+        {
+            TruncatedContext = string.Join('\n', parts),
+            OriginalTokens = originalTokens,
+            TruncatedTokens = keptTokens,
+            WasTruncated = keptTokens < originalTokens,
+            Reason = keptTokens < originalTokens ? DetermineTruncationReason(originalTokens, maxTokens) : TruncationReason.None
+        };
+
+        if (result.WasTruncated)
+        {
+            ContextTruncated?.Invoke(this, result);
+        }
+
+        return result;
+    }
+
+    /// <summary>
+    /// Cuts one digest's text to maxTokens, keeping the command line and as much
+    /// of the end (tail and exit status) as fits
+    /// </summary>
+    private string TruncateDigest(string text, int maxTokens)
+    {
+        const string Marker = "[... truncated ...]\n";
+        var maxChars = Math.Max(maxTokens, 0) * 4;
+        var commandEnd = text.IndexOf('\n') + 1;
+
+        if (commandEnd == 0 || commandEnd + Marker.Length >= maxChars)
+        {
+            return text[..Math.Min(text.Length, maxChars)];
+        }
+
+        var end = text[^(maxChars - commandEnd - Marker.Length)..];
+        var lineStart = end.IndexOf('\n') + 1;
+        if (lineStart > 0 && lineStart < end.Length)
+        {
+            end = end[lineStart..];
+        }
+
+        return text[..commandEnd] + Marker + end;
+    }
+
     private TruncationResult TruncateContext(string context, int currentTokens, int targetTokens)
     {
         var lines = context.Split('\n');
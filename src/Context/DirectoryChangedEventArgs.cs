@@ -9,7 +9,8 @@ public enum DirectoryChangeType
 {
     UserCommand,    // User typed command (cd)
     ParsedPrompt,  // Detected from prompt
-    StackOperation  // push/pop from history
+    StackOperation, // push/pop from history
+    ShellReported   // Reported by the shell itself (OSC 7, found natively)
 }
 
 /// <summary>
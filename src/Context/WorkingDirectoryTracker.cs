@@ -131,6 +131,8 @@ public class WorkingDirectoryTracker
     private readonly ILogger<WorkingDirectoryTracker> _logger;
     private readonly DirectoryState _state;
     private readonly ConcurrentQueue<string> _commandQueue;
+    private bool _shellReportsDirectory;
+    private bool _reportedSincePrompt;
 
     /// <summary>
     /// Maximum history size
@@ -209,6 +211,25 @@ public class WorkingDirectoryTracker
 
         var parsed = _parser.ParsePrompt(terminalOutput);
 
+        // The shell says where it is before each prompt; guessing from prompts could
+        // only disagree. A prompt with no report before it means this shell does not
+        // report (ssh to another host, a different shell), so parsing takes over again.
+        if (_shellReportsDirectory && parsed.IsDetected)
+        {
+            if (_reportedSincePrompt)
+            {
+                _reportedSincePrompt = false;
+                return;
+            }
+
+            _shellReportsDirectory = false;
+            _logger.LogInformation("Shell stopped reporting its directory; parsing prompts again");
+        }
+        else if (_shellReportsDirectory)
+        {
+            return;
+        }
+
         if (parsed.IsDetected && !string.IsNullOrWhiteSpace(parsed.Directory))
         {
             var expandedDir = parsed.GetExpandedDirectory(_parser.GetHomeDirectory());
@@ -223,6 +244,23 @@ public class WorkingDirectoryTracker
         _state.Hostname = parsed.Hostname ?? _state.Hostname;
     }
 
+    /// <summary>
+    /// Applies a working directory reported by the shell, as delivered by the native
+    /// DIRECTORY mark; prompt parsing stops until a prompt arrives without a report
+    /// </summary>
+    /// <param name="directory">Directory the shell reported</param>
+    public void ApplyShellDirectory(string directory)
+    {
+        if (string.IsNullOrWhiteSpace(directory))
+        {
+            return;
+        }
+
+        _shellReportsDirectory = true;
+        _reportedSincePrompt = true;
+        SetDirectory(directory, DirectoryChangeType.ShellReported);
+    }
+
     /// <summary>
     /// Sets the current directory
     /// </summary>
@@ -368,10 +406,14 @@ public class WorkingDirectoryTracker
     }
 
     /// <summary>
-    /// Resets tracker to home directory
+    /// Resets tracker to home directory, as for a new session; prompts are parsed
+    /// until the shell reports its directory again
     /// </summary>
     public void ResetToHome()
     {
+        _shellReportsDirectory = false;
+        _reportedSincePrompt = false;
+
         var homeDir = _parser.GetHomeDirectory();
         SetDirectory(homeDir, DirectoryChangeType.UserCommand);
 
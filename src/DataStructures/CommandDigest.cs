@@ -0,0 +1,108 @@
+using System;
+using System.Collections.Generic;
+using System.Text;
+
+namespace PairAdmin.DataStructures;
+
+/// <summary>
+/// First and last lines of one command's output with counts of what lies between,
+/// as kept by the native command digest store (PairAdminDigestInfo in pairadmin.h)
+/// </summary>
+public sealed class CommandDigest
+{
+    /// <summary>
+    /// 1-based command number in the session
+    /// </summary>
+    public ulong Sequence { get; init; }
+
+    /// <summary>
+    /// Command line as submitted (redacted like input), empty if it was not seen
+    /// </summary>
+    public string CommandLine { get; init; } = string.Empty;
+
+    /// <summary>
+    /// Whether the command line may differ from what the shell ran
+    /// </summary>
+    public bool IsCommandInexact { get; init; }
+
+    /// <summary>
+    /// First lines of output
+    /// </summary>
+    public IReadOnlyList<string> HeadLines { get; init; } = Array.Empty<string>();
+
+    /// <summary>
+    /// Last lines of output; while running, the last may still be incomplete
+    /// </summary>
+    public IReadOnlyList<string> TailLines { get; init; } = Array.Empty<string>();
+
+    /// <summary>
+    /// Output lines in all
+    /// </summary>
+    public long TotalLines { get; init; }
+
+    /// <summary>
+    /// Lines in neither head nor tail
+    /// </summary>
+    public long ElidedLines { get; init; }
+
+    /// <summary>
+    /// Text bytes in neither head nor tail, cut parts of long lines included
+    /// </summary>
+    public long ElidedBytes { get; init; }
+
+    /// <summary>
+    /// Output bytes the command produced, escape sequences included
+    /// </summary>
+    public long OutputBytes { get; init; }
+
+    /// <summary>
+    /// Exit status, or null if the shell did not report it
+    /// </summary>
+    public int? ExitCode { get; init; }
+
+    /// <summary>
+    /// The command has not finished yet
+    /// </summary>
+    public bool IsRunning { get; init; }
+
+    /// <summary>
+    /// Some lines were longer than the native limit and were cut
+    /// </summary>
+    public bool HasCutLines { get; init; }
+
+    /// <summary>
+    /// Formats the digest as context text: the command, its head, a note of what was
+    /// left out, its tail and how it ended
+    /// </summary>
+    public string ToContextString()
+    {
+        var builder = new StringBuilder();
+
+        builder.Append("$ ").AppendLine(CommandLine);
+        foreach (var line in HeadLines)
+        {
+            builder.AppendLine(line);
+        }
+
+        if (ElidedLines > 0)
+        {
+            builder.AppendLine($"[... {ElidedLines} lines, {ElidedBytes} bytes omitted ...]");
+        }
+
+        foreach (var line in TailLines)
+        {
+            builder.AppendLine(line);
+        }
+
+        if (IsRunning)
+        {
+            builder.AppendLine("[still running]");
+        }
+        else if (ExitCode.HasValue)
+        {
+            builder.AppendLine($"[exit {ExitCode.Value}]");
+        }
+
+        return builder.ToString();
+    }
+}
@@ -84,14 +84,43 @@ public static class PuTTYInterop
         PairAdminCallback callback);
 
     /// <summary>
-    /// Get PuTTY terminal window handle
+    /// Terminal window of the process-wide session
     /// </summary>
-    /// <returns>Handle to PuTTY terminal window</returns>
+    /// <returns>Handle to PuTTY terminal window, or IntPtr.Zero until it exists</returns>
     [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
     public static extern IntPtr pairadmin_get_terminal_hwnd();
 
     /// <summary>
-    /// Initialize the PuTTY subsystem
+    /// PAIRADMIN_API_VERSION this layer was written against
+    /// </summary>
+    public const uint ApiVersion = 1;
+
+    /// <summary>
+    /// Build and load state of the native library (PairAdminCapabilities)
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct PairAdminCapabilities
+    {
+        public uint ApiVersion;
+        public uint Features;
+        public uint Cpu;
+        public uint Loaded;
+        public uint MaxSessions;
+        public uint MaxSubscribers;
+        public ulong RingDefaultSize;
+    }
+
+    /// <summary>
+    /// Query version, features and which subsystems are loaded; creates nothing
+    /// and may be called before pairadmin_init
+    /// </summary>
+    /// <returns>0 on success</returns>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int pairadmin_get_capabilities(out PairAdminCapabilities caps);
+
+    /// <summary>
+    /// Initialize the PuTTY subsystem. Only starts the session thread: rings,
+    /// capture files, the redaction automaton and the log are made on first use.
     /// </summary>
     /// <param name="parentHwnd">Parent window handle for embedding (can be IntPtr.Zero)</param>
     /// <returns>0 on success, non-zero on failure</returns>
@@ -99,12 +128,13 @@ public static class PuTTYInterop
     public static extern int pairadmin_init(IntPtr parentHwnd);
 
     /// <summary>
-    /// Connect to an SSH server
+    /// Queue a connection to an SSH server on the native session thread.
+    /// Returns at once; the outcome arrives as a Connected or Error event.
     /// </summary>
     /// <param name="hostname">Host to connect to</param>
     /// <param name="port">Port number (default 22)</param>
     /// <param name="username">Username for authentication</param>
-    /// <returns>0 on success, non-zero on failure</returns>
+    /// <returns>0 if the attempt was queued, non-zero on failure</returns>
     [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
     public static extern int pairadmin_connect(
         [MarshalAs(UnmanagedType.LPStr)] string hostname,
@@ -153,6 +183,150 @@ public static class PuTTYInterop
 
     #endregion
 
+    #region Per-Session API
+
+    /// <summary>
+    /// Delegate for per-session callbacks, invoked on the session's own delivery thread
+    /// </summary>
+    /// <param name="sessionId">Id of the session the event belongs to</param>
+    /// <param name="eventType">Type of event</param>
+    /// <param name="data">Pointer to event data, valid only during the call unless retained</param>
+    /// <param name="length">Length of data in bytes</param>
+    /// <param name="user">Opaque pointer passed to pairadmin_session_create</param>
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void PairAdminSessionCallback(
+        uint sessionId,
+        PairAdminEventType eventType,
+        IntPtr data,
+        nuint length,
+        IntPtr user);
+
+    /// <summary>
+    /// Per-session delivery statistics (PairAdminSessionStats)
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct PairAdminSessionStats
+    {
+        public ulong Events;
+        public ulong Bytes;
+        public ulong DroppedEvents;
+        public ulong DroppedBytes;
+    }
+
+    /// <summary>
+    /// Create and start an independent session with its own ring, threads and window
+    /// </summary>
+    /// <param name="callback">Callback for this session's events; keep the delegate alive until destroyed</param>
+    /// <param name="user">Opaque pointer handed back to the callback</param>
+    /// <param name="parentHwnd">Parent window for the session's terminal</param>
+    /// <param name="ringCapacity">Event ring size in bytes (0 for the default)</param>
+    /// <returns>Session handle, or IntPtr.Zero on failure</returns>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern IntPtr pairadmin_session_create(
+        [MarshalAs(UnmanagedType.FunctionPtr)] PairAdminSessionCallback callback,
+        IntPtr user,
+        IntPtr parentHwnd,
+        nuint ringCapacity);
+
+    /// <summary>
+    /// Close and free a session; blocks until its threads have exited
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void pairadmin_session_destroy(IntPtr session);
+
+    /// <summary>
+    /// Id carried by the session's callbacks
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern uint pairadmin_session_get_id(IntPtr session);
+
+    /// <summary>
+    /// Keep the event being delivered instead of copying it; call only from inside the
+    /// session callback
+    /// </summary>
+    /// <returns>
+    /// The record (PairAdminEventHeader, then the payload), valid until
+    /// <see cref="pairadmin_session_release"/>; IntPtr.Zero if the session's arena is
+    /// full and the data has to be copied
+    /// </returns>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern IntPtr pairadmin_session_retain(IntPtr session);
+
+    /// <summary>
+    /// Give a retained record back; from any thread, before the session is destroyed
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void pairadmin_session_release(IntPtr session, IntPtr record);
+
+    /// <summary>
+    /// Queue a connection for one session; the outcome arrives as an event
+    /// </summary>
+    /// <returns>0 if the attempt was queued, non-zero on failure</returns>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+    public static extern int pairadmin_session_connect(
+        IntPtr session,
+        [MarshalAs(UnmanagedType.LPStr)] string hostname,
+        int port,
+        [MarshalAs(UnmanagedType.LPStr)] string? username);
+
+    /// <summary>
+    /// Queue a disconnect for one session
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void pairadmin_session_disconnect(IntPtr session);
+
+    /// <summary>
+    /// Current state of one session
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern PairAdminState pairadmin_session_get_state(IntPtr session);
+
+    /// <summary>
+    /// Last error message of one session
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern IntPtr pairadmin_session_get_error(IntPtr session);
+
+    /// <summary>
+    /// Delivery statistics of one session
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void pairadmin_session_get_stats(IntPtr session, out PairAdminSessionStats stats);
+
+    /// <summary>
+    /// Terminal window of one session (IntPtr.Zero until the backend has created it)
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern IntPtr pairadmin_session_get_hwnd(IntPtr session);
+
+    /// <summary>
+    /// Embed the terminal window in a parent window; applied by the session
+    /// thread, now or once the window exists
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int pairadmin_embed(IntPtr parentHwnd);
+
+    /// <summary>
+    /// Place the embedded terminal window in parent client coordinates;
+    /// coalesced to one move per frame
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int pairadmin_set_bounds(int x, int y, int width, int height);
+
+    /// <summary>
+    /// pairadmin_embed for one session
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int pairadmin_session_embed(IntPtr session, IntPtr parentHwnd);
+
+    /// <summary>
+    /// pairadmin_set_bounds for one session
+    /// </summary>
+    [DllImport("PairAdminPuTTY", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int pairadmin_session_set_bounds(IntPtr session, int x, int y, int width, int height);
+
+    #endregion
+
     #region Windows APIs for Window Management
 
     /// <summary>
@@ -262,6 +436,25 @@ public static class PuTTYInterop
         pairadmin_set_callback(callback);
     }
 
+    /// <summary>
+    /// Handshake with the native library: loads it and checks it speaks this
+    /// layer's API version, without initializing anything
+    /// </summary>
+    /// <returns>The library's capabilities, or null if it is missing or incompatible</returns>
+    public static PairAdminCapabilities? GetCapabilities()
+    {
+        try
+        {
+            if (pairadmin_get_capabilities(out var caps) != 0 || caps.ApiVersion != ApiVersion)
+                return null;
+            return caps;
+        }
+        catch (Exception ex) when (ex is DllNotFoundException or EntryPointNotFoundException)
+        {
+            return null;
+        }
+    }
+
     /// <summary>
     /// Initialize the integrated PuTTY library
     /// </summary>
@@ -279,7 +472,7 @@ public static class PuTTYInterop
     /// <param name="hostname">Host to connect to</param>
     /// <param name="port">Port number (default 22)</param>
     /// <param name="username">Username for authentication (optional)</param>
-    /// <returns>True if connection was initiated successfully</returns>
+    /// <returns>True if the connection attempt was queued; watch for Connected/Error events</returns>
     public static bool Connect(string hostname, int port = 22, string? username = null)
     {
         int result = pairadmin_connect(hostname, port, username ?? "");
@@ -327,7 +520,8 @@ public static class PuTTYInterop
     }
 
     /// <summary>
-    /// Get the terminal window handle from the integrated PuTTY
+    /// Get the terminal window handle from the integrated PuTTY; IntPtr.Zero
+    /// until the session has created its window (see <see cref="EmbedTerminal"/>)
     /// </summary>
     public static IntPtr GetTerminalHandle()
     {
@@ -352,6 +546,28 @@ public static class PuTTYInterop
         }
     }
 
+    /// <summary>
+    /// Embed the PuTTY terminal in a parent window without blocking on
+    /// PuTTY's thread
+    /// </summary>
+    /// <param name="parentHandle">Parent window handle (TerminalPane)</param>
+    public static bool EmbedTerminal(IntPtr parentHandle)
+    {
+        return pairadmin_embed(parentHandle) == 0;
+    }
+
+    /// <summary>
+    /// Place the embedded PuTTY terminal; safe to call on every layout pass
+    /// </summary>
+    /// <param name="x">X position</param>
+    /// <param name="y">Y position</param>
+    /// <param name="width">Width</param>
+    /// <param name="height">Height</param>
+    public static bool SetTerminalBounds(int x, int y, int width, int height)
+    {
+        return pairadmin_set_bounds(x, y, width, height) == 0;
+    }
+
     /// <summary>
     /// Set parent window relationship
     /// </summary>
@@ -0,0 +1,39 @@
+using System;
+
+namespace PairAdmin.IoInterceptor.Events;
+
+/// <summary>
+/// Session state change reported by the native session thread
+/// </summary>
+public enum SessionStateChange
+{
+    /// <summary>Connection established</summary>
+    Connected = 3,
+
+    /// <summary>Connection closed</summary>
+    Disconnected = 4,
+
+    /// <summary>Connection attempt or session failed</summary>
+    Error = 5
+}
+
+/// <summary>
+/// Event arguments for session state events (connect, disconnect, error)
+/// </summary>
+public class SessionStateEventArgs : EventArgs
+{
+    /// <summary>
+    /// Timestamp when the event was received
+    /// </summary>
+    public DateTime Timestamp { get; init; }
+
+    /// <summary>
+    /// What happened to the session
+    /// </summary>
+    public SessionStateChange Change { get; init; }
+
+    /// <summary>
+    /// "host:port" for Connected, the reason or error message otherwise
+    /// </summary>
+    public string Message { get; init; } = string.Empty;
+}
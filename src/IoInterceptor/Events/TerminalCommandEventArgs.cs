@@ -0,0 +1,71 @@
+using System;
+
+namespace PairAdmin.IoInterceptor.Events;
+
+/// <summary>
+/// Native command flags (PAIRADMIN_COMMAND_* in pairadmin.h)
+/// </summary>
+[Flags]
+public enum TerminalCommandFlags : uint
+{
+    /// <summary>Typed key by key</summary>
+    None = 0,
+
+    /// <summary>Some of the line was pasted</summary>
+    Pasted = 0x001,
+
+    /// <summary>Edited with keys only the shell interprets (history, Tab, arrows)</summary>
+    Inexact = 0x002,
+
+    /// <summary>Longer than the native line buffer</summary>
+    Truncated = 0x004,
+
+    /// <summary>; &amp; | ` or $( run further commands</summary>
+    Chained = 0x008,
+
+    /// <summary>$VAR or ${...}</summary>
+    Expansion = 0x010,
+
+    /// <summary>../</summary>
+    Traversal = 0x020,
+
+    /// <summary>\xNN, %NN or 0xNN</summary>
+    Encoded = 0x040,
+
+    /// <summary>A command name is on the native denylist</summary>
+    Denied = 0x100,
+
+    /// <summary>Enter was withheld from the server</summary>
+    Blocked = 0x200
+}
+
+/// <summary>
+/// Event arguments for a command line submitted with Enter, assembled natively
+/// </summary>
+public class TerminalCommandEventArgs : EventArgs
+{
+    /// <summary>
+    /// Timestamp when the line was submitted
+    /// </summary>
+    public DateTime Timestamp { get; init; }
+
+    /// <summary>
+    /// Command line as the native line editor saw it (redacted like input)
+    /// </summary>
+    public string CommandLine { get; init; } = string.Empty;
+
+    /// <summary>
+    /// What the native prefilter found in the line
+    /// </summary>
+    public TerminalCommandFlags Flags { get; init; }
+
+    /// <summary>
+    /// Denylist entry that matched, or null if none
+    /// </summary>
+    public string? DeniedCommand { get; init; }
+
+    /// <summary>
+    /// Whether the text may differ from what the shell runs
+    /// </summary>
+    public bool IsExact => (Flags & (TerminalCommandFlags.Inexact | TerminalCommandFlags.Truncated)) == 0;
+}
@@ -0,0 +1,70 @@
+using System;
+using PairAdmin.IoInterceptor.Services;
+
+namespace PairAdmin.IoInterceptor.Events;
+
+/// <summary>
+/// Kind of shell mark (PAIRADMIN_EVENT_PROMPT .. PAIRADMIN_EVENT_DIRECTORY in pairadmin.h)
+/// </summary>
+public enum TerminalMarkType
+{
+    /// <summary>The shell is showing a prompt</summary>
+    Prompt = 9,
+
+    /// <summary>A command's output starts</summary>
+    CommandStart = 10,
+
+    /// <summary>A command finished</summary>
+    CommandEnd = 11,
+
+    /// <summary>The shell reported its working directory</summary>
+    Directory = 12
+}
+
+/// <summary>
+/// Event arguments for a prompt or command boundary found by the native output hook
+/// </summary>
+public class TerminalMarkEventArgs : EventArgs
+{
+    /// <summary>
+    /// Timestamp when the mark was delivered
+    /// </summary>
+    public DateTime Timestamp { get; init; }
+
+    /// <summary>
+    /// What the mark is
+    /// </summary>
+    public TerminalMarkType Type { get; init; }
+
+    /// <summary>
+    /// Session output bytes before the mark, counted before redaction
+    /// </summary>
+    public long Offset { get; init; }
+
+    /// <summary>
+    /// For <see cref="TerminalMarkType.CommandEnd"/>, where the command's output started;
+    /// its output is [CommandOffset, Offset)
+    /// </summary>
+    public long CommandOffset { get; init; }
+
+    /// <summary>
+    /// Exit status reported by the shell, or null if it gave none
+    /// </summary>
+    public int? ExitCode { get; init; }
+
+    /// <summary>
+    /// Whether the shell said so or the prompt fingerprint matched
+    /// </summary>
+    public NativeShellMarks Source { get; init; }
+
+    /// <summary>
+    /// Working directory (<see cref="TerminalMarkType.Directory"/> only)
+    /// </summary>
+    public string? Directory { get; init; }
+
+    /// <summary>
+    /// For <see cref="TerminalMarkType.Directory"/>, whether the shell repeated the
+    /// directory it reported last; shells report it before every prompt
+    /// </summary>
+    public bool Unchanged { get; init; }
+}
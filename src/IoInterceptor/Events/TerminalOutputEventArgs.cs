@@ -31,4 +31,9 @@ public class TerminalOutputEventArgs : EventArgs
     /// Whether the data contains ANSI escape sequences
     /// </summary>
     public bool ContainsAnsiSequences { get; init; }
+
+    /// <summary>
+    /// Whether escape sequences were already removed by the native filter
+    /// </summary>
+    public bool IsEscapeFiltered { get; init; }
 }
@@ -0,0 +1,44 @@
+using System;
+
+namespace PairAdmin.IoInterceptor.Events;
+
+/// <summary>
+/// Event arguments for a new terminal window, or its removal (PAIRADMIN_EVENT_WINDOW)
+/// </summary>
+public class TerminalWindowEventArgs : EventArgs
+{
+    /// <summary>
+    /// Timestamp when the event was delivered
+    /// </summary>
+    public DateTime Timestamp { get; init; }
+
+    /// <summary>
+    /// Terminal window handle, or IntPtr.Zero once the window is gone
+    /// </summary>
+    public IntPtr Handle { get; init; }
+
+    /// <summary>
+    /// Window it has been embedded in, or IntPtr.Zero if not embedded yet
+    /// </summary>
+    public IntPtr Parent { get; init; }
+
+    /// <summary>
+    /// X position in parent client coordinates
+    /// </summary>
+    public int X { get; init; }
+
+    /// <summary>
+    /// Y position in parent client coordinates
+    /// </summary>
+    public int Y { get; init; }
+
+    /// <summary>
+    /// Width applied, or 0 if no bounds have been set
+    /// </summary>
+    public int Width { get; init; }
+
+    /// <summary>
+    /// Height applied, or 0 if no bounds have been set
+    /// </summary>
+    public int Height { get; init; }
+}
@@ -1,10 +1,16 @@
 using System;
+using System.Buffers.Binary;
+using System.IO;
 using System.Reactive.Subjects;
 using System.Runtime.InteropServices;
 using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
 using Microsoft.Extensions.Logging;
+using PairAdmin.DataStructures;
 using PairAdmin.IoInterceptor.Events;
 using PairAdmin.IoInterceptor.Models;
+using PairAdmin.IoInterceptor.Services;
 
 namespace PairAdmin.IoInterceptor;
 
@@ -16,11 +22,69 @@ public class IOInterceptor : IDisposable
     private readonly ILogger<IOInterceptor> _logger;
     private readonly Subject<TerminalOutputEventArgs> _outputSubject;
     private readonly Subject<TerminalInputEventArgs> _inputSubject;
+    private readonly Subject<SessionStateEventArgs> _sessionSubject;
+    private readonly Subject<TerminalCommandEventArgs> _commandSubject;
+    private readonly Subject<TerminalMarkEventArgs> _markSubject;
+    private readonly Subject<TerminalWindowEventArgs> _windowSubject;
     private readonly TerminalStatistics _statistics;
+    private readonly IoInterceptorConfiguration _configuration;
     private PairAdminCallback? _callbackDelegate;
+    private PairAdminBatchCallback? _batchCallbackDelegate;
+    private readonly List<NativeSubscription> _nativeSubscriptions = new();
+    private Thread? _drainThread;
+    private IntPtr _eventRegion;
+    private volatile bool _draining;
     private bool _isRegistered;
+    private bool _captureOpen;
+    private bool _screenOpen;
+    private bool _digestsOpen;
+    private bool _recording;
+    private bool _exporting;
     private bool _disposed;
 
+    // Layout of PairAdminEventHeader in pairadmin.h
+    private const int RecordHeaderSize = 24;
+    private const int RecordAlignment = 8;
+
+    // PAIRADMIN_EVENT_GAP
+    private const int GapEventType = 7;
+
+    // PAIRADMIN_EVENT_TYPE_COUNT; types 1 .. EventTypeCount - 1 are defined
+    private const int EventTypeCount = 14;
+
+    // PAIRADMIN_TEXT_ASCII, as set in record header flags and ChunkInfo.Flags
+    private const uint TextAscii = 0x1;
+
+    // PAIRADMIN_SCREEN_ALTERNATE and PAIRADMIN_SCREEN_MAX_COLS
+    private const uint ScreenAlternate = 0x1;
+    private const int ScreenMaxColumns = 1024;
+
+    // PAIRADMIN_EVENT_COMMAND and its PairAdminCommandInfo header
+    private const int CommandEventType = 8;
+    private const int CommandInfoSize = 16;
+
+    // PAIRADMIN_EVENT_PROMPT .. PAIRADMIN_EVENT_DIRECTORY, their PairAdminMarkInfo header
+    // and PAIRADMIN_EXIT_UNKNOWN
+    private const int FirstMarkEventType = 9;
+    private const int LastMarkEventType = 12;
+    private const int MarkInfoSize = 32;
+    private const int ExitUnknown = int.MinValue;
+
+    // PAIRADMIN_MARK_UNCHANGED
+    private const ushort MarkUnchanged = 0x1;
+
+    // PAIRADMIN_EVENT_WINDOW and its PairAdminWindowInfo
+    private const int WindowEventType = 13;
+    private const int WindowInfoSize = 32;
+
+    // PAIRADMIN_DIGEST_RUNNING, _CUT and _INEXACT
+    private const uint DigestRunning = 0x1;
+    private const uint DigestCut = 0x2;
+    private const uint DigestInexact = 0x4;
+
+    // PAIRADMIN_STATS_BUCKETS
+    private const int StatsBuckets = 20;
+
     /// <summary>
     /// PairAdmin callback delegate type matching the native signature
     /// </summary>
@@ -30,6 +94,28 @@ public class IOInterceptor : IDisposable
     [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
     public delegate void PairAdminCallback(byte eventType, IntPtr data, int length);
 
+    /// <summary>
+    /// Batch callback delegate type matching the native signature
+    /// </summary>
+    /// <param name="eventType">Type of event (1=Output, 2=Input)</param>
+    /// <param name="data">Pointer to the coalesced fragments</param>
+    /// <param name="length">Total length of data</param>
+    /// <param name="index">Pointer to the PairAdminBatchEntry array</param>
+    /// <param name="count">Number of fragments in the batch</param>
+    /// <param name="info">Pointer to the PairAdminChunkInfo for the whole batch</param>
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void PairAdminBatchCallback(int eventType, IntPtr data, nuint length, IntPtr index, nuint count, IntPtr info);
+
+    /// <summary>
+    /// Native subscriber callback delegate type matching the native signature
+    /// </summary>
+    /// <param name="eventType">Type of event (1=Output, 2=Input, 6=Output text, 8=Command, 9-12=Shell marks, 13=Window)</param>
+    /// <param name="data">Pointer to event data</param>
+    /// <param name="length">Length of data</param>
+    /// <param name="user">Opaque pointer passed to pairadmin_add_subscriber</param>
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void PairAdminSubscriberCallback(int eventType, IntPtr data, nuint length, IntPtr user);
+
     /// <summary>
     /// Observable stream of terminal output events
     /// </summary>
@@ -40,6 +126,26 @@ public class IOInterceptor : IDisposable
     /// </summary>
     public IObservable<TerminalInputEventArgs> InputEvents => _inputSubject;
 
+    /// <summary>
+    /// Observable stream of session state events (connected, disconnected, error)
+    /// </summary>
+    public IObservable<SessionStateEventArgs> SessionEvents => _sessionSubject;
+
+    /// <summary>
+    /// Observable stream of command lines submitted with Enter, assembled by the native input hook
+    /// </summary>
+    public IObservable<TerminalCommandEventArgs> CommandEvents => _commandSubject;
+
+    /// <summary>
+    /// Observable stream of prompt, command and directory marks found by the native output hook
+    /// </summary>
+    public IObservable<TerminalMarkEventArgs> MarkEvents => _markSubject;
+
+    /// <summary>
+    /// Observable stream of terminal windows created (and removed) by the native session thread
+    /// </summary>
+    public IObservable<TerminalWindowEventArgs> WindowEvents => _windowSubject;
+
     /// <summary>
     /// Terminal I/O statistics
     /// </summary>
@@ -50,14 +156,34 @@ public class IOInterceptor : IDisposable
     /// </summary>
     public bool IsRegistered => _isRegistered;
 
+    /// <summary>
+    /// Whether the batch callback is currently registered with PuTTY
+    /// </summary>
+    public bool IsBatchRegistered => _batchCallbackDelegate != null;
+
+    /// <summary>
+    /// Whether events are being drained from the native event ring
+    /// </summary>
+    public bool IsQueuedCaptureActive => _draining;
+
+    /// <summary>
+    /// Payload bytes the native event ring has discarded on overflow
+    /// </summary>
+    public ulong NativeDroppedBytes => NativeMethods.pairadmin_get_dropped_bytes();
+
     /// <summary>
     /// Creates a new IOInterceptor instance
     /// </summary>
-    public IOInterceptor(ILogger<IOInterceptor> logger)
+    public IOInterceptor(ILogger<IOInterceptor> logger, IoInterceptorConfiguration? configuration = null)
     {
         _logger = logger ?? throw new ArgumentNullException(nameof(logger));
+        _configuration = configuration ?? new IoInterceptorConfiguration();
         _outputSubject = new Subject<TerminalOutputEventArgs>();
         _inputSubject = new Subject<TerminalInputEventArgs>();
+        _sessionSubject = new Subject<SessionStateEventArgs>();
+        _commandSubject = new Subject<TerminalCommandEventArgs>();
+        _markSubject = new Subject<TerminalMarkEventArgs>();
+        _windowSubject = new Subject<TerminalWindowEventArgs>();
         _statistics = new TerminalStatistics();
     }
 
@@ -78,6 +204,7 @@ public class IOInterceptor : IDisposable
             _callbackDelegate = OnPuTTYCallback;
 
             // Register with native PuTTY library
+            ApplyNativeOptions();
             NativeMethods.pairadmin_set_callback(_callbackDelegate);
             _isRegistered = true;
 
@@ -102,6 +229,7 @@ public class IOInterceptor : IDisposable
 
         try
         {
+            // Returns only once no native hook can still be running the delegate
             NativeMethods.pairadmin_set_callback(null);
             _callbackDelegate = null;
             _isRegistered = false;
@@ -115,150 +243,1553 @@ public class IOInterceptor : IDisposable
     }
 
     /// <summary>
-    /// Get the PuTTY terminal window handle for embedding
+    /// Register the batch callback so PuTTY output arrives coalesced per burst
+    /// on a native thread, rather than once per terminal fragment.
+    /// Safe to call while the terminal is active.
     /// </summary>
-    public IntPtr GetTerminalWindowHandle()
+    public void RegisterBatchCallback()
     {
-        try
+        if (_batchCallbackDelegate != null)
         {
-            return NativeMethods.pairadmin_get_terminal_hwnd();
+            _logger.LogWarning("Batch callback already registered");
+            return;
         }
-        catch (Exception ex)
+
+        // Create and store delegate to prevent garbage collection
+        var callback = new PairAdminBatchCallback(OnPuTTYBatchCallback);
+        ApplyNativeOptions();
+        if (NativeMethods.pairadmin_set_batch_callback(
+                callback,
+                (nuint)_configuration.MaxBatchBytes,
+                (uint)_configuration.MaxBatchDelayUs) != 0)
         {
-            _logger.LogError(ex, "Failed to get terminal window handle");
-            return IntPtr.Zero;
+            throw new InvalidOperationException("Failed to register PairAdmin batch callback");
         }
+        _batchCallbackDelegate = callback;
+
+        _logger.LogInformation("PairAdmin batch callback registered ({MaxBytes} bytes, {MaxDelay} us, {Policy})",
+            _configuration.MaxBatchBytes, _configuration.MaxBatchDelayUs, _configuration.BatchPolicy);
     }
 
     /// <summary>
-    /// Callback handler invoked by PuTTY for terminal I/O events
+    /// Unregister the batch callback; pending fragments are flushed first
     /// </summary>
-    private void OnPuTTYCallback(byte eventType, IntPtr data, int length)
+    public void UnregisterBatchCallback()
     {
-        if (length <= 0 || data == IntPtr.Zero)
+        if (_batchCallbackDelegate == null)
         {
             return;
         }
 
         try
         {
-            // Copy data from native memory
-            var buffer = new byte[length];
-            Marshal.Copy(data, buffer, 0, length);
+            NativeMethods.pairadmin_set_batch_callback(null, 0, 0);
+            _batchCallbackDelegate = null;
+
+            _logger.LogInformation("PairAdmin batch callback unregistered");
+        }
+        catch (Exception ex)
+        {
+            _logger.LogError(ex, "Failed to unregister PairAdmin batch callback");
+        }
+    }
 
-            // Parse as UTF-8 string
-            var text = Encoding.UTF8.GetString(buffer);
+    /// <summary>
+    /// Switch PuTTY's hooks to the native event ring and drain it on a dedicated thread.
+    /// Safe to call while the terminal is active.
+    /// </summary>
+    public void StartQueuedCapture()
+    {
+        if (_draining)
+        {
+            _logger.LogWarning("Queued capture already active");
+            return;
+        }
 
-            if (eventType == 1) // Output
+        ApplyNativeOptions();
+
+        if (_configuration.UseSharedEventRegion)
+        {
+            if (NativeMethods.pairadmin_map_event_region((nuint)_configuration.NativeRingSize, out _eventRegion) != 0)
             {
-                ProcessOutput(buffer, text);
+                throw new InvalidOperationException("Failed to map the native event region");
             }
-            else if (eventType == 2) // Input
+        }
+        else if (NativeMethods.pairadmin_ring_open((nuint)_configuration.NativeRingSize) != 0)
+        {
+            throw new InvalidOperationException("Failed to open the native event ring");
+        }
+
+        _draining = true;
+        _drainThread = new Thread(_eventRegion != IntPtr.Zero ? DrainRegionLoop : DrainLoop)
+        {
+            IsBackground = true,
+            Name = "PairAdmin event drain"
+        };
+        _drainThread.Start();
+
+        _logger.LogInformation("Queued capture started ({RingSize} byte ring)", _configuration.NativeRingSize);
+    }
+
+    /// <summary>
+    /// Stop draining and return PuTTY's hooks to direct callback delivery.
+    /// Safe to call while the terminal is active.
+    /// </summary>
+    public void StopQueuedCapture()
+    {
+        if (!_draining)
+        {
+            return;
+        }
+
+        _draining = false;
+        NativeMethods.pairadmin_wake_events();
+        _drainThread?.Join();
+        _drainThread = null;
+
+        try
+        {
+            // Also unmaps the shared region when one is in use
+            NativeMethods.pairadmin_ring_close();
+            _eventRegion = IntPtr.Zero;
+        }
+        catch (Exception ex)
+        {
+            _logger.LogError(ex, "Failed to close the native event ring");
+        }
+
+        _logger.LogInformation("Queued capture stopped");
+    }
+
+    /// <summary>
+    /// Subscribe to the native event stream with its own cursor and native thread.
+    /// Unlike <see cref="OutputEvents"/>, a slow handler only loses its own backlog
+    /// and never delays other consumers. Dispose the result to unsubscribe.
+    /// </summary>
+    /// <param name="eventTypes">Event types to receive (1=Output, 2=Input, 6=Output text, 8=Command, 9-12=Shell marks, 13=Window)</param>
+    /// <param name="handler">Invoked on the subscriber's thread with the event type and payload</param>
+    public NativeSubscription AddNativeSubscriber(int[] eventTypes, Action<int, byte[]> handler)
+    {
+        ArgumentNullException.ThrowIfNull(eventTypes);
+        ArgumentNullException.ThrowIfNull(handler);
+
+        uint mask = EventMask(eventTypes, nameof(eventTypes));
+
+        var subscription = new NativeSubscription(this, handler);
+        subscription.Id = NativeMethods.pairadmin_add_subscriber(subscription.Callback, IntPtr.Zero, mask);
+        if (subscription.Id <= 0)
+        {
+            throw new InvalidOperationException("Failed to add PairAdmin native subscriber");
+        }
+
+        lock (_nativeSubscriptions)
+        {
+            _nativeSubscriptions.Add(subscription);
+        }
+
+        _logger.LogInformation("Native subscriber {Id} added (mask 0x{Mask:x})", subscription.Id, mask);
+        return subscription;
+    }
+
+    private void RemoveNativeSubscriber(NativeSubscription subscription)
+    {
+        lock (_nativeSubscriptions)
+        {
+            if (!_nativeSubscriptions.Remove(subscription))
             {
-                ProcessInput(buffer, text);
+                return;
             }
         }
+
+        try
+        {
+            // Returns only once the subscriber thread has stopped calling the delegate
+            NativeMethods.pairadmin_remove_subscriber(subscription.Id);
+
+            _logger.LogInformation("Native subscriber {Id} removed", subscription.Id);
+        }
         catch (Exception ex)
         {
-            _logger.LogError(ex, "Error processing PuTTY callback: eventType={EventType}, length={Length}",
-                eventType, length);
+            _logger.LogError(ex, "Failed to remove PairAdmin native subscriber {Id}", subscription.Id);
         }
     }
 
     /// <summary>
-    /// Process terminal output event
+    /// Start the native capture store: every output and input event is appended to
+    /// memory-mapped segment files, so any range of lines can be read back later
+    /// without keeping it on the managed heap
     /// </summary>
-    private void ProcessOutput(byte[] data, string text)
+    /// <param name="directory">Directory for the segment files (null for the temp directory)</param>
+    public void StartNativeCapture(string? directory = null)
     {
-        // Count newlines for line statistics
-        int lines = 0;
-        foreach (char c in text)
+        if (NativeMethods.pairadmin_capture_open(IntPtr.Zero, directory, 0) != 0)
         {
-            if (c == '\n') lines++;
+            throw new InvalidOperationException("Failed to open PairAdmin capture store");
         }
 
-        // Update statistics
-        _statistics.RecordOutput(data.Length, lines);
+        _captureOpen = true;
+        _logger.LogInformation("Native capture started in {Directory}", directory ?? Path.GetTempPath());
+    }
 
-        // Check for ANSI sequences (basic check for ESC character)
-        bool hasAnsi = text.Contains('\x1b');
+    /// <summary>
+    /// Stop the native capture store; the segment files stay on disk
+    /// </summary>
+    public void StopNativeCapture()
+    {
+        if (!_captureOpen)
+        {
+            return;
+        }
 
-        // Create event args
-        var args = new TerminalOutputEventArgs
+        NativeMethods.pairadmin_capture_close(IntPtr.Zero);
+        _captureOpen = false;
+        _logger.LogInformation("Native capture stopped");
+    }
+
+    /// <summary>
+    /// Write everything the native capture store holds to a compressed export file:
+    /// full segments, already compressed in the background, are copied as they are
+    /// and only the live one is compressed now
+    /// </summary>
+    /// <param name="path">Export file to create; an existing file is replaced</param>
+    /// <returns>Bytes written</returns>
+    public long ExportNativeCapture(string path)
+    {
+        var written = _captureOpen ? NativeMethods.pairadmin_capture_export(IntPtr.Zero, path) : -1;
+        if (written < 0)
         {
-            Timestamp = DateTime.UtcNow,
-            RawData = data,
-            ParsedData = text,
-            ContainsAnsiSequences = hasAnsi
-        };
+            throw new IOException($"Failed to export PairAdmin capture store to {path}");
+        }
 
-        // Publish to subscribers
-        _outputSubject.OnNext(args);
+        _logger.LogInformation("Native capture exported to {Path} ({Bytes} bytes)", path, written);
+        return written;
+    }
 
-        _logger.LogDebug("Terminal output: {Length} bytes, {Lines} lines", data.Length, lines);
+    /// <summary>
+    /// Complete output lines in the native capture store
+    /// </summary>
+    public ulong CapturedLineCount => NativeMethods.pairadmin_log_line_count(IntPtr.Zero);
+
+    /// <summary>
+    /// Read a range of captured output lines (0-based), newlines included
+    /// </summary>
+    /// <param name="firstLine">First line to return</param>
+    /// <param name="count">Maximum number of lines</param>
+    /// <param name="maxBytes">Upper bound on the bytes copied</param>
+    public string ReadCapturedLines(ulong firstLine, int count, int maxBytes = 1 << 20)
+    {
+        if (count <= 0)
+        {
+            return string.Empty;
+        }
+
+        var buffer = new byte[maxBytes];
+        var written = NativeMethods.pairadmin_log_read_range(
+            IntPtr.Zero, firstLine, (uint)count, buffer, (nuint)buffer.Length, out _);
+        return Encoding.UTF8.GetString(buffer, 0, (int)written);
     }
 
     /// <summary>
-    /// Process terminal input event
+    /// Get the newest captured output lines (oldest first), the line still being
+    /// written last. The native line store hands back spans into its own memory,
+    /// so only the requested lines are decoded, however long the log is.
     /// </summary>
-    private void ProcessInput(byte[] data, string text)
+    /// <param name="count">Maximum number of lines</param>
+    public unsafe string[] GetCapturedLastLines(int count)
     {
-        // Update statistics
-        _statistics.RecordInput(data.Length);
+        if (count <= 0 || !_captureOpen)
+        {
+            return Array.Empty<string>();
+        }
 
-        // Determine if interactive (single character or printable)
-        bool isInteractive = data.Length <= 4 || text.All(c => !char.IsControl(c) || c == '\r' || c == '\n');
+        var spans = new LineSpan[count];
+        uint filled;
+        fixed (LineSpan* p = spans)
+        {
+            filled = NativeMethods.pairadmin_get_last_lines(IntPtr.Zero, (uint)count, p);
+        }
 
-        // Create event args
-        var args = new TerminalInputEventArgs
+        var lines = new string[filled];
+        for (var i = 0; i < lines.Length; i++)
         {
-            Timestamp = DateTime.UtcNow,
-            RawData = data,
-            CommandString = text,
-            IsInteractive = isInteractive
-        };
+            lines[i] = Encoding.UTF8.GetString((byte*)spans[i].Data, (int)spans[i].Length);
+        }
+        return lines;
+    }
 
-        // Publish to subscribers
-        _inputSubject.OnNext(args);
+    /// <summary>
+    /// Start the native screen model: output is interpreted into a virtual screen,
+    /// so what the terminal shows can be read without replaying full-screen redraws
+    /// </summary>
+    /// <param name="columns">Screen width (0 for 80)</param>
+    /// <param name="rows">Screen height (0 for 24)</param>
+    public void OpenScreenModel(int columns = 0, int rows = 0)
+    {
+        if (NativeMethods.pairadmin_screen_open(IntPtr.Zero, (uint)Math.Max(columns, 0), (uint)Math.Max(rows, 0)) != 0)
+        {
+            throw new InvalidOperationException("Failed to open PairAdmin screen model");
+        }
 
-        _logger.LogDebug("Terminal input: {Length} bytes", data.Length);
+        _screenOpen = true;
+        _logger.LogInformation("Native screen model opened");
     }
 
     /// <summary>
-    /// Dispose resources
+    /// Stop the native screen model
     /// </summary>
-    public void Dispose()
+    public void CloseScreenModel()
     {
-        if (_disposed)
+        if (!_screenOpen)
         {
             return;
         }
 
-        UnregisterCallback();
+        NativeMethods.pairadmin_screen_close(IntPtr.Zero);
+        _screenOpen = false;
+        _logger.LogInformation("Native screen model closed");
+    }
 
-        _outputSubject.OnCompleted();
-        _outputSubject.Dispose();
+    /// <summary>
+    /// Follow a terminal resize; every row counts as changed afterwards
+    /// </summary>
+    public void ResizeScreen(int columns, int rows)
+    {
+        if (_screenOpen &&
+            NativeMethods.pairadmin_screen_resize(IntPtr.Zero, (uint)Math.Max(columns, 0), (uint)Math.Max(rows, 0)) != 0)
+        {
+            _logger.LogWarning("Failed to resize PairAdmin screen model to {Columns}x{Rows}", columns, rows);
+        }
+    }
 
-        _inputSubject.OnCompleted();
-        _inputSubject.Dispose();
+    /// <summary>
+    /// Get the whole screen as it is now
+    /// </summary>
+    public TerminalScreen GetScreenSnapshot()
+    {
+        if (!_screenOpen)
+        {
+            return new TerminalScreen();
+        }
 
-        _disposed = true;
+        // Every row at four bytes per cell plus its newline; one retry if the
+        // terminal grew in between
+        var info = new ScreenInfo();
+        var buffer = Array.Empty<byte>();
+        nuint written = 0;
+        for (var attempt = 0; attempt < 2; attempt++)
+        {
+            NativeMethods.pairadmin_get_screen_snapshot(IntPtr.Zero, null, 0, out info);
+            buffer = new byte[(int)info.Rows * ((int)info.Cols * 4 + 1)];
+            written = NativeMethods.pairadmin_get_screen_snapshot(IntPtr.Zero, buffer, (nuint)buffer.Length, out var taken);
+            var grew = taken.Cols > info.Cols || taken.Rows > info.Rows;
+            info = taken;
+            if (!grew)
+            {
+                break;
+            }
+        }
 
-        _logger.LogInformation("IOInterceptor disposed");
+        return ToScreen(info, Encoding.UTF8.GetString(buffer, 0, (int)written), new Dictionary<int, string>());
     }
 
     /// <summary>
-    /// Native methods for PuTTY integration
+    /// Get the rows changed after generation <paramref name="since"/>, the
+    /// <see cref="TerminalScreen.Generation"/> of an earlier call (0 for every row)
     /// </summary>
-    private static class NativeMethods
+    public TerminalScreen GetScreenChanges(ulong since)
     {
-        private const string DllName = "PairAdminPuTTY";
+        if (!_screenOpen)
+        {
+            return new TerminalScreen();
+        }
 
-        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
-        public static extern void pairadmin_set_callback(
-            [MarshalAs(UnmanagedType.FunctionPtr)] PairAdminCallback? callback);
+        var buffer = new byte[4096];
+        ScreenInfo info;
+        nuint written;
+        while (NativeMethods.pairadmin_get_screen_changes(
+                   IntPtr.Zero, since, buffer, (nuint)buffer.Length, out written, out info) < 0)
+        {
+            if (written == 0)
+            {
+                return new TerminalScreen();
+            }
+            buffer = new byte[(int)written + ScreenMaxColumns * 4];
+        }
 
-        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
-        public static extern IntPtr pairadmin_get_terminal_hwnd();
+        var rows = new Dictionary<int, string>();
+        var offset = 0;
+        while (offset < (int)written)
+        {
+            var row = BinaryPrimitives.ReadInt32LittleEndian(buffer.AsSpan(offset));
+            var length = BinaryPrimitives.ReadInt32LittleEndian(buffer.AsSpan(offset + 4));
+            rows[row] = Encoding.UTF8.GetString(buffer, offset + 8, length);
+            offset += (8 + length + 3) & ~3;
+        }
+
+        return ToScreen(info, string.Empty, rows);
+    }
+
+    /// <summary>
+    /// Start keeping native digests of each command's output: the first
+    /// <paramref name="headLines"/> and last <paramref name="tailLines"/> lines for the
+    /// last <paramref name="commands"/> commands (0 for the native defaults). Needs
+    /// <see cref="IoInterceptorConfiguration.NativeShellMarks"/> to find the commands.
+    /// </summary>
+    public void OpenCommandDigests(int headLines = 0, int tailLines = 0, int commands = 0)
+    {
+        if (NativeMethods.pairadmin_digest_open(IntPtr.Zero, (uint)Math.Max(headLines, 0),
+                (uint)Math.Max(tailLines, 0), (uint)Math.Max(commands, 0)) != 0)
+        {
+            throw new InvalidOperationException("Failed to open PairAdmin command digests");
+        }
+
+        _digestsOpen = true;
+        _logger.LogInformation("Native command digests opened");
+    }
+
+    /// <summary>
+    /// Stop keeping native command digests
+    /// </summary>
+    public void CloseCommandDigests()
+    {
+        if (!_digestsOpen)
+        {
+            return;
+        }
+
+        NativeMethods.pairadmin_digest_close(IntPtr.Zero);
+        _digestsOpen = false;
+        _logger.LogInformation("Native command digests closed");
+    }
+
+    /// <summary>
+    /// Digest of command <paramref name="sequence"/>, or null if it is no longer held
+    /// </summary>
+    public CommandDigest? GetCommandDigest(ulong sequence)
+    {
+        if (!_digestsOpen)
+        {
+            return null;
+        }
+
+        var buffer = new byte[4096];
+        DigestInfo info;
+        nuint written;
+        while (NativeMethods.pairadmin_get_command_digest(
+                   IntPtr.Zero, sequence, out info, buffer, (nuint)buffer.Length, out written) != 0)
+        {
+            if (written == 0)
+            {
+                return null;
+            }
+            // A running command may have grown in between
+            buffer = new byte[(int)written + 4096];
+        }
+
+        var head = (int)info.HeadLength;
+        var command = (int)info.CommandLength;
+        return new CommandDigest
+        {
+            Sequence = info.Sequence,
+            CommandLine = Encoding.UTF8.GetString(buffer, 0, command),
+            IsCommandInexact = (info.Flags & DigestInexact) != 0,
+            HeadLines = SplitDigestLines(Encoding.UTF8.GetString(buffer, command, head)),
+            TailLines = SplitDigestLines(Encoding.UTF8.GetString(buffer, command + head, (int)info.TailLength)),
+            TotalLines = (long)info.Lines,
+            ElidedLines = (long)info.ElidedLines,
+            ElidedBytes = (long)info.ElidedBytes,
+            OutputBytes = (long)info.OutputBytes,
+            ExitCode = info.ExitCode == ExitUnknown ? null : info.ExitCode,
+            IsRunning = (info.Flags & DigestRunning) != 0,
+            HasCutLines = (info.Flags & DigestCut) != 0
+        };
+    }
+
+    /// <summary>
+    /// Digests of up to <paramref name="count"/> of the newest commands, oldest first
+    /// </summary>
+    public IReadOnlyList<CommandDigest> GetRecentCommandDigests(int count)
+    {
+        var digests = new List<CommandDigest>();
+        if (!_digestsOpen)
+        {
+            return digests;
+        }
+
+        for (var sequence = NativeMethods.pairadmin_digest_latest(IntPtr.Zero); sequence > 0 && digests.Count < count; sequence--)
+        {
+            var digest = GetCommandDigest(sequence);
+            if (digest == null)
+            {
+                break;
+            }
+            digests.Add(digest);
+        }
+
+        digests.Reverse();
+        return digests;
+    }
+
+    private static string[] SplitDigestLines(string text)
+    {
+        if (text.Length == 0)
+        {
+            return Array.Empty<string>();
+        }
+
+        return text.EndsWith('\n') ? text[..^1].Split('\n') : text.Split('\n');
+    }
+
+    private static TerminalScreen ToScreen(in ScreenInfo info, string text, Dictionary<int, string> rows)
+    {
+        return new TerminalScreen
+        {
+            Columns = (int)info.Cols,
+            Rows = (int)info.Rows,
+            CursorColumn = (int)info.CursorCol,
+            CursorRow = (int)info.CursorRow,
+            Generation = info.Generation,
+            IsAlternateScreen = (info.Flags & ScreenAlternate) != 0,
+            Text = text,
+            ChangedRows = rows
+        };
+    }
+
+    /// <summary>
+    /// Record every event the native layer delivers, after redaction and escape
+    /// filtering, to a compact trace file that <see cref="ReplayTraceAsync"/> can
+    /// play back later
+    /// </summary>
+    /// <param name="path">Trace file to create; an existing file is replaced</param>
+    public void StartRecording(string path)
+    {
+        if (NativeMethods.pairadmin_record_start(path) != 0)
+        {
+            throw new IOException($"Failed to open PairAdmin trace file {path}");
+        }
+
+        _recording = true;
+        _logger.LogInformation("Native recording started to {Path}", path);
+    }
+
+    /// <summary>
+    /// Stop recording and flush the trace file
+    /// </summary>
+    public void StopRecording()
+    {
+        if (!_recording)
+        {
+            return;
+        }
+
+        NativeMethods.pairadmin_record_stop();
+        _recording = false;
+        _logger.LogInformation("Native recording stopped");
+    }
+
+    /// <summary>
+    /// Stream events to an audit collector from a native thread that reads the
+    /// event ring like a subscriber, in compressed batches the collector
+    /// acknowledges; after a reconnect it resends from the last acknowledged
+    /// offset. Nothing passes through managed code.
+    /// </summary>
+    /// <param name="transport">TCP or named pipe</param>
+    /// <param name="address">"host:port" for TCP, the pipe path otherwise</param>
+    /// <param name="eventTypes">Event types to export; empty for output and input</param>
+    /// <param name="streamId">Names the stream to the collector; 0 lets the native layer pick one</param>
+    /// <param name="bufferBytes">Batches kept while the collector is away; 0 for the native default (8 MB)</param>
+    public void StartAuditExport(
+        NativeExportTransport transport,
+        string address,
+        int[]? eventTypes = null,
+        ulong streamId = 0,
+        uint bufferBytes = 0)
+    {
+        ArgumentException.ThrowIfNullOrEmpty(address);
+
+        uint mask = EventMask(eventTypes ?? Array.Empty<int>(), nameof(eventTypes));
+
+        var config = new ExportConfig
+        {
+            Transport = (uint)transport,
+            Address = Marshal.StringToHGlobalAnsi(address),
+            StreamId = streamId,
+            EventMask = mask,
+            BufferBytes = bufferBytes
+        };
+        try
+        {
+            // The native layer copies the address
+            if (NativeMethods.pairadmin_export_start(ref config) != 0)
+            {
+                throw new InvalidOperationException($"Failed to start PairAdmin audit export to {address}");
+            }
+        }
+        finally
+        {
+            Marshal.FreeHGlobal(config.Address);
+        }
+
+        _exporting = true;
+        _logger.LogInformation("Native audit export started to {Transport} {Address}", transport, address);
+    }
+
+    /// <summary>
+    /// Stop the audit exporter after a last attempt to send what it holds
+    /// </summary>
+    public void StopAuditExport()
+    {
+        if (!_exporting)
+        {
+            return;
+        }
+
+        NativeMethods.pairadmin_export_stop();
+        _exporting = false;
+        _logger.LogInformation("Native audit export stopped");
+    }
+
+    /// <summary>
+    /// Snapshot of the audit exporter's progress
+    /// </summary>
+    public NativeExportStatistics GetAuditExportStatistics()
+    {
+        NativeMethods.pairadmin_export_get_stats(out var stats);
+        return new NativeExportStatistics
+        {
+            Running = stats.Running != 0,
+            Connected = stats.Connected != 0,
+            Connects = (long)stats.Connects,
+            NextOffset = (long)stats.NextOffset,
+            AckedOffset = (long)stats.AckedOffset,
+            BufferedBytes = (long)stats.BufferedBytes,
+            SentBytes = (long)stats.SentBytes,
+            DroppedBytes = (long)stats.DroppedBytes,
+            LostBytes = (long)stats.LostBytes
+        };
+    }
+
+    /// <summary>
+    /// Replay a recorded trace through the registered callback or event ring, as
+    /// if a live session were producing it
+    /// </summary>
+    /// <param name="path">Trace written by <see cref="StartRecording"/></param>
+    /// <param name="speed">Pacing relative to the recording (2.0 twice as fast); 0 for as fast as possible</param>
+    /// <param name="cancellationToken">Stops the replay after the event in flight</param>
+    /// <returns>Number of events replayed</returns>
+    public Task<long> ReplayTraceAsync(string path, double speed = 1.0, CancellationToken cancellationToken = default)
+    {
+        if (speed < 0)
+        {
+            throw new ArgumentOutOfRangeException(nameof(speed));
+        }
+
+        return Task.Factory.StartNew(() =>
+        {
+            using var registration = cancellationToken.Register(NativeMethods.pairadmin_replay_cancel);
+            var replayed = NativeMethods.pairadmin_replay(path, speed);
+            if (replayed < 0)
+            {
+                throw new InvalidDataException($"{path} is not a readable PairAdmin trace");
+            }
+
+            _logger.LogInformation("Replayed {Count} events from {Path}", replayed, path);
+            return replayed;
+        }, cancellationToken, TaskCreationOptions.LongRunning, TaskScheduler.Default);
+    }
+
+    /// <summary>
+    /// Get the PuTTY terminal window handle for embedding; IntPtr.Zero until the
+    /// process-wide session has created its window (<see cref="WindowEvents"/> reports it)
+    /// </summary>
+    public IntPtr GetTerminalWindowHandle()
+    {
+        try
+        {
+            return NativeMethods.pairadmin_get_terminal_hwnd();
+        }
+        catch (Exception ex)
+        {
+            _logger.LogError(ex, "Failed to get terminal window handle");
+            return IntPtr.Zero;
+        }
+    }
+
+    /// <summary>
+    /// Callback handler invoked by PuTTY for terminal I/O events
+    /// </summary>
+    private void OnPuTTYCallback(byte eventType, IntPtr data, int length)
+    {
+        if (length <= 0 || data == IntPtr.Zero)
+        {
+            return;
+        }
+
+        try
+        {
+            // Copy data from native memory
+            var buffer = new byte[length];
+            Marshal.Copy(data, buffer, 0, length);
+
+            // Chunks end on a character boundary; the scan says whether they are plain ASCII
+            var info = ScanChunk(buffer);
+            var text = DecodeText(buffer, info.Flags);
+
+            PublishEvent(eventType, buffer, text, info);
+        }
+        catch (Exception ex)
+        {
+            _logger.LogError(ex, "Error processing PuTTY callback: eventType={EventType}, length={Length}",
+                eventType, length);
+        }
+    }
+
+    /// <summary>
+    /// Batch callback handler invoked on the native batch thread
+    /// </summary>
+    private void OnPuTTYBatchCallback(int eventType, IntPtr data, nuint length, IntPtr index, nuint count, IntPtr info)
+    {
+        if (length == 0 || data == IntPtr.Zero)
+        {
+            return;
+        }
+
+        try
+        {
+            var buffer = new byte[(int)length];
+            Marshal.Copy(data, buffer, 0, buffer.Length);
+
+            // The batch thread has already scanned the payload
+            var chunk = Marshal.PtrToStructure<ChunkInfo>(info);
+            var text = DecodeText(buffer, chunk.Flags);
+
+            PublishEvent(eventType, buffer, text, chunk);
+        }
+        catch (Exception ex)
+        {
+            _logger.LogError(ex, "Error processing PuTTY batch: eventType={EventType}, length={Length}",
+                eventType, length);
+        }
+    }
+
+    /// <summary>
+    /// Drain loop run on the dedicated consumer thread
+    /// </summary>
+    private void DrainLoop()
+    {
+        var buffer = new byte[Math.Max(_configuration.BufferSize, NativeMethods.ReadBufferMin)];
+
+        while (_draining)
+        {
+            int read;
+            try
+            {
+                read = (int)NativeMethods.pairadmin_read_events(buffer, (nuint)buffer.Length);
+            }
+            catch (Exception ex)
+            {
+                _logger.LogError(ex, "Failed to read from the native event ring");
+                break;
+            }
+
+            if (read == 0)
+            {
+                NativeMethods.pairadmin_wait_events((uint)_configuration.DrainWaitTimeoutMs);
+                continue;
+            }
+
+            DispatchRecords(buffer.AsSpan(0, read));
+        }
+    }
+
+    /// <summary>
+    /// Drain loop that reads records in place from the shared event region
+    /// </summary>
+    private unsafe void DrainRegionLoop()
+    {
+        var region = (RegionHeader*)_eventRegion;
+        byte* data = (byte*)_eventRegion + region->DataOffset;
+        ulong capacity = region->Capacity;
+        ulong tail = region->Tail;
+
+        while (_draining)
+        {
+            ulong head = Volatile.Read(ref region->Head);
+            if (tail == head)
+            {
+                NativeMethods.pairadmin_wait_events((uint)_configuration.DrainWaitTimeoutMs);
+                continue;
+            }
+
+            while (tail != head)
+            {
+                ulong offset = tail & (capacity - 1);
+                ulong contiguous = capacity - offset;
+                ushort eventType = 0;
+                ushort flags = 0;
+                ulong length = 0;
+
+                // Too short for a header: skipped like a pad
+                if (contiguous >= RecordHeaderSize)
+                {
+                    var header = new ReadOnlySpan<byte>(data + offset, RecordHeaderSize);
+                    eventType = BinaryPrimitives.ReadUInt16LittleEndian(header);
+                    flags = BinaryPrimitives.ReadUInt16LittleEndian(header.Slice(2));
+                    length = BinaryPrimitives.ReadUInt32LittleEndian(header.Slice(4));
+                }
+
+                ulong size = eventType == 0 // Pad to the end of the data area
+                    ? contiguous
+                    : (ulong)RecordSize((int)Math.Min(length, contiguous));
+
+                // A length running past the wrap means the record was torn by a
+                // concurrent reclaim; the commit below fails in that case
+                bool torn = size > contiguous;
+                if (torn)
+                {
+                    size = contiguous;
+                }
+
+                byte[]? payload = eventType == 0 || torn
+                    ? null
+                    : new ReadOnlySpan<byte>(data + offset + RecordHeaderSize, (int)length).ToArray();
+
+                // Commit each record; failure means the native side reclaimed it
+                // (DropOldest) while it was being copied, so the copy is discarded
+                ulong observed = Interlocked.CompareExchange(ref region->Tail, tail + size, tail);
+                if (observed != tail)
+                {
+                    tail = observed;
+                    head = Volatile.Read(ref region->Head);
+                    continue;
+                }
+
+                tail += size;
+                if (payload != null)
+                {
+                    DispatchRecord(eventType, flags, payload);
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// Split a batch returned by pairadmin_read_events into events
+    /// </summary>
+    private void DispatchRecords(ReadOnlySpan<byte> batch)
+    {
+        int offset = 0;
+
+        while (offset + RecordHeaderSize <= batch.Length)
+        {
+            var header = batch.Slice(offset, RecordHeaderSize);
+            ushort eventType = BinaryPrimitives.ReadUInt16LittleEndian(header);
+            ushort flags = BinaryPrimitives.ReadUInt16LittleEndian(header.Slice(2));
+            int length = (int)BinaryPrimitives.ReadUInt32LittleEndian(header.Slice(4));
+
+            DispatchRecord(eventType, flags, batch.Slice(offset + RecordHeaderSize, length).ToArray());
+            offset += RecordSize(length);
+        }
+    }
+
+    /// <summary>
+    /// Publish a single queued record
+    /// </summary>
+    private void DispatchRecord(ushort eventType, ushort flags, byte[] payload)
+    {
+        try
+        {
+            var text = eventType == GapEventType ? string.Empty : DecodeText(payload, flags);
+
+            PublishEvent(eventType, payload, text);
+        }
+        catch (Exception ex)
+        {
+            _logger.LogError(ex, "Error processing queued event: eventType={EventType}, length={Length}",
+                eventType, payload.Length);
+        }
+    }
+
+    /// <summary>
+    /// Decode a payload natively flagged as ASCII without UTF-8 validation
+    /// </summary>
+    private static string DecodeText(byte[] data, uint flags) =>
+        (flags & TextAscii) != 0 ? Encoding.Latin1.GetString(data) : Encoding.UTF8.GetString(data);
+
+    private static int RecordSize(int length) =>
+        (RecordHeaderSize + length + RecordAlignment - 1) & ~(RecordAlignment - 1);
+
+    /// <summary>
+    /// Build the native event mask, refusing types the native layer does not define
+    /// </summary>
+    private static uint EventMask(int[] eventTypes, string paramName)
+    {
+        uint mask = 0;
+        foreach (var eventType in eventTypes)
+        {
+            if (eventType <= 0 || eventType >= 32 || eventType >= EventTypeCount)
+            {
+                throw new ArgumentOutOfRangeException(paramName, eventType,
+                    $"Event type must be between 1 and {EventTypeCount - 1}");
+            }
+            mask |= 1u << eventType;
+        }
+        return mask;
+    }
+
+    /// <summary>
+    /// Route a decoded event to the matching processor
+    /// </summary>
+    private void PublishEvent(int eventType, byte[] data, string text, ChunkInfo? info = null)
+    {
+        if (eventType == 1) // Output
+        {
+            ProcessOutput(data, text, escapeFiltered: false, info ?? ScanChunk(data));
+        }
+        else if (eventType == 2) // Input
+        {
+            ProcessInput(data, text);
+        }
+        else if (eventType is >= 3 and <= 5) // Connected, Disconnected, Error
+        {
+            ProcessSessionEvent((SessionStateChange)eventType, text);
+        }
+        else if (eventType == 6) // Output with escape sequences removed natively
+        {
+            ProcessOutput(data, text, escapeFiltered: true, info ?? ScanChunk(data));
+        }
+        else if (eventType == GapEventType && data.Length >= 16) // PairAdminGapInfo
+        {
+            long records = BinaryPrimitives.ReadInt64LittleEndian(data);
+            long bytes = BinaryPrimitives.ReadInt64LittleEndian(data.AsSpan(8));
+            _statistics.RecordGap(records, bytes);
+
+            _logger.LogWarning("Native event ring overflowed: {Records} records, {Bytes} bytes lost", records, bytes);
+        }
+        else if (eventType == CommandEventType && data.Length >= CommandInfoSize) // PairAdminCommandInfo + line
+        {
+            ProcessCommand(data);
+        }
+        else if (eventType is >= FirstMarkEventType and <= LastMarkEventType && data.Length >= MarkInfoSize) // PairAdminMarkInfo + path
+        {
+            ProcessMark((TerminalMarkType)eventType, data);
+        }
+        else if (eventType == WindowEventType && data.Length >= WindowInfoSize) // PairAdminWindowInfo
+        {
+            ProcessWindow(data);
+        }
+    }
+
+    /// <summary>
+    /// Newline/ESC/non-ASCII statistics for a chunk, computed natively in one SIMD pass
+    /// </summary>
+    private static unsafe ChunkInfo ScanChunk(ReadOnlySpan<byte> data)
+    {
+        fixed (byte* p = data)
+        {
+            NativeMethods.pairadmin_scan_chunk(p, (nuint)data.Length, out var info);
+            return info;
+        }
+    }
+
+    /// <summary>
+    /// Copy the native hot-path counters (hook and callback latency, ring high-water mark,
+    /// batch mode) into <see cref="Statistics"/>
+    /// </summary>
+    public void RefreshNativeStatistics()
+    {
+        NativeMethods.pairadmin_get_stats(out var stats);
+
+        _statistics.RecordNative(ToHookStatistics(stats.Output), ToHookStatistics(stats.Input),
+            ToHookStatistics(stats.Callback), (long)stats.RingHighWater,
+            (NativeBatchMode)stats.BatchMode, (long)stats.BatchSwitches);
+    }
+
+    private static NativeHookStatistics ToHookStatistics(HookStats stats) => new()
+    {
+        Calls = (long)stats.Calls,
+        Bytes = (long)stats.Bytes,
+        TotalTime = TimeSpan.FromTicks((long)(stats.TotalNs / 100)),
+        MaxLatency = TimeSpan.FromTicks((long)(stats.MaxNs / 100)),
+        Histogram = Array.ConvertAll(stats.Histogram ?? Array.Empty<ulong>(), v => (long)v)
+    };
+
+    /// <summary>
+    /// Push configuration into the native layer before delivery starts
+    /// </summary>
+    private void ApplyNativeOptions()
+    {
+        NativeMethods.pairadmin_set_vt_filter((int)_configuration.NativeEscapeFilter);
+        NativeMethods.pairadmin_set_redaction((uint)_configuration.NativeRedaction);
+
+        var denylist = _configuration.NativeCommandDenylist.ToArray();
+        if (NativeMethods.pairadmin_set_command_denylist(denylist, (uint)denylist.Length, (int)_configuration.NativeDenyMode) != 0)
+        {
+            _logger.LogWarning("Native command denylist rejected ({Count} names)", denylist.Length);
+        }
+
+        if (NativeMethods.pairadmin_set_shell_marks((uint)_configuration.NativeShellMarks, _configuration.NativePromptFingerprint) != 0)
+        {
+            _logger.LogWarning("Native shell marks rejected (fingerprint {Fingerprint})", _configuration.NativePromptFingerprint);
+        }
+
+        NativeMethods.pairadmin_set_overflow_policy((int)_configuration.OverflowPolicy, (uint)_configuration.OverflowTimeoutUs);
+        NativeMethods.pairadmin_set_batch_policy((int)_configuration.BatchPolicy);
+    }
+
+    /// <summary>
+    /// Process terminal output event
+    /// </summary>
+    private void ProcessOutput(byte[] data, string text, bool escapeFiltered, ChunkInfo info)
+    {
+        int lines = (int)info.Newlines;
+
+        // Update statistics; when both streams are delivered only the raw one is counted
+        if (!escapeFiltered || _configuration.NativeEscapeFilter == NativeEscapeFilterMode.Replace)
+        {
+            _statistics.RecordOutput(data.Length, lines);
+        }
+
+        // Check for ANSI sequences (basic check for ESC character)
+        bool hasAnsi = !escapeFiltered && info.Escapes > 0;
+
+        // Create event args
+        var args = new TerminalOutputEventArgs
+        {
+            Timestamp = DateTime.UtcNow,
+            RawData = data,
+            ParsedData = text,
+            ContainsAnsiSequences = hasAnsi,
+            IsEscapeFiltered = escapeFiltered
+        };
+
+        // Publish to subscribers
+        _outputSubject.OnNext(args);
+
+        _logger.LogDebug("Terminal output: {Length} bytes, {Lines} lines", data.Length, lines);
+    }
+
+    /// <summary>
+    /// Process terminal input event
+    /// </summary>
+    private void ProcessInput(byte[] data, string text)
+    {
+        // Update statistics
+        _statistics.RecordInput(data.Length);
+
+        // Determine if interactive (single character or printable)
+        bool isInteractive = data.Length <= 4 || text.All(c => !char.IsControl(c) || c == '\r' || c == '\n');
+
+        // Create event args
+        var args = new TerminalInputEventArgs
+        {
+            Timestamp = DateTime.UtcNow,
+            RawData = data,
+            CommandString = text,
+            IsInteractive = isInteractive
+        };
+
+        // Publish to subscribers
+        _inputSubject.OnNext(args);
+
+        _logger.LogDebug("Terminal input: {Length} bytes", data.Length);
+    }
+
+    /// <summary>
+    /// Process a command line assembled by the native input hook
+    /// </summary>
+    private void ProcessCommand(byte[] data)
+    {
+        var flags = (TerminalCommandFlags)BinaryPrimitives.ReadUInt32LittleEndian(data);
+        int denied = (int)BinaryPrimitives.ReadUInt32LittleEndian(data.AsSpan(4));
+        int length = (int)Math.Min(BinaryPrimitives.ReadUInt32LittleEndian(data.AsSpan(8)), (uint)(data.Length - CommandInfoSize));
+        var denylist = _configuration.NativeCommandDenylist;
+
+        var args = new TerminalCommandEventArgs
+        {
+            Timestamp = DateTime.UtcNow,
+            CommandLine = Encoding.UTF8.GetString(data, CommandInfoSize, length),
+            Flags = flags,
+            DeniedCommand = denied > 0 && denied <= denylist.Count ? denylist[denied - 1] : null
+        };
+
+        _commandSubject.OnNext(args);
+
+        if ((flags & TerminalCommandFlags.Denied) != 0)
+        {
+            _logger.LogWarning("Denied command {Command} {Action}", args.DeniedCommand,
+                (flags & TerminalCommandFlags.Blocked) != 0 ? "held back" : "submitted");
+        }
+    }
+
+    /// <summary>
+    /// Process a prompt or command boundary found by the native output hook
+    /// </summary>
+    private void ProcessMark(TerminalMarkType type, byte[] data)
+    {
+        int exitCode = BinaryPrimitives.ReadInt32LittleEndian(data.AsSpan(16));
+        int length = (int)Math.Min(BinaryPrimitives.ReadUInt32LittleEndian(data.AsSpan(24)), (uint)(data.Length - MarkInfoSize));
+
+        var args = new TerminalMarkEventArgs
+        {
+            Timestamp = DateTime.UtcNow,
+            Type = type,
+            Offset = (long)BinaryPrimitives.ReadUInt64LittleEndian(data),
+            CommandOffset = (long)BinaryPrimitives.ReadUInt64LittleEndian(data.AsSpan(8)),
+            ExitCode = exitCode == ExitUnknown ? null : exitCode,
+            Source = (NativeShellMarks)BinaryPrimitives.ReadUInt16LittleEndian(data.AsSpan(20)),
+            Unchanged = (BinaryPrimitives.ReadUInt16LittleEndian(data.AsSpan(22)) & MarkUnchanged) != 0,
+            Directory = type == TerminalMarkType.Directory ? Encoding.UTF8.GetString(data, MarkInfoSize, length) : null
+        };
+
+        _markSubject.OnNext(args);
+
+        _logger.LogDebug("Shell mark {Type} at {Offset}", type, args.Offset);
+    }
+
+    /// <summary>
+    /// Process a terminal window announced by the native session thread
+    /// </summary>
+    private void ProcessWindow(byte[] data)
+    {
+        var args = new TerminalWindowEventArgs
+        {
+            Timestamp = DateTime.UtcNow,
+            Handle = (IntPtr)(long)BinaryPrimitives.ReadUInt64LittleEndian(data),
+            Parent = (IntPtr)(long)BinaryPrimitives.ReadUInt64LittleEndian(data.AsSpan(8)),
+            X = BinaryPrimitives.ReadInt32LittleEndian(data.AsSpan(16)),
+            Y = BinaryPrimitives.ReadInt32LittleEndian(data.AsSpan(20)),
+            Width = BinaryPrimitives.ReadInt32LittleEndian(data.AsSpan(24)),
+            Height = BinaryPrimitives.ReadInt32LittleEndian(data.AsSpan(28))
+        };
+
+        _windowSubject.OnNext(args);
+
+        _logger.LogDebug("Terminal window {Handle} in {Parent}", args.Handle, args.Parent);
+    }
+
+    /// <summary>
+    /// Process a session state event from the native session thread
+    /// </summary>
+    private void ProcessSessionEvent(SessionStateChange change, string message)
+    {
+        var args = new SessionStateEventArgs
+        {
+            Timestamp = DateTime.UtcNow,
+            Change = change,
+            Message = message
+        };
+
+        _sessionSubject.OnNext(args);
+
+        if (change == SessionStateChange.Error)
+        {
+            _logger.LogWarning("Session error: {Message}", message);
+        }
+        else
+        {
+            _logger.LogInformation("Session {Change}: {Message}", change, message);
+        }
+    }
+
+    /// <summary>
+    /// Dispose resources
+    /// </summary>
+    public void Dispose()
+    {
+        if (_disposed)
+        {
+            return;
+        }
+
+        NativeSubscription[] subscriptions;
+        lock (_nativeSubscriptions)
+        {
+            subscriptions = _nativeSubscriptions.ToArray();
+        }
+        foreach (var subscription in subscriptions)
+        {
+            subscription.Dispose();
+        }
+
+        UnregisterBatchCallback();
+        StopQueuedCapture();
+        StopNativeCapture();
+        CloseScreenModel();
+        CloseCommandDigests();
+        StopRecording();
+        StopAuditExport();
+        UnregisterCallback();
+
+        _outputSubject.OnCompleted();
+        _outputSubject.Dispose();
+
+        _inputSubject.OnCompleted();
+        _inputSubject.Dispose();
+
+        _sessionSubject.OnCompleted();
+        _sessionSubject.Dispose();
+
+        _commandSubject.OnCompleted();
+        _commandSubject.Dispose();
+        _markSubject.OnCompleted();
+        _markSubject.Dispose();
+        _windowSubject.OnCompleted();
+        _windowSubject.Dispose();
+
+        _disposed = true;
+
+        _logger.LogInformation("IOInterceptor disposed");
+    }
+
+    /// <summary>
+    /// A native event subscriber created by <see cref="AddNativeSubscriber"/>
+    /// </summary>
+    public sealed class NativeSubscription : IDisposable
+    {
+        private readonly IOInterceptor _owner;
+        private readonly Action<int, byte[]> _handler;
+
+        internal NativeSubscription(IOInterceptor owner, Action<int, byte[]> handler)
+        {
+            _owner = owner;
+            _handler = handler;
+
+            // Stored to prevent garbage collection while native code holds it
+            Callback = OnEvent;
+        }
+
+        internal PairAdminSubscriberCallback Callback { get; }
+
+        /// <summary>
+        /// Native subscriber id
+        /// </summary>
+        public int Id { get; internal set; }
+
+        /// <summary>
+        /// Bytes this subscriber skipped because it fell behind the event ring
+        /// </summary>
+        public ulong DroppedBytes => NativeMethods.pairadmin_get_subscriber_dropped(Id);
+
+        private void OnEvent(int eventType, IntPtr data, nuint length, IntPtr user)
+        {
+            if (length == 0 || data == IntPtr.Zero)
+            {
+                return;
+            }
+
+            try
+            {
+                var buffer = new byte[(int)length];
+                Marshal.Copy(data, buffer, 0, buffer.Length);
+                _handler(eventType, buffer);
+            }
+            catch (Exception ex)
+            {
+                _owner._logger.LogError(ex, "Error in native subscriber {Id}: eventType={EventType}", Id, eventType);
+            }
+        }
+
+        /// <summary>
+        /// Remove the subscription
+        /// </summary>
+        public void Dispose() => _owner.RemoveNativeSubscriber(this);
+    }
+
+    /// <summary>
+    /// Mirror of PairAdminRegionHeader in pairadmin.h
+    /// </summary>
+    [StructLayout(LayoutKind.Explicit, Size = 192)]
+    private struct RegionHeader
+    {
+        [FieldOffset(0)] public uint Magic;
+        [FieldOffset(4)] public uint Version;
+        [FieldOffset(8)] public ulong Capacity;
+        [FieldOffset(16)] public ulong DataOffset;
+        [FieldOffset(64)] public ulong Head;
+        [FieldOffset(128)] public ulong Tail;
+    }
+
+    /// <summary>
+    /// Mirror of PairAdminLineSpan in pairadmin.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    private struct LineSpan
+    {
+        public IntPtr Data;
+        public uint Length;
+        public uint Flags;
+    }
+
+    /// <summary>
+    /// Mirror of PairAdminScreenInfo in pairadmin.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    private struct ScreenInfo
+    {
+        public uint Cols;
+        public uint Rows;
+        public uint CursorCol;
+        public uint CursorRow;
+        public ulong Generation;
+        public uint Flags;
+        public uint Reserved;
+    }
+
+    /// <summary>
+    /// Mirror of PairAdminDigestInfo in pairadmin.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    private struct DigestInfo
+    {
+        public ulong Sequence;
+        public ulong StartOffset;
+        public ulong EndOffset;
+        public ulong OutputBytes;
+        public ulong TextBytes;
+        public ulong ElidedBytes;
+        public ulong Lines;
+        public ulong ElidedLines;
+        public int ExitCode;
+        public uint Flags;
+        public uint CommandLength;
+        public uint HeadLength;
+        public uint TailLength;
+        public uint Reserved;
+    }
+
+    /// <summary>
+    /// Mirror of PairAdminHookStats in pairadmin.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    private struct HookStats
+    {
+        public ulong Calls;
+        public ulong Bytes;
+        public ulong TotalNs;
+        public ulong MaxNs;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = StatsBuckets)]
+        public ulong[] Histogram;
+    }
+
+    /// <summary>
+    /// Mirror of PairAdminStats in pairadmin.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    private struct NativeStats
+    {
+        public HookStats Output;
+        public HookStats Input;
+        public HookStats Callback;
+        public ulong RingHighWater;
+        public uint Threads;
+        public uint BatchMode;
+        public ulong BatchSwitches;
+    }
+
+    /// <summary>
+    /// Mirror of PairAdminExportConfig in pairadmin.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    private struct ExportConfig
+    {
+        public uint Transport;
+        public uint Flags;
+        public IntPtr Address;
+        public ulong StreamId;
+        public uint EventMask;
+        public uint BatchBytes;
+        public uint FlushMs;
+        public uint BufferBytes;
+    }
+
+    /// <summary>
+    /// Mirror of PairAdminExportStats in pairadmin.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    private struct ExportStats
+    {
+        public uint Running;
+        public uint Connected;
+        public ulong Connects;
+        public ulong NextOffset;
+        public ulong AckedOffset;
+        public ulong BufferedBytes;
+        public ulong SentBytes;
+        public ulong DroppedBytes;
+        public ulong LostBytes;
+    }
+
+    /// <summary>
+    /// Mirror of PairAdminChunkInfo in pairadmin.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    private struct ChunkInfo
+    {
+        public long LastNewline;
+        public uint Newlines;
+        public uint Escapes;
+        public uint NonAscii;
+        public uint Flags;
+    }
+
+    /// <summary>
+    /// Native methods for PuTTY integration
+    /// </summary>
+    private static class NativeMethods
+    {
+        private const string DllName = "PairAdminPuTTY";
+
+        // PAIRADMIN_READ_BUFFER_MIN: one maximum-size record
+        public const int ReadBufferMin = RecordHeaderSize + 16384;
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_set_callback(
+            [MarshalAs(UnmanagedType.FunctionPtr)] PairAdminCallback? callback);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr pairadmin_get_terminal_hwnd();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_set_batch_policy(int policy);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_set_batch_callback(
+            [MarshalAs(UnmanagedType.FunctionPtr)] PairAdminBatchCallback? callback,
+            nuint maxBytes,
+            uint maxDelayUs);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_ring_open(nuint capacity);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_set_vt_filter(int mode);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_set_redaction(uint rules);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern int pairadmin_set_command_denylist(
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPStr)] string[] names,
+            uint count,
+            int mode);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_set_shell_marks(
+            uint sources,
+            [MarshalAs(UnmanagedType.LPStr)] string? fingerprint);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_set_overflow_policy(int policy, uint timeoutUs);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern ulong pairadmin_get_dropped_bytes();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern unsafe void pairadmin_scan_chunk(byte* data, nuint length, out ChunkInfo info);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_ring_close();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern nuint pairadmin_read_events(byte[] buffer, nuint capacity);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_wait_events(uint timeoutMs);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_wake_events();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_map_event_region(nuint bytes, out IntPtr regionBase);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_add_subscriber(
+            [MarshalAs(UnmanagedType.FunctionPtr)] PairAdminSubscriberCallback callback,
+            IntPtr user,
+            uint eventMask);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_remove_subscriber(int id);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern ulong pairadmin_get_subscriber_dropped(int id);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_get_stats(out NativeStats stats);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern int pairadmin_record_start([MarshalAs(UnmanagedType.LPStr)] string path);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_record_stop();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_export_start(ref ExportConfig config);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_export_stop();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_export_get_stats(out ExportStats stats);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern long pairadmin_replay([MarshalAs(UnmanagedType.LPStr)] string path, double speed);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_replay_cancel();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern int pairadmin_capture_open(
+            IntPtr session,
+            [MarshalAs(UnmanagedType.LPStr)] string? directory,
+            nuint segmentBytes);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_capture_close(IntPtr session);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern long pairadmin_capture_export(
+            IntPtr session, [MarshalAs(UnmanagedType.LPStr)] string path);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern ulong pairadmin_log_line_count(IntPtr session);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern nuint pairadmin_log_read_range(
+            IntPtr session, ulong firstLine, uint count, byte[] buffer, nuint capacity, out uint lines);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern unsafe uint pairadmin_get_last_lines(IntPtr session, uint n, LineSpan* spans);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_screen_open(IntPtr session, uint cols, uint rows);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_screen_close(IntPtr session);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_screen_resize(IntPtr session, uint cols, uint rows);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern nuint pairadmin_get_screen_snapshot(
+            IntPtr session, byte[]? buffer, nuint capacity, out ScreenInfo info);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_get_screen_changes(
+            IntPtr session, ulong since, byte[] buffer, nuint capacity, out nuint written, out ScreenInfo info);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_digest_open(IntPtr session, uint headLines, uint tailLines, uint commands);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void pairadmin_digest_close(IntPtr session);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern ulong pairadmin_digest_latest(IntPtr session);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int pairadmin_get_command_digest(
+            IntPtr session, ulong sequence, out DigestInfo info, byte[] buffer, nuint capacity, out nuint written);
     }
 }
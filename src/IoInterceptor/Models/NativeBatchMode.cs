@@ -0,0 +1,16 @@
+namespace PairAdmin.IoInterceptor.Models;
+
+/// <summary>
+/// What the native batch thread is doing (PairAdminBatchMode in pairadmin.h)
+/// </summary>
+public enum NativeBatchMode
+{
+    /// <summary>No batch callback registered</summary>
+    Off = 0,
+
+    /// <summary>Holding batches up to the configured limits</summary>
+    Throughput = 1,
+
+    /// <summary>Flushing output as soon as the event ring is drained</summary>
+    PassThrough = 2
+}
@@ -0,0 +1,52 @@
+namespace PairAdmin.IoInterceptor.Models;
+
+/// <summary>
+/// Progress of the native audit exporter (PairAdminExportStats in pairadmin.h)
+/// </summary>
+public sealed class NativeExportStatistics
+{
+    /// <summary>
+    /// Whether the exporter thread is running
+    /// </summary>
+    public bool Running { get; init; }
+
+    /// <summary>
+    /// Whether the collector is connected and has answered the hello
+    /// </summary>
+    public bool Connected { get; init; }
+
+    /// <summary>
+    /// Successful connections, reconnects included
+    /// </summary>
+    public long Connects { get; init; }
+
+    /// <summary>
+    /// Stream bytes batched so far
+    /// </summary>
+    public long NextOffset { get; init; }
+
+    /// <summary>
+    /// Stream bytes the collector has acknowledged
+    /// </summary>
+    public long AckedOffset { get; init; }
+
+    /// <summary>
+    /// Bytes of batches held for sending or resending
+    /// </summary>
+    public long BufferedBytes { get; init; }
+
+    /// <summary>
+    /// Bytes written to the connection, framing included
+    /// </summary>
+    public long SentBytes { get; init; }
+
+    /// <summary>
+    /// Record bytes dropped from a full buffer before they were sent
+    /// </summary>
+    public long DroppedBytes { get; init; }
+
+    /// <summary>
+    /// Event ring bytes overwritten before the exporter read them
+    /// </summary>
+    public long LostBytes { get; init; }
+}
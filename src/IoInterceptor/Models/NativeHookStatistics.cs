@@ -0,0 +1,66 @@
+using System;
+
+namespace PairAdmin.IoInterceptor.Models;
+
+/// <summary>
+/// Counters the native layer keeps for one hook or for its callbacks (PairAdminHookStats in pairadmin.h)
+/// </summary>
+public sealed class NativeHookStatistics
+{
+    /// <summary>
+    /// Histogram bucket k counts spans of [2^(k+7), 2^(k+8)) ns
+    /// </summary>
+    public const int FirstBucketShift = 7;
+
+    /// <summary>
+    /// Calls recorded
+    /// </summary>
+    public long Calls { get; init; }
+
+    /// <summary>
+    /// Payload bytes passed in
+    /// </summary>
+    public long Bytes { get; init; }
+
+    /// <summary>
+    /// Total time spent inside
+    /// </summary>
+    public TimeSpan TotalTime { get; init; }
+
+    /// <summary>
+    /// Longest single call
+    /// </summary>
+    public TimeSpan MaxLatency { get; init; }
+
+    /// <summary>
+    /// Call counts per latency bucket; the first also holds shorter calls, the last longer ones
+    /// </summary>
+    public long[] Histogram { get; init; } = Array.Empty<long>();
+
+    /// <summary>
+    /// Mean time per call
+    /// </summary>
+    public TimeSpan AverageLatency => Calls == 0 ? TimeSpan.Zero : TimeSpan.FromTicks(TotalTime.Ticks / Calls);
+
+    /// <summary>
+    /// Upper bound of the bucket holding the given fraction of calls (0.99 for p99)
+    /// </summary>
+    public TimeSpan Percentile(double fraction)
+    {
+        long target = (long)Math.Ceiling(Calls * fraction);
+        long seen = 0;
+
+        for (int k = 0; k < Histogram.Length; k++)
+        {
+            seen += Histogram[k];
+            if (seen >= target && seen > 0)
+            {
+                return k == Histogram.Length - 1
+                    ? MaxLatency
+                    : TimeSpan.FromTicks((1L << (k + FirstBucketShift + 1)) / 100);
+            }
+        }
+
+        return TimeSpan.Zero;
+    }
+}
@@ -0,0 +1,51 @@
+using System;
+using System.Collections.Generic;
+
+namespace PairAdmin.IoInterceptor.Models;
+
+/// <summary>
+/// State of the native screen model (PairAdminScreenInfo in pairadmin.h), with either
+/// the whole screen or the rows changed since an earlier generation
+/// </summary>
+public sealed class TerminalScreen
+{
+    /// <summary>
+    /// Screen width in cells
+    /// </summary>
+    public int Columns { get; init; }
+
+    /// <summary>
+    /// Screen height in rows
+    /// </summary>
+    public int Rows { get; init; }
+
+    /// <summary>
+    /// Cursor column, 0-based
+    /// </summary>
+    public int CursorColumn { get; init; }
+
+    /// <summary>
+    /// Cursor row, 0-based
+    /// </summary>
+    public int CursorRow { get; init; }
+
+    /// <summary>
+    /// Generation this state belongs to; pass it to the next GetScreenChanges call
+    /// </summary>
+    public ulong Generation { get; init; }
+
+    /// <summary>
+    /// A full-screen program has the alternate screen up
+    /// </summary>
+    public bool IsAlternateScreen { get; init; }
+
+    /// <summary>
+    /// Screen text, one line per row without trailing blanks (snapshots only)
+    /// </summary>
+    public string Text { get; init; } = string.Empty;
+
+    /// <summary>
+    /// Text of each row that changed, by row index (change queries only)
+    /// </summary>
+    public IReadOnlyDictionary<int, string> ChangedRows { get; init; } = new Dictionary<int, string>();
+}
@@ -13,6 +13,8 @@ public class TerminalStatistics
     private long _outputBytes;
     private long _inputBytes;
     private long _outputLines;
+    private long _lostRecords;
+    private long _lostBytes;
 
     /// <summary>
     /// Session start time
@@ -49,6 +51,46 @@ public class TerminalStatistics
     /// </summary>
     public long OutputLines => Interlocked.Read(ref _outputLines);
 
+    /// <summary>
+    /// Records the native layer reported lost to ring overflow
+    /// </summary>
+    public long LostRecords => Interlocked.Read(ref _lostRecords);
+
+    /// <summary>
+    /// Payload bytes the native layer reported lost to ring overflow
+    /// </summary>
+    public long LostBytes => Interlocked.Read(ref _lostBytes);
+
+    /// <summary>
+    /// Time the native output hook spends on PuTTY's thread
+    /// </summary>
+    public NativeHookStatistics? NativeOutputHook { get; private set; }
+
+    /// <summary>
+    /// Time the native input hook spends on PuTTY's thread
+    /// </summary>
+    public NativeHookStatistics? NativeInputHook { get; private set; }
+
+    /// <summary>
+    /// Time spent inside callbacks invoked by the native layer
+    /// </summary>
+    public NativeHookStatistics? NativeCallbacks { get; private set; }
+
+    /// <summary>
+    /// Most bytes ever queued in one native event ring
+    /// </summary>
+    public long NativeRingHighWater { get; private set; }
+
+    /// <summary>
+    /// What the native batch thread was doing at the last refresh
+    /// </summary>
+    public NativeBatchMode NativeBatchMode { get; private set; }
+
+    /// <summary>
+    /// Times the adaptive batch policy has switched mode
+    /// </summary>
+    public long NativeBatchModeSwitches { get; private set; }
+
     /// <summary>
     /// Session duration
     /// </summary>
@@ -75,6 +117,30 @@ public class TerminalStatistics
         LastActivityTime = DateTime.UtcNow;
     }
 
+    /// <summary>
+    /// Add a gap reported by the native layer
+    /// </summary>
+    public void RecordGap(long records, long bytes)
+    {
+        Interlocked.Add(ref _lostRecords, records);
+        Interlocked.Add(ref _lostBytes, bytes);
+    }
+
+    /// <summary>
+    /// Replace the native hot-path counters with a fresh snapshot
+    /// </summary>
+    public void RecordNative(NativeHookStatistics output, NativeHookStatistics input,
+        NativeHookStatistics callbacks, long ringHighWater,
+        NativeBatchMode batchMode = NativeBatchMode.Off, long batchModeSwitches = 0)
+    {
+        NativeOutputHook = output;
+        NativeInputHook = input;
+        NativeCallbacks = callbacks;
+        NativeRingHighWater = ringHighWater;
+        NativeBatchMode = batchMode;
+        NativeBatchModeSwitches = batchModeSwitches;
+    }
+
     /// <summary>
     /// Reset all statistics
     /// </summary>
@@ -85,5 +151,13 @@ public class TerminalStatistics
         Interlocked.Exchange(ref _outputBytes, 0);
         Interlocked.Exchange(ref _inputBytes, 0);
         Interlocked.Exchange(ref _outputLines, 0);
+        Interlocked.Exchange(ref _lostRecords, 0);
+        Interlocked.Exchange(ref _lostBytes, 0);
+        NativeOutputHook = null;
+        NativeInputHook = null;
+        NativeCallbacks = null;
+        NativeRingHighWater = 0;
+        NativeBatchMode = NativeBatchMode.Off;
+        NativeBatchModeSwitches = 0;
     }
 }
@@ -35,6 +35,79 @@ public class IoInterceptorConfiguration
     /// </summary>
     public int BufferSize { get; set; } = 8192;
 
+    /// <summary>
+    /// Capacity of the native event ring used for queued capture (bytes, 0 = native default)
+    /// </summary>
+    public int NativeRingSize { get; set; } = 1 << 20;
+
+    /// <summary>
+    /// Whether queued capture reads records in place from the native shared-memory region
+    /// instead of copying batches out with pairadmin_read_events
+    /// </summary>
+    public bool UseSharedEventRegion { get; set; } = true;
+
+    /// <summary>
+    /// Longest the drain thread sleeps on the native ring's wake event before it looks
+    /// again (milliseconds). It is woken at once by new events and by StopQueuedCapture.
+    /// </summary>
+    public int DrainWaitTimeoutMs { get; set; } = 1000;
+
+    /// <summary>
+    /// Flush a native batch once it reaches this many bytes (0 = native default)
+    /// </summary>
+    public int MaxBatchBytes { get; set; } = 65536;
+
+    /// <summary>
+    /// Flush a native batch this long after its first fragment (microseconds, 0 = native default)
+    /// </summary>
+    public int MaxBatchDelayUs { get; set; } = 5000;
+
+    /// <summary>
+    /// Whether native batches always wait out the limits or only for bulk output
+    /// </summary>
+    public NativeBatchPolicy BatchPolicy { get; set; } = NativeBatchPolicy.Fixed;
+
+    /// <summary>
+    /// Native escape sequence filtering applied to terminal output
+    /// </summary>
+    public NativeEscapeFilterMode NativeEscapeFilter { get; set; } = NativeEscapeFilterMode.Off;
+
+    /// <summary>
+    /// Secrets masked by the native hooks before output or input reaches managed code
+    /// </summary>
+    public NativeRedactionRules NativeRedaction { get; set; } = NativeRedactionRules.None;
+
+    /// <summary>
+    /// Command names checked natively against every line submitted with Enter
+    /// </summary>
+    public List<string> NativeCommandDenylist { get; set; } = new();
+
+    /// <summary>
+    /// Whether a line naming a denied command is only reported or also held back
+    /// </summary>
+    public NativeDenyMode NativeDenyMode { get; set; } = NativeDenyMode.Off;
+
+    /// <summary>
+    /// Prompt and command boundaries reported natively as <see cref="IOInterceptor.MarkEvents"/>
+    /// </summary>
+    public NativeShellMarks NativeShellMarks { get; set; } = NativeShellMarks.Off;
+
+    /// <summary>
+    /// Text a prompt ends with, such as "$ ", for shells without integration (at most 32 bytes)
+    /// </summary>
+    public string NativePromptFingerprint { get; set; } = string.Empty;
+
+    /// <summary>
+    /// What the native hooks do when the event ring is full
+    /// </summary>
+    public NativeOverflowPolicy OverflowPolicy { get; set; } = NativeOverflowPolicy.DropNewest;
+
+    /// <summary>
+    /// Longest the terminal may wait for the consumer under <see cref="NativeOverflowPolicy.BlockWithTimeout"/>
+    /// (microseconds, 0 = native default)
+    /// </summary>
+    public int OverflowTimeoutUs { get; set; } = 10000;
+
     /// <summary>
     /// Whether to track output event statistics
     /// </summary>
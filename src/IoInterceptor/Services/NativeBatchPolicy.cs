@@ -0,0 +1,13 @@
+namespace PairAdmin.IoInterceptor.Services;
+
+/// <summary>
+/// How long the native batch thread holds output (PairAdminBatchPolicy in pairadmin.h)
+/// </summary>
+public enum NativeBatchPolicy
+{
+    /// <summary>Always batch up to MaxBatchBytes / MaxBatchDelayUs</summary>
+    Fixed = 0,
+
+    /// <summary>Pass typing echo straight through and batch only bulk output</summary>
+    Adaptive = 1
+}
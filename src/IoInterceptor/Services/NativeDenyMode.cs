@@ -0,0 +1,16 @@
+namespace PairAdmin.IoInterceptor.Services;
+
+/// <summary>
+/// What the native hooks do with a command line naming a denied command (PairAdminDenyMode in pairadmin.h)
+/// </summary>
+public enum NativeDenyMode
+{
+    /// <summary>No native denylist</summary>
+    Off = 0,
+
+    /// <summary>Flag denied lines on the command event</summary>
+    Report = 1,
+
+    /// <summary>Also withhold the Enter that would submit a denied line</summary>
+    Block = 2
+}
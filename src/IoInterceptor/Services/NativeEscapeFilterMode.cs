@@ -0,0 +1,16 @@
+namespace PairAdmin.IoInterceptor.Services;
+
+/// <summary>
+/// Native escape sequence filter modes (PairAdminVtMode in pairadmin.h)
+/// </summary>
+public enum NativeEscapeFilterMode
+{
+    /// <summary>Raw output only</summary>
+    Off = 0,
+
+    /// <summary>Raw output followed by a filtered copy</summary>
+    Alongside = 1,
+
+    /// <summary>Filtered output instead of raw output</summary>
+    Replace = 2
+}
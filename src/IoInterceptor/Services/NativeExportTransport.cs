@@ -0,0 +1,13 @@
+namespace PairAdmin.IoInterceptor.Services;
+
+/// <summary>
+/// How the native audit exporter reaches its collector (PAIRADMIN_EXPORT_* in pairadmin.h)
+/// </summary>
+public enum NativeExportTransport
+{
+    /// <summary>TCP to "host:port" or "[v6]:port"</summary>
+    Tcp = 1,
+
+    /// <summary>Named pipe, e.g. \\.\pipe\pairadmin-audit</summary>
+    Pipe = 2
+}
@@ -0,0 +1,19 @@
+namespace PairAdmin.IoInterceptor.Services;
+
+/// <summary>
+/// What the native hooks do when the event ring is full (PairAdminOverflowPolicy in pairadmin.h)
+/// </summary>
+public enum NativeOverflowPolicy
+{
+    /// <summary>Discard the new record</summary>
+    DropNewest = 0,
+
+    /// <summary>Discard the oldest queued records to make room</summary>
+    DropOldest = 1,
+
+    /// <summary>Merge overflowing output into one record holding the latest bytes</summary>
+    Coalesce = 2,
+
+    /// <summary>Wait a bounded time for the consumer, then drop</summary>
+    BlockWithTimeout = 3
+}
@@ -0,0 +1,23 @@
+namespace PairAdmin.IoInterceptor.Services;
+
+/// <summary>
+/// Native redaction rule groups (PairAdminRedactRules in pairadmin.h)
+/// </summary>
+[Flags]
+public enum NativeRedactionRules
+{
+    /// <summary>No native redaction</summary>
+    None = 0,
+
+    /// <summary>PEM, OpenSSH and PGP private key bodies</summary>
+    PrivateKeys = 0x1,
+
+    /// <summary>Cloud and API tokens with a recognisable prefix</summary>
+    Tokens = 0x2,
+
+    /// <summary>Password and secret assignments, and input typed at password prompts</summary>
+    Passwords = 0x4,
+
+    /// <summary>Every rule group</summary>
+    All = PrivateKeys | Tokens | Passwords
+}
@@ -0,0 +1,20 @@
+namespace PairAdmin.IoInterceptor.Services;
+
+/// <summary>
+/// Where the native hooks find prompt and command boundaries (PAIRADMIN_MARKS_* in pairadmin.h)
+/// </summary>
+[Flags]
+public enum NativeShellMarks
+{
+    /// <summary>No native marks</summary>
+    Off = 0,
+
+    /// <summary>OSC 133/633 prompt and command marks, OSC 7 working directory</summary>
+    ShellIntegration = 0x1,
+
+    /// <summary>Output ending in <see cref="IoInterceptorConfiguration.NativePromptFingerprint"/> is a prompt</summary>
+    Fingerprint = 0x2,
+
+    /// <summary>Both; the fingerprint is dropped for a session once its shell sends OSC 133</summary>
+    All = ShellIntegration | Fingerprint
+}
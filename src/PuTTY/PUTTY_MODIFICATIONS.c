@@ -17,9 +17,7 @@
 /*
 void term_data_hook(Terminal *term, const char *data, size_t len)
 {
-    if (pairadmin_callback) {
-        pairadmin_callback(PAIRADMIN_EVENT_OUTPUT, data, len);
-    }
+    pairadmin_hook_output(data, len);
 }
 */
 
@@ -42,9 +40,7 @@ void term_data_hook(Terminal *term, const char *data, size_t len)
 /*
 void ldisc_send_hook(Ldisc *ldisc, const void *buf, size_t len)
 {
-    if (pairadmin_callback) {
-        pairadmin_callback(PAIRADMIN_EVENT_INPUT, buf, len);
-    }
+    pairadmin_hook_input(buf, len);
 }
 */
 
@@ -54,6 +50,10 @@ void ldisc_send_hook(Ldisc *ldisc, const void *buf, size_t len)
 // Modified:
 //     ldisc_send_hook(ldisc, buf, len);  // PairAdmin modification
 //     return ldisc_send(ldisc, buf, len);
+//
+// Or, to let the native command denylist withhold a denied line's Enter:
+//     size_t n = pairadmin_hook_input_checked(buf, len);  // PairAdmin modification
+//     return ldisc_send(ldisc, buf, n);
 
 
 // ============================================================================
@@ -71,6 +71,9 @@ void ldisc_send_hook(Ldisc *ldisc, const void *buf, size_t len)
 // Location: After line ~245
 
 // PairAdmin modification: Expose terminal window handle
+// For PuTTY's own use only; PairAdmin reads the window through the DLL's
+// pairadmin_get_terminal_hwnd(), which returns what open() passes to
+// pairadmin_session_set_hwnd() below.
 /*
 HWND putty_get_terminal_hwnd(void)
 {
@@ -78,6 +81,36 @@ HWND putty_get_terminal_hwnd(void)
 }
 */
 
+// Location: WinMain, before the message loop
+
+// PairAdmin modification: Run sessions on the PairAdmin session thread
+// When hosted by PairAdmin, WinMain does not connect or pump messages
+// itself. It registers a PairAdminSessionBackend whose members wrap the
+// code WinMain already has, and the session thread calls them:
+//   open()  - create the terminal window under parent_hwnd, fill in conf
+//             (host, port, username) and start_backend()
+//   run()   - one pass of the message loop: run_toplevel_callbacks(),
+//             then MsgWaitForMultipleObjects() on the socket events and
+//             the window's messages for up to timeout_ms. Returns
+//             PAIRADMIN_BACKEND_CONNECTED once the seat reports the
+//             connection is up, PAIRADMIN_BACKEND_CLOSED after
+//             notify_remote_exit() or connection_fatal()
+//   close() - backend_free() and destroy the terminal window
+//   error() - the message last passed to connection_fatal()/modalfatalbox()
+// Sessions from pairadmin_session_create() run these members on their
+// own threads at the same time. window.c's globals (conf, term, backend,
+// hwnd) therefore become per-session state, kept thread-local or keyed
+// by pairadmin_session_get_id(pairadmin_session_current()). open() calls
+// pairadmin_session_set_hwnd(pairadmin_session_current(), hwnd) once the
+// terminal window exists, and close() calls it again with NULL before
+// destroying the window.
+/*
+    PairAdminSessionBackend backend = {
+        NULL, pa_putty_open, pa_putty_run, pa_putty_close, pa_putty_error
+    };
+    pairadmin_set_session_backend(&backend);
+*/
+
 
 // ============================================================================
 // NEW FILE: pairadmin.h
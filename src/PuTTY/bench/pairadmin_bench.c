@@ -0,0 +1,731 @@
+// Benchmark harness for the PairAdmin hook layer
+//
+// Replays terminal output traces through pairadmin_hook_output() the way
+// term_data() would and reports throughput, per-call hook latency and
+// the heap allocations made on the hook thread. The built-in traces
+// model the three shapes that matter: keystroke echoes (many tiny
+// fragments), bulk `cat` (full 16 KB reads) and ANSI-heavy `htop`
+// redraws. A raw capture of real output, or a trace written by
+// pairadmin_record_start(), can be replayed with --trace; recorded
+// traces keep their original OUTPUT fragment sizes.
+//
+// Each trace runs with direct callback delivery and through the event
+// ring with a consumer thread, each with a callback that does nothing
+// and one that spins for --slow-us per call.
+//
+//   pairadmin_bench [--workload echo|cat|htop|all] [--trace FILE]
+//                   [--chunk BYTES] [--delivery direct|ring|all]
+//                   [--callback dummy|slow|all] [--slow-us N]
+//                   [--vt off|alongside|replace] [--redact] [--scale N]
+//                   [--cpu plain|sse2|avx2|neon] [--startup]
+//
+// --cpu caps the vector kernels the library may pick, to compare them
+// on one machine; by default it uses the best the CPU has.
+//
+// --startup times the calls a host makes while starting up instead, each
+// with what it left loaded (PAIRADMIN_LOADED_*), against the 300 ms
+// cold-start budget for the whole application.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
+
+#define BENCH_READ_BYTES 16384
+
+typedef struct BenchTrace {
+    const char *name;
+    unsigned char *data;
+    size_t *fragments;          // Length of each hook call, in order
+    size_t count;
+    size_t capacity;
+    size_t bytes;
+} BenchTrace;
+
+typedef struct BenchResult {
+    double mb_per_s;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+    int64_t allocations;        // -1 where they cannot be counted
+    uint64_t dropped;
+} BenchResult;
+
+static uint32_t bench_slow_us = 20;
+static volatile uint64_t bench_sink = 0;
+
+// ------------------------------------------------------------
+// Allocation counting
+//
+// Only calls made on the replaying thread are counted: the hook path
+// should not allocate at all, whatever the consumer side does.
+// ------------------------------------------------------------
+
+static PA_THREAD_LOCAL int bench_counting = 0;
+static PA_THREAD_LOCAL int64_t bench_allocations = 0;
+
+#if defined(__GLIBC__)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+#define BENCH_COUNTS_ALLOCATIONS 1
+
+void *malloc(size_t size)
+{
+    bench_allocations += bench_counting;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    bench_allocations += bench_counting;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+    bench_allocations += bench_counting;
+    return __libc_realloc(p, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size)
+{
+    bench_allocations += bench_counting;
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : 12; // ENOMEM
+}
+
+#elif defined(_MSC_VER) && defined(_DEBUG)
+
+#define BENCH_COUNTS_ALLOCATIONS 1
+
+static int bench_alloc_hook(int type, void *data, size_t size, int block, long request,
+                            const unsigned char *file, int line)
+{
+    (void)data;
+    (void)size;
+    (void)block;
+    (void)request;
+    (void)file;
+    (void)line;
+    if (type != _HOOK_FREE) {
+        bench_allocations += bench_counting;
+    }
+    return 1;
+}
+
+#else
+
+#define BENCH_COUNTS_ALLOCATIONS 0
+
+#endif
+
+// ------------------------------------------------------------
+// Traces
+// ------------------------------------------------------------
+
+static uint32_t bench_random_state = 0x2545f491u;
+
+static uint32_t bench_random(uint32_t range)
+{
+    bench_random_state = bench_random_state * 1664525u + 1013904223u;
+    return (bench_random_state >> 8) % range;
+}
+
+static void bench_trace_init(BenchTrace *t, const char *name, size_t bytes, size_t fragments)
+{
+    memset(t, 0, sizeof(*t));
+    t->name = name;
+    // Same bytes whichever traces are selected
+    bench_random_state = 0x2545f491u;
+    t->data = (unsigned char *)malloc(bytes);
+    t->capacity = bytes;
+    t->fragments = (size_t *)malloc(sizeof(size_t) * fragments);
+    if (!t->data || !t->fragments) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+static void bench_trace_free(BenchTrace *t)
+{
+    free(t->data);
+    free(t->fragments);
+}
+
+// Append to the fragment being built
+static void bench_put(BenchTrace *t, const void *data, size_t len)
+{
+    if (t->bytes + len > t->capacity) {
+        len = t->capacity - t->bytes;
+    }
+    memcpy(t->data + t->bytes, data, len);
+    t->bytes += len;
+}
+
+static void bench_puts(BenchTrace *t, const char *s)
+{
+    bench_put(t, s, strlen(s));
+}
+
+// Close the fragment built since the previous one
+static void bench_cut(BenchTrace *t, size_t *start)
+{
+    if (t->bytes > *start) {
+        t->fragments[t->count++] = t->bytes - *start;
+        *start = t->bytes;
+    }
+}
+
+static const char *const bench_words[] = {
+    "total", "drwxr-xr-x", "root", "4096", "Oct", "config", "service", "started",
+    "kernel:", "[", "OK", "]", "eth0", "link", "up", "systemd[1]:", "Reached",
+    "target", "/var/log/syslog", "connection", "from", "192.168.1.24", "port", "22",
+};
+
+#define BENCH_WORDS (sizeof(bench_words) / sizeof(bench_words[0]))
+
+static void bench_line(BenchTrace *t, size_t width)
+{
+    size_t start = t->bytes;
+
+    while (t->bytes - start < width) {
+        bench_puts(t, bench_words[bench_random(BENCH_WORDS)]);
+        bench_put(t, " ", 1);
+    }
+    bench_put(t, "\r\n", 2);
+}
+
+// Interactive shell: each typed key echoed on its own, then a command's
+// few lines of output and a coloured prompt
+static void bench_trace_echo(BenchTrace *t, uint32_t scale)
+{
+    static const char prompt[] = "\x1b[01;32madmin@web01\x1b[00m:\x1b[01;34m~\x1b[00m$ ";
+    size_t commands = 20000u * scale;
+    size_t start = 0;
+    size_t i;
+    uint32_t k;
+
+    bench_trace_init(t, "echo", commands * 512, commands * 32);
+    for (i = 0; i < commands && t->bytes + 512 <= t->capacity; i++) {
+        uint32_t keys = 4 + bench_random(16);
+        uint32_t lines = bench_random(4);
+
+        for (k = 0; k < keys; k++) {
+            char c = (char)('a' + bench_random(26));
+
+            bench_put(t, &c, 1);
+            bench_cut(t, &start);
+        }
+        bench_put(t, "\r\n", 2);
+        bench_cut(t, &start);
+        for (k = 0; k < lines; k++) {
+            bench_line(t, 30 + bench_random(40));
+        }
+        bench_puts(t, prompt);
+        bench_cut(t, &start);
+    }
+}
+
+// `cat` of a large log: plain text in full-size reads
+static void bench_trace_cat(BenchTrace *t, uint32_t scale)
+{
+    size_t total = (size_t)32u * 1024u * 1024u * scale;
+    size_t start = 0;
+
+    bench_trace_init(t, "cat", total + 256, total / BENCH_READ_BYTES + 2);
+    while (t->bytes + 256 <= t->capacity) {
+        bench_line(t, 40 + bench_random(80));
+        if (t->bytes - start >= BENCH_READ_BYTES) {
+            t->fragments[t->count++] = BENCH_READ_BYTES;
+            start += BENCH_READ_BYTES;
+        }
+    }
+    bench_cut(t, &start);
+}
+
+// `htop` redraws: cursor addressing, 256-colour SGR and erase-line on
+// every row, meters made of short coloured runs
+static void bench_trace_htop(BenchTrace *t, uint32_t scale)
+{
+    size_t frames = 2000u * scale;
+    size_t start = 0;
+    char cell[64];
+    size_t f;
+    uint32_t row;
+    uint32_t col;
+
+    bench_trace_init(t, "htop", frames * 12288, frames * 8);
+    for (f = 0; f < frames && t->bytes + 12288 <= t->capacity; f++) {
+        bench_puts(t, "\x1b[?25l\x1b[H");
+        for (row = 1; row <= 24; row++) {
+            snprintf(cell, sizeof(cell), "\x1b[%u;1H\x1b[0m", (unsigned)row);
+            bench_puts(t, cell);
+            if (row <= 4) {
+                uint32_t fill = bench_random(40);
+
+                snprintf(cell, sizeof(cell), "\x1b[1;36m%3u\x1b[0m\x1b[1m[", (unsigned)row);
+                bench_puts(t, cell);
+                for (col = 0; col < 40; col++) {
+                    if (col < fill) {
+                        snprintf(cell, sizeof(cell), "\x1b[38;5;%um|", 34u + col % 3 * 42u);
+                        bench_puts(t, cell);
+                    } else {
+                        bench_put(t, " ", 1);
+                    }
+                }
+                snprintf(cell, sizeof(cell), "\x1b[0m%5.1f%%\x1b[1m]\x1b[K", fill * 2.5);
+                bench_puts(t, cell);
+            } else {
+                snprintf(cell, sizeof(cell), "\x1b[38;5;%um%6u \x1b[0mroot      20   0 ",
+                         (unsigned)(bench_random(6) + 1), (unsigned)(1000 + bench_random(60000)));
+                bench_puts(t, cell);
+                snprintf(cell, sizeof(cell), "\x1b[1;32m%5uM\x1b[0m \x1b[31m%4.1f\x1b[0m ",
+                         (unsigned)bench_random(4096), bench_random(1000) / 10.0);
+                bench_puts(t, cell);
+                bench_puts(t, bench_words[bench_random(BENCH_WORDS)]);
+                bench_puts(t, "\x1b[K");
+            }
+            // PuTTY hands over whatever one socket read returned
+            if (t->bytes - start >= 4096) {
+                bench_cut(t, &start);
+            }
+        }
+        bench_puts(t, "\x1b[?25h");
+        bench_cut(t, &start);
+    }
+}
+
+static size_t bench_varint(const unsigned char *p, size_t avail, uint64_t *v)
+{
+    uint64_t result = 0;
+    size_t n = 0;
+
+    while (n < avail && n < 10) {
+        result |= (uint64_t)(p[n] & 0x7f) << (7 * n);
+        if (!(p[n++] & 0x80)) {
+            *v = result;
+            return n;
+        }
+    }
+    return 0;
+}
+
+// Keep the OUTPUT records of a recorded trace, one hook call each,
+// packed to the front of the data. The first pass only counts them.
+static void bench_trace_records(BenchTrace *t)
+{
+    int pass;
+
+    for (pass = 0; pass < 2; pass++) {
+        size_t in = PAIRADMIN_TRACE_HEADER_SIZE;
+        size_t out = 0;
+        size_t count = 0;
+
+        while (in < t->bytes) {
+            uint64_t delta;
+            uint64_t length;
+            unsigned type;
+            size_t n = bench_varint(t->data + in, t->bytes - in, &delta);
+
+            if (n == 0 || in + n >= t->bytes) {
+                break;
+            }
+            in += n;
+            type = t->data[in++];
+            n = bench_varint(t->data + in, t->bytes - in, &length);
+            if (n == 0 || length > t->bytes - in - n) {
+                break;
+            }
+            in += n;
+            if (type == PAIRADMIN_EVENT_OUTPUT && length > 0) {
+                if (pass == 1) {
+                    memmove(t->data + out, t->data + in, (size_t)length);
+                    t->fragments[count] = (size_t)length;
+                }
+                out += (size_t)length;
+                count++;
+            }
+            in += (size_t)length;
+        }
+
+        if (pass == 0) {
+            free(t->fragments);
+            t->fragments = (size_t *)malloc(sizeof(size_t) * (count + 1));
+            if (!t->fragments) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        } else {
+            t->bytes = out;
+            t->count = count;
+        }
+    }
+}
+
+static int bench_trace_file(BenchTrace *t, const char *path, size_t chunk)
+{
+    FILE *f = fopen(path, "rb");
+    long size;
+    size_t start = 0;
+
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(f);
+        fprintf(stderr, "%s is empty\n", path);
+        return -1;
+    }
+
+    bench_trace_init(t, "trace", (size_t)size, (size_t)size / chunk + 1);
+    t->bytes = fread(t->data, 1, (size_t)size, f);
+    fclose(f);
+    if (t->bytes >= PAIRADMIN_TRACE_HEADER_SIZE && memcmp(t->data, PAIRADMIN_TRACE_MAGIC, 8) == 0) {
+        bench_trace_records(t);
+        return 0;
+    }
+    while (start < t->bytes) {
+        size_t len = t->bytes - start < chunk ? t->bytes - start : chunk;
+
+        t->fragments[t->count++] = len;
+        start += len;
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Callbacks
+// ------------------------------------------------------------
+
+static void bench_consume(const void *data, size_t len, int slow)
+{
+    bench_sink += len + ((const unsigned char *)data)[0];
+    if (slow) {
+        uint64_t until = pa_now_us() + bench_slow_us;
+
+        while (pa_now_us() < until) {
+        }
+    }
+}
+
+static void bench_callback_dummy(PairAdminEventType event, const void *data, size_t len)
+{
+    (void)event;
+    bench_consume(data, len, 0);
+}
+
+static void bench_callback_slow(PairAdminEventType event, const void *data, size_t len)
+{
+    (void)event;
+    bench_consume(data, len, 1);
+}
+
+typedef struct BenchConsumer {
+    PaThread thread;
+    volatile uint32_t stop;
+    int slow;
+    unsigned char *buffer;
+} BenchConsumer;
+
+static void bench_consumer_thread(void *arg)
+{
+    BenchConsumer *c = (BenchConsumer *)arg;
+
+    for (;;) {
+        size_t n = pairadmin_read_events(c->buffer, 4 * PAIRADMIN_READ_BUFFER_MIN);
+        size_t off = 0;
+
+        if (n == 0) {
+            if (pa_load_acquire_u32(&c->stop)) {
+                break;
+            }
+            pa_thread_yield();
+            continue;
+        }
+        while (off < n) {
+            const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(c->buffer + off);
+
+            bench_consume(hdr + 1, hdr->length, c->slow);
+            off += PAIRADMIN_RECORD_SIZE(hdr->length);
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// Measurement
+// ------------------------------------------------------------
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int bench_run(const BenchTrace *t, int ring, int slow, BenchResult *r)
+{
+    uint64_t *latency = (uint64_t *)malloc(sizeof(uint64_t) * (t->count ? t->count : 1));
+    BenchConsumer consumer;
+    const unsigned char *p = t->data;
+    uint64_t started;
+    uint64_t elapsed;
+    size_t i;
+
+    if (!latency) {
+        return -1;
+    }
+    memset(&consumer, 0, sizeof(consumer));
+    memset(r, 0, sizeof(*r));
+
+    if (ring) {
+        consumer.slow = slow;
+        consumer.buffer = (unsigned char *)malloc(4 * PAIRADMIN_READ_BUFFER_MIN);
+        if (!consumer.buffer || pairadmin_ring_open(0) != 0 ||
+            pa_thread_start(&consumer.thread, bench_consumer_thread, &consumer) != 0) {
+            free(consumer.buffer);
+            free(latency);
+            return -1;
+        }
+    } else {
+        pairadmin_set_callback(slow ? bench_callback_slow : bench_callback_dummy);
+    }
+
+    bench_allocations = 0;
+    bench_counting = 1;
+    started = pa_now_us();
+    for (i = 0; i < t->count; i++) {
+        uint64_t start = pa_ticks();
+
+        pairadmin_hook_output(p, t->fragments[i]);
+        latency[i] = pa_ticks() - start;
+        p += t->fragments[i];
+    }
+    elapsed = pa_now_us() - started;
+    bench_counting = 0;
+
+    if (ring) {
+        r->dropped = pairadmin_get_dropped_events();
+        pa_store_release_u32(&consumer.stop, 1);
+        pa_thread_join(&consumer.thread);
+        pairadmin_ring_close();
+        free(consumer.buffer);
+    } else {
+        pairadmin_set_callback(NULL);
+    }
+
+    qsort(latency, t->count, sizeof(uint64_t), bench_compare_u64);
+    if (t->count) {
+        r->p50_ns = pa_ticks_ns(latency[t->count / 2]);
+        r->p99_ns = pa_ticks_ns(latency[t->count * 99 / 100]);
+        r->max_ns = pa_ticks_ns(latency[t->count - 1]);
+    }
+    r->mb_per_s = elapsed ? (double)t->bytes / (double)elapsed : 0.0;
+    r->allocations = BENCH_COUNTS_ALLOCATIONS ? bench_allocations : -1;
+    free(latency);
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Startup
+// ------------------------------------------------------------
+
+static void bench_startup_step(const char *name, uint64_t started, uint64_t *total)
+{
+    uint64_t elapsed = pa_now_us() - started;
+    PairAdminCapabilities caps;
+
+    pairadmin_get_capabilities(&caps);
+    *total += elapsed;
+    printf("%-22s %10lu us   loaded 0x%02x\n", name, (unsigned long)elapsed, (unsigned)caps.loaded);
+}
+
+static int bench_startup(void)
+{
+    PairAdminCapabilities caps;
+    uint64_t total = 0;
+    uint64_t started;
+
+    started = pa_now_us();
+    pairadmin_get_capabilities(&caps);
+    bench_startup_step("get_capabilities", started, &total);
+
+    started = pa_now_us();
+    if (pairadmin_init(NULL) != 0) {
+        fprintf(stderr, "pairadmin_init failed\n");
+        return 1;
+    }
+    bench_startup_step("init", started, &total);
+
+    started = pa_now_us();
+    pairadmin_set_callback(bench_callback_dummy);
+    pairadmin_set_redaction(PAIRADMIN_REDACT_ALL);
+    bench_startup_step("callback + redaction", started, &total);
+
+    started = pa_now_us();
+    if (pairadmin_capture_open(NULL, NULL, 0) != 0) {
+        fprintf(stderr, "pairadmin_capture_open failed\n");
+        return 1;
+    }
+    bench_startup_step("capture_open", started, &total);
+
+    printf("%-22s %10lu us\n", "total", (unsigned long)total);
+
+    pairadmin_capture_close(NULL);
+    pairadmin_set_callback(NULL);
+    pairadmin_shutdown();
+    return 0;
+}
+
+static int bench_match(const char *selected, const char *name)
+{
+    return strcmp(selected, "all") == 0 || strcmp(selected, name) == 0;
+}
+
+static void bench_usage(void)
+{
+    fprintf(stderr,
+            "usage: pairadmin_bench [--workload echo|cat|htop|all] [--trace FILE]\n"
+            "                       [--chunk BYTES] [--delivery direct|ring|all]\n"
+            "                       [--callback dummy|slow|all] [--slow-us N]\n"
+            "                       [--vt off|alongside|replace] [--redact] [--scale N]\n"
+            "                       [--cpu plain|sse2|avx2|neon] [--startup]\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const char *const deliveries[] = {"direct", "ring"};
+    static const char *const callbacks[] = {"dummy", "slow"};
+    const char *workload = "all";
+    const char *delivery = "all";
+    const char *callback = "all";
+    const char *trace = NULL;
+    size_t chunk = BENCH_READ_BYTES;
+    uint32_t scale = 1;
+    BenchTrace traces[3];
+    size_t trace_count = 0;
+    int startup = 0;
+    size_t i;
+    int d;
+    int c;
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+    _CrtSetAllocHook(bench_alloc_hook);
+#endif
+
+    for (i = 1; i < (size_t)argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < (size_t)argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--redact") == 0) {
+            pairadmin_set_redaction(PAIRADMIN_REDACT_ALL);
+            continue;
+        }
+        if (strcmp(arg, "--startup") == 0) {
+            startup = 1;
+            continue;
+        }
+        if (!value) {
+            bench_usage();
+            return 2;
+        }
+        i++;
+        if (strcmp(arg, "--workload") == 0) {
+            workload = value;
+        } else if (strcmp(arg, "--trace") == 0) {
+            trace = value;
+        } else if (strcmp(arg, "--chunk") == 0) {
+            chunk = (size_t)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--delivery") == 0) {
+            delivery = value;
+        } else if (strcmp(arg, "--callback") == 0) {
+            callback = value;
+        } else if (strcmp(arg, "--slow-us") == 0) {
+            bench_slow_us = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--scale") == 0) {
+            scale = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--cpu") == 0) {
+            pairadmin_set_cpu_features(strcmp(value, "avx2") == 0 ? PAIRADMIN_CPU_SSE2 | PAIRADMIN_CPU_AVX2 :
+                                       strcmp(value, "sse2") == 0 ? PAIRADMIN_CPU_SSE2 :
+                                       strcmp(value, "neon") == 0 ? PAIRADMIN_CPU_NEON : 0);
+        } else if (strcmp(arg, "--vt") == 0) {
+            pairadmin_set_vt_filter(strcmp(value, "replace") == 0 ? PAIRADMIN_VT_REPLACE :
+                                    strcmp(value, "alongside") == 0 ? PAIRADMIN_VT_ALONGSIDE :
+                                    PAIRADMIN_VT_OFF);
+        } else {
+            bench_usage();
+            return 2;
+        }
+    }
+    if (chunk == 0 || scale == 0) {
+        bench_usage();
+        return 2;
+    }
+    if (startup) {
+        return bench_startup();
+    }
+
+    if (trace) {
+        if (bench_trace_file(&traces[trace_count], trace, chunk) != 0) {
+            return 1;
+        }
+        trace_count++;
+    } else {
+        if (bench_match(workload, "echo")) {
+            bench_trace_echo(&traces[trace_count++], scale);
+        }
+        if (bench_match(workload, "cat")) {
+            bench_trace_cat(&traces[trace_count++], scale);
+        }
+        if (bench_match(workload, "htop")) {
+            bench_trace_htop(&traces[trace_count++], scale);
+        }
+    }
+
+    printf("cpu features: 0x%x\n", (unsigned)pairadmin_get_cpu_features());
+    printf("%-8s %-8s %-8s %10s %9s %12s %9s %9s %10s %7s %8s\n", "trace", "delivery", "callback",
+           "bytes", "calls", "MB/s", "p50 ns", "p99 ns", "max ns", "allocs", "dropped");
+    for (i = 0; i < trace_count; i++) {
+        const BenchTrace *t = &traces[i];
+
+        for (d = 0; d < 2; d++) {
+            if (!bench_match(delivery, deliveries[d])) {
+                continue;
+            }
+            for (c = 0; c < 2; c++) {
+                BenchResult r;
+
+                if (!bench_match(callback, callbacks[c])) {
+                    continue;
+                }
+                if (bench_run(t, d, c, &r) != 0) {
+                    fprintf(stderr, "%s/%s/%s: setup failed\n", t->name, deliveries[d], callbacks[c]);
+                    return 1;
+                }
+                printf("%-8s %-8s %-8s %10lu %9lu %12.1f %9lu %9lu %10lu %7ld %8lu\n", t->name,
+                       deliveries[d], callbacks[c], (unsigned long)t->bytes, (unsigned long)t->count,
+                       r.mb_per_s, (unsigned long)r.p50_ns, (unsigned long)r.p99_ns,
+                       (unsigned long)r.max_ns, (long)r.allocations, (unsigned long)r.dropped);
+            }
+        }
+    }
+
+    for (i = 0; i < trace_count; i++) {
+        bench_trace_free(&traces[i]);
+    }
+    return 0;
+}
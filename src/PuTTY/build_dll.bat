@@ -1,6 +1,17 @@
 @echo off
 REM ============================================================
 REM Build PairAdminPuTTY.dll
+REM
+REM   build_dll.bat [release|lto|pgo-generate|pgo-use]
+REM
+REM release       /O2 (default)
+REM lto           /O2 /GL, linked with /LTCG
+REM pgo-generate  lto, instrumented; run PairAdmin with the DLL through
+REM               typical sessions to write profiles to build\pgo
+REM pgo-use       lto, optimised with the profiles from pgo-generate
+REM
+REM No /arch: the SIMD kernels are picked at run time (pairadmin_cpu.c).
+REM The CMake presets (CMakePresets.json) build the same profiles.
 REM ============================================================
 
 setlocal enabledelayedexpansion
@@ -9,12 +20,58 @@ set SRC_DIR=%~dp0
 set BUILD_DIR=%SRC_DIR%build
 set OUTPUT_DIR=%SRC_DIR%..\..\lib
 set VCPKG_ROOT=%SRC_DIR%..\..\..\vcpkg
+set PGO_DIR=%BUILD_DIR%\pgo
+
+set PROFILE=%~1
+if "%PROFILE%"=="" set PROFILE=release
+
+set CFLAGS=/O2 /Oi /Gy
+set LDFLAGS=/OPT:REF /OPT:ICF
+if /i "%PROFILE%"=="release" (
+    rem defaults
+) else if /i "%PROFILE%"=="lto" (
+    set CFLAGS=!CFLAGS! /GL
+    set LDFLAGS=!LDFLAGS! /LTCG
+) else if /i "%PROFILE%"=="pgo-generate" (
+    set CFLAGS=!CFLAGS! /GL
+    set LDFLAGS=!LDFLAGS! /LTCG /GENPROFILE:PGD="%PGO_DIR%\PairAdminPuTTY.pgd"
+) else if /i "%PROFILE%"=="pgo-use" (
+    set CFLAGS=!CFLAGS! /GL
+    set LDFLAGS=!LDFLAGS! /LTCG /USEPROFILE:PGD="%PGO_DIR%\PairAdminPuTTY.pgd"
+) else (
+    echo ERROR: Unknown profile "%PROFILE%" ^(release, lto, pgo-generate or pgo-use^)
+    exit /b 1
+)
 
-echo Building PairAdminPuTTY.dll...
+REM Translation units linked into the DLL (keep in sync with CMakeLists.txt)
+set SOURCES="%SRC_DIR%pairadmin.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_region.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_batch.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_vt.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_scan.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_subscribers.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_export.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_session.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_arena.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_capture.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_compress.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_screen.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_digest.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_redact.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_line.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_marks.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_stats.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_trace.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_record.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_platform.c"
+set SOURCES=%SOURCES% "%SRC_DIR%pairadmin_cpu.c"
+
+echo Building PairAdminPuTTY.dll (%PROFILE%)...
 
 REM Create directories
 if not exist "%BUILD_DIR%" mkdir "%BUILD_DIR%"
 if not exist "%OUTPUT_DIR%" mkdir "%OUTPUT_DIR%"
+if not exist "%PGO_DIR%" mkdir "%PGO_DIR%"
 
 REM Find Visual Studio installation
 set VS2022=
@@ -38,10 +95,10 @@ echo.
 echo Compiling PairAdminPuTTY.dll...
 echo.
 
-cl.exe /c /nologo /O2 /MD /DNDEBUG /D_CRT_SECURE_NO_WARNINGS /DPAIRADMIN_EXPORTS ^
+cl.exe /c /nologo %CFLAGS% /MD /DNDEBUG /D_CRT_SECURE_NO_WARNINGS /DPAIRADMIN_EXPORTS ^
     /I"%SRC_DIR%" ^
-    /Fo"%BUILD_DIR%\pairadmin.obj" ^
-    "%SRC_DIR%pairadmin.c"
+    /Fo"%BUILD_DIR%\\" ^
+    %SOURCES%
 
 if errorlevel 1 (
     echo ERROR: Compilation failed
@@ -53,8 +110,8 @@ echo.
 echo Linking PairAdminPuTTY.dll...
 echo.
 
-link.exe /nologo /DLL /OUT:"%OUTPUT_DIR%\PairAdminPuTTY.dll" /DEF:"%SRC_DIR%pairadmin.def" ^
-    "%BUILD_DIR%\pairadmin.obj" kernel32.lib user32.lib /IMPLIB:"%OUTPUT_DIR%\PairAdminPuTTY.lib"
+link.exe /nologo /DLL %LDFLAGS% /OUT:"%OUTPUT_DIR%\PairAdminPuTTY.dll" /DEF:"%SRC_DIR%pairadmin.def" ^
+    "%BUILD_DIR%\*.obj" kernel32.lib user32.lib advapi32.lib ws2_32.lib /IMPLIB:"%OUTPUT_DIR%\PairAdminPuTTY.lib"
 
 if errorlevel 1 (
     echo ERROR: Linking failed
@@ -62,7 +119,7 @@ if errorlevel 1 (
 )
 
 REM Clean up
-if exist "%BUILD_DIR%\pairadmin.obj" del "%BUILD_DIR%\pairadmin.obj"
+del /q "%BUILD_DIR%\*.obj" 2>nul
 
 echo.
 echo ============================================================
@@ -23,9 +23,12 @@ size_t ldisc_send(Ldisc *ldisc, const void *buf, size_t len)
 // PairAdmin modification: Add terminal input hook
 // This callback notifies PairAdmin when user input is sent to SSH server
 #ifdef PAIRADMIN_INTEGRATION
-    if (pairadmin_callback) {
-        pairadmin_callback(PAIRADMIN_EVENT_INPUT, buf, len);
-    }
+    pairadmin_hook_input(buf, len);
+#endif // PAIRADMIN_INTEGRATION
+
+// Or, with PAIRADMIN_DENY_BLOCK, send only what the denylist accepts:
+#ifdef PAIRADMIN_INTEGRATION
+    len = pairadmin_hook_input_checked(buf, len);
 #endif // PAIRADMIN_INTEGRATION
 
 /* END MODIFICATION */
@@ -45,8 +48,10 @@ size_t ldisc_send(Ldisc *ldisc, const void *buf, size_t len)
  * security checks before dangerous commands are executed.
  *
  * Performance Impact:
- * - Minimal overhead (single function call per user input)
- * - No buffering or data copying
+ * - Minimal overhead (single function call per user input); the time
+ *   actually spent is reported by pairadmin_get_stats()
+ * - With the event ring open the hook only copies into the ring
+ * - Without the ring the callback runs synchronously on PuTTY's thread
  * - No modification to PuTTY's line discipline logic
  *
  * Testing:
@@ -1,43 +1,1066 @@
-// Stub implementation of PuTTY modifications for PairAdmin
-// 
-// This file demonstrates the structure of PuTTY modifications that would be made
-// to enable I/O interception and callback registration.
+// Event delivery core for PairAdmin
 //
-// In production deployment, these modifications would be applied to actual
-// PuTTY source code (terminal.c, ldisc.c, window.c)
+// PuTTY's terminal and line discipline call pairadmin_hook_output() and
+// pairadmin_hook_input() (see PUTTY_MODIFICATIONS.c for where). Each
+// event is either handed straight to the registered callback or, once
+// pairadmin_ring_open() has been called, written to a single-producer
+// event ring that the batcher, subscribers, exporters and
+// pairadmin_read_events() drain off PuTTY's thread. This file holds the
+// ring itself (producer, consumer and subscriber sides, with the
+// overflow policies, and the shared-memory region it can live in), the
+// epoch sections that let the control calls swap the callback or ring
+// while hooks are running, and the routing that splits output into raw
+// and escape-filtered text events.
+
+#include <stdlib.h>
+#include <string.h>
 
 #include "pairadmin.h"
+#include "pairadmin_internal.h"
 
 // Global callback pointer - initialized to NULL
 PairAdminCallback pairadmin_callback = NULL;
 
-// Set the PairAdmin callback
+// Hook read sections: readers count themselves in the slot selected by
+// the epoch's low bit; synchronize flips the epoch and waits for the
+// old slot to drain
+static volatile uint32_t pairadmin_epoch = 0;
+static volatile uint32_t pairadmin_epoch_readers[2] = { 0, 0 };
+
+// Serialises the control functions (callback, ring) against each other
+static volatile uint32_t pairadmin_control = 0;
+
+// Event ring used for queued delivery - NULL while delivering directly
+static PaRing *pairadmin_ring = NULL;
+
+// Source of PaRing ids; rings are only created under pairadmin_control
+static uint64_t pairadmin_ring_ids = 0;
+
+// What the producer does when the ring is full
+static volatile uint32_t pairadmin_overflow_policy = PAIRADMIN_OVERFLOW_DROP_NEWEST;
+static volatile uint32_t pairadmin_overflow_timeout_us = PAIRADMIN_OVERFLOW_DEFAULT_TIMEOUT_US;
+
+// Escape filter: mode requested by the host, and the producer's own copy
+// so the parser is reset on PuTTY's thread when the mode changes
+static volatile uint32_t pairadmin_vt_mode = PAIRADMIN_VT_OFF;
+static PaVtFilter pairadmin_vt;
+
+// ------------------------------------------------------------
+// Epoch-based quiescence
+// ------------------------------------------------------------
+
+uint32_t pa_epoch_enter(void)
+{
+    uint32_t slot = pa_load_acquire_u32(&pairadmin_epoch) & 1;
+
+    pa_atomic_inc_u32(&pairadmin_epoch_readers[slot]);
+    return slot;
+}
+
+void pa_epoch_exit(uint32_t slot)
+{
+    pa_atomic_dec_u32(&pairadmin_epoch_readers[slot]);
+}
+
+static void pa_epoch_flip(void)
+{
+    uint32_t old = pa_atomic_inc_u32(&pairadmin_epoch) - 1;
+
+    while (pa_load_acquire_u32(&pairadmin_epoch_readers[old & 1]) != 0) {
+        pa_thread_yield();
+    }
+}
+
+// Two flips: a reader that sampled the epoch just before the first flip
+// but counted itself after the check already sees the new pointers, and
+// the second flip waits out the slot it landed in.
+void pa_epoch_synchronize(void)
+{
+    pa_epoch_flip();
+    pa_epoch_flip();
+}
+
+static void pa_control_lock(void)
+{
+    while (!pa_atomic_cas_u32(&pairadmin_control, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_control_unlock(void)
+{
+    pa_store_release_u32(&pairadmin_control, 0);
+}
+
+// Set the PairAdmin callback. Once this returns the previous callback
+// is no longer running on any hook and will not be called again.
 void pairadmin_set_callback(PairAdminCallback callback)
 {
-    pairadmin_callback = callback;
-}
-
-// Stub: Terminal output hook
-// In actual PuTTY terminal.c, this would be called after term_data()
-// void term_data_hook(Terminal *term, const char *data, size_t len)
-// {
-//     if (pairadmin_callback) {
-//         pairadmin_callback(PAIRADMIN_EVENT_OUTPUT, data, len);
-//     }
-// }
-
-// Stub: Terminal input hook
-// In actual PuTTY ldisc.c, this would be called before ldisc_send()
-// void ldisc_send_hook(Ldisc *ldisc, const void *buf, size_t len)
-// {
-//     if (pairadmin_callback) {
-//         pairadmin_callback(PAIRADMIN_EVENT_INPUT, buf, len);
-//     }
-// }
-
-// Stub: Get terminal window handle
-// In actual PuTTY window.c, this would return the terminal window HWND
-// HWND putty_get_terminal_hwnd(void)
-// {
-//     return hwnd_terminal;
-// }
+    pa_trace_register();
+    pa_control_lock();
+    pa_atomic_xchg_ptr((void *volatile *)&pairadmin_callback, (void *)callback);
+    pa_epoch_synchronize();
+    pa_control_unlock();
+}
+
+// ------------------------------------------------------------
+// Event ring
+// ------------------------------------------------------------
+
+size_t pa_ring_capacity(size_t requested)
+{
+    size_t size = 1;
+
+    // Every record must fit even when it has to be pushed past a pad
+    if (requested < 4 * PAIRADMIN_READ_BUFFER_MIN) {
+        requested = 4 * PAIRADMIN_READ_BUFFER_MIN;
+    }
+    while (size < requested) {
+        size <<= 1;
+    }
+    return size;
+}
+
+void pa_ring_layout(PaRing *ring, void *block, size_t capacity)
+{
+    PairAdminRegionHeader *ctl = (PairAdminRegionHeader *)block;
+
+    memset(ctl, 0, sizeof(PairAdminRegionHeader));
+    ctl->magic = PAIRADMIN_REGION_MAGIC;
+    ctl->version = PAIRADMIN_REGION_VERSION;
+    ctl->capacity = capacity;
+    ctl->data_offset = sizeof(PairAdminRegionHeader);
+
+    ring->ctl = ctl;
+    ring->data = (unsigned char *)block + sizeof(PairAdminRegionHeader);
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+    ring->id = ++pairadmin_ring_ids;
+}
+
+PaRing *pa_ring_create(size_t capacity)
+{
+    PaRing *ring;
+    void *block;
+
+    capacity = pa_ring_capacity(capacity);
+
+    ring = (PaRing *)pa_aligned_alloc(sizeof(PaRing));
+    if (!ring) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(PaRing));
+
+    block = pa_aligned_alloc(sizeof(PairAdminRegionHeader) + capacity);
+    if (!block) {
+        pa_aligned_free(ring);
+        return NULL;
+    }
+    if (pa_waker_create(&ring->waker, NULL) != 0) {
+        pa_aligned_free(block);
+        pa_aligned_free(ring);
+        return NULL;
+    }
+    ring->block = block;
+    ring->block_size = sizeof(PairAdminRegionHeader) + capacity;
+    pa_ring_layout(ring, block, capacity);
+    return ring;
+}
+
+PaRing *pa_ring_create_owned(size_t capacity)
+{
+    PaRing *ring;
+
+    pa_control_lock();
+    ring = pa_ring_create(capacity);
+    pa_control_unlock();
+    return ring;
+}
+
+void pa_ring_destroy(PaRing *ring)
+{
+    if (!ring) {
+        return;
+    }
+    if (ring->shared) {
+        pa_region_destroy(ring);
+        return;
+    }
+    pa_waker_destroy(&ring->waker);
+    pa_aligned_free(ring->block);
+    pa_aligned_free(ring);
+}
+
+// ------------------------------------------------------------
+// Producer side
+//
+// A write reserves room at head, padding past the end of the buffer if
+// the record would straddle it, then fills the record in and publishes
+// head. When the ring is full the overflow policy decides what happens:
+// drop the new record, reclaim the oldest ones, merge into a pending
+// record, or wait a bounded time for the consumer. Anything lost is
+// reported in a PAIRADMIN_EVENT_GAP record ahead of the next data.
+//
+// The consumer sleeps on the ring's waker once it has caught up, so a
+// write that lands in an empty ring has to wake it. Only that write
+// does: after publishing head, a full fence and a reload of tail tell
+// whether the consumer had already taken everything before it. The
+// consumer fences between its last commit and its final look at head,
+// so one of the two always sees the other.
+// ------------------------------------------------------------
+
+// BLOCK_WITH_TIMEOUT: yield this many times, then poll at this interval
+#define PA_BLOCK_SPINS 64
+#define PA_BLOCK_POLL_US 100
+
+PA_INLINE uint32_t pa_ring_policy(PaRing *ring)
+{
+    // A ring without a primary consumer always reclaims
+    if (pa_load_acquire_u32(&ring->reclaim)) {
+        return PAIRADMIN_OVERFLOW_DROP_OLDEST;
+    }
+    return pa_load_acquire_u32(&pairadmin_overflow_policy);
+}
+
+static void pa_ring_lose(PaRing *ring, uint64_t records, uint64_t bytes)
+{
+    if (pa_trace_on(PA_TRACE_RING)) {
+        pa_trace_overflow(ring->id, pa_ring_policy(ring), records, bytes);
+    }
+    ring->dropped_records += records;
+    ring->dropped_bytes += bytes;
+    ring->gap_records += records;
+    ring->gap_bytes += bytes;
+}
+
+// DROP_OLDEST: advance tail past the oldest records until it reaches at
+// least `until`. Each step is a compare-and-swap, so a record the
+// consumer committed first is left to it and only records actually
+// taken from it are counted. Subscribers detect that they fell behind
+// tail and skip ahead; the CAS is a full barrier, so tail is visible
+// before the freed space is written again.
+static void pa_ring_reclaim(PaRing *ring, uint64_t until)
+{
+    int counted = !pa_load_acquire_u32(&ring->reclaim);
+    uint64_t tail = pa_load_acquire_u64(&ring->ctl->tail);
+
+    while (tail < until) {
+        size_t offset = (size_t)(tail & ring->mask);
+        size_t contiguous = ring->capacity - offset;
+        const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(ring->data + offset);
+        size_t size;
+
+        if (contiguous < sizeof(PairAdminEventHeader) || hdr->type == PA_RECORD_PAD) {
+            hdr = NULL;
+            size = contiguous;
+        } else {
+            size = PAIRADMIN_RECORD_SIZE(hdr->length);
+        }
+
+        if (!pa_atomic_cas_u64(&ring->ctl->tail, tail, tail + size)) {
+            // The consumer moved on first
+            tail = pa_load_acquire_u64(&ring->ctl->tail);
+            continue;
+        }
+        if (hdr && counted) {
+            if (hdr->type == PAIRADMIN_EVENT_GAP) {
+                // Fold the lost marker into the next one
+                const PairAdminGapInfo *gap = (const PairAdminGapInfo *)(hdr + 1);
+                ring->gap_records += gap->records;
+                ring->gap_bytes += gap->bytes;
+            } else {
+                pa_ring_lose(ring, 1, hdr->length);
+            }
+        }
+        tail += size;
+    }
+    ring->cached_tail = tail;
+}
+
+// BLOCK_WITH_TIMEOUT: wait for the consumer to free enough space. After
+// one timeout the ring counts as stalled and later writes drop at once
+// until space frees up, so a dead consumer cannot freeze the terminal.
+static int pa_ring_wait(PaRing *ring, uint64_t end)
+{
+    uint64_t deadline;
+    unsigned spins = 0;
+
+    if (ring->stalled) {
+        return 0;
+    }
+    deadline = pa_now_us() + pa_load_acquire_u32(&pairadmin_overflow_timeout_us);
+
+    for (;;) {
+        ring->cached_tail = pa_load_acquire_u64(&ring->ctl->tail);
+        if (end - ring->cached_tail <= ring->capacity) {
+            return 1;
+        }
+        if (pa_now_us() >= deadline) {
+            ring->stalled = 1;
+            return 0;
+        }
+        if (++spins < PA_BLOCK_SPINS) {
+            pa_thread_yield();
+        } else {
+            pa_sleep_us(PA_BLOCK_POLL_US);
+        }
+    }
+}
+
+// Find room for a record of `need` bytes. On success *pos is where it
+// starts; any pad it needs has been written but nothing is published.
+static int pa_ring_reserve(PaRing *ring, size_t need, uint64_t *pos)
+{
+    uint64_t head = ring->ctl->head;
+    size_t offset = (size_t)(head & ring->mask);
+    size_t contiguous = ring->capacity - offset;
+    size_t skip = contiguous < need ? contiguous : 0;
+    uint64_t end = head + skip + need;
+
+    if (end - ring->cached_tail > ring->capacity) {
+        ring->cached_tail = pa_load_acquire_u64(&ring->ctl->tail);
+        if (end - ring->cached_tail > ring->capacity) {
+            // A full ring must not wait on a consumer nobody has woken
+            pa_ring_notify(ring);
+            switch (pa_ring_policy(ring)) {
+            case PAIRADMIN_OVERFLOW_DROP_OLDEST:
+                pa_ring_reclaim(ring, end - ring->capacity);
+                break;
+            case PAIRADMIN_OVERFLOW_BLOCK_WITH_TIMEOUT:
+                if (!pa_ring_wait(ring, end)) {
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+            }
+        }
+    }
+    ring->stalled = 0;
+
+    // cached_tail lags, so only a possible new high is worth a fresh tail
+    if (end - ring->cached_tail > ring->high_water) {
+        ring->cached_tail = pa_load_acquire_u64(&ring->ctl->tail);
+        if (end - ring->cached_tail > ring->high_water) {
+            ring->high_water = end - ring->cached_tail;
+            pa_stats_ring_fill(ring->high_water);
+        }
+    }
+
+    if (skip) {
+        if (skip >= sizeof(PairAdminEventHeader)) {
+            PairAdminEventHeader *pad = (PairAdminEventHeader *)(ring->data + offset);
+            pad->type = PA_RECORD_PAD;
+            pad->flags = 0;
+            pad->length = (uint32_t)(skip - sizeof(PairAdminEventHeader));
+        }
+        head += skip;
+    }
+    *pos = head;
+    return 0;
+}
+
+static void pa_ring_put(PaRing *ring, uint64_t pos, uint16_t type, uint16_t flags,
+                        const void *data, uint32_t len, uint64_t timestamp_us)
+{
+    PairAdminEventHeader *hdr = (PairAdminEventHeader *)(ring->data + (size_t)(pos & ring->mask));
+
+    hdr->type = type;
+    hdr->flags = flags;
+    hdr->length = len;
+    hdr->sequence = ring->sequence++;
+    hdr->timestamp_us = timestamp_us;
+    memcpy(hdr + 1, data, len);
+
+    pa_store_release_u64(&ring->ctl->head, pos + PAIRADMIN_RECORD_SIZE(len));
+}
+
+// Whether need more bytes fit at head without reclaiming anything
+static int pa_ring_fits(PaRing *ring, size_t need)
+{
+    uint64_t end = ring->ctl->head + need;
+
+    if (end - ring->cached_tail <= ring->capacity) {
+        return 1;
+    }
+    ring->cached_tail = pa_load_acquire_u64(&ring->ctl->tail);
+    return end - ring->cached_tail <= ring->capacity;
+}
+
+// Write what an earlier overflow left behind: the gap marker, then the
+// coalesced record. Returns non-zero if the ring is still too full.
+// Under DROP_OLDEST the marker waits until it and the next record of
+// `next` bytes fit without reclaiming: written at once it would cost a
+// reclaim, and so a marker, of its own, and a ring kept full would
+// carry one ahead of every record.
+static int pa_ring_flush_pending(PaRing *ring, size_t next)
+{
+    uint64_t pos;
+
+    if ((ring->gap_records || ring->gap_bytes) &&
+        (pa_ring_policy(ring) != PAIRADMIN_OVERFLOW_DROP_OLDEST ||
+         pa_ring_fits(ring, PAIRADMIN_RECORD_SIZE(sizeof(PairAdminGapInfo)) + next))) {
+        PairAdminGapInfo gap;
+
+        if (pa_ring_reserve(ring, PAIRADMIN_RECORD_SIZE(sizeof(gap)), &pos) != 0) {
+            return -1;
+        }
+        // Read after reserving: reclaiming may have added to the gap
+        gap.records = ring->gap_records;
+        gap.bytes = ring->gap_bytes;
+        ring->gap_records = 0;
+        ring->gap_bytes = 0;
+        pa_ring_put(ring, pos, PAIRADMIN_EVENT_GAP, 0, &gap, sizeof(gap), pa_now_us());
+    }
+
+    if (ring->coalesce_len) {
+        if (pa_ring_reserve(ring, PAIRADMIN_RECORD_SIZE(ring->coalesce_len), &pos) != 0) {
+            return -1;
+        }
+        pa_ring_put(ring, pos, ring->coalesce_type, 0, ring->coalesce,
+                    ring->coalesce_len, ring->coalesce_us);
+        ring->coalesce_len = 0;
+    }
+    return 0;
+}
+
+// COALESCE: merge the fragment into the pending record, which keeps the
+// most recent PAIRADMIN_MAX_PAYLOAD bytes of the most recent event type
+static void pa_ring_coalesce(PaRing *ring, uint16_t type, const void *data,
+                             uint32_t len, uint64_t timestamp_us)
+{
+    if (ring->coalesce_len && ring->coalesce_type != type) {
+        pa_ring_lose(ring, 1, ring->coalesce_len);
+        ring->coalesce_len = 0;
+    }
+    if (ring->coalesce_len == 0) {
+        ring->coalesce_type = type;
+        ring->coalesce_us = timestamp_us;
+    }
+    if (ring->coalesce_len + len > PAIRADMIN_MAX_PAYLOAD) {
+        uint32_t excess = ring->coalesce_len + len - PAIRADMIN_MAX_PAYLOAD;
+
+        memmove(ring->coalesce, ring->coalesce + excess, ring->coalesce_len - excess);
+        ring->coalesce_len -= excess;
+        pa_ring_lose(ring, 0, excess);
+    }
+    memcpy(ring->coalesce + ring->coalesce_len, data, len);
+    ring->coalesce_len += len;
+}
+
+// After publishing: note whether the consumer had caught up with start,
+// head before this write. A subscriber-only ring has no one to wake.
+PA_INLINE void pa_ring_check_idle(PaRing *ring, uint64_t start)
+{
+    if (ring->wake || pa_load_acquire_u32(&ring->reclaim)) {
+        return;
+    }
+    pa_fence_full();
+    if (pa_load_acquire_u64(&ring->ctl->tail) >= start) {
+        ring->wake = 1;
+    }
+}
+
+int pa_ring_write(PaRing *ring, uint16_t type, uint16_t flags, const void *data, uint32_t len)
+{
+    uint64_t now = pa_now_us();
+    uint64_t start = ring->ctl->head;
+    uint64_t pos;
+
+    if ((ring->gap_records || ring->gap_bytes || ring->coalesce_len) &&
+        pa_ring_flush_pending(ring, PAIRADMIN_RECORD_SIZE(len)) != 0) {
+        goto overflow;
+    }
+    if (pa_ring_reserve(ring, PAIRADMIN_RECORD_SIZE(len), &pos) != 0) {
+        goto overflow;
+    }
+    pa_ring_put(ring, pos, type, flags, data, len, now);
+    pa_ring_check_idle(ring, start);
+    return 0;
+
+overflow:
+    if (pa_ring_policy(ring) == PAIRADMIN_OVERFLOW_COALESCE) {
+        pa_ring_coalesce(ring, type, data, len, now);
+        return 0;
+    }
+    pa_ring_lose(ring, 1, len);
+    return -1;
+}
+
+void pa_ring_notify(PaRing *ring)
+{
+    if (ring->wake) {
+        ring->wake = 0;
+        pa_waker_signal(&ring->waker);
+    }
+}
+
+// ------------------------------------------------------------
+// Consumer side
+//
+// Every step past a record (or pad) is committed with a compare-and-
+// swap on tail. If it fails, DROP_OLDEST reclaimed the record while it
+// was being read: the copy is discarded and reading resumes at the new
+// tail, which the producer has already counted as lost.
+// ------------------------------------------------------------
+
+// Copies as many whole records as fit in buf
+size_t pa_ring_read(PaRing *ring, void *buf, size_t cap)
+{
+    unsigned char *out = (unsigned char *)buf;
+    uint64_t tail = pa_load_acquire_u64(&ring->ctl->tail);
+    size_t written = 0;
+
+    ring->cached_head = pa_load_acquire_u64(&ring->ctl->head);
+
+    while (tail != ring->cached_head) {
+        size_t offset = (size_t)(tail & ring->mask);
+        size_t contiguous = ring->capacity - offset;
+        const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(ring->data + offset);
+        size_t size;
+        int keep = 0;
+
+        if (contiguous < sizeof(PairAdminEventHeader) || hdr->type == PA_RECORD_PAD) {
+            size = contiguous;
+        } else {
+            size = PAIRADMIN_RECORD_SIZE(hdr->length);
+            if (size > contiguous) {
+                // Torn by a concurrent reclaim; the commit below fails
+                size = contiguous;
+            } else {
+                if (written + size > cap) {
+                    break;
+                }
+                memcpy(out + written, hdr, size);
+                keep = 1;
+            }
+        }
+
+        if (!pa_atomic_cas_u64(&ring->ctl->tail, tail, tail + size)) {
+            tail = pa_load_acquire_u64(&ring->ctl->tail);
+            ring->cached_head = pa_load_acquire_u64(&ring->ctl->head);
+            continue;
+        }
+        if (keep) {
+            written += size;
+        }
+        tail += size;
+    }
+    return written;
+}
+
+// In place. Used by native consumers such as the batcher so each payload
+// is copied only once, into the consumer's own buffer. fn sees the
+// record before it is committed; discard undoes it if the commit fails.
+size_t pa_ring_drain(PaRing *ring, PaRecordFn fn, PaDiscardFn discard, void *ctx, size_t max_records)
+{
+    uint64_t tail = pa_load_acquire_u64(&ring->ctl->tail);
+    size_t handled = 0;
+
+    ring->cached_head = pa_load_acquire_u64(&ring->ctl->head);
+
+    while (tail != ring->cached_head && handled < max_records) {
+        size_t offset = (size_t)(tail & ring->mask);
+        size_t contiguous = ring->capacity - offset;
+        PairAdminEventHeader hdr;
+        size_t size;
+        int seen = 0;
+
+        if (contiguous < sizeof(PairAdminEventHeader)) {
+            size = contiguous;
+        } else {
+            // fn gets a private copy of the header, so a concurrent
+            // reclaim cannot change the length it was checked against
+            memcpy(&hdr, ring->data + offset, sizeof(hdr));
+            size = hdr.type == PA_RECORD_PAD ? contiguous : PAIRADMIN_RECORD_SIZE(hdr.length);
+            if (size > contiguous) {
+                // Torn by a concurrent reclaim; the commit below fails
+                size = contiguous;
+            } else if (hdr.type != PA_RECORD_PAD) {
+                fn(&hdr, ring->data + offset + sizeof(hdr), ctx);
+                seen = 1;
+            }
+        }
+
+        if (!pa_atomic_cas_u64(&ring->ctl->tail, tail, tail + size)) {
+            if (seen) {
+                discard(ctx);
+            }
+            tail = pa_load_acquire_u64(&ring->ctl->tail);
+            ring->cached_head = pa_load_acquire_u64(&ring->ctl->head);
+            continue;
+        }
+        handled += seen;
+        tail += size;
+    }
+    return handled;
+}
+
+// The fence pairs with the producer's in pa_ring_check_idle(): either
+// this sees the new head, or the producer sees tail and signals
+PA_INLINE int pa_ring_pending(PaRing *ring)
+{
+    pa_fence_full();
+    return pa_load_acquire_u64(&ring->ctl->head) != pa_load_acquire_u64(&ring->ctl->tail);
+}
+
+int pa_ring_await(PaRing *ring, uint64_t timeout_us)
+{
+    if (pa_ring_pending(ring)) {
+        return 1;
+    }
+    pa_waker_wait(&ring->waker, timeout_us);
+    return pa_ring_pending(ring);
+}
+
+void pa_ring_wake(PaRing *ring)
+{
+    pa_waker_signal(&ring->waker);
+}
+
+// A copied record is trustworthy if tail had not passed it (the
+// producer only reuses space behind tail), or if head is still far
+// enough away that even a pad plus a maximum record cannot reach it.
+PA_INLINE int pa_ring_intact(PaRing *ring, uint64_t pos)
+{
+    pa_fence_acquire();
+    if (pa_load_acquire_u64(&ring->ctl->tail) <= pos) {
+        return 1;
+    }
+    return pa_load_acquire_u64(&ring->ctl->head) + 2 * PAIRADMIN_READ_BUFFER_MIN
+           <= pos + ring->capacity;
+}
+
+// Subscriber side. Reads like pa_ring_read() but from a private cursor
+// and without releasing anything, so any number of subscribers can walk
+// the ring independently. Because the producer may overwrite a record
+// while it is being copied, each copy is validated afterwards (seqlock
+// style); a record that fails is discarded and the cursor jumps to tail,
+// the oldest record still present.
+size_t pa_ring_peek(PaRing *ring, uint64_t *cursor, uint32_t mask,
+                    void *buf, size_t cap, uint64_t *lost)
+{
+    unsigned char *out = (unsigned char *)buf;
+    uint64_t pos = *cursor;
+    uint64_t head = pa_load_acquire_u64(&ring->ctl->head);
+    size_t written = 0;
+
+    while (pos != head) {
+        size_t offset = (size_t)(pos & ring->mask);
+        size_t contiguous = ring->capacity - offset;
+        PairAdminEventHeader hdr;
+        size_t size;
+        int wanted;
+        int fits;
+
+        if (contiguous < sizeof(PairAdminEventHeader)) {
+            pos += contiguous;
+            continue;
+        }
+
+        memcpy(&hdr, ring->data + offset, sizeof(hdr));
+        if (hdr.type == PA_RECORD_PAD) {
+            size = contiguous;
+            wanted = 0;
+        } else {
+            size = PAIRADMIN_RECORD_SIZE(hdr.length);
+            wanted = hdr.type < 32 && ((mask >> hdr.type) & 1) != 0;
+        }
+        fits = written + size <= cap;
+
+        if (wanted && fits && size <= contiguous) {
+            memcpy(out + written, ring->data + offset, size);
+        }
+        if (!pa_ring_intact(ring, pos)) {
+            uint64_t tail = pa_load_acquire_u64(&ring->ctl->tail);
+
+            // tail never passes head, so reload it after the jump
+            *lost += tail - pos;
+            pos = tail;
+            head = pa_load_acquire_u64(&ring->ctl->head);
+            continue;
+        }
+        if (size > contiguous) {
+            // Cannot happen for a record the producer finished; stay in step
+            pos += contiguous;
+            continue;
+        }
+        if (wanted) {
+            if (!fits) {
+                break;
+            }
+            written += size;
+        }
+        pos += size;
+    }
+
+    *cursor = pos;
+    return written;
+}
+
+PaRing *pa_current_ring(void)
+{
+    return (PaRing *)pa_load_acquire_ptr((void *const volatile *)&pairadmin_ring);
+}
+
+int pairadmin_ring_open(size_t capacity)
+{
+    PaRing *ring;
+    int result = 0;
+
+    pa_trace_register();
+    pa_control_lock();
+    if (!pairadmin_ring) {
+        ring = pa_ring_create(capacity ? capacity : PAIRADMIN_RING_DEFAULT_SIZE);
+        if (ring) {
+            pa_store_release_ptr((void *volatile *)&pairadmin_ring, ring);
+        } else {
+            result = -1;
+        }
+    } else if (pairadmin_ring->reclaim) {
+        // Opened for subscribers: the caller becomes its consumer. Once no
+        // hook can still be reclaiming, tail belongs to the caller.
+        pa_store_release_u32(&pairadmin_ring->reclaim, 0);
+        pa_epoch_synchronize();
+    }
+    pa_control_unlock();
+    return result;
+}
+
+int pa_ring_open_reclaiming(void)
+{
+    PaRing *ring;
+    int result = 0;
+
+    pa_control_lock();
+    if (!pairadmin_ring) {
+        ring = pa_ring_create(PAIRADMIN_RING_DEFAULT_SIZE);
+        if (ring) {
+            ring->reclaim = 1;
+            pa_store_release_ptr((void *volatile *)&pairadmin_ring, ring);
+            result = 1;
+        } else {
+            result = -1;
+        }
+    }
+    pa_control_unlock();
+    return result;
+}
+
+void pairadmin_ring_close(void)
+{
+    PaRing *ring;
+
+    pa_batch_stop();
+
+    pa_control_lock();
+    ring = (PaRing *)pa_atomic_xchg_ptr((void *volatile *)&pairadmin_ring, NULL);
+    pa_epoch_synchronize();
+    pa_control_unlock();
+
+    pa_ring_destroy(ring);
+}
+
+int pairadmin_map_event_region(size_t bytes, void **base)
+{
+    PaRing *ring;
+    int result = -1;
+
+    pa_trace_register();
+    pa_control_lock();
+    if (!pairadmin_ring) {
+        ring = pa_region_create(bytes ? bytes : PAIRADMIN_RING_DEFAULT_SIZE);
+        if (ring) {
+            if (base) {
+                *base = ring->ctl;
+            }
+            pa_store_release_ptr((void *volatile *)&pairadmin_ring, ring);
+            result = 0;
+        }
+    }
+    pa_control_unlock();
+    return result;
+}
+
+void pairadmin_unmap_event_region(void)
+{
+    pairadmin_ring_close();
+}
+
+const char *pairadmin_get_event_region_name(void)
+{
+    PaRing *ring = pa_current_ring();
+
+    return ring && ring->shared ? ring->name : NULL;
+}
+
+size_t pairadmin_read_events(void *buf, size_t cap)
+{
+    PaRing *ring = pa_current_ring();
+
+    if (!ring || !buf) {
+        return 0;
+    }
+    return pa_ring_read(ring, buf, cap);
+}
+
+intptr_t pairadmin_get_event_handle(void)
+{
+    PaRing *ring = pa_current_ring();
+
+    return ring ? pa_waker_handle(&ring->waker) : -1;
+}
+
+int pairadmin_wait_events(uint32_t timeout_ms)
+{
+    PaRing *ring = pa_current_ring();
+
+    if (!ring) {
+        return -1;
+    }
+    return pa_ring_await(ring, timeout_ms == PAIRADMIN_WAIT_INFINITE ?
+                         PA_WAIT_FOREVER : (uint64_t)timeout_ms * 1000u);
+}
+
+void pairadmin_wake_events(void)
+{
+    PaRing *ring = pa_current_ring();
+
+    if (ring) {
+        pa_ring_wake(ring);
+    }
+}
+
+uint64_t pairadmin_get_dropped_events(void)
+{
+    PaRing *ring = pa_current_ring();
+
+    return ring ? ring->dropped_records : 0;
+}
+
+uint64_t pairadmin_get_dropped_bytes(void)
+{
+    PaRing *ring = pa_current_ring();
+
+    return ring ? ring->dropped_bytes : 0;
+}
+
+int pairadmin_set_overflow_policy(PairAdminOverflowPolicy policy, uint32_t timeout_us)
+{
+    if ((uint32_t)policy > PAIRADMIN_OVERFLOW_BLOCK_WITH_TIMEOUT) {
+        return -1;
+    }
+    pa_store_release_u32(&pairadmin_overflow_timeout_us,
+                         timeout_us ? timeout_us : PAIRADMIN_OVERFLOW_DEFAULT_TIMEOUT_US);
+    pa_store_release_u32(&pairadmin_overflow_policy, (uint32_t)policy);
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Hooks
+// ------------------------------------------------------------
+
+void pairadmin_set_vt_filter(PairAdminVtMode mode)
+{
+    pa_store_release_u32(&pairadmin_vt_mode, (uint32_t)mode);
+}
+
+PA_INLINE int pa_is_text_event(PairAdminEventType event)
+{
+    return event == PAIRADMIN_EVENT_OUTPUT || event == PAIRADMIN_EVENT_OUTPUT_TEXT ||
+           event == PAIRADMIN_EVENT_INPUT;
+}
+
+// Bytes of p[0..len) that go into one record: all of them if they fit,
+// else as many as fit without splitting a character of a text event
+static size_t pa_record_chunk(PairAdminEventType event, const unsigned char *p, size_t len)
+{
+    size_t chunk;
+
+    if (len <= PAIRADMIN_MAX_PAYLOAD) {
+        return len;
+    }
+    chunk = pa_is_text_event(event) ? pa_utf8_boundary(p, PAIRADMIN_MAX_PAYLOAD) : 0;
+    return chunk ? chunk : PAIRADMIN_MAX_PAYLOAD;
+}
+
+static void pairadmin_emit(PaRing *ring, PairAdminEventType event, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+
+    if (pa_load_acquire_u32(&pa_recording)) {
+        pa_record_event(event, data, len);
+    }
+
+    // A ring opened only for subscribers has no primary consumer, so the
+    // direct callback keeps running alongside it
+    if (!ring || pa_load_acquire_u32(&ring->reclaim)) {
+        PairAdminCallback callback = (PairAdminCallback)
+            pa_load_acquire_ptr((void *const volatile *)&pairadmin_callback);
+        if (callback) {
+            uint64_t start = pa_span_begin(PA_STATS_CALLBACK, len);
+
+            callback(event, data, len);
+            pa_span_end(PA_STATS_CALLBACK, len, start);
+        }
+        if (!ring) {
+            return;
+        }
+    }
+
+    while (len > 0) {
+        uint32_t chunk = (uint32_t)pa_record_chunk(event, p, len);
+        uint16_t flags = pa_is_text_event(event) ? (uint16_t)pa_utf8_flags(p, chunk) : 0;
+
+        pa_ring_write(ring, (uint16_t)event, flags, p, chunk);
+        p += chunk;
+        len -= chunk;
+    }
+    pa_ring_notify(ring);
+}
+
+static void pairadmin_emit_text(PaRing *ring, PaVtFilter *vt, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+
+    while (len > 0) {
+        size_t chunk = pa_record_chunk(PAIRADMIN_EVENT_OUTPUT, p, len);
+        size_t stripped = pa_vt_strip(&vt->parser, p, chunk, vt->scratch);
+
+        if (stripped > 0) {
+            pairadmin_emit(ring, PAIRADMIN_EVENT_OUTPUT_TEXT, vt->scratch, stripped);
+        }
+        p += chunk;
+        len -= chunk;
+    }
+}
+
+static void pairadmin_route_output(PaRing *ring, PaVtFilter *vt, const void *data, size_t len)
+{
+    uint32_t vt_mode = pa_load_acquire_u32(&pairadmin_vt_mode);
+
+    if (vt_mode != vt->active) {
+        pa_vt_reset(&vt->parser);
+        vt->active = vt_mode;
+    }
+    if (vt_mode != PAIRADMIN_VT_OFF) {
+        if (vt_mode == PAIRADMIN_VT_ALONGSIDE) {
+            pairadmin_emit(ring, PAIRADMIN_EVENT_OUTPUT, data, len);
+        }
+        pairadmin_emit_text(ring, vt, data, len);
+        return;
+    }
+    pairadmin_emit(ring, PAIRADMIN_EVENT_OUTPUT, data, len);
+}
+
+// OUTPUT up to its last complete UTF-8 sequence; the partial one is
+// held in vt->joined and completed by the head of the next fragment
+static void pairadmin_route_utf8(PaRing *ring, PaVtFilter *vt, const unsigned char *p, size_t len)
+{
+    size_t keep;
+
+    if (vt->held) {
+        size_t room = sizeof(vt->joined) - vt->held;
+        size_t take = len < room ? len : room;
+        size_t n = vt->held + take;
+
+        memcpy(vt->joined + vt->held, p, take);
+        keep = pa_utf8_boundary(vt->joined, n);
+        if (keep < vt->held) {
+            // Still incomplete, so all of this fragment was taken
+            vt->held = n;
+            return;
+        }
+        pairadmin_route_output(ring, vt, vt->joined, keep);
+        // The partial sequence keep found, if any, is still in p
+        p += keep - vt->held;
+        len -= keep - vt->held;
+        vt->held = 0;
+    }
+
+    keep = pa_utf8_boundary(p, len);
+    if (keep > 0) {
+        pairadmin_route_output(ring, vt, p, keep);
+    }
+    memcpy(vt->joined, p + keep, len - keep);
+    vt->held = len - keep;
+}
+
+static void pairadmin_route(PaRing *ring, PaVtFilter *vt, PairAdminEventType event,
+                            const void *data, size_t len)
+{
+    if (event == PAIRADMIN_EVENT_OUTPUT) {
+        pairadmin_route_utf8(ring, vt, (const unsigned char *)data, len);
+        return;
+    }
+
+    // Whatever a session ends with goes out before it is reported
+    if (vt->held && (event == PAIRADMIN_EVENT_CONNECTED || event == PAIRADMIN_EVENT_DISCONNECTED ||
+                     event == PAIRADMIN_EVENT_ERROR)) {
+        size_t held = vt->held;
+
+        vt->held = 0;
+        pairadmin_route_output(ring, vt, vt->joined, held);
+    }
+    pairadmin_emit(ring, event, data, len);
+}
+
+void pa_dispatch(PairAdminEventType event, const void *data, size_t len)
+{
+    uint32_t slot;
+
+    if (!data || len == 0) {
+        return;
+    }
+
+    slot = pa_epoch_enter();
+    pairadmin_route(pa_current_ring(), &pairadmin_vt, event, data, len);
+    pa_epoch_exit(slot);
+}
+
+void pa_dispatch_raw(PairAdminEventType event, const void *data, size_t len)
+{
+    uint32_t slot;
+
+    if (!data || len == 0) {
+        return;
+    }
+
+    slot = pa_epoch_enter();
+    pairadmin_emit(pa_current_ring(), event, data, len);
+    pa_epoch_exit(slot);
+}
+
+void pa_dispatch_ring(PaRing *ring, PaVtFilter *vt, PairAdminEventType event,
+                      const void *data, size_t len)
+{
+    if (!data || len == 0) {
+        return;
+    }
+    pairadmin_route(ring, vt, event, data, len);
+}
+
+void pairadmin_hook_output(const void *data, size_t len)
+{
+    uint64_t start = pa_span_begin(PA_STATS_OUTPUT, len);
+
+    pa_session_route(PAIRADMIN_EVENT_OUTPUT, data, len);
+    pa_span_end(PA_STATS_OUTPUT, len, start);
+}
+
+void pairadmin_hook_input(const void *data, size_t len)
+{
+    uint64_t start = pa_span_begin(PA_STATS_INPUT, len);
+
+    pa_session_route(PAIRADMIN_EVENT_INPUT, data, len);
+    pa_span_end(PA_STATS_INPUT, len, start);
+}
+
+size_t pairadmin_hook_input_checked(const void *data, size_t len)
+{
+    uint64_t start = pa_span_begin(PA_STATS_INPUT, len);
+    size_t accepted = pa_session_route_checked(data, len);
+
+    pa_span_end(PA_STATS_INPUT, len, start);
+    return accepted;
+}
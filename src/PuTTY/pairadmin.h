@@ -2,6 +2,7 @@
 #define PAIRADMIN_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -10,26 +11,1249 @@ extern "C" {
 #endif
 #endif
 
-// PairAdmin event types
+// Marks the functions PairAdminPuTTY.dll exports. MSVC takes the list
+// from pairadmin.def; elsewhere everything else is built hidden.
+#if !defined(_WIN32) && defined(__GNUC__)
+#define PAIRADMIN_API __attribute__((visibility("default")))
+#else
+#define PAIRADMIN_API
+#endif
+
+// PairAdmin event types, matching PuTTYInterop.PairAdminEventType
 typedef enum {
     PAIRADMIN_EVENT_OUTPUT = 1,  // Terminal output from SSH
-    PAIRADMIN_EVENT_INPUT = 2     // User input to terminal
+    PAIRADMIN_EVENT_INPUT = 2,    // User input to terminal
+    PAIRADMIN_EVENT_CONNECTED = 3,     // Session is up ("host:port")
+    PAIRADMIN_EVENT_DISCONNECTED = 4,  // Session ended (reason text)
+    PAIRADMIN_EVENT_ERROR = 5,         // Connect or session failure (message)
+    PAIRADMIN_EVENT_OUTPUT_TEXT = 6,  // Terminal output with escape sequences removed
+    PAIRADMIN_EVENT_GAP = 7,          // Records were lost here (PairAdminGapInfo)
+    PAIRADMIN_EVENT_COMMAND = 8,      // A line was entered (PairAdminCommandInfo + text)
+    PAIRADMIN_EVENT_PROMPT = 9,          // A prompt starts (PairAdminMarkInfo)
+    PAIRADMIN_EVENT_COMMAND_START = 10,  // A command's output starts (PairAdminMarkInfo)
+    PAIRADMIN_EVENT_COMMAND_END = 11,    // The command finished (PairAdminMarkInfo)
+    PAIRADMIN_EVENT_DIRECTORY = 12,      // The shell reported its directory
+                                         // (PairAdminMarkInfo + path)
+    PAIRADMIN_EVENT_WINDOW = 13          // The terminal window was created, replaced
+                                         // or destroyed (PairAdminWindowInfo)
 } PairAdminEventType;
 
+// One past the highest PairAdminEventType
+#define PAIRADMIN_EVENT_TYPE_COUNT 14
+
 // Callback function type
 typedef void (*PairAdminCallback)(PairAdminEventType event, const void *data, size_t len);
 
-// Global callback pointer - to be set by PairAdmin
+// Global callback pointer - to be set by PairAdmin through
+// pairadmin_set_callback(); read only by the hooks
 extern PairAdminCallback pairadmin_callback;
 
-// Function to register callback
-extern void pairadmin_set_callback(PairAdminCallback callback);
+// Function to register callback. Safe to call at any time from any
+// thread except from inside the callback itself. When it returns, the
+// previous callback is not running and will not be invoked again, so
+// its owner may release it (e.g. a managed delegate).
+extern PAIRADMIN_API void pairadmin_set_callback(PairAdminCallback callback);
 
-// Function to get terminal window handle (Windows only)
-#ifdef _WIN32
-typedef void* HWND;
-extern HWND putty_get_terminal_hwnd(void);
-#endif
+// ------------------------------------------------------------
+// Hook entry points
+//
+// Called from the PuTTY modifications (terminal.c, ldisc.c).
+// With the event ring open these only copy into the ring and
+// return; otherwise they invoke pairadmin_callback directly.
+// ------------------------------------------------------------
+
+extern PAIRADMIN_API void pairadmin_hook_output(const void *data, size_t len);
+extern PAIRADMIN_API void pairadmin_hook_input(const void *data, size_t len);
+
+// ldisc variant of pairadmin_hook_input() that can hold a denied command
+// back: returns how many bytes of data ldisc may send. Under
+// PAIRADMIN_DENY_BLOCK the Enter that would submit a denied line, and
+// everything after it, is withheld, leaving the line in the shell for
+// the user to edit. Otherwise returns len.
+extern PAIRADMIN_API size_t pairadmin_hook_input_checked(const void *data, size_t len);
+
+// ------------------------------------------------------------
+// Escape sequence filter
+//
+// Optional streaming VT parser run on terminal output in the hook.
+// It removes CSI/OSC/DCS and other escape sequences plus C0 controls
+// other than TAB and LF, keeping its state across fragments, and
+// emits the result as PAIRADMIN_EVENT_OUTPUT_TEXT.
+// ------------------------------------------------------------
+
+typedef enum {
+    PAIRADMIN_VT_OFF = 0,        // Raw OUTPUT only (default)
+    PAIRADMIN_VT_ALONGSIDE = 1,  // Raw OUTPUT followed by OUTPUT_TEXT
+    PAIRADMIN_VT_REPLACE = 2     // OUTPUT_TEXT instead of raw OUTPUT
+} PairAdminVtMode;
+
+// Select the filter mode; takes effect with the next output fragment
+extern PAIRADMIN_API void pairadmin_set_vt_filter(PairAdminVtMode mode);
+
+// ------------------------------------------------------------
+// UTF-8 boundaries
+//
+// A multi-byte character split between two term_data() calls is never
+// split between two events: OUTPUT is passed on up to its last complete
+// sequence and the partial one (at most 3 bytes) goes out with the next
+// fragment, or with the next session state event. Payloads too large
+// for one record are cut between characters too. Ring records of OUTPUT,
+// OUTPUT_TEXT and INPUT carry PAIRADMIN_TEXT_* in their header flags,
+// and pairadmin_scan_chunk() reports the same for any buffer, so a
+// consumer can take an ASCII fast path or skip validation.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_TEXT_ASCII 0x1    // Every byte is below 0x80
+#define PAIRADMIN_TEXT_UTF8 0x2     // Well-formed UTF-8 (also set for ASCII)
+
+// ------------------------------------------------------------
+// Redaction
+//
+// Optional masking of secrets in OUTPUT and INPUT inside the hook,
+// before the bytes reach the ring, any callback or the capture store.
+// A single automaton matches every rule's keyword in one pass; the
+// secret that follows is replaced byte for byte with '*' (line breaks
+// are kept), including secrets split across fragments. Keywords stay
+// visible. While a possible token is still too short to tell, up to
+// 39 bytes of it are held back until the next fragment decides; if the
+// session connects, disconnects or fails first, they go out as they
+// were ahead of that event.
+// ------------------------------------------------------------
+
+typedef enum {
+    PAIRADMIN_REDACT_OFF = 0,
+    PAIRADMIN_REDACT_PRIVATE_KEYS = 0x1,  // PEM/OpenSSH/PGP private key bodies
+    PAIRADMIN_REDACT_TOKENS = 0x2,        // AWS, GitHub, Google, OpenAI, Stripe,
+                                          // Slack keys, JWTs, Bearer tokens
+    PAIRADMIN_REDACT_PASSWORDS = 0x4,     // password=..., secret: ..., and input
+                                          // typed at a password prompt
+    PAIRADMIN_REDACT_ALL = 0x7
+} PairAdminRedactRules;
+
+// Select the rule groups (PAIRADMIN_REDACT_* ORed together, or OFF);
+// takes effect with the next fragment. Returns -1 for unknown bits.
+extern PAIRADMIN_API int pairadmin_set_redaction(uint32_t rules);
+extern PAIRADMIN_API uint32_t pairadmin_get_redaction(void);
+
+// ------------------------------------------------------------
+// Command lines
+//
+// The input hook follows the line being typed (text, paste, backspace,
+// Ctrl-U, Ctrl-W) and, when Enter submits it, emits it whole as one
+// PAIRADMIN_EVENT_COMMAND after the INPUT that carried the Enter: a
+// PairAdminCommandInfo followed by the line, redacted like INPUT. Input
+// answering a password prompt (see Redaction) is not reported. Each
+// line is checked at Enter against a native denylist of command names.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_COMMAND_MAX 4096
+
+#define PAIRADMIN_COMMAND_PASTED 0x001      // Some of it was pasted
+#define PAIRADMIN_COMMAND_INEXACT 0x002     // Edited with keys only the shell
+                                            // interprets (history, Tab, arrows)
+#define PAIRADMIN_COMMAND_TRUNCATED 0x004   // Longer than PAIRADMIN_COMMAND_MAX
+#define PAIRADMIN_COMMAND_CHAINED 0x008     // ; & | ` or $( run further commands
+#define PAIRADMIN_COMMAND_EXPANSION 0x010   // $VAR or ${...}
+#define PAIRADMIN_COMMAND_TRAVERSAL 0x020   // ../
+#define PAIRADMIN_COMMAND_ENCODED 0x040     // \xNN, %NN or 0xNN
+#define PAIRADMIN_COMMAND_DENIED 0x100      // A command name is on the denylist
+#define PAIRADMIN_COMMAND_BLOCKED 0x200     // Enter was withheld from the server
+
+// Payload header of a PAIRADMIN_EVENT_COMMAND record
+typedef struct PairAdminCommandInfo {
+    uint32_t flags;             // PAIRADMIN_COMMAND_*
+    uint32_t denied;            // 1-based denylist entry matched, 0 if none
+    uint32_t length;            // Bytes of command text following
+    uint32_t reserved;
+} PairAdminCommandInfo;
+
+typedef enum {
+    PAIRADMIN_DENY_OFF = 0,      // No denylist (default)
+    PAIRADMIN_DENY_REPORT = 1,   // Flag denied lines as PAIRADMIN_COMMAND_DENIED
+    PAIRADMIN_DENY_BLOCK = 2     // Also withhold their Enter in
+                                 // pairadmin_hook_input_checked()
+} PairAdminDenyMode;
+
+// Replace the denylist with count command names, matched ignoring case
+// against the command of every simple command in a line; sudo, env, a
+// directory path and VAR=value prefixes are looked through, and quotes
+// and backslashes anywhere in the name are resolved as the shell would
+// (\rm, r''m, "r"m and $'rm' all match rm). A name the shell only
+// builds when it runs the line, from $VAR or a substitution, is not
+// matched; such lines carry PAIRADMIN_COMMAND_EXPANSION or _CHAINED.
+// Not callable from a hook or callback. Returns 0, or -1 on bad arguments.
+extern PAIRADMIN_API int pairadmin_set_command_denylist(const char *const *names, uint32_t count,
+                                                        PairAdminDenyMode mode);
+
+// ------------------------------------------------------------
+// Shell marks
+//
+// The output hook recognises shell integration sequences as they pass:
+// OSC 133 (and VS Code's OSC 633) A, C and D;<status> become PROMPT,
+// COMMAND_START and COMMAND_END, and OSC 7 file:// URLs (or 633;P;Cwd=
+// and iTerm2's 1337;CurrentDir=) become DIRECTORY, each time the shell
+// sends one; a report of the directory already reported is flagged
+// PAIRADMIN_MARK_UNCHANGED. For shells without integration a prompt fingerprint, such
+// as "$ ", stands in: output that ends with it when the hook returns is
+// taken as a prompt, and the next command line submitted starts a
+// command. A session that has sent OSC 133 is not fingerprinted.
+//
+// Each mark follows the OUTPUT that contained its sequence and carries
+// a byte offset into the session's output as it arrived from the
+// server, before redaction or filtering. The output of one command is
+// [command_offset, offset) of its COMMAND_END.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_MARKS_OFF 0
+#define PAIRADMIN_MARKS_SHELL 0x1          // OSC 133/633/7 sequences
+#define PAIRADMIN_MARKS_FINGERPRINT 0x2    // The prompt fingerprint
+
+// Longest prompt fingerprint
+#define PAIRADMIN_FINGERPRINT_MAX 32
+
+// exit_code when the shell did not report one
+#define PAIRADMIN_EXIT_UNKNOWN INT32_MIN
+
+// PairAdminMarkInfo flags: DIRECTORY repeats the last one reported
+#define PAIRADMIN_MARK_UNCHANGED 0x1
+
+// Payload header of PROMPT, COMMAND_START, COMMAND_END and DIRECTORY
+typedef struct PairAdminMarkInfo {
+    uint64_t offset;            // Output bytes before the mark
+    uint64_t command_offset;    // COMMAND_END: where the command started
+    int32_t exit_code;          // COMMAND_END: status, or PAIRADMIN_EXIT_UNKNOWN
+    uint16_t source;            // PAIRADMIN_MARKS_SHELL or _FINGERPRINT
+    uint16_t flags;             // PAIRADMIN_MARK_*
+    uint32_t length;            // DIRECTORY: bytes of path following
+    uint32_t reserved2;
+} PairAdminMarkInfo;
+
+// Select the sources (PAIRADMIN_MARKS_* ORed together, or OFF) and the
+// fingerprint, which later output to each session is matched against
+// (NULL or "" for none). Not callable from a hook or callback.
+// Returns 0, or -1 for unknown bits or a fingerprint that is too long.
+extern PAIRADMIN_API int pairadmin_set_shell_marks(uint32_t sources, const char *fingerprint);
+
+// ------------------------------------------------------------
+// Event ring
+//
+// Fixed-size lock-free single-producer/single-consumer queue.
+// PuTTY's thread is the producer; exactly one consumer thread
+// drains it with pairadmin_read_events().
+// ------------------------------------------------------------
+
+// Default ring capacity (bytes)
+#define PAIRADMIN_RING_DEFAULT_SIZE (1u << 20)
+
+// Larger hook payloads are split into several records
+#define PAIRADMIN_MAX_PAYLOAD 16384
+
+// Record header as returned by pairadmin_read_events()
+typedef struct PairAdminEventHeader {
+    uint16_t type;          // PairAdminEventType
+    uint16_t flags;         // PAIRADMIN_TEXT_* for text events, otherwise 0
+    uint32_t length;        // Payload bytes following the header
+    uint64_t sequence;      // Per-ring record number, starts at 0
+    uint64_t timestamp_us;  // Monotonic capture time in microseconds
+} PairAdminEventHeader;
+
+// Total size of a record with the given payload length; records
+// are packed back to back at this stride
+#define PAIRADMIN_RECORD_SIZE(len) \
+    ((sizeof(PairAdminEventHeader) + (size_t)(len) + 7) & ~(size_t)7)
+
+// Smallest buffer guaranteed to hold any single record
+#define PAIRADMIN_READ_BUFFER_MIN PAIRADMIN_RECORD_SIZE(PAIRADMIN_MAX_PAYLOAD)
+
+// Control block at the start of the ring's storage. For a shared
+// region this is what an out-of-process consumer maps and reads.
+// Explicit padding keeps head and tail on separate cache lines.
+#define PAIRADMIN_REGION_MAGIC 0x52454150u  // "PAER"
+#define PAIRADMIN_REGION_VERSION 1
+
+typedef struct PairAdminRegionHeader {
+    uint32_t magic;           // PAIRADMIN_REGION_MAGIC
+    uint32_t version;         // PAIRADMIN_REGION_VERSION
+    uint64_t capacity;        // Data area size in bytes (power of two)
+    uint64_t data_offset;     // Data area offset from the region base
+    uint64_t reserved0[5];
+    volatile uint64_t head;   // Bytes ever written (producer)
+    uint64_t reserved1[7];
+    volatile uint64_t tail;   // Bytes ever consumed (consumer)
+    uint64_t reserved2[7];
+} PairAdminRegionHeader;
+
+// Open the event ring and switch the hooks to queued delivery.
+// Capacity is rounded up to a power of two (0 = default). If a ring
+// opened for subscribers exists already, the caller becomes its
+// consumer instead and capacity is ignored.
+// Safe to call while the hooks are running.
+// Returns 0 on success, non-zero on failure.
+extern PAIRADMIN_API int pairadmin_ring_open(size_t capacity);
+
+// Close the ring and return to direct callback delivery. Safe while
+// the hooks are running: returns once none of them can still be
+// writing to the ring. The consumer must have stopped reading first.
+extern PAIRADMIN_API void pairadmin_ring_close(void);
+
+// Copy whole records from the ring into buf (consumer thread only).
+// Returns the number of bytes written, 0 if the ring is empty,
+// closed, or cap is smaller than the next record.
+extern PAIRADMIN_API size_t pairadmin_read_events(void *buf, size_t cap);
+
+// Records discarded because the ring was full
+extern PAIRADMIN_API uint64_t pairadmin_get_dropped_events(void);
+
+// Payload bytes discarded because the ring was full
+extern PAIRADMIN_API uint64_t pairadmin_get_dropped_bytes(void);
+
+// Instead of polling pairadmin_read_events(), the consumer can read
+// until the ring is empty and then sleep on its wake event. The event
+// is signalled when a hook call puts records into an empty ring, once
+// per call however many records it writes, and when a write finds the
+// ring full. Records arriving while earlier ones are still queued
+// signal nothing, so an idle terminal costs its consumer no wakeups.
+#define PAIRADMIN_WAIT_INFINITE 0xffffffffu
+
+// A shared region's event is named after it with this suffix
+#define PAIRADMIN_EVENT_WAKE_SUFFIX ".Wake"
+
+// Block until the ring holds records, for up to timeout_ms
+// (PAIRADMIN_WAIT_INFINITE = no limit). Consumer thread only.
+// Returns 1 if records are queued; 0 on timeout or after
+// pairadmin_wake_events(); -1 if no ring is open.
+extern PAIRADMIN_API int pairadmin_wait_events(uint32_t timeout_ms);
+
+// Make a pairadmin_wait_events() return early, e.g. to stop its thread
+extern PAIRADMIN_API void pairadmin_wake_events(void);
+
+// The wake event, for a consumer that waits on other things as well:
+// an auto-reset event HANDLE on Windows, elsewhere a descriptor that
+// polls readable until pairadmin_wait_events(0) finds the ring empty.
+// -1 if no ring is open. Owned by the ring; do not close it.
+extern PAIRADMIN_API intptr_t pairadmin_get_event_handle(void);
+
+// ------------------------------------------------------------
+// Overflow policy
+//
+// What the hooks do when the ring is full. Whatever is lost is
+// reported by a PAIRADMIN_EVENT_GAP record placed ahead of the next
+// data that fits, so consumers can see where the stream has holes.
+// Under DROP_OLDEST the lost records predate everything still queued,
+// so the marker arrives after the hole; the jump in `sequence` shows
+// exactly where it is. While the ring stays full one marker collects
+// every loss, and is written once the consumer has made room again.
+// ------------------------------------------------------------
+
+typedef enum {
+    PAIRADMIN_OVERFLOW_DROP_NEWEST = 0,        // Discard the new record (default)
+    PAIRADMIN_OVERFLOW_DROP_OLDEST = 1,        // Discard the oldest records to make room
+    PAIRADMIN_OVERFLOW_COALESCE = 2,           // Merge into one pending record that keeps
+                                               // the latest PAIRADMIN_MAX_PAYLOAD bytes
+    PAIRADMIN_OVERFLOW_BLOCK_WITH_TIMEOUT = 3  // Wait up to timeout_us, then drop
+} PairAdminOverflowPolicy;
+
+#define PAIRADMIN_OVERFLOW_DEFAULT_TIMEOUT_US 10000
+
+// Payload of a PAIRADMIN_EVENT_GAP record
+typedef struct PairAdminGapInfo {
+    uint64_t records;   // Whole records lost since the previous marker
+    uint64_t bytes;     // Payload bytes lost, including partial ones
+} PairAdminGapInfo;
+
+// Select the policy; takes effect with the next write. timeout_us is
+// only used by BLOCK_WITH_TIMEOUT (0 = default). Once a wait has timed
+// out, further writes drop immediately until the ring has room again,
+// so a stalled consumer cannot freeze the terminal.
+// Returns 0 on success, non-zero for an unknown policy.
+extern PAIRADMIN_API int pairadmin_set_overflow_policy(PairAdminOverflowPolicy policy, uint32_t timeout_us);
+
+// ------------------------------------------------------------
+// Shared-memory event region
+//
+// Like pairadmin_ring_open(), but the ring lives in a named
+// shared-memory mapping so a consumer can read records in place
+// instead of copying them out with pairadmin_read_events():
+//
+//   head = acquire-load(hdr->head)
+//   while (tail != head) {
+//       off = tail & (capacity - 1)
+//       if (capacity - off < sizeof(PairAdminEventHeader)) -> skip to wrap
+//       rec = base + data_offset + off
+//       if (rec->type == 0) -> pad record, skip to wrap
+//       use rec in place; next = tail + PAIRADMIN_RECORD_SIZE(rec->length)
+//       if (!compare-and-swap(hdr->tail, tail, next)) -> reclaimed, discard
+//           what was read and restart at tail = acquire-load(hdr->tail)
+//       tail = next
+//   }
+//
+// Pads are committed the same way. The compare-and-swap only fails
+// under PAIRADMIN_OVERFLOW_DROP_OLDEST, where the producer advances
+// tail itself; with the other policies a plain release-store suffices.
+// ------------------------------------------------------------
+
+// Map a region with a data area of at least `bytes` (0 = default)
+// and open the ring in it. *base receives the PairAdminRegionHeader.
+// Safe to call while the hooks are running.
+// Returns 0 on success, non-zero on failure (including when a ring
+// is already open).
+extern PAIRADMIN_API int pairadmin_map_event_region(size_t bytes, void **base);
+
+// Unmap the region; equivalent to pairadmin_ring_close()
+extern PAIRADMIN_API void pairadmin_unmap_event_region(void);
+
+// Name other processes can open the region by, or NULL if none. On
+// Windows its wake event is this name plus PAIRADMIN_EVENT_WAKE_SUFFIX.
+extern PAIRADMIN_API const char *pairadmin_get_event_region_name(void);
+
+// ------------------------------------------------------------
+// Chunk scanner
+// ------------------------------------------------------------
+
+// Per-chunk byte statistics
+typedef struct PairAdminChunkInfo {
+    int64_t last_newline;   // Offset of the last '\n', -1 if none
+    uint32_t newlines;      // Number of '\n' bytes
+    uint32_t escapes;       // Number of ESC (0x1b) bytes
+    uint32_t non_ascii;     // Number of bytes >= 0x80
+    uint32_t flags;         // PAIRADMIN_TEXT_*
+} PairAdminChunkInfo;
+
+// Fill info for data[0..len) in a single SIMD pass, plus a UTF-8
+// validation of the non-ASCII stretches if there are any
+extern PAIRADMIN_API void pairadmin_scan_chunk(const void *data, size_t len, PairAdminChunkInfo *info);
+
+// ------------------------------------------------------------
+// CPU dispatch
+//
+// The scanner and the UTF-8 checks of the hook path pick their vector
+// kernel at run time from what the CPU supports (AVX2 or SSE2 on x86,
+// NEON on ARM64, plain C otherwise), so one build runs at full speed
+// on old and new machines alike.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_CPU_SSE2 0x1
+#define PAIRADMIN_CPU_AVX2 0x2
+#define PAIRADMIN_CPU_NEON 0x4
+#define PAIRADMIN_CPU_ALL 0x7
+
+// Features the kernels use: those the CPU has, less any masked off
+extern PAIRADMIN_API uint32_t pairadmin_get_cpu_features(void);
+
+// Let the kernels use only the features in mask (0 for plain C,
+// PAIRADMIN_CPU_ALL to undo); for benchmarks and tests. Takes effect
+// with the next call. Returns the features now in use.
+extern PAIRADMIN_API uint32_t pairadmin_set_cpu_features(uint32_t mask);
+
+// ------------------------------------------------------------
+// Batched callback delivery
+//
+// A native thread drains the event ring and coalesces consecutive
+// fragments of the same type into one contiguous buffer, so the
+// consumer sees one call per burst instead of one per term_data().
+// A batch is flushed when it would exceed max_bytes, when the event
+// type changes, or max_delay_us after its first fragment arrived.
+//
+// Under the adaptive policy the batch thread watches the OUTPUT
+// fragments going past instead of always waiting out max_delay_us.
+// Output after a pause of a few milliseconds is taken to be typing echo
+// and flushed as soon as the ring is drained; once a burst runs past a
+// few kilobytes without such a pause it is bulk output and batched to
+// the limits again, until the next pause.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_BATCH_DEFAULT_BYTES 65536
+#define PAIRADMIN_BATCH_DEFAULT_DELAY_US 5000
+
+typedef enum {
+    PAIRADMIN_BATCH_FIXED = 0,      // Always batch to the limits (default)
+    PAIRADMIN_BATCH_ADAPTIVE = 1    // Pass echo through, batch bulk output
+} PairAdminBatchPolicy;
+
+// What the batch thread is doing now, as reported in PairAdminStats
+typedef enum {
+    PAIRADMIN_BATCH_MODE_OFF = 0,           // No batch callback registered
+    PAIRADMIN_BATCH_MODE_THROUGHPUT = 1,    // Holding batches to the limits
+    PAIRADMIN_BATCH_MODE_PASSTHROUGH = 2    // Flushing as soon as the ring is drained
+} PairAdminBatchMode;
+
+// One coalesced fragment within a batch
+typedef struct PairAdminBatchEntry {
+    uint32_t offset;        // Start of the fragment in the batch data
+    uint32_t length;        // Fragment length in bytes
+    uint64_t timestamp_us;  // Capture time of the fragment
+} PairAdminBatchEntry;
+
+// Batch callback: data/len is the concatenated payload, index/count
+// describes the fragments it was built from and info is the
+// pairadmin_scan_chunk() result for the whole payload. All are only
+// valid for the duration of the call. Invoked on the batch thread.
+typedef void (*PairAdminBatchCallback)(PairAdminEventType event,
+                                       const void *data, size_t len,
+                                       const PairAdminBatchEntry *index, size_t count,
+                                       const PairAdminChunkInfo *info);
+
+// Register the batch callback (NULL to stop batching). Opens the event
+// ring if it is not open yet. The batch thread is then the ring's consumer;
+// do not call pairadmin_read_events() while it runs. Stopping delivers
+// what was queued when it was asked to and returns, however busy the
+// terminal is.
+// 0 for max_bytes or max_delay_us selects the defaults.
+// Returns 0 on success, non-zero on failure.
+extern PAIRADMIN_API int pairadmin_set_batch_callback(PairAdminBatchCallback callback,
+                                                      size_t max_bytes, uint32_t max_delay_us);
+
+// Select the policy; takes effect with the next fragment, also while
+// batching. Returns 0 on success, non-zero for an unknown policy.
+extern PAIRADMIN_API int pairadmin_set_batch_policy(PairAdminBatchPolicy policy);
+
+// ------------------------------------------------------------
+// Subscribers
+//
+// Any number of independent readers of the event stream, each with its
+// own cursor into the ring, its own delivery thread and its own set of
+// event types. Subscribers never slow the hooks or each other: one that
+// falls a ring's worth behind skips to the oldest record still present
+// and counts the bytes it missed. If no ring is open, adding the first
+// subscriber opens one; until a consumer attaches with
+// pairadmin_ring_open() that ring discards its oldest records when full
+// and pairadmin_callback keeps being called directly.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_MAX_SUBSCRIBERS 8
+
+// Event mask bit for one PairAdminEventType
+#define PAIRADMIN_EVENT_MASK(type) (1u << (type))
+#define PAIRADMIN_EVENT_MASK_ALL 0xffffffffu
+
+// Subscriber callback, invoked once per record on the subscriber's own
+// thread. data is only valid for the duration of the call.
+typedef void (*PairAdminSubscriberCallback)(PairAdminEventType event,
+                                            const void *data, size_t len,
+                                            void *user);
+
+// Add a subscriber for the event types in event_mask. Delivery starts
+// with the first event after this returns.
+// Returns a subscriber id (> 0), or -1 on failure or when all
+// PAIRADMIN_MAX_SUBSCRIBERS slots are in use.
+extern PAIRADMIN_API int pairadmin_add_subscriber(PairAdminSubscriberCallback callback,
+                                                  void *user, uint32_t event_mask);
+
+// Remove a subscriber. When it returns the callback is not running and
+// will not be called again. Not callable from a subscriber callback;
+// the callback may call pairadmin_get_subscriber_dropped() meanwhile.
+extern PAIRADMIN_API void pairadmin_remove_subscriber(int id);
+
+// Bytes the subscriber skipped because it fell behind
+extern PAIRADMIN_API uint64_t pairadmin_get_subscriber_dropped(int id);
+
+// ------------------------------------------------------------
+// Audit export
+//
+// An optional exporter thread streams the shared ring to a central
+// collector over TCP or a named pipe (a Unix domain socket off Windows).
+// It reads the ring like a subscriber, so the hooks never wait for it:
+// if it falls behind, it skips what the ring has overwritten and counts
+// it. Records are sent as written to the ring, in batches of whole
+// records, each an LZ4 block like those of capture archives
+// (pairadmin_capture_decompress() reads them). The wire has no TLS of
+// its own; for a remote collector, point it at a local TLS forwarder or
+// use a pipe to a local agent.
+//
+// Each batch covers a range of the export stream: the uncompressed
+// record bytes since pairadmin_export_start(), counted from 0. Sent
+// batches stay buffered until the collector acknowledges them, up to
+// buffer_bytes; past that, or while the collector is unreachable, the
+// oldest are dropped. After a reconnect the collector says where it got
+// to and sending resumes from there.
+//
+// Wire protocol, all integers little-endian:
+//   exporter  -> PairAdminExportHello
+//   collector -> PairAdminExportAck   offset it has everything before
+//   exporter  -> PairAdminExportBatch + stored bytes, repeated
+//   collector -> PairAdminExportAck   whenever it has made a batch safe
+// A batch can start before the collector's offset (resent after a
+// reconnect; the collector skips what it has) or after it (dropped
+// while buffered; the gap says how much). Records the ring overwrote
+// before the exporter read them never get an offset; the next batch's
+// lost_bytes counts them.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_EXPORT_TCP 1          // address is "host:port"
+#define PAIRADMIN_EXPORT_PIPE 2         // address is "\\.\pipe\name", or a socket path
+
+#define PAIRADMIN_EXPORT_UNCOMPRESSED 0x1   // Send batches as they are
+
+#define PAIRADMIN_EXPORT_HELLO_MAGIC 0x4f4c4850u  // "PHLO"
+#define PAIRADMIN_EXPORT_ACK_MAGIC 0x4b434150u    // "PACK"
+#define PAIRADMIN_EXPORT_BATCH_MAGIC 0x48544250u  // "PBTH"
+#define PAIRADMIN_EXPORT_VERSION 1
+
+#define PAIRADMIN_EXPORT_BATCH_COMPRESSED 0x1     // Stored bytes are an LZ4 block
+
+typedef struct PairAdminExportConfig {
+    uint32_t transport;         // PAIRADMIN_EXPORT_TCP or _PIPE
+    uint32_t flags;             // PAIRADMIN_EXPORT_*
+    const char *address;
+    uint64_t stream_id;         // Names the stream to the collector; 0 picks one
+    uint32_t event_mask;        // PAIRADMIN_EVENT_MASK bits; 0 for OUTPUT and INPUT
+    uint32_t batch_bytes;       // Record bytes per batch at most; 0 for 64 KB
+    uint32_t flush_ms;          // Longest a record waits for its batch; 0 for 200
+    uint32_t buffer_bytes;      // Batches kept for resending; 0 for 8 MB
+} PairAdminExportConfig;
+
+// First message on every connection (32 bytes)
+typedef struct PairAdminExportHello {
+    uint32_t magic;             // PAIRADMIN_EXPORT_HELLO_MAGIC
+    uint32_t version;           // PAIRADMIN_EXPORT_VERSION
+    uint64_t stream_id;
+    uint32_t process_id;
+    uint32_t reserved;
+    uint64_t oldest_offset;     // Start of the oldest batch still buffered
+} PairAdminExportHello;
+
+// Collector's answer to the hello, and its acknowledgements (16 bytes)
+typedef struct PairAdminExportAck {
+    uint32_t magic;             // PAIRADMIN_EXPORT_ACK_MAGIC
+    uint32_t reserved;
+    uint64_t offset;            // Stream bytes it holds, from the start
+} PairAdminExportAck;
+
+// Ahead of each batch's stored bytes (40 bytes)
+typedef struct PairAdminExportBatch {
+    uint32_t magic;             // PAIRADMIN_EXPORT_BATCH_MAGIC
+    uint32_t flags;             // PAIRADMIN_EXPORT_BATCH_*
+    uint64_t offset;            // Stream offset of its first record byte
+    uint64_t lost_bytes;        // Ring bytes skipped since the previous batch
+    uint32_t raw_bytes;         // Record bytes (PairAdminEventHeader + payload, packed)
+    uint32_t stored_bytes;      // Bytes following, equal to raw_bytes if not compressed
+    uint32_t records;
+    uint32_t reserved;
+} PairAdminExportBatch;
+
+typedef struct PairAdminExportStats {
+    uint32_t running;
+    uint32_t connected;
+    uint64_t connects;          // Successful connections, reconnects included
+    uint64_t next_offset;       // Stream bytes batched so far
+    uint64_t acked_offset;      // Acknowledged by the collector
+    uint64_t buffered_bytes;    // Stored bytes of batches held for sending or resending
+    uint64_t sent_bytes;        // Written to the connection, framing included
+    uint64_t dropped_bytes;     // Record bytes dropped from a full buffer
+    uint64_t lost_bytes;        // Ring bytes overwritten before the exporter read them
+} PairAdminExportStats;
+
+// Start the exporter thread. Connecting, and reconnecting with backoff,
+// happens on that thread; this only checks the arguments and opens the
+// ring if none is open. Returns 0, or -1 on bad arguments, failure, or
+// if an exporter is already running.
+extern PAIRADMIN_API int pairadmin_export_start(const PairAdminExportConfig *config);
+
+// Send what is batched if connected, then stop the thread and close the
+// connection. Blocks for at most about one send timeout.
+extern PAIRADMIN_API void pairadmin_export_stop(void);
+
+// Counters of the running, or last, exporter
+extern PAIRADMIN_API void pairadmin_export_get_stats(PairAdminExportStats *stats);
+
+// ------------------------------------------------------------
+// Recording and replay
+//
+// A trace records every event as delivered to the callback, ring or
+// session callbacks (after redaction and escape filtering) in a compact
+// file. Replaying it feeds the events back through pairadmin_callback
+// or the event ring as if the hooks had produced them, for load tests
+// with real traffic shapes and no SSH server. Replay shares the ring
+// with the hooks, so run it while no session is producing.
+//
+// File layout, integers little-endian:
+//   char[8]  PAIRADMIN_TRACE_MAGIC
+//   uint32   PAIRADMIN_TRACE_VERSION
+//   uint32   reserved (0)
+//   uint64   wall clock at start, microseconds since 1970 UTC
+// then per event:
+//   varint   microseconds since the previous event (since start for the first)
+//   uint8    PairAdminEventType
+//   varint   payload length
+//   bytes    payload
+// Varints are unsigned LEB128. A file cut short ends at its last whole
+// event. A file holding a type outside PairAdminEventType is rejected
+// before any of it is delivered.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_TRACE_MAGIC "PATRACE\0"
+#define PAIRADMIN_TRACE_VERSION 1
+#define PAIRADMIN_TRACE_HEADER_SIZE 24
+
+// Start recording to path (created or truncated), ending any recording
+// in progress. Returns 0, or -1 if the file cannot be created.
+extern PAIRADMIN_API int pairadmin_record_start(const char *path);
+
+// Flush and close the trace
+extern PAIRADMIN_API void pairadmin_record_stop(void);
+
+// Deliver the events of a trace. speed scales the recorded pacing (1.0
+// = original, 2.0 = twice as fast); 0 delivers as fast as possible.
+// Blocks until done or pairadmin_replay_cancel(). Returns the number of
+// events delivered, or -1 if path is not a valid trace.
+extern PAIRADMIN_API int64_t pairadmin_replay(const char *path, double speed);
+
+// Make a running pairadmin_replay() return after its current event
+extern PAIRADMIN_API void pairadmin_replay_cancel(void);
+
+// ------------------------------------------------------------
+// Hot-path statistics
+//
+// Counters kept by the hooks themselves, to show what PairAdmin costs
+// PuTTY's thread. Each thread that runs a hook or callback updates its
+// own cache line, so counting adds no shared writes; time is read with
+// QueryPerformanceCounter (CLOCK_MONOTONIC off Windows). Hook time
+// includes callbacks run synchronously from the hook. Totals are
+// cumulative since the library was loaded. On Windows the same spans,
+// ring overflow, batch flushes and session state changes are also
+// written as ETW events by the "PairAdmin-PuTTY" TraceLogging provider.
+// ------------------------------------------------------------
+
+// Latency histogram: bucket k counts spans of [2^(k+7), 2^(k+8)) ns;
+// bucket 0 also holds anything shorter, the last anything longer
+#define PAIRADMIN_STATS_BUCKETS 20
+
+typedef struct PairAdminHookStats {
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t total_ns;          // Time spent inside
+    uint64_t max_ns;            // Longest single call
+    uint64_t histogram[PAIRADMIN_STATS_BUCKETS];
+} PairAdminHookStats;
+
+typedef struct PairAdminStats {
+    PairAdminHookStats output;      // pairadmin_hook_output()
+    PairAdminHookStats input;       // pairadmin_hook_input() and _checked()
+    PairAdminHookStats callback;    // Every callback invocation, on any thread
+    uint64_t ring_high_water;       // Most bytes ever queued in one event ring
+    uint32_t threads;               // Threads that have recorded anything
+    uint32_t batch_mode;            // PairAdminBatchMode
+    uint64_t batch_switches;        // Adaptive mode changes since batching started
+} PairAdminStats;
+
+// Sum every thread's counters into stats. Safe from any thread; counts
+// still being updated may be one call behind.
+extern PAIRADMIN_API void pairadmin_get_stats(PairAdminStats *stats);
+
+// ------------------------------------------------------------
+// Capabilities
+//
+// The DLL does as little as it can before it is needed: loading it and
+// pairadmin_init() create no files, rings or automata. The event ring
+// is made by the first consumer or subscriber, the redaction automaton
+// by the first pairadmin_set_redaction() that enables a rule, capture
+// segments by the first event captured and the session log by its first
+// line. pairadmin_get_capabilities() is the host's handshake: callable
+// before anything else, it says which build it is talking to and what
+// has been brought up so far.
+// ------------------------------------------------------------
+
+// Bumped when an exported structure or signature changes incompatibly
+#define PAIRADMIN_API_VERSION 1
+
+// What this build can do (PairAdminCapabilities.features)
+#define PAIRADMIN_FEATURE_BACKEND 0x1   // A PuTTY backend is registered
+#define PAIRADMIN_FEATURE_EMBED 0x2     // pairadmin_embed() moves real windows
+#define PAIRADMIN_FEATURE_TRACE 0x4     // ETW TraceLogging provider built in
+
+// What exists so far (PairAdminCapabilities.loaded)
+#define PAIRADMIN_LOADED_SESSION 0x01   // Process-wide session thread running
+#define PAIRADMIN_LOADED_RING 0x02      // Event ring open
+#define PAIRADMIN_LOADED_REDACTION 0x04 // Redaction automaton built
+#define PAIRADMIN_LOADED_CAPTURE 0x08   // Process-wide capture store open
+#define PAIRADMIN_LOADED_SEGMENTS 0x10  // ... and its first segment mapped
+#define PAIRADMIN_LOADED_LOG 0x20       // Session log file created
+
+typedef struct PairAdminCapabilities {
+    uint32_t api_version;       // PAIRADMIN_API_VERSION
+    uint32_t features;          // PAIRADMIN_FEATURE_*
+    uint32_t cpu;               // PAIRADMIN_CPU_*, as pairadmin_get_cpu_features()
+    uint32_t loaded;            // PAIRADMIN_LOADED_*
+    uint32_t max_sessions;      // PAIRADMIN_MAX_SESSIONS
+    uint32_t max_subscribers;   // PAIRADMIN_MAX_SUBSCRIBERS
+    uint64_t ring_default_size; // PAIRADMIN_RING_DEFAULT_SIZE
+} PairAdminCapabilities;
+
+// Fill caps. Safe from any thread, before pairadmin_init() and while
+// sessions run; creates nothing. Returns 0, or -1 if caps is NULL.
+extern PAIRADMIN_API int pairadmin_get_capabilities(PairAdminCapabilities *caps);
+
+// ------------------------------------------------------------
+// Session lifecycle
+//
+// A dedicated session thread owns the PuTTY event loop. Every call
+// below only hands it a command and returns; progress is reported as
+// PAIRADMIN_EVENT_CONNECTED, _DISCONNECTED and _ERROR through the same
+// path as terminal output (callback, ring, subscribers). Because the
+// session thread runs PuTTY, it is also the thread calling the hooks.
+// ------------------------------------------------------------
+
+// Values match PuTTYInterop.PairAdminState
+typedef enum {
+    PAIRADMIN_STATE_NOT_INITIALIZED = 0,
+    PAIRADMIN_STATE_INITIALIZING = 1,
+    PAIRADMIN_STATE_READY = 2,
+    PAIRADMIN_STATE_CONNECTING = 3,
+    PAIRADMIN_STATE_CONNECTED = 4,
+    PAIRADMIN_STATE_DISCONNECTING = 5,
+    PAIRADMIN_STATE_ERROR = -1
+} PairAdminState;
+
+// Return values of PairAdminSessionBackend.run
+#define PAIRADMIN_BACKEND_PENDING 0     // Still connecting
+#define PAIRADMIN_BACKEND_CONNECTED 1   // Session established
+#define PAIRADMIN_BACKEND_CLOSED (-1)   // Connection closed or failed
+
+// The PuTTY side of a session, registered by the PuTTY build (see
+// PUTTY_MODIFICATIONS.c). Members are called on the session thread;
+// with several sessions open they run concurrently, one thread per
+// session, and pairadmin_session_current() tells them which is theirs.
+typedef struct PairAdminSessionBackend {
+    void *ctx;
+
+    // Start connecting; returns 0, or non-zero with error() describing why
+    int (*open)(void *ctx, void *parent_hwnd, const char *host, int port, const char *user);
+
+    // Run the event loop for up to timeout_ms; returns PAIRADMIN_BACKEND_*
+    int (*run)(void *ctx, uint32_t timeout_ms);
+
+    // Tear the connection down; called once after a successful open()
+    void (*close)(void *ctx);
+
+    // Last failure, or NULL
+    const char *(*error)(void *ctx);
+} PairAdminSessionBackend;
+
+// Register the backend (copied). Each session takes a copy when it
+// connects, so a change applies from the next connect on.
+extern PAIRADMIN_API int pairadmin_set_session_backend(const PairAdminSessionBackend *backend);
+
+// Start the session thread. parent_hwnd is handed to the backend for
+// the terminal window. Nothing else is set up here (see Capabilities).
+// Returns 0, also when already initialized.
+extern PAIRADMIN_API int pairadmin_init(void *parent_hwnd);
+
+// Queue a connection attempt; returns 0 at once, or -1 if the layer is
+// not initialized, a session is active or no backend is registered.
+// The outcome arrives as PAIRADMIN_EVENT_CONNECTED or _ERROR.
+extern PAIRADMIN_API int pairadmin_connect(const char *hostname, int port, const char *username);
+
+// Queue a disconnect; PAIRADMIN_EVENT_DISCONNECTED follows
+extern PAIRADMIN_API void pairadmin_disconnect(void);
+
+extern PAIRADMIN_API int pairadmin_is_connected(void);
+extern PAIRADMIN_API PairAdminState pairadmin_get_state(void);
+
+// Last error message ("" if none). Valid until the next error.
+extern PAIRADMIN_API const char *pairadmin_get_error(void);
+
+// Close any session and stop the session thread. Blocks until it has
+// exited; not callable from a callback. Returns 0.
+extern PAIRADMIN_API int pairadmin_shutdown(void);
+
+// Path of the session log, or "" before the first session starts. The
+// file is created with its first line, normally at the first connect.
+extern PAIRADMIN_API const char *pairadmin_get_log_path(void);
+
+// ------------------------------------------------------------
+// Per-session handles
+//
+// The functions above drive one process-wide session that reports
+// through pairadmin_callback and the shared ring. Each handle below is a
+// further, independent session: its own session thread, event ring,
+// delivery thread, statistics and terminal window. Its events, tagged
+// with its id, go only to its own callback. Up to
+// PAIRADMIN_MAX_SESSIONS may be open at once.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_MAX_SESSIONS 64
+
+typedef struct PairAdminSession PairAdminSession;
+
+// Invoked on the session's delivery thread, in order. data is only
+// valid for the duration of the call unless the callback retains it.
+typedef void (*PairAdminSessionCallback)(uint32_t session_id, PairAdminEventType event,
+                                         const void *data, size_t len, void *user);
+
+typedef struct PairAdminSessionStats {
+    uint64_t events;            // Records delivered to the callback
+    uint64_t bytes;             // Payload bytes delivered
+    uint64_t dropped_events;    // Records the session's ring discarded
+    uint64_t dropped_bytes;
+} PairAdminSessionStats;
+
+// Create and start a session. ring_capacity is the size of its event
+// ring (0 for PAIRADMIN_RING_DEFAULT_SIZE); parent_hwnd is handed to the
+// backend for the terminal window. Returns NULL on failure.
+extern PAIRADMIN_API PairAdminSession *pairadmin_session_create(PairAdminSessionCallback callback, void *user,
+                                                                void *parent_hwnd, size_t ring_capacity);
+
+// Close the connection, deliver what is still queued and free the
+// session. Blocks until its threads have exited; not callable from its
+// own callback or backend.
+extern PAIRADMIN_API void pairadmin_session_destroy(PairAdminSession *session);
+
+// Ids start at 1; 0 is the process-wide session
+extern PAIRADMIN_API uint32_t pairadmin_session_get_id(const PairAdminSession *session);
+
+// Keep the event being delivered instead of copying it; only from
+// inside the session's callback. Returns its record (header, then the
+// same payload as data), valid until pairadmin_session_release(), or
+// NULL if the session's arena had no block for it and data has to be
+// copied as usual. Retained records are bounded by the ring size: once
+// that much is held, further events are delivered but cannot be kept.
+extern PAIRADMIN_API const PairAdminEventHeader *pairadmin_session_retain(PairAdminSession *session);
+
+// Give a retained record back; from any thread, before the session is
+// destroyed
+extern PAIRADMIN_API void pairadmin_session_release(PairAdminSession *session, const PairAdminEventHeader *record);
+
+// As pairadmin_connect()/pairadmin_disconnect(), for one session
+extern PAIRADMIN_API int pairadmin_session_connect(PairAdminSession *session, const char *hostname,
+                                                   int port, const char *username);
+extern PAIRADMIN_API void pairadmin_session_disconnect(PairAdminSession *session);
+
+extern PAIRADMIN_API PairAdminState pairadmin_session_get_state(PairAdminSession *session);
+extern PAIRADMIN_API const char *pairadmin_session_get_error(PairAdminSession *session);
+extern PAIRADMIN_API void pairadmin_session_get_stats(PairAdminSession *session, PairAdminSessionStats *stats);
+
+// Terminal window of the session, set by the backend once it exists
+extern PAIRADMIN_API void pairadmin_session_set_hwnd(PairAdminSession *session, void *hwnd);
+extern PAIRADMIN_API void *pairadmin_session_get_hwnd(PairAdminSession *session);
+
+// Session whose thread is calling, or NULL off the session threads.
+// For the backend; the process-wide session is returned too.
+extern PAIRADMIN_API PairAdminSession *pairadmin_session_current(void);
+
+// ------------------------------------------------------------
+// Window embedding
+//
+// The terminal window belongs to the session thread, so moving it from
+// the UI thread makes that thread wait while PuTTY reflows the terminal,
+// once per SetWindowPos. These calls only record the request and return;
+// the session thread reparents the window (as a borderless child) and
+// applies the latest bounds, at most once per frame, so a splitter drag
+// costs one term_size() per frame however many layout passes WPF runs.
+// Both are kept and applied again to any window the backend creates
+// later, each of which is announced as PAIRADMIN_EVENT_WINDOW; the
+// host need not poll for the handle.
+// ------------------------------------------------------------
+
+// Shortest time between two resizes of the terminal window
+#define PAIRADMIN_EMBED_FRAME_US 16667
+
+// Payload of PAIRADMIN_EVENT_WINDOW
+typedef struct PairAdminWindowInfo {
+    uint64_t hwnd;              // Terminal window, 0 once it is gone
+    uint64_t parent;            // Window it is embedded in, 0 if not embedded
+    int32_t x;                  // Bounds applied, in the parent's client area;
+    int32_t y;                  // width and height are 0 if none were set
+    int32_t width;
+    int32_t height;
+} PairAdminWindowInfo;
+
+// Embed the process-wide session's terminal window in parent (NULL to
+// stop reparenting new windows). Returns 0.
+extern PAIRADMIN_API int pairadmin_embed(void *parent);
+
+// Place it at x, y, width x height in the parent's client area. Returns
+// -1 if width or height is negative.
+extern PAIRADMIN_API int pairadmin_set_bounds(int32_t x, int32_t y, int32_t width, int32_t height);
+
+// Terminal window of the process-wide session, as the backend reported
+// it with pairadmin_session_set_hwnd(); NULL until it exists
+extern PAIRADMIN_API void *pairadmin_get_terminal_hwnd(void);
+
+// As above, for one session
+extern PAIRADMIN_API int pairadmin_session_embed(PairAdminSession *session, void *parent);
+extern PAIRADMIN_API int pairadmin_session_set_bounds(PairAdminSession *session, int32_t x, int32_t y,
+                                                      int32_t width, int32_t height);
+
+// ------------------------------------------------------------
+// Capture store
+//
+// Raw OUTPUT and INPUT events of a session appended as timestamped
+// frames to memory-mapped, append-only segment files, plus a line
+// store that keeps every output line contiguous and indexed by number,
+// so any range of lines can be read back without re-parsing the log or
+// holding it in managed memory. session is a handle from
+// pairadmin_session_create(), or NULL for the process-wide session.
+// Files are named pairadmin-<pid>-<session id>-<segment>.pacap and stay
+// on disk after the store is closed; the line store's .palines files
+// are removed then.
+//
+// The line store keeps each line within one text segment of
+// segment_bytes. A line still open when its segment fills moves to the
+// next one whole if it is at most a quarter of segment_bytes; a longer
+// one is ended there, without a newline, and what follows it is the
+// next line. A line longer than a segment is always split this way.
+//
+// A background thread compresses each segment once it is full, and the
+// last one at close, into a .pacapz archive that replaces it: the
+// segment's frames cut into blocks of whole frames, each compressed on
+// its own (LZ4 block format), then a PairAdminCaptureBlock index and a
+// PairAdminCaptureArchive trailer. Reading the trailer at the end of the
+// file finds the index, and the index's timestamps find the block
+// holding any moment, so an archive can be read from any point without
+// decompressing what comes before. A segment that can't be archived
+// (disk full) stays as it is.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_CAPTURE_DEFAULT_SEGMENT (64u << 20)
+#define PAIRADMIN_CAPTURE_MAGIC 0x53434150u  // "PACS"
+#define PAIRADMIN_CAPTURE_VERSION 1
+
+// Start of every segment file (64 bytes)
+typedef struct PairAdminCaptureSegment {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;          // Segment number within the session, from 0
+    uint64_t first_line;        // Output lines completed before this segment
+    volatile uint64_t used;     // Bytes written, this header included
+    uint64_t reserved[4];
+} PairAdminCaptureSegment;
+
+// One frame; length payload bytes follow, padded to 8
+typedef struct PairAdminCaptureFrame {
+    uint64_t timestamp_us;      // Wall clock, microseconds since 1970 UTC
+    uint32_t length;
+    uint16_t type;              // PAIRADMIN_EVENT_OUTPUT or _INPUT
+    uint16_t flags;             // Reserved, currently 0
+} PairAdminCaptureFrame;
+
+#define PAIRADMIN_CAPTURE_FRAME_SIZE(len) \
+    ((sizeof(PairAdminCaptureFrame) + (size_t)(len) + 7u) & ~(size_t)7u)
+
+#define PAIRADMIN_ARCHIVE_MAGIC 0x5a434150u  // "PACZ"
+#define PAIRADMIN_ARCHIVE_VERSION 1
+
+// Frame bytes of a block before compression, at most
+#define PAIRADMIN_ARCHIVE_BLOCK (64u * 1024)
+
+// One entry of an archive's block index
+typedef struct PairAdminCaptureBlock {
+    uint64_t offset;            // From the start of the archive
+    uint64_t timestamp_us;      // Of the block's first frame
+    uint32_t compressed;        // Bytes stored; equal to raw if the block is stored as is
+    uint32_t raw;               // Frame bytes it decompresses to
+} PairAdminCaptureBlock;
+
+// Last 64 bytes of an archive. Blocks start at offset 0; the index of
+// block_count entries at index_offset, 8-aligned, as is the archive's
+// size.
+typedef struct PairAdminCaptureArchive {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;          // As in the segment it was made from
+    uint64_t first_line;
+    uint64_t raw_bytes;         // Frame bytes in all blocks, before compression
+    uint64_t index_offset;
+    uint64_t archive_bytes;     // Whole archive, this trailer included
+    uint32_t block_count;
+    uint32_t reserved[3];
+} PairAdminCaptureArchive;
+
+// Start capturing into directory (NULL for the temp directory) in
+// segments of segment_bytes (0 for the default). No file is created
+// until the first event arrives. Returns 0, also when the store is open
+// already, or -1 if directory does not exist. A segment that can't be
+// made later stops the capture, as a full disk does.
+extern PAIRADMIN_API int pairadmin_capture_open(PairAdminSession *session, const char *directory,
+                                                size_t segment_bytes);
+
+// Stop capturing and close the segment files; an export still running
+// closes them when it finishes. Not callable from a hook or callback.
+extern PAIRADMIN_API void pairadmin_capture_close(PairAdminSession *session);
+
+// Write everything captured so far to path as archives, one per segment
+// in order, back to back: archived segments are copied as they are and
+// the rest compressed on the way out. Each archive's trailer gives its
+// size, so the file is walked from the end. Blocks the compressor while
+// it runs; a pairadmin_capture_close() meanwhile returns at once and
+// leaves the files to the export. Returns the bytes written, or -1 on failure or without a
+// store.
+extern PAIRADMIN_API int64_t pairadmin_capture_export(PairAdminSession *session, const char *path);
+
+// Decompress one archive block of len bytes into dst (at least the
+// block's raw bytes). Returns the bytes produced, or -1 if the block is
+// malformed or dst too small.
+extern PAIRADMIN_API int64_t pairadmin_capture_decompress(const void *src, size_t len, void *dst, size_t cap);
+
+// Complete output lines captured so far
+extern PAIRADMIN_API uint64_t pairadmin_log_line_count(PairAdminSession *session);
+
+// Copy up to count output lines starting at line first_line (0-based)
+// into buf, as captured, newlines included. Stops at the last whole
+// line that fits; a first line longer than cap is cut to cap bytes. The
+// final line may be incomplete if output is still arriving. *lines, if
+// given, receives the number of lines copied. Returns bytes written.
+extern PAIRADMIN_API size_t pairadmin_log_read_range(PairAdminSession *session, uint64_t first_line,
+                                                     uint32_t count, void *buf, size_t cap,
+                                                     uint32_t *lines);
+
+// One output line in the line store
+typedef struct PairAdminLineSpan {
+    const char *data;           // Not NUL-terminated
+    uint32_t length;            // Trailing "\r\n" or "\n" excluded
+    uint32_t flags;             // PAIRADMIN_LINE_*
+} PairAdminLineSpan;
+
+// The line has no newline yet: output for it may still arrive
+#define PAIRADMIN_LINE_OPEN 0x1u
+
+// Fill out_spans with up to n of the newest output lines, oldest first,
+// the open line last if it has text. The spans point into the store
+// itself, so this costs n index lookups however much has been captured;
+// they stay valid until pairadmin_capture_close(). Returns the number of
+// spans filled.
+extern PAIRADMIN_API uint32_t pairadmin_get_last_lines(PairAdminSession *session, uint32_t n,
+                                                       PairAdminLineSpan *out_spans);
+
+// ------------------------------------------------------------
+// Screen model
+//
+// A virtual screen fed from a session's OUTPUT, so a consumer can read
+// what the terminal shows instead of replaying every redraw of a
+// full-screen program. Cursor movement, erases, insert/delete, scroll
+// regions and the alternate screen are followed; attributes are not.
+// Each row remembers the generation it last changed in, and the
+// generation advances once per output fragment that changed anything,
+// so pairadmin_get_screen_changes(since = last generation seen) returns
+// just the rows redrawn in between. Text is UTF-8 without trailing
+// blanks; a double-width character takes two cells.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_SCREEN_DEFAULT_COLS 80
+#define PAIRADMIN_SCREEN_DEFAULT_ROWS 24
+#define PAIRADMIN_SCREEN_MAX_COLS 1024
+#define PAIRADMIN_SCREEN_MAX_ROWS 1024
+
+// The alternate screen (vim, less, top) is showing
+#define PAIRADMIN_SCREEN_ALTERNATE 0x1u
+
+typedef struct PairAdminScreenInfo {
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t cursor_col;        // 0-based
+    uint32_t cursor_row;
+    uint64_t generation;        // Of the state returned
+    uint32_t flags;             // PAIRADMIN_SCREEN_*
+    uint32_t reserved;
+} PairAdminScreenInfo;
+
+// One changed row; length bytes of text follow, padded to 4
+typedef struct PairAdminScreenRow {
+    uint32_t row;
+    uint32_t length;
+} PairAdminScreenRow;
+
+#define PAIRADMIN_SCREEN_ROW_SIZE(len) \
+    ((sizeof(PairAdminScreenRow) + (size_t)(len) + 3u) & ~(size_t)3u)
+
+// Start modelling the session's screen at cols x rows (0 for 80x24,
+// clamped to the maximum). Returns 0, also when the model is open
+// already, or -1 if it can't be allocated.
+extern PAIRADMIN_API int pairadmin_screen_open(PairAdminSession *session, uint32_t cols, uint32_t rows);
+
+// Stop modelling. Not callable from a hook or callback.
+extern PAIRADMIN_API void pairadmin_screen_close(PairAdminSession *session);
+
+// Follow a terminal resize; call wherever PuTTY's term_size() runs.
+// Text is kept from the top left, the rows ending at the cursor when
+// rows shrink; every row counts as changed. Returns -1 if no model is
+// open or memory runs out.
+extern PAIRADMIN_API int pairadmin_screen_resize(PairAdminSession *session, uint32_t cols, uint32_t rows);
+
+// Copy the screen into buf as one line per row, each ending in '\n',
+// leaving out blank rows below the text and the cursor. Stops at the
+// last whole row that fits. info, if given, receives the state the text
+// belongs to (zeroed without a model). Returns bytes written.
+extern PAIRADMIN_API size_t pairadmin_get_screen_snapshot(PairAdminSession *session, char *buf, size_t cap,
+                                                          PairAdminScreenInfo *info);
+
+// Write every row changed after generation since as a
+// PairAdminScreenRow plus text, top to bottom; since = 0 returns the
+// whole screen. Returns the number of rows written with *written set to
+// the bytes used, or -1 with *written set to the bytes needed if they
+// don't fit in cap (or no model is open, *written = 0).
+extern PAIRADMIN_API int32_t pairadmin_get_screen_changes(PairAdminSession *session, uint64_t since,
+                                                          void *buf, size_t cap, size_t *written,
+                                                          PairAdminScreenInfo *info);
+
+// ------------------------------------------------------------
+// Command digests
+//
+// Each command bracketed by COMMAND_START and COMMAND_END marks (see
+// pairadmin_set_shell_marks) is kept as its first and last lines of
+// output text plus counts of what lies between, so a context builder
+// can take a 50 MB build log as a few dozen lines and the exit status.
+// Text is the session's redacted OUTPUT with escape sequences and
+// carriage returns removed. Memory is fixed by the limits given at
+// open: the running command's buffers and up to `commands` finished
+// digests, whatever the commands print.
+// ------------------------------------------------------------
+
+#define PAIRADMIN_DIGEST_DEFAULT_LINES 20
+#define PAIRADMIN_DIGEST_MAX_LINES 1000
+#define PAIRADMIN_DIGEST_DEFAULT_COMMANDS 64
+#define PAIRADMIN_DIGEST_MAX_COMMANDS 4096
+
+// Longer lines are cut, longer command lines likewise
+#define PAIRADMIN_DIGEST_LINE_MAX 512
+#define PAIRADMIN_DIGEST_COMMAND_MAX 1024
+
+// No COMMAND_END yet: the counts are those so far
+#define PAIRADMIN_DIGEST_RUNNING 0x1u
+// Some line was longer than PAIRADMIN_DIGEST_LINE_MAX
+#define PAIRADMIN_DIGEST_CUT 0x2u
+// The command line is inexact or missing (PAIRADMIN_COMMAND_INEXACT)
+#define PAIRADMIN_DIGEST_INEXACT 0x4u
+
+// Followed in the buffer by the command line, the head lines and the
+// tail lines, each line ending in '\n' but a running command's last
+typedef struct PairAdminDigestInfo {
+    uint64_t sequence;          // 1-based, per store
+    uint64_t start_offset;      // Raw output offsets of the marks
+    uint64_t end_offset;        // 0 while running
+    uint64_t output_bytes;      // OUTPUT bytes received, after redaction
+    uint64_t text_bytes;        // Once escape sequences are removed
+    uint64_t elided_bytes;      // Text in neither head nor tail
+    uint64_t lines;
+    uint64_t elided_lines;      // Lines in neither head nor tail
+    int32_t exit_code;          // PAIRADMIN_EXIT_UNKNOWN if not reported
+    uint32_t flags;             // PAIRADMIN_DIGEST_*
+    uint32_t command_length;
+    uint32_t head_length;
+    uint32_t tail_length;
+    uint32_t reserved;
+} PairAdminDigestInfo;
+
+// Start keeping digests of head_lines and tail_lines lines (0 for the
+// default each) for the last `commands` commands (0 for the default).
+// Returns 0, also when the store is open already, or -1 if it can't be
+// allocated.
+extern PAIRADMIN_API int pairadmin_digest_open(PairAdminSession *session, uint32_t head_lines,
+                                               uint32_t tail_lines, uint32_t commands);
+
+// Stop keeping digests. Not callable from a hook or callback.
+extern PAIRADMIN_API void pairadmin_digest_close(PairAdminSession *session);
+
+// Sequence of the newest command, running or finished; 0 if none or no
+// store
+extern PAIRADMIN_API uint64_t pairadmin_digest_latest(PairAdminSession *session);
+
+// Copy the digest of command `sequence` into info and its text into
+// buf. Returns 0 with *written set to the text bytes, or -1 with
+// *written set to the bytes needed if they don't fit in cap (0 if the
+// command is no longer held, not started yet or no store is open).
+extern PAIRADMIN_API int pairadmin_get_command_digest(PairAdminSession *session, uint64_t sequence,
+                                                      PairAdminDigestInfo *info, void *buf, size_t cap,
+                                                      size_t *written);
 
 #ifdef _WIN32
 #ifdef __cplusplus
@@ -0,0 +1,122 @@
+// Block arena for PairAdmin
+//
+// Records that outlive their delivery - a session consumer holding on to
+// an event rather than copying it again - live in blocks from an arena
+// instead of the heap, so a day-long session neither mallocs per
+// fragment nor fragments the heap. Size classes follow what term_data()
+// is handed: keystroke echoes, prompt and short lines, an SSH packet's
+// worth, a typical bulk read and a full record. All blocks are carved
+// from one allocation made with the arena, which caps what consumers
+// can hold however long the session runs.
+//
+// Only the owner thread allocates, from free lists it keeps to itself.
+// Other threads free by pushing onto a per-class return stack with one
+// compare-and-swap, and the owner takes a whole stack back with a single
+// exchange once its own list runs dry. Nothing ever pops one block off a
+// shared stack, so there is no ABA problem and no lock.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+struct PaBlock {
+    PaBlock *next;
+    uint32_t size_class;
+    uint32_t reserved;
+};
+
+// Usable bytes of each class; all multiples of 8
+static const size_t pa_arena_class_bytes[PA_ARENA_CLASSES] = {
+    128, 512, 2048, 8192, PAIRADMIN_READ_BUFFER_MIN,
+};
+
+int pa_arena_init(PaArena *arena, size_t budget)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->base = (unsigned char *)malloc(budget);
+    if (!arena->base) {
+        return -1;
+    }
+    arena->size = budget;
+    return 0;
+}
+
+void pa_arena_destroy(PaArena *arena)
+{
+    free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
+
+static PaBlock *pa_arena_take(PaArena *arena, unsigned c)
+{
+    PaBlock *b = arena->free[c];
+
+    if (!b && pa_load_acquire_ptr((void *const volatile *)&arena->returned[c])) {
+        b = (PaBlock *)pa_atomic_xchg_ptr((void *volatile *)&arena->returned[c], NULL);
+    }
+    if (b) {
+        arena->free[c] = b->next;
+    }
+    return b;
+}
+
+static PaBlock *pa_arena_carve(PaArena *arena, unsigned c)
+{
+    size_t need = sizeof(PaBlock) + pa_arena_class_bytes[c];
+    PaBlock *b;
+
+    if (arena->size - arena->carved < need) {
+        return NULL;
+    }
+    b = (PaBlock *)(arena->base + arena->carved);
+    b->size_class = c;
+    b->reserved = 0;
+    arena->carved += need;
+    return b;
+}
+
+void *pa_arena_alloc(PaArena *arena, size_t bytes)
+{
+    unsigned c = 0;
+    unsigned k;
+    PaBlock *b;
+
+    while (c < PA_ARENA_CLASSES && bytes > pa_arena_class_bytes[c]) {
+        c++;
+    }
+    if (c == PA_ARENA_CLASSES) {
+        return NULL;
+    }
+
+    b = pa_arena_take(arena, c);
+    if (!b) {
+        b = pa_arena_carve(arena, c);
+    }
+    // Budget spent: a free block of a larger class still fits
+    for (k = c + 1; !b && k < PA_ARENA_CLASSES; k++) {
+        b = pa_arena_take(arena, k);
+    }
+    return b ? b + 1 : NULL;
+}
+
+void pa_arena_recycle(PaArena *arena, void *block)
+{
+    PaBlock *b = (PaBlock *)block - 1;
+
+    b->next = arena->free[b->size_class];
+    arena->free[b->size_class] = b;
+}
+
+void pa_arena_free(PaArena *arena, void *block)
+{
+    PaBlock *b = (PaBlock *)block - 1;
+    void *volatile *top = (void *volatile *)&arena->returned[b->size_class];
+    void *head;
+
+    do {
+        head = pa_load_acquire_ptr((void *const volatile *)top);
+        b->next = (PaBlock *)head;
+    } while (!pa_atomic_cas_ptr(top, head, b));
+}
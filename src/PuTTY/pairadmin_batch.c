@@ -0,0 +1,281 @@
+// Batched callback delivery for PairAdmin
+//
+// PuTTY calls term_data() with tiny fragments - often a few bytes per
+// SSH packet. Rather than crossing into managed code for each one, a
+// native thread drains the event ring and hands the consumer one
+// contiguous buffer per burst, plus an index of the original fragments.
+//
+// How long to hold a batch depends on what is arriving. A keystroke
+// echo wants to reach the AI at once, and holding it buys nothing;
+// `cat` of a large file wants every microsecond of coalescing. Any
+// single delay penalises one of the two, so the adaptive policy tells
+// them apart from the OUTPUT timestamps and lengths already in the
+// ring: output after a quiet spell starts a new burst, and a burst
+// counts as bulk once it has carried PA_BATCH_BURST_BYTES.
+//
+// Between bursts the thread sleeps on the ring's waker, and while a
+// batch is held it sleeps until the batch is due or more arrives.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+// Records handled per drain pass before the delay check runs again
+#define PA_BATCH_DRAIN_RECORDS 256
+
+// Adaptive policy: a gap in output this long ends a burst, and a burst
+// this large is bulk output. Typing echo arrives tens of milliseconds
+// apart a few bytes at a time; bulk output back to back in SSH packets.
+#define PA_BATCH_QUIET_US 10000
+#define PA_BATCH_BURST_BYTES 4096
+
+typedef struct PaBatcher {
+    PairAdminBatchCallback callback;
+    size_t max_bytes;
+    uint64_t max_delay_us;
+    PaRing *ring;
+    int owns_ring;
+    PaThread thread;
+    volatile uint32_t stop;
+
+    // Batch being assembled
+    uint16_t type;
+    unsigned char *data;
+    size_t length;
+    PairAdminBatchEntry *entries;
+    size_t count;
+    size_t entries_cap;
+    uint64_t first_us;
+
+    // Adaptive policy
+    uint64_t last_output_us;
+    uint64_t burst_bytes;
+    volatile uint32_t mode;             // PairAdminBatchMode
+    volatile uint64_t switches;
+} PaBatcher;
+
+static PaBatcher pa_batcher;
+static volatile uint32_t pa_batch_policy = PAIRADMIN_BATCH_FIXED;
+
+static void pa_batch_flush(PaBatcher *b)
+{
+    PairAdminChunkInfo info;
+    uint64_t start;
+
+    if (b->count == 0) {
+        return;
+    }
+    pairadmin_scan_chunk(b->data, b->length, &info);
+    if (pa_trace_on(PA_TRACE_BATCH)) {
+        pa_trace_batch(b->type, b->length, b->count, pa_now_us() - b->first_us);
+    }
+    start = pa_span_begin(PA_STATS_CALLBACK, b->length);
+    b->callback((PairAdminEventType)b->type, b->data, b->length, b->entries, b->count, &info);
+    pa_span_end(PA_STATS_CALLBACK, b->length, start);
+    b->length = 0;
+    b->count = 0;
+}
+
+// Follow the output stream and pick the mode for it
+static void pa_batch_observe(PaBatcher *b, const PairAdminEventHeader *hdr)
+{
+    uint32_t mode = PAIRADMIN_BATCH_MODE_THROUGHPUT;
+
+    if (hdr->type != PAIRADMIN_EVENT_OUTPUT && hdr->type != PAIRADMIN_EVENT_OUTPUT_TEXT) {
+        return;
+    }
+    if (hdr->timestamp_us - b->last_output_us >= PA_BATCH_QUIET_US) {
+        b->burst_bytes = 0;
+    }
+    b->last_output_us = hdr->timestamp_us;
+    b->burst_bytes += hdr->length;
+
+    if (pa_load_acquire_u32(&pa_batch_policy) == PAIRADMIN_BATCH_ADAPTIVE &&
+        b->burst_bytes <= PA_BATCH_BURST_BYTES) {
+        mode = PAIRADMIN_BATCH_MODE_PASSTHROUGH;
+    }
+    if (mode != b->mode) {
+        pa_store_release_u32(&b->mode, mode);
+        pa_store_release_u64(&b->switches, b->switches + 1);
+    }
+}
+
+static void pa_batch_append(const PairAdminEventHeader *hdr, const void *payload, void *ctx)
+{
+    PaBatcher *b = (PaBatcher *)ctx;
+    PairAdminBatchEntry *entry;
+
+    pa_batch_observe(b, hdr);
+
+    // Flushes happen before appending, never right after: the record
+    // just appended is not committed until pa_ring_drain() says so
+    if (b->count > 0 &&
+        (hdr->type != b->type ||
+         b->length >= b->max_bytes ||
+         b->length + hdr->length > b->max_bytes ||
+         b->count == b->entries_cap)) {
+        pa_batch_flush(b);
+    }
+
+    if (b->count == 0) {
+        b->type = hdr->type;
+        b->first_us = hdr->timestamp_us;
+    }
+
+    entry = &b->entries[b->count++];
+    entry->offset = (uint32_t)b->length;
+    entry->length = hdr->length;
+    entry->timestamp_us = hdr->timestamp_us;
+    memcpy(b->data + b->length, payload, hdr->length);
+    b->length += hdr->length;
+}
+
+// The last appended record was reclaimed while it was being copied
+static void pa_batch_discard(void *ctx)
+{
+    PaBatcher *b = (PaBatcher *)ctx;
+
+    b->length = b->entries[--b->count].offset;
+}
+
+static size_t pa_batch_drain(PaBatcher *b)
+{
+    return pa_ring_drain(b->ring, pa_batch_append, pa_batch_discard, b, PA_BATCH_DRAIN_RECORDS);
+}
+
+static void pa_batch_thread(void *arg)
+{
+    PaBatcher *b = (PaBatcher *)arg;
+    uint64_t end;
+
+    while (!pa_load_acquire_u32(&b->stop)) {
+        size_t handled = pa_batch_drain(b);
+        uint64_t age;
+
+        if (b->length >= b->max_bytes ||
+            (b->mode == PAIRADMIN_BATCH_MODE_PASSTHROUGH && handled < PA_BATCH_DRAIN_RECORDS)) {
+            pa_batch_flush(b);
+        }
+        if (b->count == 0) {
+            if (handled == 0) {
+                pa_ring_await(b->ring, PA_WAIT_FOREVER);
+            }
+            continue;
+        }
+
+        age = pa_now_us() - b->first_us;
+        if (age >= b->max_delay_us) {
+            pa_batch_flush(b);
+        } else if (handled == 0) {
+            pa_ring_await(b->ring, b->max_delay_us - age);
+        }
+    }
+
+    // Deliver whatever was captured before the stop request, and no
+    // more: under continuous output the ring never runs dry, and stopping
+    // must not wait for the terminal to go quiet
+    end = pa_load_acquire_u64(&b->ring->ctl->head);
+    while (pa_load_acquire_u64(&b->ring->ctl->tail) < end && pa_batch_drain(b) > 0) {
+    }
+    pa_batch_flush(b);
+}
+
+static void pa_batch_release(PaBatcher *b)
+{
+    pa_store_release_u32(&b->mode, PAIRADMIN_BATCH_MODE_OFF);
+    free(b->data);
+    free(b->entries);
+    b->data = NULL;
+    b->entries = NULL;
+    b->callback = NULL;
+    b->ring = NULL;
+}
+
+void pa_batch_stop(void)
+{
+    PaBatcher *b = &pa_batcher;
+
+    if (!b->thread.running) {
+        return;
+    }
+    pa_store_release_u32(&b->stop, 1);
+    pa_ring_wake(b->ring);
+    pa_thread_join(&b->thread);
+    pa_batch_release(b);
+}
+
+int pairadmin_set_batch_callback(PairAdminBatchCallback callback,
+                                 size_t max_bytes, uint32_t max_delay_us)
+{
+    PaBatcher *b = &pa_batcher;
+    int owns_ring = b->owns_ring;
+    size_t buffer_size;
+
+    pa_batch_stop();
+
+    if (!callback) {
+        if (owns_ring) {
+            b->owns_ring = 0;
+            pairadmin_ring_close();
+        }
+        return 0;
+    }
+
+    // Opens the ring, or takes over one opened only for subscribers
+    if (!pa_current_ring()) {
+        owns_ring = 1;
+    }
+    if (pairadmin_ring_open(0) != 0) {
+        return -1;
+    }
+
+    b->max_bytes = max_bytes ? max_bytes : PAIRADMIN_BATCH_DEFAULT_BYTES;
+    b->max_delay_us = max_delay_us ? max_delay_us : PAIRADMIN_BATCH_DEFAULT_DELAY_US;
+
+    // A single record may be larger than max_bytes; it then goes out alone
+    buffer_size = b->max_bytes > PAIRADMIN_MAX_PAYLOAD ? b->max_bytes : PAIRADMIN_MAX_PAYLOAD;
+    b->entries_cap = b->max_bytes / PA_RECORD_ALIGN + 16;
+    b->data = (unsigned char *)malloc(buffer_size);
+    b->entries = (PairAdminBatchEntry *)malloc(b->entries_cap * sizeof(PairAdminBatchEntry));
+    b->callback = callback;
+    b->ring = pa_current_ring();
+    b->owns_ring = owns_ring;
+    b->length = 0;
+    b->count = 0;
+    b->stop = 0;
+    b->last_output_us = 0;
+    b->burst_bytes = 0;
+    b->switches = 0;
+    pa_store_release_u32(&b->mode, PAIRADMIN_BATCH_MODE_THROUGHPUT);
+
+    if (!b->data || !b->entries || pa_thread_start(&b->thread, pa_batch_thread, b) != 0) {
+        pa_batch_release(b);
+        if (owns_ring) {
+            b->owns_ring = 0;
+            pairadmin_ring_close();
+        }
+        return -1;
+    }
+    return 0;
+}
+
+int pairadmin_set_batch_policy(PairAdminBatchPolicy policy)
+{
+    if (policy != PAIRADMIN_BATCH_FIXED && policy != PAIRADMIN_BATCH_ADAPTIVE) {
+        return -1;
+    }
+    pa_store_release_u32(&pa_batch_policy, (uint32_t)policy);
+    return 0;
+}
+
+uint32_t pa_batch_mode(void)
+{
+    return pa_load_acquire_u32(&pa_batcher.mode);
+}
+
+uint64_t pa_batch_switches(void)
+{
+    return pa_load_acquire_u64(&pa_batcher.switches);
+}
@@ -0,0 +1,874 @@
+// Capture store for PairAdmin
+//
+// Every OUTPUT and INPUT event of a session is appended, in order, as a
+// timestamped frame to a memory-mapped segment file; a full segment is
+// left as it is and the next one started. Appending is a memcpy on the
+// producer thread, so the hooks never wait on disk I/O: the kernel
+// writes the pages back on its own schedule.
+//
+// For reading by line the output bytes also go to a line store: mapped
+// text segments in which every line is contiguous, each with a packed
+// array of uint32 line-start offsets that grows down from the end of
+// the mapping as newlines arrive. A line is then a pointer and a length
+// looked up by index, so the last N lines cost N lookups, not a pass
+// over the bytes. A line still open when its text segment fills is
+// copied to the start of the next one, which keeps lines whole.
+//
+// Full segments are no longer written, so a background thread
+// compresses each into an archive (see pairadmin.h) and deletes it,
+// which is most of a day-long capture's disk and page cache. The line
+// store stays uncompressed: readers get spans straight into it.
+//
+// Opening the store creates no files. The first segment is made by the
+// first event and the first text segment by the first output, so a
+// capture opened at startup costs nothing until the session produces.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+// A segment must hold its header and the largest frame
+#define PA_CAPTURE_MIN_SEGMENT (1u << 20)
+#define PA_CAPTURE_MAX_SEGMENT (1u << 30)
+#define PA_CAPTURE_MAX_SEGMENTS 4096
+
+// An open line longer than this fraction of a text segment is ended at
+// the segment boundary instead of being carried over
+#define PA_CAPTURE_CARRY_DIVISOR 4
+
+// How often the compressor looks for a full segment
+#define PA_CAPTURE_COMPRESS_IDLE_US 100000
+
+// Text segment of the line store. Text grows up from the base of the
+// mapping and the line starts grow down from its end.
+typedef struct PaLineSegment {
+    PaFileMap map;
+    uint64_t first_line;        // Line of starts[0]; immutable once published
+    volatile uint64_t used;     // Text bytes
+    volatile uint32_t starts;   // Line starts recorded
+    char path[PA_PATH_MAX + 64];
+} PaLineSegment;
+
+#define PA_LINE_START(seg, k) \
+    (((uint32_t *)((unsigned char *)(seg)->map.base + (seg)->map.size))[-1 - (ptrdiff_t)(k)])
+
+struct PaCapture {
+    // Immutable after open
+    char directory[PA_PATH_MAX];
+    uint32_t session_id;
+    size_t segment_bytes;
+
+    // The open store's own reference plus one per export running; the
+    // last one released destroys the store
+    volatile uint32_t refs;
+
+    // Published by the producer with release; never change once set,
+    // except that the compressor clears a segment it has archived
+    PaFileMap *segments[PA_CAPTURE_MAX_SEGMENTS];
+    PaLineSegment *texts[PA_CAPTURE_MAX_SEGMENTS];
+    volatile uint32_t segment_count;
+    volatile uint32_t text_count;
+    volatile uint64_t line_count;
+
+    // Producer-local
+    PA_ALIGN(PA_CACHE_LINE) PairAdminCaptureSegment *head;
+    PaLineSegment *text;
+    uint64_t lines;
+    int failed;                 // Out of disk or segments: capture stops
+
+    // Compressor thread. Segments before sealed are done with, archived
+    // or left raw; archive_lock is held while one is being archived and
+    // for the whole of an export.
+    PaThread compressor;
+    volatile uint32_t stopping;
+    volatile uint32_t sealed;
+    volatile uint32_t archive_lock;
+    unsigned char archived[PA_CAPTURE_MAX_SEGMENTS];
+};
+
+// Serialises open/close
+static volatile uint32_t pa_capture_lock = 0;
+
+static void pa_capture_mutex_lock(void)
+{
+    while (!pa_atomic_cas_u32(&pa_capture_lock, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_capture_mutex_unlock(void)
+{
+    pa_store_release_u32(&pa_capture_lock, 0);
+}
+
+static void pa_capture_archive_lock(PaCapture *c)
+{
+    while (!pa_atomic_cas_u32(&c->archive_lock, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_capture_archive_unlock(PaCapture *c)
+{
+    pa_store_release_u32(&c->archive_lock, 0);
+}
+
+static void pa_capture_path(const PaCapture *c, uint32_t n, const char *ext, char *path, size_t cap)
+{
+    snprintf(path, cap, "%s" PA_PATH_SEP "pairadmin-%lu-%u-%04u.%s",
+             c->directory, pa_process_id(), (unsigned)c->session_id, (unsigned)n, ext);
+}
+
+// ------------------------------------------------------------
+// Producer side
+// ------------------------------------------------------------
+
+// Start the next segment; the previous one stays mapped for readers
+static int pa_capture_roll(PaCapture *c)
+{
+    uint32_t n = c->segment_count;
+    char path[PA_PATH_MAX + 64];
+    PairAdminCaptureSegment *head;
+    PaFileMap *map;
+
+    if (n == PA_CAPTURE_MAX_SEGMENTS) {
+        return -1;
+    }
+    pa_capture_path(c, n, "pacap", path, sizeof(path));
+
+    map = (PaFileMap *)calloc(1, sizeof(PaFileMap));
+    if (!map || pa_file_map_create(map, path, c->segment_bytes) != 0) {
+        free(map);
+        return -1;
+    }
+
+    head = (PairAdminCaptureSegment *)map->base;
+    memset(head, 0, sizeof(PairAdminCaptureSegment));
+    head->magic = PAIRADMIN_CAPTURE_MAGIC;
+    head->version = PAIRADMIN_CAPTURE_VERSION;
+    head->sequence = n;
+    head->first_line = c->lines;
+    head->used = sizeof(PairAdminCaptureSegment);
+
+    c->segments[n] = map;
+    c->head = head;
+    pa_store_release_u32(&c->segment_count, n + 1);
+    return 0;
+}
+
+// Start the next text segment, carrying the open line over
+static int pa_capture_roll_text(PaCapture *c)
+{
+    uint32_t n = c->text_count;
+    PaLineSegment *prev = c->text;
+    PaLineSegment *seg;
+    size_t carry = 0;
+
+    if (n == PA_CAPTURE_MAX_SEGMENTS) {
+        return -1;
+    }
+
+    seg = (PaLineSegment *)calloc(1, sizeof(PaLineSegment));
+    if (!seg) {
+        return -1;
+    }
+    pa_capture_path(c, n, "palines", seg->path, sizeof(seg->path));
+    if (pa_file_map_create(&seg->map, seg->path, c->segment_bytes) != 0) {
+        free(seg);
+        return -1;
+    }
+
+    if (prev) {
+        uint32_t open = PA_LINE_START(prev, prev->starts - 1);
+
+        carry = (size_t)prev->used - open;
+        if (carry > c->segment_bytes / PA_CAPTURE_CARRY_DIVISOR) {
+            // Too long to carry: it ends here, without a newline
+            carry = 0;
+            c->lines++;
+        } else {
+            memcpy(seg->map.base, (unsigned char *)prev->map.base + open, carry);
+        }
+    }
+
+    seg->first_line = c->lines;
+    seg->used = carry;
+    PA_LINE_START(seg, 0) = 0;
+    seg->starts = 1;
+
+    c->texts[n] = seg;
+    c->text = seg;
+    pa_store_release_u32(&c->text_count, n + 1);
+    return 0;
+}
+
+// Append output to the line store, recording a start after each newline
+static int pa_capture_text(PaCapture *c, const unsigned char *p, size_t len)
+{
+    if (!c->text && pa_capture_roll_text(c) != 0) {
+        return -1;
+    }
+    while (len > 0) {
+        PaLineSegment *seg = c->text;
+        uint64_t used = seg->used;
+        size_t room = c->segment_bytes - (size_t)used - (size_t)(seg->starts + 1) * sizeof(uint32_t);
+        const unsigned char *nl;
+        size_t take;
+
+        if (room == 0 || room > c->segment_bytes) {
+            if (pa_capture_roll_text(c) != 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        take = len < room ? len : room;
+        nl = (const unsigned char *)memchr(p, '\n', take);
+        if (nl) {
+            take = (size_t)(nl - p) + 1;
+        }
+
+        memcpy((unsigned char *)seg->map.base + used, p, take);
+        pa_store_release_u64(&seg->used, used + take);
+        if (nl) {
+            PA_LINE_START(seg, seg->starts) = (uint32_t)(used + take);
+            pa_store_release_u32(&seg->starts, seg->starts + 1);
+            c->lines++;
+        }
+        p += take;
+        len -= take;
+    }
+    return 0;
+}
+
+void pa_capture_append(PaCapture *c, PairAdminEventType event, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t now;
+
+    if (c->failed || !data || len == 0) {
+        return;
+    }
+    now = pa_wall_time_us();
+
+    while (len > 0) {
+        uint32_t chunk = len > PAIRADMIN_MAX_PAYLOAD ? PAIRADMIN_MAX_PAYLOAD : (uint32_t)len;
+        size_t size = PAIRADMIN_CAPTURE_FRAME_SIZE(chunk);
+        PairAdminCaptureFrame *frame;
+        uint64_t used = c->head ? c->head->used : c->segment_bytes;
+
+        if (used + size > c->segment_bytes) {
+            if (pa_capture_roll(c) != 0) {
+                c->failed = 1;
+                return;
+            }
+            used = c->head->used;
+        }
+
+        frame = (PairAdminCaptureFrame *)((unsigned char *)c->head + used);
+        frame->timestamp_us = now;
+        frame->length = chunk;
+        frame->type = (uint16_t)event;
+        frame->flags = 0;
+        memcpy(frame + 1, p, chunk);
+        pa_store_release_u64(&c->head->used, used + size);
+
+        if (event == PAIRADMIN_EVENT_OUTPUT && pa_capture_text(c, p, chunk) != 0) {
+            c->failed = 1;
+        }
+
+        // Text and line starts first, then the count that covers them
+        pa_store_release_u64(&c->line_count, c->lines);
+
+        if (c->failed) {
+            return;
+        }
+        p += chunk;
+        len -= chunk;
+    }
+}
+
+int pa_capture_mapped(PaCapture *c)
+{
+    return pa_load_acquire_u32(&c->segment_count) > 0;
+}
+
+// ------------------------------------------------------------
+// Archives
+// ------------------------------------------------------------
+
+// Write the frames of a segment up to used to f as one archive.
+// Returns the archive's size, or -1 on a write or allocation failure.
+static int64_t pa_capture_write_archive(FILE *f, const PairAdminCaptureSegment *head, uint64_t used)
+{
+    const unsigned char *base = (const unsigned char *)head;
+    size_t bound = pa_lz_bound(PAIRADMIN_ARCHIVE_BLOCK);
+    unsigned char *scratch = (unsigned char *)malloc(bound);
+    PairAdminCaptureBlock *index = NULL;
+    PairAdminCaptureArchive trailer;
+    static const unsigned char zeros[8];
+    uint64_t pos = sizeof(PairAdminCaptureSegment);
+    uint64_t offset = 0;
+    uint32_t count = 0;
+    uint32_t room = 0;
+    int64_t result = -1;
+
+    if (!scratch) {
+        return -1;
+    }
+
+    while (pos < used) {
+        const unsigned char *data = base + pos;
+        uint64_t end = pos;
+        size_t raw;
+        size_t compressed;
+
+        // Whole frames only, so every block starts on a frame
+        while (end < used) {
+            const PairAdminCaptureFrame *frame = (const PairAdminCaptureFrame *)(base + end);
+            uint64_t size = PAIRADMIN_CAPTURE_FRAME_SIZE(frame->length);
+
+            if (end + size > used || (end > pos && end + size - pos > PAIRADMIN_ARCHIVE_BLOCK)) {
+                break;
+            }
+            end += size;
+        }
+        if (end == pos) {
+            break;
+        }
+
+        if (count == room) {
+            uint32_t grown_room = room ? room * 2 : 256;
+            PairAdminCaptureBlock *grown = (PairAdminCaptureBlock *)realloc(
+                index, grown_room * sizeof(PairAdminCaptureBlock));
+
+            if (!grown) {
+                goto done;
+            }
+            index = grown;
+            room = grown_room;
+        }
+
+        raw = (size_t)(end - pos);
+        compressed = pa_lz_compress(data, raw, scratch, bound);
+        if (compressed > 0 && compressed < raw) {
+            data = scratch;
+        } else {
+            compressed = raw;
+        }
+        if (fwrite(data, 1, compressed, f) != compressed) {
+            goto done;
+        }
+
+        index[count].offset = offset;
+        index[count].timestamp_us = ((const PairAdminCaptureFrame *)(base + pos))->timestamp_us;
+        index[count].compressed = (uint32_t)compressed;
+        index[count].raw = (uint32_t)raw;
+        count++;
+        offset += compressed;
+        pos = end;
+    }
+
+    // The index and trailer start 8-aligned, so archives back to back do too
+    if (offset & 7) {
+        size_t pad = 8 - (size_t)(offset & 7);
+
+        if (fwrite(zeros, 1, pad, f) != pad) {
+            goto done;
+        }
+        offset += pad;
+    }
+
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.magic = PAIRADMIN_ARCHIVE_MAGIC;
+    trailer.version = PAIRADMIN_ARCHIVE_VERSION;
+    trailer.sequence = head->sequence;
+    trailer.first_line = head->first_line;
+    trailer.raw_bytes = pos - sizeof(PairAdminCaptureSegment);
+    trailer.index_offset = offset;
+    trailer.archive_bytes = offset + (uint64_t)count * sizeof(PairAdminCaptureBlock) + sizeof(trailer);
+    trailer.block_count = count;
+    if ((count && fwrite(index, sizeof(PairAdminCaptureBlock), count, f) != count) ||
+        fwrite(&trailer, sizeof(trailer), 1, f) != 1) {
+        goto done;
+    }
+    result = (int64_t)trailer.archive_bytes;
+
+done:
+    free(index);
+    free(scratch);
+    return result;
+}
+
+// Replace segment n, which nothing writes to any more, with its archive.
+// On failure the segment is kept as it is.
+static void pa_capture_seal(PaCapture *c, uint32_t n)
+{
+    PaFileMap *map = c->segments[n];
+    const PairAdminCaptureSegment *head = (const PairAdminCaptureSegment *)map->base;
+    uint64_t used = head->used;
+    char path[PA_PATH_MAX + 64];
+    char archive[PA_PATH_MAX + 64];
+    char partial[PA_PATH_MAX + 80];
+    FILE *f;
+    int ok;
+
+    pa_capture_path(c, n, "pacap", path, sizeof(path));
+    pa_capture_path(c, n, "pacapz", archive, sizeof(archive));
+    snprintf(partial, sizeof(partial), "%s.tmp", archive);
+
+    pa_capture_archive_lock(c);
+    f = fopen(partial, "wb");
+    ok = f && pa_capture_write_archive(f, head, used) >= 0;
+    if (f && fclose(f) != 0) {
+        ok = 0;
+    }
+    if (ok && rename(partial, archive) == 0) {
+        c->segments[n] = NULL;
+        c->archived[n] = 1;
+        pa_file_map_close(map, (size_t)used);
+        free(map);
+        remove(path);
+    } else if (f) {
+        remove(partial);
+    }
+    pa_capture_archive_unlock(c);
+
+    pa_store_release_u32(&c->sealed, n + 1);
+}
+
+static void pa_capture_compressor_thread(void *arg)
+{
+    PaCapture *c = (PaCapture *)arg;
+
+    for (;;) {
+        // Read stopping first: once it is set the producer is gone and
+        // the last segment is full too
+        int stopping = pa_load_acquire_u32(&c->stopping) != 0;
+        uint32_t count = pa_load_acquire_u32(&c->segment_count);
+        uint32_t full = stopping || count == 0 ? count : count - 1;
+
+        if (c->sealed < full) {
+            pa_capture_seal(c, c->sealed);
+            continue;
+        }
+        if (stopping) {
+            break;
+        }
+        pa_sleep_us(PA_CAPTURE_COMPRESS_IDLE_US);
+    }
+}
+
+// Append the file at path to f; its size, or -1
+static int64_t pa_capture_copy_file(FILE *f, const char *path)
+{
+    unsigned char buffer[65536];
+    FILE *in = fopen(path, "rb");
+    int64_t total = 0;
+    size_t n;
+
+    if (!in) {
+        return -1;
+    }
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        if (fwrite(buffer, 1, n, f) != n) {
+            fclose(in);
+            return -1;
+        }
+        total += (int64_t)n;
+    }
+    if (ferror(in)) {
+        total = -1;
+    }
+    fclose(in);
+    return total;
+}
+
+static int64_t pa_capture_export(PaCapture *c, FILE *f)
+{
+    uint32_t count = pa_load_acquire_u32(&c->segment_count);
+    int64_t total = 0;
+    uint32_t i;
+
+    pa_capture_archive_lock(c);
+    for (i = 0; i < count; i++) {
+        int64_t n;
+
+        if (c->archived[i]) {
+            char archive[PA_PATH_MAX + 64];
+
+            pa_capture_path(c, i, "pacapz", archive, sizeof(archive));
+            n = pa_capture_copy_file(f, archive);
+        } else {
+            const PairAdminCaptureSegment *head = (const PairAdminCaptureSegment *)c->segments[i]->base;
+
+            // The last segment up to its last whole frame
+            n = pa_capture_write_archive(f, head, pa_load_acquire_u64(&head->used));
+        }
+        if (n < 0) {
+            total = -1;
+            break;
+        }
+        total += n;
+    }
+    pa_capture_archive_unlock(c);
+    return total;
+}
+
+// ------------------------------------------------------------
+// Reader side
+// ------------------------------------------------------------
+
+// Last text segment, of the first count, holding the start of line
+static uint32_t pa_capture_find(PaCapture *c, uint32_t count, uint64_t line)
+{
+    uint32_t lo = 0;
+    uint32_t hi = count;
+
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (c->texts[mid]->first_line <= line) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Bytes of line in text segment seg, newline included. line_count is
+// the caller's snapshot; line line_count is the one still open and runs
+// to its first newline, if one has arrived since, or to the end of text.
+static const unsigned char *pa_capture_line(const PaLineSegment *seg, uint64_t line,
+                                            uint64_t line_count, size_t *len)
+{
+    const unsigned char *base = (const unsigned char *)seg->map.base;
+    uint64_t used = pa_load_acquire_u64(&seg->used);
+    uint32_t starts = pa_load_acquire_u32(&seg->starts);
+    uint32_t k = (uint32_t)(line - seg->first_line);
+    uint32_t start = PA_LINE_START(seg, k);
+
+    if (k + 1 < starts) {
+        *len = PA_LINE_START(seg, k + 1) - start;
+    } else if (line < line_count) {
+        // Ended at the segment boundary
+        *len = (size_t)used - start;
+    } else {
+        const unsigned char *nl = (const unsigned char *)memchr(base + start, '\n',
+                                                                (size_t)used - start);
+
+        *len = nl ? (size_t)(nl - (base + start)) + 1 : (size_t)used - start;
+    }
+    return base + start;
+}
+
+static size_t pa_capture_read(PaCapture *c, uint64_t first_line, uint32_t count,
+                              void *buf, size_t cap, uint32_t *lines)
+{
+    uint64_t line_count = pa_load_acquire_u64(&c->line_count);
+    uint32_t text_count = pa_load_acquire_u32(&c->text_count);
+    unsigned char *out = (unsigned char *)buf;
+    uint64_t last = first_line + count;
+    size_t written = 0;
+    uint32_t copied = 0;
+    uint32_t segment;
+    uint64_t line;
+
+    // Line line_count is the one still being written
+    if (text_count == 0 || first_line > line_count || count == 0 || cap == 0) {
+        goto done;
+    }
+    if (last > line_count + 1) {
+        last = line_count + 1;
+    }
+
+    segment = pa_capture_find(c, text_count, first_line);
+    for (line = first_line; line < last; line++) {
+        const unsigned char *p;
+        size_t len;
+
+        while (segment + 1 < text_count && c->texts[segment + 1]->first_line <= line) {
+            segment++;
+        }
+        p = pa_capture_line(c->texts[segment], line, line_count, &len);
+        if (len == 0) {
+            break;
+        }
+        if (written + len > cap) {
+            // Whole lines only, except a first line longer than cap
+            if (copied == 0) {
+                memcpy(out, p, cap);
+                written = cap;
+                copied = 1;
+            }
+            break;
+        }
+        memcpy(out + written, p, len);
+        written += len;
+        copied++;
+    }
+
+done:
+    if (lines) {
+        *lines = copied;
+    }
+    return written;
+}
+
+static uint32_t pa_capture_last(PaCapture *c, uint32_t n, PairAdminLineSpan *spans)
+{
+    uint64_t line_count = pa_load_acquire_u64(&c->line_count);
+    uint32_t text_count = pa_load_acquire_u32(&c->text_count);
+    uint32_t segment;
+    uint64_t first;
+    uint64_t line;
+    uint32_t out = 0;
+    size_t open = 0;
+
+    if (n == 0 || text_count == 0) {
+        return 0;
+    }
+
+    // The open line counts as the newest when it has text
+    segment = pa_capture_find(c, text_count, line_count);
+    pa_capture_line(c->texts[segment], line_count, line_count, &open);
+    first = line_count + (open > 0) > n ? line_count + (open > 0) - n : 0;
+
+    segment = pa_capture_find(c, text_count, first);
+    for (line = first; line <= line_count && out < n; line++) {
+        const unsigned char *p;
+        size_t len;
+
+        while (segment + 1 < text_count && c->texts[segment + 1]->first_line <= line) {
+            segment++;
+        }
+        p = pa_capture_line(c->texts[segment], line, line_count, &len);
+        if (line == line_count && len == 0) {
+            break;
+        }
+        spans[out].flags = line == line_count && (len == 0 || p[len - 1] != '\n')
+                               ? PAIRADMIN_LINE_OPEN : 0;
+        if (len > 0 && p[len - 1] == '\n') {
+            len--;
+        }
+        if (len > 0 && p[len - 1] == '\r') {
+            len--;
+        }
+        spans[out].data = (const char *)p;
+        spans[out].length = (uint32_t)len;
+        out++;
+    }
+    return out;
+}
+
+static void pa_capture_destroy(PaCapture *c)
+{
+    uint32_t i;
+
+    // The compressor archives what is left, the last segment included
+    pa_store_release_u32(&c->stopping, 1);
+    pa_thread_join(&c->compressor);
+
+    for (i = 0; i < c->segment_count; i++) {
+        PaFileMap *map = c->segments[i];
+
+        if (map) {
+            pa_file_map_close(map, (size_t)((PairAdminCaptureSegment *)map->base)->used);
+            free(map);
+        }
+    }
+    // The line store is only an index over the captured output
+    for (i = 0; i < c->text_count; i++) {
+        PaLineSegment *seg = c->texts[i];
+
+        pa_file_map_close(&seg->map, 0);
+        remove(seg->path);
+        free(seg);
+    }
+    pa_aligned_free(c);
+}
+
+static void pa_capture_release(PaCapture *c)
+{
+    if (pa_atomic_dec_u32(&c->refs) == 0) {
+        pa_capture_destroy(c);
+    }
+}
+
+// ------------------------------------------------------------
+// Control
+// ------------------------------------------------------------
+
+int pairadmin_capture_open(PairAdminSession *session, const char *directory, size_t segment_bytes)
+{
+    PaCapture *volatile *slot = pa_session_capture_slot(session);
+    PaCapture *c;
+
+    pa_capture_mutex_lock();
+    if (*slot) {
+        pa_capture_mutex_unlock();
+        return 0;
+    }
+
+    c = (PaCapture *)pa_aligned_alloc(sizeof(PaCapture));
+    if (!c) {
+        pa_capture_mutex_unlock();
+        return -1;
+    }
+    memset(c, 0, sizeof(PaCapture));
+
+    if (directory && *directory) {
+        if (strlen(directory) >= sizeof(c->directory)) {
+            goto fail;
+        }
+        strcpy(c->directory, directory);
+    } else if (pa_temp_dir(c->directory, sizeof(c->directory)) != 0) {
+        goto fail;
+    }
+
+    if (segment_bytes == 0) {
+        segment_bytes = PAIRADMIN_CAPTURE_DEFAULT_SEGMENT;
+    }
+    if (segment_bytes < PA_CAPTURE_MIN_SEGMENT) {
+        segment_bytes = PA_CAPTURE_MIN_SEGMENT;
+    }
+    if (segment_bytes > PA_CAPTURE_MAX_SEGMENT) {
+        segment_bytes = PA_CAPTURE_MAX_SEGMENT;
+    }
+    c->segment_bytes = PA_ALIGN_UP(segment_bytes, 8);
+    c->session_id = pairadmin_session_get_id(session);
+    c->refs = 1;
+
+    // Segments are made on first use; only check they can be
+    if (!pa_dir_exists(c->directory) ||
+        pa_thread_start(&c->compressor, pa_capture_compressor_thread, c) != 0) {
+        goto fail;
+    }
+
+    pa_store_release_ptr((void *volatile *)slot, c);
+    pa_capture_mutex_unlock();
+    return 0;
+
+fail:
+    pa_capture_destroy(c);
+    pa_capture_mutex_unlock();
+    return -1;
+}
+
+void pairadmin_capture_close(PairAdminSession *session)
+{
+    PaCapture *volatile *slot = pa_session_capture_slot(session);
+    PaCapture *c;
+
+    pa_capture_mutex_lock();
+    c = (PaCapture *)pa_atomic_xchg_ptr((void *volatile *)slot, NULL);
+    pa_capture_mutex_unlock();
+
+    if (c) {
+        // Hooks and readers use the store inside an epoch section; an
+        // export still writing holds a reference of its own
+        pa_epoch_synchronize();
+        pa_capture_release(c);
+    }
+}
+
+int64_t pairadmin_capture_export(PairAdminSession *session, const char *path)
+{
+    PaCapture *volatile *slot = pa_session_capture_slot(session);
+    int64_t written = -1;
+    uint32_t epoch;
+    PaCapture *c;
+    FILE *f;
+
+    if (!path) {
+        return -1;
+    }
+
+    // Only the reference is taken inside the epoch section: compressing
+    // and writing would hold up every pa_epoch_synchronize() meanwhile
+    epoch = pa_epoch_enter();
+    c = (PaCapture *)pa_load_acquire_ptr((void *const volatile *)slot);
+    if (c) {
+        pa_atomic_inc_u32(&c->refs);
+    }
+    pa_epoch_exit(epoch);
+    if (!c) {
+        return -1;
+    }
+
+    if ((f = fopen(path, "wb")) != NULL) {
+        written = pa_capture_export(c, f);
+        if (fclose(f) != 0) {
+            written = -1;
+        }
+        if (written < 0) {
+            remove(path);
+        }
+    }
+    pa_capture_release(c);
+    return written;
+}
+
+uint64_t pairadmin_log_line_count(PairAdminSession *session)
+{
+    PaCapture *volatile *slot = pa_session_capture_slot(session);
+    uint64_t count = 0;
+    uint32_t epoch;
+    PaCapture *c;
+
+    epoch = pa_epoch_enter();
+    c = (PaCapture *)pa_load_acquire_ptr((void *const volatile *)slot);
+    if (c) {
+        count = pa_load_acquire_u64(&c->line_count);
+    }
+    pa_epoch_exit(epoch);
+    return count;
+}
+
+size_t pairadmin_log_read_range(PairAdminSession *session, uint64_t first_line, uint32_t count,
+                                void *buf, size_t cap, uint32_t *lines)
+{
+    PaCapture *volatile *slot = pa_session_capture_slot(session);
+    size_t written = 0;
+    uint32_t epoch;
+    PaCapture *c;
+
+    if (lines) {
+        *lines = 0;
+    }
+    if (!buf) {
+        return 0;
+    }
+
+    epoch = pa_epoch_enter();
+    c = (PaCapture *)pa_load_acquire_ptr((void *const volatile *)slot);
+    if (c) {
+        written = pa_capture_read(c, first_line, count, buf, cap, lines);
+    }
+    pa_epoch_exit(epoch);
+    return written;
+}
+
+uint32_t pairadmin_get_last_lines(PairAdminSession *session, uint32_t n, PairAdminLineSpan *out_spans)
+{
+    PaCapture *volatile *slot = pa_session_capture_slot(session);
+    uint32_t count = 0;
+    uint32_t epoch;
+    PaCapture *c;
+
+    if (!out_spans) {
+        return 0;
+    }
+
+    epoch = pa_epoch_enter();
+    c = (PaCapture *)pa_load_acquire_ptr((void *const volatile *)slot);
+    if (c) {
+        count = pa_capture_last(c, n, out_spans);
+    }
+    pa_epoch_exit(epoch);
+    return count;
+}
@@ -0,0 +1,215 @@
+// Block compression for PairAdmin
+//
+// A byte-compatible LZ4 block codec, small enough to carry instead of a
+// dependency: a sequence is a token (literal count, match length - 4),
+// longer counts continued in 255s, the literals, and a 16-bit offset
+// back into what has been decoded. Terminal output is prompts, paths
+// and tables repeated over and over, so even this greedy single-probe
+// matcher gets it down five to ten times. Compression runs on the
+// capture store's background thread only; decoding is bounds-checked
+// throughout, since archives are read back from disk.
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#define PA_LZ_HASH_BITS 12
+#define PA_LZ_MIN_MATCH 4
+#define PA_LZ_MAX_OFFSET 65535
+
+// The format ends every block with at least 5 literals, and no match
+// starts in the last 12 bytes
+#define PA_LZ_LAST_LITERALS 5
+#define PA_LZ_MATCH_LIMIT 12
+
+// Probe further apart the longer nothing has matched, so incompressible
+// input costs little
+#define PA_LZ_SKIP_SHIFT 6
+
+PA_INLINE uint32_t pa_lz_read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+PA_INLINE uint32_t pa_lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - PA_LZ_HASH_BITS);
+}
+
+static unsigned char *pa_lz_put_length(unsigned char *op, size_t n)
+{
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+size_t pa_lz_bound(size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+size_t pa_lz_compress(const void *src, size_t len, void *dst, size_t cap)
+{
+    const unsigned char *in = (const unsigned char *)src;
+    const unsigned char *end = in + len;
+    const unsigned char *ip = in;
+    const unsigned char *anchor = in;
+    unsigned char *out = (unsigned char *)dst;
+    unsigned char *op = out;
+    size_t literals;
+    uint32_t table[1u << PA_LZ_HASH_BITS];
+
+    // Positions are offsets from in; a stale or zero entry is caught by
+    // comparing the bytes
+    memset(table, 0, sizeof(table));
+
+    if (len > PA_LZ_MATCH_LIMIT) {
+        const unsigned char *match_start_limit = end - PA_LZ_MATCH_LIMIT;
+        const unsigned char *match_end_limit = end - PA_LZ_LAST_LITERALS;
+
+        while (ip < match_start_limit) {
+            uint32_t v = pa_lz_read32(ip);
+            uint32_t h = pa_lz_hash(v);
+            const unsigned char *ref = in + table[h];
+            const unsigned char *m;
+            size_t match;
+            size_t offset;
+            unsigned char *token;
+
+            table[h] = (uint32_t)(ip - in);
+            if (ref >= ip || (size_t)(ip - ref) > PA_LZ_MAX_OFFSET || pa_lz_read32(ref) != v) {
+                ip += 1 + ((size_t)(ip - anchor) >> PA_LZ_SKIP_SHIFT);
+                continue;
+            }
+
+            m = ip + PA_LZ_MIN_MATCH;
+            ref += PA_LZ_MIN_MATCH;
+            while (m < match_end_limit && *m == *ref) {
+                m++;
+                ref++;
+            }
+
+            literals = (size_t)(ip - anchor);
+            match = (size_t)(m - ip) - PA_LZ_MIN_MATCH;
+            offset = (size_t)(m - ref);
+            if ((size_t)(out + cap - op) < 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1) {
+                return 0;
+            }
+
+            token = op++;
+            *token = (unsigned char)((literals >= 15 ? 15 : literals) << 4);
+            if (literals >= 15) {
+                op = pa_lz_put_length(op, literals - 15);
+            }
+            memcpy(op, anchor, literals);
+            op += literals;
+            *op++ = (unsigned char)offset;
+            *op++ = (unsigned char)(offset >> 8);
+            *token |= (unsigned char)(match >= 15 ? 15 : match);
+            if (match >= 15) {
+                op = pa_lz_put_length(op, match - 15);
+            }
+
+            // One position inside the match, so the next repeat of it is found
+            table[pa_lz_hash(pa_lz_read32(m - 2))] = (uint32_t)(m - 2 - in);
+            ip = anchor = m;
+        }
+    }
+
+    literals = (size_t)(end - anchor);
+    if ((size_t)(out + cap - op) < 1 + literals / 255 + 1 + literals) {
+        return 0;
+    }
+    *op++ = (unsigned char)((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) {
+        op = pa_lz_put_length(op, literals - 15);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+    return (size_t)(op - out);
+}
+
+// Continued length, or -1 if it runs past the input
+static int pa_lz_get_length(const unsigned char **ip, const unsigned char *end, size_t *n)
+{
+    unsigned char b;
+
+    do {
+        if (*ip >= end) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+int64_t pa_lz_decompress(const void *src, size_t len, void *dst, size_t cap)
+{
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *end = ip + len;
+    unsigned char *out = (unsigned char *)dst;
+    unsigned char *op = out;
+
+    while (ip < end) {
+        unsigned token = *ip++;
+        size_t literals = token >> 4;
+        size_t match = token & 15;
+        size_t offset;
+
+        if (literals == 15 && pa_lz_get_length(&ip, end, &literals) != 0) {
+            return -1;
+        }
+        if (literals > (size_t)(end - ip) || literals > cap - (size_t)(op - out)) {
+            return -1;
+        }
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+        if (ip == end) {
+            // The last sequence has no match
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+        offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (match == 15 && pa_lz_get_length(&ip, end, &match) != 0) {
+            return -1;
+        }
+        match += PA_LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - out) || match > cap - (size_t)(op - out)) {
+            return -1;
+        }
+
+        if (offset >= match) {
+            memcpy(op, op - offset, match);
+            op += match;
+        } else {
+            // Overlapping: a run repeating the last offset bytes
+            const unsigned char *ref = op - offset;
+
+            while (match--) {
+                *op++ = *ref++;
+            }
+        }
+    }
+    return (int64_t)(op - out);
+}
+
+int64_t pairadmin_capture_decompress(const void *src, size_t len, void *dst, size_t cap)
+{
+    if (!src || !dst) {
+        return -1;
+    }
+    return pa_lz_decompress(src, len, dst, cap);
+}
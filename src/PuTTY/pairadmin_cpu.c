@@ -0,0 +1,125 @@
+// Runtime CPU feature detection for PairAdmin
+//
+// One DLL serves old jump hosts and current workstations, so the vector
+// kernels are not chosen by compiler flags. The CPU is asked once, on
+// first use, and the kernels in pairadmin_scan.c branch on the result.
+// pairadmin_set_cpu_features() narrows the set for benchmarks and for
+// checking the fallbacks on a machine that has everything.
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PA_CPU_X86 1
+#if !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+#endif
+
+// Not yet detected
+#define PA_CPU_UNKNOWN 0x80000000u
+
+static volatile uint32_t pa_cpu_detected = PA_CPU_UNKNOWN;
+static volatile uint32_t pa_cpu_allowed = PAIRADMIN_CPU_ALL;
+
+#if defined(PA_CPU_X86)
+
+static void pa_cpuid(uint32_t leaf, uint32_t sub, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+
+    __cpuidex(r, (int)leaf, (int)sub);
+    regs[0] = (uint32_t)r[0];
+    regs[1] = (uint32_t)r[1];
+    regs[2] = (uint32_t)r[2];
+    regs[3] = (uint32_t)r[3];
+#else
+    if (!__get_cpuid_count(leaf, sub, &regs[0], &regs[1], &regs[2], &regs[3])) {
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    }
+#endif
+}
+
+// XCR0: which register states the OS saves on a context switch
+static uint64_t pa_xgetbv(void)
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo;
+    uint32_t hi;
+
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+static uint32_t pa_cpu_detect(void)
+{
+    uint32_t regs[4];
+    uint32_t features = 0;
+    uint32_t max_leaf;
+
+    pa_cpuid(0, 0, regs);
+    max_leaf = regs[0];
+    if (max_leaf < 1) {
+        return 0;
+    }
+
+    pa_cpuid(1, 0, regs);
+    if (regs[3] & (1u << 26)) {
+        features |= PAIRADMIN_CPU_SSE2;
+    }
+
+    // AVX2 needs the instructions and an OS that saves the YMM state
+    // (OSXSAVE set and XCR0 covering XMM and YMM)
+    if ((regs[2] & (1u << 27)) && (regs[2] & (1u << 28)) && (pa_xgetbv() & 0x6) == 0x6 &&
+        max_leaf >= 7) {
+        pa_cpuid(7, 0, regs);
+        if (regs[1] & (1u << 5)) {
+            features |= PAIRADMIN_CPU_AVX2;
+        }
+    }
+    return features;
+}
+
+#elif defined(_M_ARM64) || defined(__aarch64__)
+
+// Advanced SIMD is part of the AArch64 base architecture
+static uint32_t pa_cpu_detect(void)
+{
+    return PAIRADMIN_CPU_NEON;
+}
+
+#else
+
+static uint32_t pa_cpu_detect(void)
+{
+    return 0;
+}
+
+#endif
+
+uint32_t pa_cpu_features(void)
+{
+    uint32_t detected = pa_load_acquire_u32(&pa_cpu_detected);
+
+    if (detected == PA_CPU_UNKNOWN) {
+        // Racing first callers compute the same answer
+        detected = pa_cpu_detect();
+        pa_store_release_u32(&pa_cpu_detected, detected);
+    }
+    return detected & pa_load_acquire_u32(&pa_cpu_allowed);
+}
+
+uint32_t pairadmin_get_cpu_features(void)
+{
+    return pa_cpu_features();
+}
+
+uint32_t pairadmin_set_cpu_features(uint32_t mask)
+{
+    pa_store_release_u32(&pa_cpu_allowed, mask & PAIRADMIN_CPU_ALL);
+    return pa_cpu_features();
+}
@@ -0,0 +1,477 @@
+// Command digests for PairAdmin
+//
+// A command's output matters mostly at its ends: what it started doing
+// and how it finished. With the command marks in place, the output of
+// each command is followed line by line as it arrives, the first lines
+// kept whole, the last ones in a ring of fixed slots and everything in
+// between only counted. A finished command is packed into one record
+// holding just what was kept; the last few records stay in a ring of
+// their own. So the store never holds more than the lines it was asked
+// for, however long the build log, and a context builder copies out a
+// digest without the output ever reaching managed memory.
+//
+// The producer holds the store's spin lock for one fragment at a time
+// and for packing a record, readers for one copy.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+// One finished command: info, then its text
+typedef struct PaDigestRecord {
+    PairAdminDigestInfo info;
+} PaDigestRecord;
+
+struct PaDigest {
+    volatile uint32_t lock;
+
+    uint32_t head_max;          // Lines
+    uint32_t tail_max;
+    uint32_t capacity;          // Records
+    PaDigestRecord **records;   // Ring, by sequence
+    uint64_t sequence;          // Newest command started
+
+    // The command line submitted last, taken up by the next start
+    uint32_t pending_flags;
+    uint32_t pending_len;
+    unsigned char pending[PAIRADMIN_DIGEST_COMMAND_MAX];
+
+    // The running command, if current.flags has PAIRADMIN_DIGEST_RUNNING
+    PairAdminDigestInfo current;
+    unsigned char command[PAIRADMIN_DIGEST_COMMAND_MAX];
+    unsigned char *head;        // head_max lines, each with its '\n'
+    uint32_t head_lines;
+    unsigned char *tail;        // tail_max slots of PAIRADMIN_DIGEST_LINE_MAX
+    uint32_t *tail_len;
+    uint32_t tail_first;
+    uint32_t tail_count;
+
+    // Line being assembled; line_len bytes kept of line_bytes
+    uint32_t line_len;
+    uint64_t line_bytes;
+    unsigned char line[PAIRADMIN_DIGEST_LINE_MAX];
+
+    PaVtParser vt;
+    unsigned char scratch[PAIRADMIN_MAX_PAYLOAD];
+};
+
+static volatile uint32_t pa_digest_slots_lock = 0;
+
+static void pa_digest_lock(volatile uint32_t *lock)
+{
+    while (!pa_atomic_cas_u32(lock, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_digest_unlock(volatile uint32_t *lock)
+{
+    pa_store_release_u32(lock, 0);
+}
+
+PA_INLINE PaDigestRecord **pa_digest_slot(PaDigest *d, uint64_t sequence)
+{
+    return &d->records[(sequence - 1) % d->capacity];
+}
+
+PA_INLINE unsigned char *pa_digest_tail_line(PaDigest *d, uint32_t i)
+{
+    return d->tail + (size_t)((d->tail_first + i) % d->tail_max) * PAIRADMIN_DIGEST_LINE_MAX;
+}
+
+PA_INLINE uint32_t pa_digest_tail_length(const PaDigest *d, uint32_t i)
+{
+    return d->tail_len[(d->tail_first + i) % d->tail_max];
+}
+
+// ------------------------------------------------------------
+// Following a command
+// ------------------------------------------------------------
+
+// Bytes of the running command's text with the open line as it is
+static size_t pa_digest_current_text(const PaDigest *d, size_t *tail_length)
+{
+    size_t tail = d->line_len;
+    uint32_t i;
+
+    for (i = 0; i < d->tail_count; i++) {
+        tail += pa_digest_tail_length(d, i) + 1;
+    }
+    *tail_length = tail;
+    return d->current.command_length + d->current.head_length + tail;
+}
+
+// The line in d->line is complete; under the lock
+static void pa_digest_line_end(PaDigest *d)
+{
+    uint32_t n = d->line_len;
+
+    d->current.lines++;
+    if (d->line_bytes > n) {
+        d->current.flags |= PAIRADMIN_DIGEST_CUT;
+    }
+
+    if (d->head_lines < d->head_max) {
+        unsigned char *at = d->head + d->current.head_length;
+
+        memcpy(at, d->line, n);
+        at[n] = '\n';
+        d->current.head_length += n + 1;
+        d->head_lines++;
+    } else if (d->tail_max > 0) {
+        uint32_t slot;
+
+        if (d->tail_count == d->tail_max) {
+            // The oldest tail line drops into the gap
+            d->tail_first = (d->tail_first + 1) % d->tail_max;
+            d->tail_count--;
+            d->current.elided_lines++;
+        }
+        slot = (d->tail_first + d->tail_count) % d->tail_max;
+        memcpy(d->tail + (size_t)slot * PAIRADMIN_DIGEST_LINE_MAX, d->line, n);
+        d->tail_len[slot] = n;
+        d->tail_count++;
+    } else {
+        d->current.elided_lines++;
+    }
+    d->line_len = 0;
+    d->line_bytes = 0;
+}
+
+// Escape-free text of the running command; under the lock
+static void pa_digest_text(PaDigest *d, const unsigned char *p, size_t n)
+{
+    d->current.text_bytes += n;
+    while (n > 0) {
+        const unsigned char *nl = (const unsigned char *)memchr(p, '\n', n);
+        size_t run = nl ? (size_t)(nl - p) : n;
+        size_t keep = PAIRADMIN_DIGEST_LINE_MAX - d->line_len;
+
+        keep = run < keep ? run : keep;
+        memcpy(d->line + d->line_len, p, keep);
+        d->line_len += (uint32_t)keep;
+        d->line_bytes += run;
+        if (!nl) {
+            break;
+        }
+        pa_digest_line_end(d);
+        p += run + 1;
+        n -= run + 1;
+    }
+}
+
+static void pa_digest_start(PaDigest *d, const PairAdminMarkInfo *mark)
+{
+    pa_digest_lock(&d->lock);
+    memset(&d->current, 0, sizeof(d->current));
+    d->current.sequence = ++d->sequence;
+    d->current.start_offset = mark->offset;
+    d->current.exit_code = PAIRADMIN_EXIT_UNKNOWN;
+    d->current.flags = PAIRADMIN_DIGEST_RUNNING | d->pending_flags;
+    d->current.command_length = d->pending_len;
+    memcpy(d->command, d->pending, d->pending_len);
+    d->head_lines = 0;
+    d->tail_first = 0;
+    d->tail_count = 0;
+    d->line_len = 0;
+    d->line_bytes = 0;
+    pa_digest_unlock(&d->lock);
+
+    d->pending_flags = PAIRADMIN_DIGEST_INEXACT;
+    d->pending_len = 0;
+    pa_vt_reset(&d->vt);
+}
+
+// Pack the running command into its record. Without memory for it the
+// command is skipped; the next start reuses the buffers either way.
+static void pa_digest_finish(PaDigest *d, uint64_t end_offset, int32_t exit_code)
+{
+    PaDigestRecord *record;
+    PaDigestRecord *old = NULL;
+    size_t tail_length;
+    size_t text;
+
+    if (d->line_bytes > 0) {
+        // An unterminated last line counts as a line
+        pa_digest_lock(&d->lock);
+        d->current.text_bytes++;
+        pa_digest_line_end(d);
+        pa_digest_unlock(&d->lock);
+    }
+    // Only the producer writes what is packed, so it reads it unlocked
+    text = pa_digest_current_text(d, &tail_length);
+    record = (PaDigestRecord *)malloc(sizeof(PaDigestRecord) + text);
+
+    pa_digest_lock(&d->lock);
+    d->current.end_offset = end_offset;
+    d->current.exit_code = exit_code;
+    d->current.flags &= ~PAIRADMIN_DIGEST_RUNNING;
+    d->current.tail_length = (uint32_t)tail_length;
+    d->current.elided_bytes = d->current.text_bytes - d->current.head_length - tail_length;
+    if (record) {
+        unsigned char *out = (unsigned char *)(record + 1);
+        uint32_t i;
+
+        record->info = d->current;
+        memcpy(out, d->command, d->current.command_length);
+        out += d->current.command_length;
+        memcpy(out, d->head, d->current.head_length);
+        out += d->current.head_length;
+        for (i = 0; i < d->tail_count; i++) {
+            uint32_t n = pa_digest_tail_length(d, i);
+
+            memcpy(out, pa_digest_tail_line(d, i), n);
+            out[n] = '\n';
+            out += n + 1;
+        }
+        old = *pa_digest_slot(d, d->current.sequence);
+        *pa_digest_slot(d, d->current.sequence) = record;
+    }
+    pa_digest_unlock(&d->lock);
+    free(old);
+}
+
+void pa_digest_feed(PaDigest *d, PairAdminEventType event, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    PairAdminMarkInfo mark;
+
+    switch (event) {
+    case PAIRADMIN_EVENT_OUTPUT:
+        if (!(d->current.flags & PAIRADMIN_DIGEST_RUNNING)) {
+            return;
+        }
+        pa_digest_lock(&d->lock);
+        d->current.output_bytes += len;
+        while (len > 0) {
+            size_t chunk = len > sizeof(d->scratch) ? sizeof(d->scratch) : len;
+
+            pa_digest_text(d, d->scratch, pa_vt_strip(&d->vt, p, chunk, d->scratch));
+            p += chunk;
+            len -= chunk;
+        }
+        pa_digest_unlock(&d->lock);
+        return;
+
+    case PAIRADMIN_EVENT_COMMAND:
+        if (len >= sizeof(PairAdminCommandInfo)) {
+            PairAdminCommandInfo info;
+            size_t n;
+
+            memcpy(&info, p, sizeof(info));
+            n = len - sizeof(info) < info.length ? len - sizeof(info) : info.length;
+            n = n < PAIRADMIN_DIGEST_COMMAND_MAX ? n : PAIRADMIN_DIGEST_COMMAND_MAX;
+            memcpy(d->pending, p + sizeof(info), n);
+            d->pending_len = (uint32_t)n;
+            d->pending_flags = ((info.flags & (PAIRADMIN_COMMAND_INEXACT | PAIRADMIN_COMMAND_TRUNCATED)) ||
+                                n < info.length) ? PAIRADMIN_DIGEST_INEXACT : 0;
+        }
+        return;
+
+    case PAIRADMIN_EVENT_COMMAND_START:
+        if (len >= sizeof(mark)) {
+            memcpy(&mark, p, sizeof(mark));
+            if (d->current.flags & PAIRADMIN_DIGEST_RUNNING) {
+                // No end was seen for the last one
+                pa_digest_finish(d, mark.offset, PAIRADMIN_EXIT_UNKNOWN);
+            }
+            pa_digest_start(d, &mark);
+        }
+        return;
+
+    case PAIRADMIN_EVENT_COMMAND_END:
+        if (len >= sizeof(mark) && (d->current.flags & PAIRADMIN_DIGEST_RUNNING)) {
+            memcpy(&mark, p, sizeof(mark));
+            pa_digest_finish(d, mark.offset, mark.exit_code);
+        }
+        // Lines typed while it ran were not commands of the shell
+        d->pending_len = 0;
+        d->pending_flags = PAIRADMIN_DIGEST_INEXACT;
+        return;
+
+    default:
+        return;
+    }
+}
+
+// ------------------------------------------------------------
+// Lifetime
+// ------------------------------------------------------------
+
+static uint32_t pa_digest_clamp(uint32_t v, uint32_t fallback, uint32_t max)
+{
+    if (v == 0) {
+        return fallback;
+    }
+    return v > max ? max : v;
+}
+
+static void pa_digest_free(PaDigest *d)
+{
+    uint32_t i;
+
+    if (d) {
+        for (i = 0; d->records && i < d->capacity; i++) {
+            free(d->records[i]);
+        }
+        free(d->records);
+        free(d->head);
+        free(d->tail);
+        free(d->tail_len);
+        free(d);
+    }
+}
+
+int pairadmin_digest_open(PairAdminSession *session, uint32_t head_lines, uint32_t tail_lines,
+                          uint32_t commands)
+{
+    PaDigest *volatile *slot = pa_session_digest_slot(session);
+    PaDigest *d;
+
+    pa_digest_lock(&pa_digest_slots_lock);
+    if (*slot) {
+        pa_digest_unlock(&pa_digest_slots_lock);
+        return 0;
+    }
+
+    d = (PaDigest *)calloc(1, sizeof(PaDigest));
+    if (d) {
+        d->head_max = pa_digest_clamp(head_lines, PAIRADMIN_DIGEST_DEFAULT_LINES, PAIRADMIN_DIGEST_MAX_LINES);
+        d->tail_max = pa_digest_clamp(tail_lines, PAIRADMIN_DIGEST_DEFAULT_LINES, PAIRADMIN_DIGEST_MAX_LINES);
+        d->capacity = pa_digest_clamp(commands, PAIRADMIN_DIGEST_DEFAULT_COMMANDS, PAIRADMIN_DIGEST_MAX_COMMANDS);
+        d->records = (PaDigestRecord **)calloc(d->capacity, sizeof(PaDigestRecord *));
+        d->head = (unsigned char *)malloc((size_t)d->head_max * (PAIRADMIN_DIGEST_LINE_MAX + 1));
+        d->tail = (unsigned char *)malloc((size_t)d->tail_max * PAIRADMIN_DIGEST_LINE_MAX);
+        d->tail_len = (uint32_t *)calloc(d->tail_max, sizeof(uint32_t));
+        d->pending_flags = PAIRADMIN_DIGEST_INEXACT;
+    }
+    if (!d || !d->records || !d->head || !d->tail || !d->tail_len) {
+        pa_digest_free(d);
+        pa_digest_unlock(&pa_digest_slots_lock);
+        return -1;
+    }
+
+    pa_store_release_ptr((void *volatile *)slot, d);
+    pa_digest_unlock(&pa_digest_slots_lock);
+    return 0;
+}
+
+void pairadmin_digest_close(PairAdminSession *session)
+{
+    PaDigest *volatile *slot = pa_session_digest_slot(session);
+    PaDigest *d;
+
+    pa_digest_lock(&pa_digest_slots_lock);
+    d = (PaDigest *)pa_atomic_xchg_ptr((void *volatile *)slot, NULL);
+    pa_digest_unlock(&pa_digest_slots_lock);
+
+    if (d) {
+        // The hooks and readers use the store inside an epoch section
+        pa_epoch_synchronize();
+        pa_digest_free(d);
+    }
+}
+
+// ------------------------------------------------------------
+// Reading
+// ------------------------------------------------------------
+
+uint64_t pairadmin_digest_latest(PairAdminSession *session)
+{
+    PaDigest *volatile *slot = pa_session_digest_slot(session);
+    uint64_t sequence = 0;
+    uint32_t epoch;
+    PaDigest *d;
+
+    epoch = pa_epoch_enter();
+    d = (PaDigest *)pa_load_acquire_ptr((void *const volatile *)slot);
+    if (d) {
+        pa_digest_lock(&d->lock);
+        sequence = d->sequence;
+        pa_digest_unlock(&d->lock);
+    }
+    pa_epoch_exit(epoch);
+    return sequence;
+}
+
+// The running command as a reader sees it; under the lock
+static int pa_digest_copy_current(PaDigest *d, PairAdminDigestInfo *info, unsigned char *out,
+                                  size_t cap, size_t *written)
+{
+    size_t tail_length;
+    size_t text = pa_digest_current_text(d, &tail_length);
+    uint32_t i;
+
+    *written = text;
+    if (!out || text > cap) {
+        return -1;
+    }
+
+    if (info) {
+        *info = d->current;
+        info->tail_length = (uint32_t)tail_length;
+        info->elided_bytes = d->current.text_bytes - d->current.head_length - tail_length;
+    }
+    memcpy(out, d->command, d->current.command_length);
+    out += d->current.command_length;
+    memcpy(out, d->head, d->current.head_length);
+    out += d->current.head_length;
+    for (i = 0; i < d->tail_count; i++) {
+        uint32_t n = pa_digest_tail_length(d, i);
+
+        memcpy(out, pa_digest_tail_line(d, i), n);
+        out[n] = '\n';
+        out += n + 1;
+    }
+    memcpy(out, d->line, d->line_len);
+    return 0;
+}
+
+int pairadmin_get_command_digest(PairAdminSession *session, uint64_t sequence,
+                                 PairAdminDigestInfo *info, void *buf, size_t cap, size_t *written)
+{
+    PaDigest *volatile *slot = pa_session_digest_slot(session);
+    unsigned char *out = (unsigned char *)buf;
+    size_t used = 0;
+    int result = -1;
+    uint32_t epoch;
+    PaDigest *d;
+
+    if (info) {
+        memset(info, 0, sizeof(*info));
+    }
+
+    epoch = pa_epoch_enter();
+    d = (PaDigest *)pa_load_acquire_ptr((void *const volatile *)slot);
+    if (d && sequence > 0) {
+        pa_digest_lock(&d->lock);
+        if (sequence == d->current.sequence && (d->current.flags & PAIRADMIN_DIGEST_RUNNING)) {
+            result = pa_digest_copy_current(d, info, out, cap, &used);
+        } else if (sequence <= d->sequence && d->sequence - sequence < d->capacity) {
+            const PaDigestRecord *record = *pa_digest_slot(d, sequence);
+
+            // Skipped for want of memory, or replaced already
+            if (record && record->info.sequence == sequence) {
+                const PairAdminDigestInfo *r = &record->info;
+
+                used = (size_t)r->command_length + r->head_length + r->tail_length;
+                if (out && used <= cap) {
+                    memcpy(out, record + 1, used);
+                    if (info) {
+                        *info = *r;
+                    }
+                    result = 0;
+                }
+            }
+        }
+        pa_digest_unlock(&d->lock);
+    }
+    pa_epoch_exit(epoch);
+
+    if (written) {
+        *written = used;
+    }
+    return result;
+}
@@ -0,0 +1,538 @@
+// Audit exporter for PairAdmin
+//
+// Compliance wants every session streamed to a central collector, and
+// re-serialising events in managed code costs each workstation CPU and
+// garbage collection for nothing. The exporter reads the shared ring on
+// its own thread with a private cursor, exactly like a subscriber, packs
+// whole records into batches, compresses each batch and writes it to
+// one persistent connection. The hooks never see it: a stalled
+// collector only makes the exporter skip what the ring overwrites.
+//
+// Sent batches are kept until the collector acknowledges them, so a
+// reconnect resends from wherever the collector says it got to. The
+// buffer is bounded; while the collector is away the oldest batches go
+// first, and the offsets in the next batches show the gap.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#define PA_EXPORT_BATCH_DEFAULT (64u * 1024)
+#define PA_EXPORT_BATCH_MAX (1u << 24)
+#define PA_EXPORT_FLUSH_DEFAULT_MS 200
+#define PA_EXPORT_BUFFER_DEFAULT (8u << 20)
+
+// Poll interval with nothing to read or send
+#define PA_EXPORT_IDLE_US 10000
+
+// Connecting, the collector's answer to the hello, and every send
+#define PA_EXPORT_TIMEOUT_MS 5000
+
+// Reconnect backoff, doubling from the first to the last
+#define PA_EXPORT_RETRY_MIN_MS 250
+#define PA_EXPORT_RETRY_MAX_MS 30000
+
+// One buffered batch; the stored bytes follow header directly, so the
+// two go out in a single send
+typedef struct PaExportBatch {
+    struct PaExportBatch *next;
+    PairAdminExportBatch header;
+} PaExportBatch;
+
+#define PA_EXPORT_WIRE(b) ((unsigned char *)&(b)->header)
+#define PA_EXPORT_WIRE_SIZE(b) (sizeof(PairAdminExportBatch) + (b)->header.stored_bytes)
+
+typedef struct PaExporter {
+    // Immutable while running
+    PairAdminExportConfig config;
+    char address[PA_PATH_MAX];
+    int running;
+    PaThread thread;
+    volatile uint32_t stop;
+    uint64_t stop_deadline_us;  // Written before stop: when the last sends give up
+
+    // Exporter thread only
+    PaConn conn;
+    int connected;
+    uint64_t ring_id;
+    uint64_t cursor;
+    unsigned char *raw;         // Batch being filled
+    size_t raw_used;
+    uint32_t raw_records;
+    uint64_t raw_started_us;
+    uint64_t lost;              // Skipped in the ring since the last batch
+    unsigned char *packed;
+    size_t packed_cap;
+    PaExportBatch *head;        // Oldest buffered
+    PaExportBatch *tail;
+    PaExportBatch *unsent;      // First not sent on this connection, or NULL
+    unsigned char ack[sizeof(PairAdminExportAck)];
+    size_t ack_used;
+    uint64_t retry_at_us;
+    uint32_t retry_ms;
+
+    // Written by the exporter thread, read by pairadmin_export_get_stats()
+    volatile uint32_t stat_connected;
+    volatile uint64_t stat_connects;
+    volatile uint64_t next_offset;
+    volatile uint64_t acked_offset;
+    volatile uint64_t buffered_bytes;
+    volatile uint64_t sent_bytes;
+    volatile uint64_t dropped_bytes;
+    volatile uint64_t lost_bytes;
+} PaExporter;
+
+static PaExporter pa_exporter;
+
+// Serialises start/stop
+static volatile uint32_t pa_export_lock = 0;
+
+static void pa_export_mutex_lock(void)
+{
+    while (!pa_atomic_cas_u32(&pa_export_lock, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_export_mutex_unlock(void)
+{
+    pa_store_release_u32(&pa_export_lock, 0);
+}
+
+PA_INLINE void pa_export_add(volatile uint64_t *counter, uint64_t n)
+{
+    pa_store_release_u64(counter, *counter + n);
+}
+
+// ------------------------------------------------------------
+// Batching
+// ------------------------------------------------------------
+
+// Copy new records from the ring into the open batch. Returns non-zero
+// if any arrived.
+static int pa_export_collect(PaExporter *x)
+{
+    size_t length = 0;
+    uint64_t lost = 0;
+    PaRing *ring;
+    uint32_t slot;
+    size_t i;
+
+    slot = pa_epoch_enter();
+    ring = pa_current_ring();
+    if (ring) {
+        if (ring->id != x->ring_id) {
+            x->ring_id = ring->id;
+            x->cursor = pa_load_acquire_u64(&ring->ctl->head);
+        }
+        length = pa_ring_peek(ring, &x->cursor, x->config.event_mask, x->raw + x->raw_used,
+                              x->config.batch_bytes - x->raw_used, &lost);
+    }
+    pa_epoch_exit(slot);
+
+    if (lost) {
+        x->lost += lost;
+        pa_export_add(&x->lost_bytes, lost);
+    }
+    if (length == 0) {
+        return 0;
+    }
+    if (x->raw_used == 0) {
+        x->raw_started_us = pa_now_us();
+    }
+    for (i = 0; i < length;) {
+        const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(x->raw + x->raw_used + i);
+
+        i += PAIRADMIN_RECORD_SIZE(hdr->length);
+        x->raw_records++;
+    }
+    x->raw_used += length;
+    return 1;
+}
+
+// Time to close the open batch: no room left for the largest record, or
+// its first record has waited flush_ms
+static int pa_export_due(const PaExporter *x)
+{
+    return x->raw_used > 0 &&
+           (x->raw_used + PAIRADMIN_READ_BUFFER_MIN > x->config.batch_bytes ||
+            pa_now_us() - x->raw_started_us >= (uint64_t)x->config.flush_ms * 1000);
+}
+
+static void pa_export_free_head(PaExporter *x)
+{
+    PaExportBatch *b = x->head;
+
+    x->head = b->next;
+    if (!x->head) {
+        x->tail = NULL;
+    }
+    if (x->unsent == b) {
+        x->unsent = b->next;
+    }
+    pa_store_release_u64(&x->buffered_bytes, x->buffered_bytes - b->header.stored_bytes);
+    free(b);
+}
+
+// Close the open batch: compress it, queue it, and make room for it by
+// dropping the oldest if the buffer is over its bound
+static void pa_export_seal(PaExporter *x)
+{
+    const unsigned char *stored = x->raw;
+    size_t stored_bytes = x->raw_used;
+    uint32_t flags = 0;
+    PaExportBatch *b;
+
+    if (x->raw_used == 0) {
+        return;
+    }
+    if (!(x->config.flags & PAIRADMIN_EXPORT_UNCOMPRESSED)) {
+        size_t n = pa_lz_compress(x->raw, x->raw_used, x->packed, x->packed_cap);
+
+        if (n > 0 && n < x->raw_used) {
+            stored = x->packed;
+            stored_bytes = n;
+            flags = PAIRADMIN_EXPORT_BATCH_COMPRESSED;
+        }
+    }
+
+    b = (PaExportBatch *)malloc(sizeof(PaExportBatch) + stored_bytes);
+    if (b) {
+        b->next = NULL;
+        b->header.magic = PAIRADMIN_EXPORT_BATCH_MAGIC;
+        b->header.flags = flags;
+        b->header.offset = x->next_offset;
+        b->header.lost_bytes = x->lost;
+        b->header.raw_bytes = (uint32_t)x->raw_used;
+        b->header.stored_bytes = (uint32_t)stored_bytes;
+        b->header.records = x->raw_records;
+        b->header.reserved = 0;
+        memcpy(PA_EXPORT_WIRE(b) + sizeof(PairAdminExportBatch), stored, stored_bytes);
+
+        if (x->tail) {
+            x->tail->next = b;
+        } else {
+            x->head = b;
+        }
+        x->tail = b;
+        if (!x->unsent) {
+            x->unsent = b;
+        }
+        x->lost = 0;
+        pa_export_add(&x->buffered_bytes, stored_bytes);
+    } else {
+        pa_export_add(&x->dropped_bytes, x->raw_used);
+    }
+    pa_export_add(&x->next_offset, x->raw_used);
+    x->raw_used = 0;
+    x->raw_records = 0;
+
+    // The newest batch always stays
+    while (x->buffered_bytes > x->config.buffer_bytes && x->head != x->tail) {
+        if (x->unsent && x->head == x->unsent) {
+            pa_export_add(&x->dropped_bytes, x->head->header.raw_bytes);
+        }
+        pa_export_free_head(x);
+    }
+}
+
+// ------------------------------------------------------------
+// Connection
+// ------------------------------------------------------------
+
+// How long a send or wait may take: the usual timeout, or once stopping
+// what is left of the one pairadmin_export_stop() allows. A send already
+// under way when stop comes began with its full timeout, which runs out
+// before the deadline does.
+static uint32_t pa_export_timeout(const PaExporter *x)
+{
+    uint64_t now;
+
+    if (!pa_load_acquire_u32(&x->stop)) {
+        return PA_EXPORT_TIMEOUT_MS;
+    }
+    now = pa_now_us();
+    return now < x->stop_deadline_us ? (uint32_t)((x->stop_deadline_us - now) / 1000) : 0;
+}
+
+static void pa_export_disconnect(PaExporter *x)
+{
+    pa_conn_close(&x->conn);
+    x->connected = 0;
+    x->ack_used = 0;
+    x->retry_at_us = pa_now_us() + (uint64_t)x->retry_ms * 1000;
+    pa_store_release_u32(&x->stat_connected, 0);
+}
+
+// The collector holds everything before offset: forget what it covers,
+// and send the rest again from the start
+static void pa_export_acknowledge(PaExporter *x, uint64_t offset)
+{
+    while (x->head && x->head->header.offset + x->head->header.raw_bytes <= offset) {
+        pa_export_free_head(x);
+    }
+    if (offset > x->acked_offset) {
+        pa_store_release_u64(&x->acked_offset, offset);
+    }
+}
+
+// Read an ack, waiting up to timeout_ms for the rest of one. Returns 1
+// if one was read, 0 if none is complete yet, -1 if the connection
+// failed or the collector sent something else.
+static int pa_export_read_ack(PaExporter *x, uint32_t timeout_ms)
+{
+    uint64_t deadline = pa_now_us() + (uint64_t)timeout_ms * 1000;
+    PairAdminExportAck ack;
+
+    while (x->ack_used < sizeof(ack)) {
+        uint64_t now = pa_now_us();
+        uint32_t wait = now < deadline ? (uint32_t)((deadline - now + 999) / 1000) : 0;
+        int n = pa_conn_recv(&x->conn, x->ack + x->ack_used, sizeof(ack) - x->ack_used, wait);
+
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        x->ack_used += (size_t)n;
+    }
+    x->ack_used = 0;
+    memcpy(&ack, x->ack, sizeof(ack));
+    if (ack.magic != PAIRADMIN_EXPORT_ACK_MAGIC) {
+        return -1;
+    }
+    pa_export_acknowledge(x, ack.offset);
+    return 1;
+}
+
+static void pa_export_connect(PaExporter *x)
+{
+    PairAdminExportHello hello;
+
+    if (pa_now_us() < x->retry_at_us) {
+        return;
+    }
+    if (pa_conn_open(&x->conn, x->config.transport == PAIRADMIN_EXPORT_PIPE, x->address,
+                     PA_EXPORT_TIMEOUT_MS) != 0) {
+        x->retry_at_us = pa_now_us() + (uint64_t)x->retry_ms * 1000;
+        x->retry_ms = x->retry_ms * 2 < PA_EXPORT_RETRY_MAX_MS ? x->retry_ms * 2 : PA_EXPORT_RETRY_MAX_MS;
+        return;
+    }
+
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = PAIRADMIN_EXPORT_HELLO_MAGIC;
+    hello.version = PAIRADMIN_EXPORT_VERSION;
+    hello.stream_id = x->config.stream_id;
+    hello.process_id = (uint32_t)pa_process_id();
+    hello.oldest_offset = x->head ? x->head->header.offset : x->next_offset;
+    x->ack_used = 0;
+
+    // Everything still buffered goes again, from where the collector is
+    x->unsent = x->head;
+    if (pa_conn_send(&x->conn, &hello, sizeof(hello), pa_export_timeout(x)) != 0 ||
+        pa_export_read_ack(x, pa_export_timeout(x)) != 1) {
+        pa_export_disconnect(x);
+        x->retry_ms = x->retry_ms * 2 < PA_EXPORT_RETRY_MAX_MS ? x->retry_ms * 2 : PA_EXPORT_RETRY_MAX_MS;
+        return;
+    }
+
+    x->connected = 1;
+    x->retry_ms = PA_EXPORT_RETRY_MIN_MS;
+    pa_export_add(&x->stat_connects, 1);
+    pa_store_release_u32(&x->stat_connected, 1);
+}
+
+// Take in acks and send every unsent batch. Returns non-zero if
+// anything moved.
+static int pa_export_pump(PaExporter *x)
+{
+    int busy = 0;
+    int n;
+
+    while ((n = pa_export_read_ack(x, 0)) == 1) {
+        busy = 1;
+    }
+    if (n < 0) {
+        pa_export_disconnect(x);
+        return 1;
+    }
+
+    while (x->unsent) {
+        PaExportBatch *b = x->unsent;
+
+        if (pa_conn_send(&x->conn, PA_EXPORT_WIRE(b), PA_EXPORT_WIRE_SIZE(b), pa_export_timeout(x)) != 0) {
+            pa_export_disconnect(x);
+            return 1;
+        }
+        pa_export_add(&x->sent_bytes, PA_EXPORT_WIRE_SIZE(b));
+        x->unsent = b->next;
+        busy = 1;
+    }
+    return busy;
+}
+
+static void pa_export_thread(void *arg)
+{
+    PaExporter *x = (PaExporter *)arg;
+
+    while (!pa_load_acquire_u32(&x->stop)) {
+        int busy = pa_export_collect(x);
+
+        if (pa_export_due(x)) {
+            pa_export_seal(x);
+        }
+        if (!x->connected) {
+            pa_export_connect(x);
+        }
+        if (x->connected && pa_export_pump(x)) {
+            busy = 1;
+        }
+        if (!busy) {
+            pa_sleep_us(PA_EXPORT_IDLE_US);
+        }
+    }
+
+    // What the ring still holds goes too, if the collector is there
+    while (pa_export_collect(x)) {
+        if (pa_export_due(x)) {
+            pa_export_seal(x);
+        }
+    }
+    pa_export_seal(x);
+    if (x->connected) {
+        pa_export_pump(x);
+    }
+    pa_export_disconnect(x);
+}
+
+// ------------------------------------------------------------
+// Control
+// ------------------------------------------------------------
+
+static void pa_export_release(PaExporter *x)
+{
+    while (x->head) {
+        pa_export_free_head(x);
+    }
+    free(x->raw);
+    free(x->packed);
+    x->raw = NULL;
+    x->packed = NULL;
+}
+
+int pairadmin_export_start(const PairAdminExportConfig *config)
+{
+    PaExporter *x = &pa_exporter;
+    PaRing *ring;
+    uint32_t epoch;
+
+    if (!config || !config->address || !*config->address ||
+        strlen(config->address) >= sizeof(x->address) ||
+        (config->transport != PAIRADMIN_EXPORT_TCP && config->transport != PAIRADMIN_EXPORT_PIPE)) {
+        return -1;
+    }
+
+    pa_export_mutex_lock();
+    if (x->running) {
+        pa_export_mutex_unlock();
+        return -1;
+    }
+
+    memset(x, 0, sizeof(*x));
+    x->config = *config;
+    strcpy(x->address, config->address);
+    x->config.address = x->address;
+    if (x->config.stream_id == 0) {
+        x->config.stream_id = ((uint64_t)pa_process_id() << 32) ^ pa_wall_time_us();
+    }
+    if (x->config.event_mask == 0) {
+        x->config.event_mask = PAIRADMIN_EVENT_MASK(PAIRADMIN_EVENT_OUTPUT) |
+                               PAIRADMIN_EVENT_MASK(PAIRADMIN_EVENT_INPUT);
+    }
+    if (x->config.batch_bytes == 0) {
+        x->config.batch_bytes = PA_EXPORT_BATCH_DEFAULT;
+    }
+    // A batch holds at least one record of any size
+    if (x->config.batch_bytes < PAIRADMIN_READ_BUFFER_MIN) {
+        x->config.batch_bytes = PAIRADMIN_READ_BUFFER_MIN;
+    }
+    if (x->config.batch_bytes > PA_EXPORT_BATCH_MAX) {
+        x->config.batch_bytes = PA_EXPORT_BATCH_MAX;
+    }
+    if (x->config.flush_ms == 0) {
+        x->config.flush_ms = PA_EXPORT_FLUSH_DEFAULT_MS;
+    }
+    if (x->config.buffer_bytes == 0) {
+        x->config.buffer_bytes = PA_EXPORT_BUFFER_DEFAULT;
+    }
+    x->retry_ms = PA_EXPORT_RETRY_MIN_MS;
+    x->packed_cap = pa_lz_bound(x->config.batch_bytes);
+    x->raw = (unsigned char *)malloc(x->config.batch_bytes);
+    x->packed = (unsigned char *)malloc(x->packed_cap);
+    if (!x->raw || !x->packed || pa_subscribers_hold() != 0) {
+        pa_export_release(x);
+        pa_export_mutex_unlock();
+        return -1;
+    }
+
+    // Bind now so every event after this call returns is exported
+    epoch = pa_epoch_enter();
+    ring = pa_current_ring();
+    if (ring) {
+        x->ring_id = ring->id;
+        x->cursor = pa_load_acquire_u64(&ring->ctl->head);
+    }
+    pa_epoch_exit(epoch);
+
+    // No address: only marks the connection closed
+    pa_conn_open(&x->conn, 0, NULL, 0);
+    if (pa_thread_start(&x->thread, pa_export_thread, x) != 0) {
+        pa_subscribers_unhold();
+        pa_export_release(x);
+        pa_export_mutex_unlock();
+        return -1;
+    }
+    x->running = 1;
+    pa_store_release_u32(&x->stat_connected, 0);
+    pa_export_mutex_unlock();
+    return 0;
+}
+
+void pairadmin_export_stop(void)
+{
+    PaExporter *x = &pa_exporter;
+
+    pa_export_mutex_lock();
+    if (!x->running) {
+        pa_export_mutex_unlock();
+        return;
+    }
+    x->stop_deadline_us = pa_now_us() + (uint64_t)PA_EXPORT_TIMEOUT_MS * 1000;
+    pa_store_release_u32(&x->stop, 1);
+    pa_thread_join(&x->thread);
+    pa_subscribers_unhold();
+    pa_export_release(x);
+    x->running = 0;
+    pa_export_mutex_unlock();
+}
+
+void pairadmin_export_get_stats(PairAdminExportStats *stats)
+{
+    PaExporter *x = &pa_exporter;
+
+    if (!stats) {
+        return;
+    }
+    stats->running = x->running && !pa_load_acquire_u32(&x->stop);
+    stats->connected = pa_load_acquire_u32(&x->stat_connected);
+    stats->connects = pa_load_acquire_u64(&x->stat_connects);
+    stats->next_offset = pa_load_acquire_u64(&x->next_offset);
+    stats->acked_offset = pa_load_acquire_u64(&x->acked_offset);
+    stats->buffered_bytes = pa_load_acquire_u64(&x->buffered_bytes);
+    stats->sent_bytes = pa_load_acquire_u64(&x->sent_bytes);
+    stats->dropped_bytes = pa_load_acquire_u64(&x->dropped_bytes);
+    stats->lost_bytes = pa_load_acquire_u64(&x->lost_bytes);
+}
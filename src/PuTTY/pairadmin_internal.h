@@ -0,0 +1,978 @@
+#ifndef PAIRADMIN_INTERNAL_H
+#define PAIRADMIN_INTERNAL_H
+
+// Internal helpers shared by the PairAdmin translation units.
+// Not installed and not part of the exported interface.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pairadmin.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PA_INLINE static __forceinline
+#define PA_ALIGN(n) __declspec(align(n))
+#else
+#define PA_INLINE static inline __attribute__((always_inline))
+#define PA_ALIGN(n) __attribute__((aligned(n)))
+#endif
+
+#if defined(_MSC_VER)
+#define PA_THREAD_LOCAL __declspec(thread)
+#else
+#define PA_THREAD_LOCAL __thread
+#endif
+
+#define PA_CACHE_LINE 64
+
+// Records in the event ring are padded to this boundary
+#define PA_RECORD_ALIGN 8
+#define PA_ALIGN_UP(n, a) (((n) + ((a) - 1)) & ~((size_t)(a) - 1))
+
+// ------------------------------------------------------------
+// Atomics
+//
+// MSVC's C mode has no usable <stdatomic.h>, so the handful of
+// operations the ring needs are spelled out per compiler.
+// ------------------------------------------------------------
+
+#if defined(_MSC_VER)
+
+PA_INLINE uint32_t pa_load_acquire_u32(const volatile uint32_t *p)
+{
+#if defined(_M_ARM64)
+    return __ldar32((unsigned __int32 volatile *)p);
+#else
+    uint32_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+#endif
+}
+
+PA_INLINE void pa_store_release_u32(volatile uint32_t *p, uint32_t v)
+{
+#if defined(_M_ARM64)
+    __stlr32((unsigned __int32 volatile *)p, v);
+#else
+    _ReadWriteBarrier();
+    *p = v;
+#endif
+}
+
+PA_INLINE uint64_t pa_load_acquire_u64(const volatile uint64_t *p)
+{
+#if defined(_M_ARM64)
+    return __ldar64((unsigned __int64 volatile *)p);
+#else
+    uint64_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+#endif
+}
+
+PA_INLINE void pa_store_release_u64(volatile uint64_t *p, uint64_t v)
+{
+#if defined(_M_ARM64)
+    __stlr64((unsigned __int64 volatile *)p, v);
+#else
+    _ReadWriteBarrier();
+    *p = v;
+#endif
+}
+
+#else
+
+PA_INLINE uint32_t pa_load_acquire_u32(const volatile uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+PA_INLINE void pa_store_release_u32(volatile uint32_t *p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+PA_INLINE uint64_t pa_load_acquire_u64(const volatile uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+PA_INLINE void pa_store_release_u64(volatile uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+#endif
+
+// Read-modify-write operations below are full barriers
+
+#if defined(_MSC_VER)
+
+PA_INLINE uint32_t pa_atomic_inc_u32(volatile uint32_t *p)
+{
+    return (uint32_t)_InterlockedIncrement((volatile long *)p);
+}
+
+PA_INLINE uint32_t pa_atomic_dec_u32(volatile uint32_t *p)
+{
+    return (uint32_t)_InterlockedDecrement((volatile long *)p);
+}
+
+PA_INLINE int pa_atomic_cas_u32(volatile uint32_t *p, uint32_t expected, uint32_t desired)
+{
+    return (uint32_t)_InterlockedCompareExchange((volatile long *)p, (long)desired, (long)expected) == expected;
+}
+
+PA_INLINE int pa_atomic_cas_u64(volatile uint64_t *p, uint64_t expected, uint64_t desired)
+{
+    return (uint64_t)_InterlockedCompareExchange64((volatile __int64 *)p, (__int64)desired, (__int64)expected) == expected;
+}
+
+PA_INLINE void *pa_atomic_xchg_ptr(void *volatile *p, void *v)
+{
+    return _InterlockedExchangePointer(p, v);
+}
+
+PA_INLINE int pa_atomic_cas_ptr(void *volatile *p, void *expected, void *desired)
+{
+    return _InterlockedCompareExchangePointer(p, desired, expected) == expected;
+}
+
+#else
+
+PA_INLINE uint32_t pa_atomic_inc_u32(volatile uint32_t *p)
+{
+    return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+PA_INLINE uint32_t pa_atomic_dec_u32(volatile uint32_t *p)
+{
+    return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+PA_INLINE int pa_atomic_cas_u32(volatile uint32_t *p, uint32_t expected, uint32_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+PA_INLINE int pa_atomic_cas_u64(volatile uint64_t *p, uint64_t expected, uint64_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+PA_INLINE void *pa_atomic_xchg_ptr(void *volatile *p, void *v)
+{
+    return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+PA_INLINE int pa_atomic_cas_ptr(void *volatile *p, void *expected, void *desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#endif
+
+PA_INLINE void *pa_load_acquire_ptr(void *const volatile *p)
+{
+#if defined(_MSC_VER)
+#if defined(_M_ARM64)
+    return (void *)__ldar64((unsigned __int64 volatile *)p);
+#else
+    void *v = *p;
+    _ReadWriteBarrier();
+    return v;
+#endif
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+PA_INLINE void pa_store_release_ptr(void *volatile *p, void *v)
+{
+#if defined(_MSC_VER)
+#if defined(_M_ARM64)
+    __stlr64((unsigned __int64 volatile *)p, (unsigned __int64)v);
+#else
+    _ReadWriteBarrier();
+    *p = v;
+#endif
+#else
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#endif
+}
+
+// Standalone fence for the seqlock-style checks in the subscriber path
+
+PA_INLINE void pa_fence_acquire(void)
+{
+#if defined(_MSC_VER)
+#if defined(_M_ARM64)
+    __dmb(_ARM64_BARRIER_ISHLD);
+#else
+    _ReadWriteBarrier();
+#endif
+#else
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+}
+
+// Full barrier: a store before it is visible before any load after it.
+// The wakeup checks need it on both sides of the ring.
+PA_INLINE void pa_fence_full(void)
+{
+#if defined(_MSC_VER)
+    MemoryBarrier();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+// ------------------------------------------------------------
+// Epoch-based quiescence
+//
+// Hooks run inside a read section: one interlocked increment and one
+// decrement, no lock. Anything that unpublishes state the hooks read
+// (callback, ring) swaps the pointer, then calls pa_epoch_synchronize()
+// before freeing or returning; once that returns no hook can still be
+// using the old value. Must not be called from inside a hook section.
+// ------------------------------------------------------------
+
+uint32_t pa_epoch_enter(void);
+void pa_epoch_exit(uint32_t slot);
+void pa_epoch_synchronize(void);
+
+// ------------------------------------------------------------
+// Bit helpers
+// ------------------------------------------------------------
+
+PA_INLINE uint32_t pa_popcount32(uint32_t v)
+{
+#if defined(_MSC_VER)
+    // __popcnt needs the POPCNT instruction, which SSE2-only CPUs lack
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    return (((v + (v >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+#else
+    return (uint32_t)__builtin_popcount(v);
+#endif
+}
+
+// Index of the highest set bit; v must be non-zero
+PA_INLINE uint32_t pa_highest_bit32(uint32_t v)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, v);
+    return (uint32_t)index;
+#else
+    return 31u - (uint32_t)__builtin_clz(v);
+#endif
+}
+
+// ------------------------------------------------------------
+// Wakers (pairadmin_platform.c)
+//
+// An auto-reset event on Windows, an eventfd on Linux and a pipe
+// elsewhere: signals collapse into one, and a wait that returns
+// consumes it. A signal nobody waits for yet is kept, so the waiter
+// re-checks its condition, waits, and cannot miss one sent in between.
+// ------------------------------------------------------------
+
+#define PA_WAIT_FOREVER UINT64_MAX
+
+typedef struct PaWaker {
+#ifdef _WIN32
+    HANDLE event;
+#else
+    int fd;                     // Read end; the eventfd itself on Linux
+    int write_fd;
+#endif
+} PaWaker;
+
+// name is only used on Windows, for an event other processes can open
+int pa_waker_create(PaWaker *waker, const char *name);
+void pa_waker_destroy(PaWaker *waker);
+void pa_waker_signal(PaWaker *waker);
+
+// Returns 1 if signalled, 0 on timeout. Rounded up to milliseconds.
+int pa_waker_wait(PaWaker *waker, uint64_t timeout_us);
+
+// The event HANDLE, or the descriptor that polls readable
+intptr_t pa_waker_handle(const PaWaker *waker);
+
+// ------------------------------------------------------------
+// Event ring (single producer, single consumer plus subscribers)
+// ------------------------------------------------------------
+
+// Record type used to skip the unusable tail of the buffer on wrap
+#define PA_RECORD_PAD 0
+
+typedef struct PaRing {
+    // Immutable after creation. ctl and data point into one block laid
+    // out as PairAdminRegionHeader + data area, either on the heap or
+    // in a named shared-memory mapping.
+    PairAdminRegionHeader *ctl;
+    unsigned char *data;
+    size_t capacity;
+    size_t mask;
+    uint64_t id;                // Distinguishes successive rings
+
+    // Set while no primary consumer owns tail: the producer then frees
+    // space itself by discarding the oldest records (subscriber-only ring)
+    volatile uint32_t reclaim;
+
+    // Producer-local: PuTTY's thread
+    PA_ALIGN(PA_CACHE_LINE) uint64_t cached_tail;
+    uint64_t sequence;
+    uint64_t dropped_records;
+    uint64_t dropped_bytes;
+    uint64_t high_water;        // Most bytes seen queued
+
+    // Losses not yet reported by a PAIRADMIN_EVENT_GAP record
+    uint64_t gap_records;
+    uint64_t gap_bytes;
+
+    // BLOCK_WITH_TIMEOUT gave up; drop without waiting until there is room
+    int stalled;
+
+    // A write found the consumer caught up; pa_ring_notify() signals it
+    int wake;
+
+    // COALESCE: pending record built while the ring was full
+    uint16_t coalesce_type;
+    uint32_t coalesce_len;
+    uint64_t coalesce_us;
+    unsigned char coalesce[PAIRADMIN_MAX_PAYLOAD];
+
+    // Consumer-local: drain thread
+    PA_ALIGN(PA_CACHE_LINE) uint64_t cached_head;
+
+    // Signalled when records arrive in an empty ring
+    PaWaker waker;
+
+    // Backing storage
+    PA_ALIGN(PA_CACHE_LINE) void *block;
+    size_t block_size;
+    int shared;
+#ifdef _WIN32
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    char name[64];
+} PaRing;
+
+// Round a requested data capacity to the size actually used
+size_t pa_ring_capacity(size_t requested);
+
+PaRing *pa_ring_create(size_t capacity);
+
+// pa_ring_create() for a ring kept outside pairadmin_control, such as a
+// session's own ring; takes the lock so ring ids stay unique
+PaRing *pa_ring_create_owned(size_t capacity);
+void pa_ring_destroy(PaRing *ring);
+
+// Initialise the region header and data pointers over block
+void pa_ring_layout(PaRing *ring, void *block, size_t capacity);
+// flags goes into the record header; a coalesced record gets 0
+int pa_ring_write(PaRing *ring, uint16_t type, uint16_t flags, const void *data, uint32_t len);
+
+// Wake the consumer if a write since the last call found it caught up.
+// Called once per hook call, after all of its records, so a fragment
+// split into several records costs one wakeup.
+void pa_ring_notify(PaRing *ring);
+
+// Consumer: wait until the ring holds records, up to timeout_us.
+// Returns 1 if it does; 0 after a timeout or a pa_ring_wake().
+int pa_ring_await(PaRing *ring, uint64_t timeout_us);
+
+// Wake a pa_ring_await() early, e.g. to stop its thread
+void pa_ring_wake(PaRing *ring);
+size_t pa_ring_read(PaRing *ring, void *buf, size_t cap);
+
+// Walk up to max_records records in place, handing each to fn and
+// releasing it. hdr is a copy; payload points into the ring. If the
+// record turns out to have been reclaimed while fn looked at it,
+// discard is called to undo fn. Consumer thread only.
+// Returns the number of records kept.
+typedef void (*PaRecordFn)(const PairAdminEventHeader *hdr, const void *payload, void *ctx);
+typedef void (*PaDiscardFn)(void *ctx);
+size_t pa_ring_drain(PaRing *ring, PaRecordFn fn, PaDiscardFn discard, void *ctx, size_t max_records);
+
+// Non-destructive read from *cursor for subscribers: copies whole
+// records whose type is in mask, leaves tail alone and adds bytes the
+// cursor had to skip because they were overwritten to *lost.
+size_t pa_ring_peek(PaRing *ring, uint64_t *cursor, uint32_t mask,
+                    void *buf, size_t cap, uint64_t *lost);
+
+// Current ring for queued delivery, or NULL
+PaRing *pa_current_ring(void);
+
+// Open a reclaiming ring for subscribers if none is open.
+// Returns 1 if it created one, 0 if a ring was already open, -1 on failure.
+int pa_ring_open_reclaiming(void);
+
+// Keep a reclaiming ring open for a reader that is not a subscriber
+// (the exporter), opening one if no ring is open; pairs like
+// pairadmin_add/remove_subscriber (pairadmin_subscribers.c). Returns 0,
+// or -1 on failure.
+int pa_subscribers_hold(void);
+void pa_subscribers_unhold(void);
+
+// ------------------------------------------------------------
+// Shared-memory region (pairadmin_region.c)
+// ------------------------------------------------------------
+
+PaRing *pa_region_create(size_t capacity);
+void pa_region_destroy(PaRing *ring);
+
+// ------------------------------------------------------------
+// Escape sequence filter (pairadmin_vt.c)
+// ------------------------------------------------------------
+
+typedef struct PaVtParser {
+    unsigned char state;
+} PaVtParser;
+
+void pa_vt_reset(PaVtParser *vt);
+
+// Filter state of one producer: the process-wide hook path and every
+// session thread with its own ring each keep one
+typedef struct PaVtFilter {
+    uint32_t active;            // Mode the parser was last reset for
+    PaVtParser parser;
+    unsigned char scratch[PAIRADMIN_MAX_PAYLOAD];
+
+    // OUTPUT held back after the last complete UTF-8 sequence, at the
+    // start of joined, where the next fragment is appended to it
+    size_t held;
+    unsigned char joined[PAIRADMIN_MAX_PAYLOAD];
+} PaVtFilter;
+
+// Strip escape sequences from in; out must hold len bytes.
+// Returns the number of bytes written.
+size_t pa_vt_strip(PaVtParser *vt, const void *in, size_t len, void *out);
+
+// ------------------------------------------------------------
+// UTF-8 (pairadmin_scan.c)
+// ------------------------------------------------------------
+
+// Length of the longest prefix of p[0..len) that does not end inside a
+// multi-byte sequence. Only a well-formed partial sequence in the last
+// 3 bytes is cut off; invalid bytes are left in.
+size_t pa_utf8_boundary(const unsigned char *p, size_t len);
+
+// PAIRADMIN_TEXT_* for data[0..len)
+uint32_t pa_utf8_flags(const void *data, size_t len);
+
+// ------------------------------------------------------------
+// CPU features (pairadmin_cpu.c)
+// ------------------------------------------------------------
+
+// PAIRADMIN_CPU_* the kernels may use; detected on the first call
+uint32_t pa_cpu_features(void);
+
+// ------------------------------------------------------------
+// Redaction (pairadmin_redact.c)
+// ------------------------------------------------------------
+
+// Room for value bytes held back while they may still be a secret: at
+// least one short of the largest rule minimum (40, github_pat_)
+#define PA_REDACT_HOLD 64
+
+// Matcher state of one direction of one producer
+typedef struct PaRedactStream {
+    uint32_t active;            // Rules the state was last reset for
+    uint16_t state;             // Automaton state
+    uint16_t rule;              // Candidate rule + 1, or 0
+    uint8_t phase;
+    uint8_t masking;            // Input: a prompt's answer is being typed
+    uint16_t sep;
+    uint32_t count;             // Value bytes so far
+    uint32_t held;
+    unsigned char hold[PA_REDACT_HOLD];
+} PaRedactStream;
+
+// Redaction state kept by each session, like its PaVtFilter
+typedef struct PaRedactor {
+    PaRedactStream output;
+    PaRedactStream input;
+    unsigned char scratch[PAIRADMIN_MAX_PAYLOAD + PA_REDACT_HOLD];
+} PaRedactor;
+
+void pa_redact_reset(PaRedactStream *stream);
+
+// Whether event has to go through pa_redact(): redaction is on, or was
+// and a stream still has to release what it holds
+int pa_redact_wanted(const PaRedactor *r, PairAdminEventType event);
+
+// Mask secrets in len bytes (at most PAIRADMIN_MAX_PAYLOAD) of OUTPUT or
+// INPUT into out. Returns the bytes written: up to len + PA_REDACT_HOLD,
+// as bytes held from before are released, or fewer as bytes are held.
+size_t pa_redact(PaRedactor *r, PairAdminEventType event, const void *data, size_t len,
+                 void *out);
+
+// The stream's session ended or restarted: forget the candidate and
+// put what it held into out, as it was. Returns the bytes written, at
+// most PA_REDACT_HOLD.
+size_t pa_redact_flush(PaRedactStream *stream, void *out);
+
+// Redact a complete text, such as an assembled command line, on its own;
+// out must hold len bytes. Returns len.
+size_t pa_redact_text(const void *data, size_t len, void *out);
+
+// Input being typed now answers a password prompt
+int pa_redact_answering(const PaRedactor *r);
+
+// The automaton has been built (by the first rule enabled)
+int pa_redact_built(void);
+
+// ------------------------------------------------------------
+// Command lines (pairadmin_line.c)
+// ------------------------------------------------------------
+
+// The line being typed in one session, as the shell will see it
+typedef struct PaLineEditor {
+    uint32_t length;
+    uint32_t flags;             // PAIRADMIN_COMMAND_* gathered while typing
+    uint8_t esc;                // Escape sequence state
+    uint8_t paste;              // Inside a bracketed paste
+    uint8_t cr;                 // Last byte was CR: an LF after it is the same Enter
+    uint8_t csi_length;
+    char csi[8];
+    char text[PAIRADMIN_COMMAND_MAX];
+    unsigned char event[sizeof(PairAdminCommandInfo) + PAIRADMIN_COMMAND_MAX];
+} PaLineEditor;
+
+void pa_line_clear(PaLineEditor *ed);
+
+// Apply input keys to the line. Stops after the byte that submits the
+// line (*done set) or at the end of data. Returns the bytes used.
+size_t pa_line_feed(PaLineEditor *ed, const void *data, size_t len, int *done);
+
+// Flags of a submitted line, including PAIRADMIN_COMMAND_DENIED and,
+// when checked is set and the denylist blocks, _BLOCKED; *denied gets
+// the 1-based denylist entry matched, or 0
+uint32_t pa_line_check(const PaLineEditor *ed, int checked, uint32_t *denied);
+
+// ------------------------------------------------------------
+// Shell marks (pairadmin_marks.c)
+// ------------------------------------------------------------
+
+// Longest OSC sequence looked into; OSC 7 paths are percent-encoded
+#define PA_MARK_OSC_MAX 2048
+
+// Mark state of one producer, kept by each session like its PaLineEditor
+typedef struct PaMarkScanner {
+    uint32_t active;            // Configuration generation last taken up
+    uint32_t sources;           // PAIRADMIN_MARKS_* in effect
+    uint32_t fingerprint_len;
+    unsigned char fingerprint[PAIRADMIN_FINGERPRINT_MAX];
+
+    uint64_t offset;            // OUTPUT bytes so far, counted while off too
+    uint8_t state;              // Escape sequence state
+    uint8_t phase;              // Where the shell is: prompt, command, ...
+    uint8_t integrated;         // OSC 133 seen: no fingerprinting
+    uint8_t pending;            // A fingerprint PROMPT is still to report
+    uint32_t osc_len;           // Past PA_MARK_OSC_MAX once too long to use
+    uint64_t line_start;        // Offset of the last line's first byte
+    uint64_t prompt_line;       // line_start of the last fingerprint prompt
+    uint64_t command_offset;
+    uint32_t tail_len;          // Last printable bytes of the line
+    unsigned char tail[PAIRADMIN_FINGERPRINT_MAX];
+    uint32_t directory;         // Hash of the last DIRECTORY, 0 if none
+    unsigned char osc[PA_MARK_OSC_MAX];
+
+    // The mark being reported: PairAdminMarkInfo + path
+    unsigned char event[sizeof(PairAdminMarkInfo) + PA_MARK_OSC_MAX];
+} PaMarkScanner;
+
+// Take up a change of configuration. Returns 0 while marks are off.
+int pa_marks_begin(PaMarkScanner *m);
+
+// Scan OUTPUT up to and including the first sequence that makes a mark.
+// Returns the bytes consumed and sets *type to the mark's event type,
+// or 0 if there was none; the payload is in m->event, *length bytes.
+size_t pa_marks_output(PaMarkScanner *m, const void *data, size_t len,
+                       uint16_t *type, uint32_t *length);
+
+// The hook is returning: marks the fingerprint makes of the output so
+// far. Call until it returns 0.
+uint16_t pa_marks_pause(PaMarkScanner *m, uint32_t *length);
+
+// A command line was submitted: COMMAND_START if that starts one
+uint16_t pa_marks_submit(PaMarkScanner *m, uint32_t *length);
+
+// ------------------------------------------------------------
+// Event dispatch (pairadmin.c)
+// ------------------------------------------------------------
+
+// The hooks' path to the process-wide callback or ring. The ring has one
+// producer, so this must be called on the thread that calls the hooks.
+void pa_dispatch(PairAdminEventType event, const void *data, size_t len);
+
+// pa_dispatch() without the escape filter, for events that already went
+// through it once (replay)
+void pa_dispatch_raw(PairAdminEventType event, const void *data, size_t len);
+
+// Same filtering into a ring the caller owns and keeps alive (a
+// session's own ring); vt is that producer's filter state
+void pa_dispatch_ring(PaRing *ring, PaVtFilter *vt, PairAdminEventType event,
+                      const void *data, size_t len);
+
+// ------------------------------------------------------------
+// Recording (pairadmin_record.c)
+// ------------------------------------------------------------
+
+// Set while pairadmin_record_start() has a trace open
+extern volatile uint32_t pa_recording;
+
+// Append one delivered event to the open trace, if any
+void pa_record_event(PairAdminEventType event, const void *data, size_t len);
+
+// ------------------------------------------------------------
+// Block arena (pairadmin_arena.c)
+// ------------------------------------------------------------
+
+#define PA_ARENA_CLASSES 5
+
+typedef struct PaBlock PaBlock;
+
+// Fixed-budget pool of blocks in size classes. One owner thread
+// allocates; blocks can be freed from any thread.
+typedef struct PaArena {
+    unsigned char *base;
+    size_t size;
+
+    // Owner only
+    size_t carved;
+    PaBlock *free[PA_ARENA_CLASSES];
+
+    // Freed by other threads; the owner takes each stack back whole
+    PaBlock *volatile returned[PA_ARENA_CLASSES];
+} PaArena;
+
+// Reserve budget bytes up front. Returns 0, or -1 if they can't be had.
+int pa_arena_init(PaArena *arena, size_t budget);
+void pa_arena_destroy(PaArena *arena);
+
+// A block of at least bytes, or NULL when the budget is spent. Owner only.
+void *pa_arena_alloc(PaArena *arena, size_t bytes);
+
+// Back to the owner's free list; owner only
+void pa_arena_recycle(PaArena *arena, void *block);
+
+// Back onto the return stack; from any thread
+void pa_arena_free(PaArena *arena, void *block);
+
+// ------------------------------------------------------------
+// Sessions (pairadmin_session.c)
+// ------------------------------------------------------------
+
+typedef struct PaCapture PaCapture;
+typedef struct PaScreen PaScreen;
+typedef struct PaDigest PaDigest;
+
+// Hook entry: into the calling session thread's own ring, or through
+// pa_dispatch() for the process-wide session and plain PuTTY threads.
+// Also appends to the session's capture store and feeds its screen.
+void pa_session_route(PairAdminEventType event, const void *data, size_t len);
+
+// pairadmin_hook_input_checked(): INPUT that may be cut short at a denied
+// command's Enter. Returns the bytes ldisc may send.
+size_t pa_session_route_checked(const void *data, size_t len);
+
+// Where a session keeps its capture store; NULL selects the
+// process-wide session
+PaCapture *volatile *pa_session_capture_slot(PairAdminSession *session);
+
+// Where a session keeps its screen model, likewise
+PaScreen *volatile *pa_session_screen_slot(PairAdminSession *session);
+
+// Where a session keeps its command digests, likewise
+PaDigest *volatile *pa_session_digest_slot(PairAdminSession *session);
+
+// ------------------------------------------------------------
+// Capture store (pairadmin_capture.c)
+// ------------------------------------------------------------
+
+// Append one event as frames; on the session's producer thread only
+void pa_capture_append(PaCapture *capture, PairAdminEventType event,
+                       const void *data, size_t len);
+
+// The first segment has been made
+int pa_capture_mapped(PaCapture *capture);
+
+// ------------------------------------------------------------
+// Block compression (pairadmin_compress.c)
+// ------------------------------------------------------------
+
+// Largest output of pa_lz_compress() for len input bytes
+size_t pa_lz_bound(size_t len);
+
+// Compress into dst; returns the bytes written, or 0 if cap is too small
+size_t pa_lz_compress(const void *src, size_t len, void *dst, size_t cap);
+
+// Returns the bytes written, or -1 for malformed input or a short dst
+int64_t pa_lz_decompress(const void *src, size_t len, void *dst, size_t cap);
+
+// ------------------------------------------------------------
+// Screen model (pairadmin_screen.c)
+// ------------------------------------------------------------
+
+// Interpret one OUTPUT fragment; on the session's producer thread only
+void pa_screen_feed(PaScreen *screen, const void *data, size_t len);
+
+// ------------------------------------------------------------
+// Command digests (pairadmin_digest.c)
+// ------------------------------------------------------------
+
+// OUTPUT, COMMAND and the command marks; on the session's producer
+// thread only
+void pa_digest_feed(PaDigest *digest, PairAdminEventType event, const void *data, size_t len);
+
+// ------------------------------------------------------------
+// Batched delivery (pairadmin_batch.c)
+// ------------------------------------------------------------
+
+// Stop the batch thread; called before the ring it drains goes away
+void pa_batch_stop(void);
+
+// PairAdminBatchMode now, and the adaptive switches counted so far
+uint32_t pa_batch_mode(void);
+uint64_t pa_batch_switches(void);
+
+// ------------------------------------------------------------
+// Hot-path statistics (pairadmin_stats.c)
+// ------------------------------------------------------------
+
+typedef enum {
+    PA_STATS_OUTPUT,
+    PA_STATS_INPUT,
+    PA_STATS_CALLBACK,
+    PA_STATS_KINDS
+} PaStatsKind;
+
+// Count one call of bytes that took ticks (pa_ticks() span), in the
+// calling thread's slot
+void pa_stats_record(PaStatsKind kind, size_t bytes, uint64_t ticks);
+
+// A ring producer on this thread saw bytes queued
+void pa_stats_ring_fill(uint64_t bytes);
+
+// ------------------------------------------------------------
+// Platform (pairadmin_platform.c)
+// ------------------------------------------------------------
+
+// Monotonic clock in microseconds
+uint64_t pa_now_us(void);
+
+// Raw high-resolution counter for timing short spans: QPC on Windows,
+// CLOCK_MONOTONIC nanoseconds elsewhere. pa_ticks_ns() converts a span.
+uint64_t pa_ticks(void);
+uint64_t pa_ticks_ns(uint64_t ticks);
+
+// Wall clock in microseconds since 1970-01-01 UTC
+uint64_t pa_wall_time_us(void);
+void pa_sleep_us(uint64_t us);
+void pa_thread_yield(void);
+
+#ifdef _WIN32
+#define PA_PATH_SEP "\\"
+#define PA_PATH_MAX 260
+#else
+#define PA_PATH_SEP "/"
+#define PA_PATH_MAX 4096
+#endif
+
+unsigned long pa_process_id(void);
+
+// Temp directory without a trailing separator; 0, or -1 if it doesn't fit
+int pa_temp_dir(char *buf, size_t cap);
+
+// Per-process file name in the temp directory: <tmp>/<prefix>-<pid>.<ext>
+// Returns 0, or -1 if it does not fit in cap bytes.
+int pa_temp_file_path(char *buf, size_t cap, const char *prefix, const char *ext);
+
+// Non-zero if path names an existing directory
+int pa_dir_exists(const char *path);
+
+// A file created at a fixed size and mapped read/write
+typedef struct PaFileMap {
+    void *base;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} PaFileMap;
+
+int pa_file_map_create(PaFileMap *map, const char *path, size_t size);
+
+// Unmap and cut the file down to the keep bytes actually written
+void pa_file_map_close(PaFileMap *map, size_t keep);
+
+void *pa_aligned_alloc(size_t size);
+void pa_aligned_free(void *p);
+
+typedef void (*PaThreadFn)(void *arg);
+
+typedef struct PaThread {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    int running;
+} PaThread;
+
+int pa_thread_start(PaThread *thread, PaThreadFn fn, void *arg);
+void pa_thread_join(PaThread *thread);
+
+// Have fn(arg) called on the calling thread as it exits; arg must not be
+// NULL and replaces any earlier one. fn is process-wide: every caller
+// passes the same. Returns 0, or -1 if the platform is out of slots.
+int pa_thread_on_exit(void (*fn)(void *), void *arg);
+
+// Terminal window placement, on the thread that owns the window. Make
+// window a borderless child of parent, or move and size it; both return
+// 0, or -1 if the window refused. No-ops without a window system.
+int pa_window_embed(void *window, void *parent);
+int pa_window_move(void *window, int32_t x, int32_t y, int32_t width, int32_t height);
+
+// A byte stream to an audit collector: TCP, or a named pipe (a Unix
+// domain socket off Windows)
+typedef struct PaConn {
+#ifdef _WIN32
+    uintptr_t sock;             // SOCKET, INVALID_SOCKET for a pipe
+    HANDLE pipe;
+#else
+    int fd;
+#endif
+} PaConn;
+
+// Connect to address ("host:port", or the pipe's path), giving up after
+// timeout_ms. Returns 0, or -1 on failure.
+int pa_conn_open(PaConn *conn, int pipe, const char *address, uint32_t timeout_ms);
+
+// Send all of data within timeout_ms (a Windows pipe write waits for the
+// reader regardless); 0, or -1 if the connection failed or timed out
+int pa_conn_send(PaConn *conn, const void *data, size_t len, uint32_t timeout_ms);
+
+// Read what has arrived, waiting up to timeout_ms for something.
+// Returns the bytes read, 0 if nothing came, -1 if the peer has gone.
+int pa_conn_recv(PaConn *conn, void *buf, size_t cap, uint32_t timeout_ms);
+
+// Close if open; safe to repeat
+void pa_conn_close(PaConn *conn);
+
+// ------------------------------------------------------------
+// Tracing (pairadmin_trace.c)
+//
+// ETW TraceLogging events, Windows only. pa_trace_on() is a single load
+// of the keywords some listener enabled; the pa_trace_* writers are only
+// called once it has said yes.
+// ------------------------------------------------------------
+
+#define PA_TRACE_HOOKS 0x1
+#define PA_TRACE_CALLBACKS 0x2
+#define PA_TRACE_RING 0x4
+#define PA_TRACE_BATCH 0x8
+#define PA_TRACE_SESSION 0x10
+
+// Register the provider once; called by every entry point that sets up
+// delivery, so hooks need not
+void pa_trace_register(void);
+
+#ifdef _WIN32
+
+extern volatile uint32_t pa_trace_keywords;
+
+PA_INLINE int pa_trace_on(uint32_t keyword)
+{
+    return (pa_load_acquire_u32(&pa_trace_keywords) & keyword) != 0;
+}
+
+void pa_trace_enter(PaStatsKind kind, size_t bytes);
+void pa_trace_exit(PaStatsKind kind, size_t bytes, uint64_t ticks);
+void pa_trace_overflow(uint64_t ring_id, uint32_t policy, uint64_t records, uint64_t bytes);
+void pa_trace_batch(uint32_t event, size_t bytes, size_t fragments, uint64_t age_us);
+void pa_trace_session(uint32_t session, int32_t from, int32_t to);
+
+#else
+
+PA_INLINE int pa_trace_on(uint32_t keyword)
+{
+    (void)keyword;
+    return 0;
+}
+
+PA_INLINE void pa_trace_enter(PaStatsKind kind, size_t bytes)
+{
+    (void)kind;
+    (void)bytes;
+}
+
+PA_INLINE void pa_trace_exit(PaStatsKind kind, size_t bytes, uint64_t ticks)
+{
+    (void)kind;
+    (void)bytes;
+    (void)ticks;
+}
+
+PA_INLINE void pa_trace_overflow(uint64_t ring_id, uint32_t policy, uint64_t records, uint64_t bytes)
+{
+    (void)ring_id;
+    (void)policy;
+    (void)records;
+    (void)bytes;
+}
+
+PA_INLINE void pa_trace_batch(uint32_t event, size_t bytes, size_t fragments, uint64_t age_us)
+{
+    (void)event;
+    (void)bytes;
+    (void)fragments;
+    (void)age_us;
+}
+
+PA_INLINE void pa_trace_session(uint32_t session, int32_t from, int32_t to)
+{
+    (void)session;
+    (void)from;
+    (void)to;
+}
+
+#endif
+
+// Time a hook or callback: counted by pa_stats_record() and, when
+// someone listens, traced as an enter/exit pair
+PA_INLINE uint64_t pa_span_begin(PaStatsKind kind, size_t bytes)
+{
+    if (pa_trace_on(kind == PA_STATS_CALLBACK ? PA_TRACE_CALLBACKS : PA_TRACE_HOOKS)) {
+        pa_trace_enter(kind, bytes);
+    }
+    return pa_ticks();
+}
+
+PA_INLINE void pa_span_end(PaStatsKind kind, size_t bytes, uint64_t start)
+{
+    uint64_t ticks = pa_ticks() - start;
+
+    pa_stats_record(kind, bytes, ticks);
+    if (pa_trace_on(kind == PA_STATS_CALLBACK ? PA_TRACE_CALLBACKS : PA_TRACE_HOOKS)) {
+        pa_trace_exit(kind, bytes, ticks);
+    }
+}
+
+#endif // PAIRADMIN_INTERNAL_H
@@ -0,0 +1,595 @@
+// Command line assembly for PairAdmin
+//
+// ldisc hands the hook keystrokes one at a time, pastes in bursts. The
+// line editor here follows what the shell's own line buffer will hold
+// (printable text, backspace, Ctrl-U, Ctrl-W, bracketed paste) so that
+// Enter yields the whole command at once. Keys that edit the line in
+// ways only the shell knows about (history, Tab completion, cursor
+// movement) leave it flagged PAIRADMIN_COMMAND_INEXACT.
+//
+// At Enter a single pass over the line splits it into simple commands,
+// flags chaining, expansion, traversal and encoded bytes, and looks the
+// name of every command up in the denylist, a small open-addressing
+// hash table replaced as a whole under the epoch.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+// Printable bytes in one input event that make it a paste
+#define PA_LINE_BURST 8
+
+// Nesting of quoted substitutions followed into
+#define PA_LINE_MAX_DEPTH 8
+
+// Escape sequence states
+enum {
+    PA_LINE_GROUND = 0,
+    PA_LINE_ESC,
+    PA_LINE_CSI,
+    PA_LINE_SS3
+};
+
+typedef struct PaDenySlot {
+    uint32_t hash;
+    uint32_t index;             // 1-based entry number; 0 marks a free slot
+    uint32_t offset;            // Name in the pool, lower case
+    uint32_t length;
+} PaDenySlot;
+
+typedef struct PaDenylist {
+    uint32_t mode;
+    uint32_t mask;              // Slot count - 1
+    PaDenySlot *slots;
+    char *pool;
+} PaDenylist;
+
+static PaDenylist *volatile pa_denylist = NULL;
+
+// ------------------------------------------------------------
+// Line editor
+// ------------------------------------------------------------
+
+void pa_line_clear(PaLineEditor *ed)
+{
+    ed->length = 0;
+    ed->flags = 0;
+}
+
+static void pa_line_erase_char(PaLineEditor *ed)
+{
+    // A whole UTF-8 sequence, not just its last byte
+    while (ed->length > 0 && ((unsigned char)ed->text[ed->length - 1] & 0xc0) == 0x80) {
+        ed->length--;
+    }
+    if (ed->length > 0) {
+        ed->length--;
+    }
+}
+
+static void pa_line_erase_word(PaLineEditor *ed)
+{
+    while (ed->length > 0 && (ed->text[ed->length - 1] == ' ' || ed->text[ed->length - 1] == '\t')) {
+        ed->length--;
+    }
+    while (ed->length > 0 && ed->text[ed->length - 1] != ' ' && ed->text[ed->length - 1] != '\t') {
+        ed->length--;
+    }
+}
+
+static void pa_line_put(PaLineEditor *ed, unsigned char c)
+{
+    if (ed->length == PAIRADMIN_COMMAND_MAX) {
+        ed->flags |= PAIRADMIN_COMMAND_TRUNCATED;
+        return;
+    }
+    ed->text[ed->length++] = (char)c;
+}
+
+// End of a CSI sequence: bracketed paste markers switch paste mode,
+// anything else (cursor keys, Delete, Home/End) edits the line unseen
+static void pa_line_csi(PaLineEditor *ed, unsigned char final)
+{
+    if (final == '~' && ed->csi_length == 3 && memcmp(ed->csi, "200", 3) == 0) {
+        ed->paste = 1;
+        ed->flags |= PAIRADMIN_COMMAND_PASTED;
+    } else if (final == '~' && ed->csi_length == 3 && memcmp(ed->csi, "201", 3) == 0) {
+        ed->paste = 0;
+    } else {
+        ed->flags |= PAIRADMIN_COMMAND_INEXACT;
+    }
+}
+
+size_t pa_line_feed(PaLineEditor *ed, const void *data, size_t len, int *done)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint32_t typed = 0;
+    size_t i;
+
+    *done = 0;
+    for (i = 0; i < len; i++) {
+        unsigned char c = p[i];
+        int cr = ed->cr;
+
+        ed->cr = 0;
+        switch (ed->esc) {
+        case PA_LINE_ESC:
+            ed->esc = c == '[' ? PA_LINE_CSI : c == 'O' ? PA_LINE_SS3 : PA_LINE_GROUND;
+            ed->csi_length = 0;
+            if (ed->esc == PA_LINE_GROUND) {
+                // Meta/Alt key: a readline command
+                ed->flags |= PAIRADMIN_COMMAND_INEXACT;
+            }
+            continue;
+        case PA_LINE_CSI:
+            if (c >= 0x40 && c <= 0x7e) {
+                ed->esc = PA_LINE_GROUND;
+                pa_line_csi(ed, c);
+            } else if (ed->csi_length < sizeof(ed->csi)) {
+                ed->csi[ed->csi_length++] = (char)c;
+            }
+            continue;
+        case PA_LINE_SS3:
+            ed->esc = PA_LINE_GROUND;
+            ed->flags |= PAIRADMIN_COMMAND_INEXACT;
+            continue;
+        }
+
+        if (c == 0x1b) {
+            ed->esc = PA_LINE_ESC;
+            continue;
+        }
+
+        if (ed->paste) {
+            // Pasted line breaks stay in the line until Enter is typed
+            if (c == '\r' || c == '\n') {
+                ed->cr = c == '\r';
+                if (!(c == '\n' && cr)) {
+                    pa_line_put(ed, '\n');
+                }
+            } else if (c >= 0x20 || c == '\t') {
+                pa_line_put(ed, c);
+            }
+            continue;
+        }
+
+        if (c >= 0x20 && c != 0x7f) {
+            pa_line_put(ed, c);
+            typed++;
+            continue;
+        }
+
+        switch (c) {
+        case '\r':
+            ed->cr = 1;
+            // Fall through
+        case '\n':
+            if (c == '\n' && cr) {
+                continue;       // The LF of a CR LF pair
+            }
+            if (typed >= PA_LINE_BURST) {
+                ed->flags |= PAIRADMIN_COMMAND_PASTED;
+            }
+            *done = 1;
+            return i + 1;
+        case 0x08:
+        case 0x7f:
+            pa_line_erase_char(ed);
+            break;
+        case 0x15:              // Ctrl-U
+            pa_line_clear(ed);
+            break;
+        case 0x17:              // Ctrl-W
+            pa_line_erase_word(ed);
+            break;
+        case 0x03:              // Ctrl-C: the line is abandoned
+            pa_line_clear(ed);
+            break;
+        case 0x04:              // Ctrl-D
+        case 0x0c:              // Ctrl-L
+            break;
+        default:
+            // Tab completion, Ctrl-R and the other readline keys
+            ed->flags |= PAIRADMIN_COMMAND_INEXACT;
+            break;
+        }
+    }
+
+    if (typed >= PA_LINE_BURST) {
+        ed->flags |= PAIRADMIN_COMMAND_PASTED;
+    }
+    return len;
+}
+
+// ------------------------------------------------------------
+// Denylist
+// ------------------------------------------------------------
+
+static unsigned char pa_line_lower(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+// FNV-1a over the lower-cased name
+static uint32_t pa_deny_hash(const char *name, size_t len)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ pa_line_lower((unsigned char)name[i])) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t pa_deny_lookup(const PaDenylist *list, const char *name, size_t len)
+{
+    uint32_t h = pa_deny_hash(name, len);
+    uint32_t i = h & list->mask;
+
+    for (;; i = (i + 1) & list->mask) {
+        const PaDenySlot *slot = &list->slots[i];
+        size_t k;
+
+        if (!slot->index) {
+            return 0;
+        }
+        if (slot->hash != h || slot->length != len) {
+            continue;
+        }
+        for (k = 0; k < len; k++) {
+            if (list->pool[slot->offset + k] != (char)pa_line_lower((unsigned char)name[k])) {
+                break;
+            }
+        }
+        if (k == len) {
+            return slot->index;
+        }
+    }
+}
+
+static void pa_deny_free(PaDenylist *list)
+{
+    if (list) {
+        free(list->slots);
+        free(list->pool);
+        free(list);
+    }
+}
+
+int pairadmin_set_command_denylist(const char *const *names, uint32_t count, PairAdminDenyMode mode)
+{
+    PaDenylist *list = NULL;
+    PaDenylist *old;
+    size_t pool = 0;
+    uint32_t slots = 4;
+    uint32_t i;
+
+    if (mode < PAIRADMIN_DENY_OFF || mode > PAIRADMIN_DENY_BLOCK || (count && !names)) {
+        return -1;
+    }
+
+    if (mode != PAIRADMIN_DENY_OFF && count > 0) {
+        for (i = 0; i < count; i++) {
+            if (!names[i]) {
+                return -1;
+            }
+            pool += strlen(names[i]);
+        }
+        // At most half full
+        while (slots < count * 2) {
+            slots <<= 1;
+        }
+
+        list = (PaDenylist *)calloc(1, sizeof(PaDenylist));
+        if (!list) {
+            return -1;
+        }
+        list->slots = (PaDenySlot *)calloc(slots, sizeof(PaDenySlot));
+        list->pool = (char *)malloc(pool + 1);
+        if (!list->slots || !list->pool) {
+            pa_deny_free(list);
+            return -1;
+        }
+        list->mode = (uint32_t)mode;
+        list->mask = slots - 1;
+
+        pool = 0;
+        for (i = 0; i < count; i++) {
+            size_t len = strlen(names[i]);
+            uint32_t h = pa_deny_hash(names[i], len);
+            uint32_t s = h & list->mask;
+            size_t k;
+
+            if (len == 0 || pa_deny_lookup(list, names[i], len)) {
+                continue;
+            }
+            while (list->slots[s].index) {
+                s = (s + 1) & list->mask;
+            }
+            for (k = 0; k < len; k++) {
+                list->pool[pool + k] = (char)pa_line_lower((unsigned char)names[i][k]);
+            }
+            list->slots[s].hash = h;
+            list->slots[s].index = i + 1;
+            list->slots[s].offset = (uint32_t)pool;
+            list->slots[s].length = (uint32_t)len;
+            pool += len;
+        }
+    }
+
+    old = (PaDenylist *)pa_atomic_xchg_ptr((void *volatile *)&pa_denylist, list);
+    if (old) {
+        // Hooks look names up inside an epoch section
+        pa_epoch_synchronize();
+        pa_deny_free(old);
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Line analysis
+// ------------------------------------------------------------
+
+static int pa_line_is_hex(unsigned char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static int pa_line_is_word(unsigned char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+// Words that run the command after them
+static int pa_line_is_wrapper(const char *w, size_t len)
+{
+    static const char *const wrappers[] = {
+        "sudo", "doas", "env", "nohup", "time", "exec", "command", "nice", "builtin", "xargs"
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(wrappers) / sizeof(wrappers[0]); i++) {
+        if (strlen(wrappers[i]) == len && memcmp(wrappers[i], w, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// sudo options that take a value
+static int pa_line_option_takes_value(const char *w, size_t len)
+{
+    return len == 2 && w[0] == '-' && strchr("ugChDpRTU", w[1]) != NULL;
+}
+
+typedef struct PaLineScan {
+    const PaDenylist *list;
+    uint32_t flags;
+    uint32_t denied;
+    int expect;                 // Next word is a command name
+    int skip;                   // Next word is an option's value
+} PaLineScan;
+
+// The word as the shell passes it on: quotes, $'...' and $"..." opened
+// and closed, backslashes resolved. Returns its length in out.
+static size_t pa_line_unquote(const char *w, size_t len, char *out)
+{
+    char quote = 0;
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        char c = w[i];
+
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = 0;
+            } else {
+                out[n++] = c;
+            }
+        } else if (c == '\\' && i + 1 < len) {
+            out[n++] = w[++i];
+        } else if (quote && c == quote) {
+            quote = 0;
+        } else if (!quote && (c == '\'' || c == '"')) {
+            quote = c;
+        } else if (!quote && c == '$' && i + 1 < len && (w[i + 1] == '\'' || w[i + 1] == '"')) {
+            continue;
+        } else {
+            out[n++] = c;
+        }
+    }
+    return n;
+}
+
+// One word of the line, quotes included
+static void pa_line_word(PaLineScan *scan, const char *w, size_t len)
+{
+    char buffer[PAIRADMIN_COMMAND_MAX];
+    const char *name = buffer;
+    size_t n;
+    const char *slash;
+
+    if (!scan->expect || len == 0) {
+        return;
+    }
+    if (scan->skip) {
+        scan->skip = 0;
+        return;
+    }
+    if (w[0] == '-') {
+        scan->skip = pa_line_option_takes_value(w, len);
+        return;
+    }
+    if (memchr(w, '=', len) && w[0] != '=') {
+        return;                 // VAR=value before the command
+    }
+
+    // \rm, r''m, "r"m, $'rm' and /bin/rm all run rm
+    n = pa_line_unquote(w, len, buffer);
+    while ((slash = (const char *)memchr(name, '/', n)) != NULL) {
+        n -= (size_t)(slash + 1 - name);
+        name = slash + 1;
+    }
+
+    if (pa_line_is_wrapper(name, n)) {
+        return;
+    }
+    scan->expect = 0;
+    if (scan->list && !scan->denied) {
+        scan->denied = pa_deny_lookup(scan->list, name, n);
+    }
+}
+
+// End of a substitution starting at from: the matching ')' of $( or
+// the closing backtick
+static size_t pa_line_substitution_end(const char *text, size_t len, size_t from, int backtick)
+{
+    int open = 1;
+    size_t i;
+
+    for (i = from; i < len; i++) {
+        if (text[i] == '\\' && i + 1 < len) {
+            i++;
+        } else if (backtick ? text[i] == '`' : text[i] == ')' && --open == 0) {
+            return i;
+        } else if (!backtick && text[i] == '(') {
+            open++;
+        }
+    }
+    return len;
+}
+
+static void pa_line_scan(PaLineScan *scan, const char *text, size_t len, int depth)
+{
+    char quote = 0;
+    size_t word = 0;
+    int in_word = 0;
+    size_t i;
+
+    scan->expect = 1;
+    for (i = 0; i <= len; i++) {
+        unsigned char c = i < len ? (unsigned char)text[i] : ' ';
+        int boundary = 0;
+        int separator = 0;
+
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = 0;
+            }
+            continue;
+        }
+
+        if (c == '$' && i + 1 < len &&
+            (pa_line_is_word((unsigned char)text[i + 1]) || text[i + 1] == '{')) {
+            scan->flags |= PAIRADMIN_COMMAND_EXPANSION;
+        }
+        if (c == '.' && i + 2 < len && text[i + 1] == '.' && text[i + 2] == '/') {
+            scan->flags |= PAIRADMIN_COMMAND_TRAVERSAL;
+        }
+        if (i + 3 < len && pa_line_is_hex((unsigned char)text[i + 2]) &&
+            pa_line_is_hex((unsigned char)text[i + 3]) &&
+            ((c == '\\' && text[i + 1] == 'x') || (c == '0' && (text[i + 1] == 'x' || text[i + 1] == 'X')))) {
+            scan->flags |= PAIRADMIN_COMMAND_ENCODED;
+        }
+        if (c == '%' && i + 2 < len && pa_line_is_hex((unsigned char)text[i + 1]) &&
+            pa_line_is_hex((unsigned char)text[i + 2])) {
+            scan->flags |= PAIRADMIN_COMMAND_ENCODED;
+        }
+
+        if (quote == '"') {
+            if (c == '"') {
+                quote = 0;
+            } else if (c == '`' || (c == '$' && i + 1 < len && text[i + 1] == '(')) {
+                // Substitution inside quotes: its commands run as well
+                size_t from = c == '`' ? i + 1 : i + 2;
+                size_t end = pa_line_substitution_end(text, len, from, c == '`');
+                int expect = scan->expect;
+                int skip = scan->skip;
+
+                scan->flags |= PAIRADMIN_COMMAND_CHAINED;
+                if (depth < PA_LINE_MAX_DEPTH) {
+                    pa_line_scan(scan, text + from, end - from, depth + 1);
+                }
+                scan->expect = expect;
+                scan->skip = skip;
+                i = end;
+            }
+            continue;
+        }
+
+        if (c == '\\' && i + 1 < len) {
+            if (!in_word) {
+                in_word = 1;
+                word = i;
+            }
+            i++;
+            continue;
+        }
+        if (c == '\'' || c == '"') {
+            if (!in_word) {
+                in_word = 1;
+                word = i;
+            }
+            quote = (char)c;
+            continue;
+        }
+
+        if (c == '&' && ((i > 0 && (text[i - 1] == '>' || text[i - 1] == '<')) ||
+                         (i + 1 < len && text[i + 1] == '>'))) {
+            // 2>&1, &>file: a redirection, not a separator
+        } else if (c == ' ' || c == '\t') {
+            boundary = 1;
+        } else if (c == ';' || c == '&' || c == '|' || c == '(' || c == ')' || c == '`' || c == '\n') {
+            boundary = separator = 1;
+        } else if (c == '$' && i + 1 < len && text[i + 1] == '(') {
+            boundary = separator = 1;
+            i++;
+        }
+
+        if (boundary) {
+            if (in_word) {
+                pa_line_word(scan, text + word, i - word);
+                in_word = 0;
+            }
+            if (separator) {
+                if (c != '\n' && c != '(' && c != ')') {
+                    scan->flags |= PAIRADMIN_COMMAND_CHAINED;
+                }
+                scan->expect = 1;
+                scan->skip = 0;
+            }
+        } else if (!in_word) {
+            in_word = 1;
+            word = i;
+        }
+    }
+}
+
+uint32_t pa_line_check(const PaLineEditor *ed, int checked, uint32_t *denied)
+{
+    PaLineScan scan;
+    PaDenylist *list;
+    uint32_t epoch;
+
+    memset(&scan, 0, sizeof(scan));
+    scan.flags = ed->flags;
+
+    epoch = pa_epoch_enter();
+    list = (PaDenylist *)pa_load_acquire_ptr((void *const volatile *)&pa_denylist);
+    scan.list = list;
+    pa_line_scan(&scan, ed->text, ed->length, 0);
+    if (scan.denied) {
+        scan.flags |= PAIRADMIN_COMMAND_DENIED;
+        if (checked && list->mode == PAIRADMIN_DENY_BLOCK) {
+            scan.flags |= PAIRADMIN_COMMAND_BLOCKED;
+        }
+    }
+    pa_epoch_exit(epoch);
+
+    *denied = scan.denied;
+    return scan.flags;
+}
@@ -0,0 +1,483 @@
+// Shell marks for PairAdmin
+//
+// Where a prompt ends and a command's output begins is only guessed at
+// by regular expressions once text reaches the managed side. Shells
+// that integrate with their terminal say so outright: OSC 133 (and the
+// VS Code variant, OSC 633) bracket the prompt and each command, and
+// OSC 7 reports the working directory. The scanner here follows the
+// escape sequences of every OUTPUT fragment, so the marks are found in
+// the one pass the bytes get before they are queued, and reported at
+// the exact byte they belong to.
+//
+// Shells without integration get a fingerprint instead: output that
+// ends in it when the hook returns, a shell sitting at a prompt, is
+// taken to be one, and the next command line submitted from it starts a
+// command. Either way the state is the session's own, a producer-only
+// structure like its line editor; only the configuration is shared,
+// swapped as a whole under the epoch like the denylist.
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+// Escape sequence states
+enum {
+    PA_MARK_GROUND = 0,
+    PA_MARK_ESC,
+    PA_MARK_CSI,
+    PA_MARK_OSC,
+    PA_MARK_OSC_ESC,
+    PA_MARK_STRING,             // DCS, SOS, PM, APC: skipped to ST
+    PA_MARK_STRING_ESC
+};
+
+// Where the shell is
+enum {
+    PA_MARK_IDLE = 0,           // No prompt since the last command
+    PA_MARK_PROMPT,             // At a prompt
+    PA_MARK_SUBMITTED,          // Line entered, the shell's C yet to come
+    PA_MARK_RUNNING             // Between COMMAND_START and COMMAND_END
+};
+
+typedef struct PaMarkConfig {
+    uint32_t sources;
+    uint32_t fingerprint_len;
+    unsigned char fingerprint[PAIRADMIN_FINGERPRINT_MAX];
+} PaMarkConfig;
+
+static PaMarkConfig *volatile pa_mark_config = NULL;
+
+// Bumped by every change; a scanner rereads the configuration once its
+// own copy is of an older generation
+static volatile uint32_t pa_mark_generation = 0;
+
+int pairadmin_set_shell_marks(uint32_t sources, const char *fingerprint)
+{
+    size_t len = fingerprint ? strlen(fingerprint) : 0;
+    PaMarkConfig *config = NULL;
+    PaMarkConfig *old;
+
+    if ((sources & ~(uint32_t)(PAIRADMIN_MARKS_SHELL | PAIRADMIN_MARKS_FINGERPRINT)) ||
+        len > PAIRADMIN_FINGERPRINT_MAX) {
+        return -1;
+    }
+    if ((sources & PAIRADMIN_MARKS_FINGERPRINT) && len == 0) {
+        sources &= ~(uint32_t)PAIRADMIN_MARKS_FINGERPRINT;
+    }
+
+    if (sources != PAIRADMIN_MARKS_OFF) {
+        config = (PaMarkConfig *)calloc(1, sizeof(PaMarkConfig));
+        if (!config) {
+            return -1;
+        }
+        config->sources = sources;
+        if (sources & PAIRADMIN_MARKS_FINGERPRINT) {
+            config->fingerprint_len = (uint32_t)len;
+            memcpy(config->fingerprint, fingerprint, len);
+        }
+    }
+
+    old = (PaMarkConfig *)pa_atomic_xchg_ptr((void *volatile *)&pa_mark_config, config);
+    pa_atomic_inc_u32(&pa_mark_generation);
+    if (old) {
+        // Scanners copy the configuration inside an epoch section
+        pa_epoch_synchronize();
+        free(old);
+    }
+    return 0;
+}
+
+int pa_marks_begin(PaMarkScanner *m)
+{
+    uint32_t generation = pa_load_acquire_u32(&pa_mark_generation);
+
+    if (generation != m->active) {
+        uint32_t epoch = pa_epoch_enter();
+        const PaMarkConfig *config =
+            (const PaMarkConfig *)pa_load_acquire_ptr((void *const volatile *)&pa_mark_config);
+
+        m->sources = config ? config->sources : PAIRADMIN_MARKS_OFF;
+        m->fingerprint_len = config ? config->fingerprint_len : 0;
+        if (m->fingerprint_len) {
+            memcpy(m->fingerprint, config->fingerprint, m->fingerprint_len);
+        }
+        pa_epoch_exit(epoch);
+
+        // Start over from here; offset keeps counting
+        m->active = generation;
+        m->state = PA_MARK_GROUND;
+        m->phase = PA_MARK_IDLE;
+        m->integrated = 0;
+        m->pending = 0;
+        m->osc_len = 0;
+        m->line_start = m->offset;
+        m->prompt_line = UINT64_MAX;
+        m->command_offset = m->offset;
+        m->tail_len = 0;
+        m->directory = 0;
+    }
+    return m->sources != PAIRADMIN_MARKS_OFF;
+}
+
+// Fill in the mark being reported
+static uint16_t pa_marks_report(PaMarkScanner *m, uint16_t type, uint16_t source, uint64_t offset,
+                                int32_t exit_code, uint32_t path_len, uint32_t *length)
+{
+    PairAdminMarkInfo info;
+
+    memset(&info, 0, sizeof(info));
+    info.offset = offset;
+    info.command_offset = type == PAIRADMIN_EVENT_COMMAND_END ? m->command_offset : offset;
+    info.exit_code = exit_code;
+    info.source = source;
+    info.length = path_len;
+    memcpy(m->event, &info, sizeof(info));
+    *length = (uint32_t)sizeof(info) + path_len;
+    return type;
+}
+
+// ------------------------------------------------------------
+// Plain text
+// ------------------------------------------------------------
+
+// Text between escape sequences, first byte at offset `at`: only the
+// line it leaves the cursor on matters
+static void pa_marks_text(PaMarkScanner *m, const unsigned char *p, size_t n, uint64_t at)
+{
+    unsigned char recent[PAIRADMIN_FINGERPRINT_MAX];
+    size_t start = n;
+    size_t k = sizeof(recent);
+    size_t got;
+    size_t keep;
+    size_t i;
+
+    while (start > 0 && p[start - 1] != '\n' && p[start - 1] != '\r') {
+        start--;
+    }
+    if (start > 0) {
+        m->line_start = at + start;
+        m->tail_len = 0;
+    }
+    if (m->fingerprint_len == 0 || m->integrated) {
+        return;
+    }
+
+    // Last printable bytes of the line, merged after what it already had
+    for (i = n; i > start && k > 0; i--) {
+        if (p[i - 1] >= 0x20 && p[i - 1] != 0x7f) {
+            recent[--k] = p[i - 1];
+        }
+    }
+    got = sizeof(recent) - k;
+    keep = m->tail_len < sizeof(recent) - got ? m->tail_len : sizeof(recent) - got;
+    memmove(m->tail, m->tail + m->tail_len - keep, keep);
+    memcpy(m->tail + keep, recent + k, got);
+    m->tail_len = (uint32_t)(keep + got);
+}
+
+// ------------------------------------------------------------
+// OSC sequences
+// ------------------------------------------------------------
+
+PA_INLINE int pa_marks_prefix(const char *s, size_t n, const char *prefix)
+{
+    size_t len = strlen(prefix);
+
+    return n >= len && memcmp(s, prefix, len) == 0;
+}
+
+PA_INLINE int pa_marks_hex(unsigned char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// OSC 7 file://host/path, OSC 633 P;Cwd= and OSC 1337 CurrentDir=. Every
+// report is passed on, so a consumer can tell a shell that stopped
+// reporting from one that stayed put; a repeat is flagged UNCHANGED.
+static uint16_t pa_marks_directory(PaMarkScanner *m, const char *s, size_t n, int url, uint64_t at,
+                                   uint32_t *length)
+{
+    unsigned char *path = m->event + sizeof(PairAdminMarkInfo);
+    uint32_t hash = 2166136261u;
+    uint16_t flags = 0;
+    size_t out = 0;
+    size_t i = 0;
+
+    if (url) {
+        // Scheme and host dropped: the path is on the machine the shell runs on
+        const char *scheme = NULL;
+
+        for (i = 0; i + 2 < n && s[i] != '/'; i++) {
+            if (s[i] == ':' && s[i + 1] == '/' && s[i + 2] == '/') {
+                scheme = s + i + 3;
+                break;
+            }
+        }
+        i = 0;
+        if (scheme) {
+            i = (size_t)(scheme - s);
+            while (i < n && s[i] != '/') {
+                i++;
+            }
+        }
+    }
+
+    for (; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+
+        if (url && c == '%' && i + 2 < n && pa_marks_hex((unsigned char)s[i + 1]) >= 0 &&
+            pa_marks_hex((unsigned char)s[i + 2]) >= 0) {
+            c = (unsigned char)(pa_marks_hex((unsigned char)s[i + 1]) << 4 | pa_marks_hex((unsigned char)s[i + 2]));
+            i += 2;
+        }
+        path[out++] = c;
+        hash = (hash ^ c) * 16777619u;
+    }
+    if (out == 0) {
+        return 0;
+    }
+
+    hash = hash ? hash : 1;
+    if (hash == m->directory) {
+        flags = PAIRADMIN_MARK_UNCHANGED;
+    }
+    m->directory = hash;
+    pa_marks_report(m, PAIRADMIN_EVENT_DIRECTORY, PAIRADMIN_MARKS_SHELL, at, PAIRADMIN_EXIT_UNKNOWN,
+                    (uint32_t)out, length);
+    memcpy(m->event + offsetof(PairAdminMarkInfo, flags), &flags, sizeof(flags));
+    return PAIRADMIN_EVENT_DIRECTORY;
+}
+
+// OSC 133/633 A (prompt), C (command output) and D;status (finished)
+static uint16_t pa_marks_shell(PaMarkScanner *m, const char *s, size_t n, uint64_t at, uint32_t *length)
+{
+    int32_t exit_code = PAIRADMIN_EXIT_UNKNOWN;
+
+    if (n == 0) {
+        return 0;
+    }
+    switch (s[0]) {
+    case 'A':
+        m->integrated = 1;
+        m->pending = 0;
+        m->phase = PA_MARK_PROMPT;
+        return pa_marks_report(m, PAIRADMIN_EVENT_PROMPT, PAIRADMIN_MARKS_SHELL, at, PAIRADMIN_EXIT_UNKNOWN, 0,
+                               length);
+
+    case 'C':
+        m->integrated = 1;
+        if (m->phase == PA_MARK_RUNNING) {
+            return 0;
+        }
+        m->phase = PA_MARK_RUNNING;
+        m->command_offset = at;
+        return pa_marks_report(m, PAIRADMIN_EVENT_COMMAND_START, PAIRADMIN_MARKS_SHELL, at,
+                               PAIRADMIN_EXIT_UNKNOWN, 0, length);
+
+    case 'D':
+        m->integrated = 1;
+        if (m->phase != PA_MARK_RUNNING && m->phase != PA_MARK_SUBMITTED) {
+            // Nothing ran: an empty line or Ctrl-C at the prompt
+            m->phase = PA_MARK_IDLE;
+            return 0;
+        }
+        m->phase = PA_MARK_IDLE;
+        if (n > 2 && s[1] == ';') {
+            size_t i = 2;
+            int negative = s[i] == '-';
+            int64_t v = 0;
+
+            i += (size_t)negative;
+            while (i < n && s[i] >= '0' && s[i] <= '9' && v <= INT32_MAX) {
+                v = v * 10 + (s[i++] - '0');
+            }
+            if (i > 2 + (size_t)negative && v <= INT32_MAX) {
+                exit_code = (int32_t)(negative ? -v : v);
+            }
+        }
+        return pa_marks_report(m, PAIRADMIN_EVENT_COMMAND_END, PAIRADMIN_MARKS_SHELL, at, exit_code, 0, length);
+
+    case 'P':
+        if (pa_marks_prefix(s, n, "P;Cwd=")) {
+            return pa_marks_directory(m, s + 6, n - 6, 0, at, length);
+        }
+        return 0;
+
+    default:
+        // B (prompt end, command line begins) and E (command line) add nothing
+        return 0;
+    }
+}
+
+// A whole OSC sequence ended at offset `at`; 0 if it makes no mark
+static uint16_t pa_marks_osc(PaMarkScanner *m, uint64_t at, uint32_t *length)
+{
+    const char *s = (const char *)m->osc;
+    size_t n = m->osc_len;
+
+    if (!(m->sources & PAIRADMIN_MARKS_SHELL) || n > PA_MARK_OSC_MAX) {
+        return 0;
+    }
+    if (pa_marks_prefix(s, n, "133;") || pa_marks_prefix(s, n, "633;")) {
+        return pa_marks_shell(m, s + 4, n - 4, at, length);
+    }
+    if (pa_marks_prefix(s, n, "7;")) {
+        return pa_marks_directory(m, s + 2, n - 2, 1, at, length);
+    }
+    if (pa_marks_prefix(s, n, "1337;CurrentDir=")) {
+        return pa_marks_directory(m, s + 16, n - 16, 0, at, length);
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Scanning
+// ------------------------------------------------------------
+
+size_t pa_marks_output(PaMarkScanner *m, const void *data, size_t len, uint16_t *type, uint32_t *length)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i = 0;
+
+    *type = 0;
+    while (i < len && !*type) {
+        unsigned char c;
+
+        if (m->state == PA_MARK_GROUND) {
+            // Text runs to the next ESC in one step
+            const unsigned char *esc = (const unsigned char *)memchr(p + i, 0x1b, len - i);
+            size_t end = esc ? (size_t)(esc - p) : len;
+
+            pa_marks_text(m, p + i, end - i, m->offset + i);
+            if (!esc) {
+                i = len;
+                break;
+            }
+            i = end + 1;
+            m->state = PA_MARK_ESC;
+            continue;
+        }
+
+        c = p[i++];
+        switch (m->state) {
+        case PA_MARK_ESC:
+            if (c == ']') {
+                m->state = PA_MARK_OSC;
+                m->osc_len = 0;
+            } else if (c == '[') {
+                m->state = PA_MARK_CSI;
+            } else if (c == 'P' || c == 'X' || c == '^' || c == '_') {
+                m->state = PA_MARK_STRING;
+            } else if (c != 0x1b && (c < 0x20 || c > 0x2f)) {
+                // Final byte; intermediates such as ESC ( B keep going
+                m->state = PA_MARK_GROUND;
+            }
+            break;
+
+        case PA_MARK_CSI:
+            if (c == 0x1b) {
+                m->state = PA_MARK_ESC;
+            } else if ((c >= 0x40 && c <= 0x7e) || c == 0x18 || c == 0x1a) {
+                m->state = PA_MARK_GROUND;
+            }
+            break;
+
+        case PA_MARK_OSC:
+            if (c == 0x07) {
+                m->state = PA_MARK_GROUND;
+                *type = pa_marks_osc(m, m->offset + i, length);
+            } else if (c == 0x1b) {
+                m->state = PA_MARK_OSC_ESC;
+            } else if (c == 0x18 || c == 0x1a) {
+                m->state = PA_MARK_GROUND;
+            } else if (m->osc_len < PA_MARK_OSC_MAX) {
+                m->osc[m->osc_len++] = c;
+            } else {
+                m->osc_len = PA_MARK_OSC_MAX + 1;
+            }
+            break;
+
+        case PA_MARK_OSC_ESC:
+            // ST ends the sequence; any other escape ends it as well,
+            // and starts over from that byte
+            *type = pa_marks_osc(m, m->offset + i - (c == '\\' ? 0 : 2), length);
+            m->state = PA_MARK_GROUND;
+            if (c != '\\') {
+                m->state = PA_MARK_ESC;
+                i--;
+            }
+            break;
+
+        case PA_MARK_STRING:
+            if (c == 0x1b) {
+                m->state = PA_MARK_STRING_ESC;
+            } else if (c == 0x18 || c == 0x1a) {
+                m->state = PA_MARK_GROUND;
+            }
+            break;
+
+        default:
+            m->state = PA_MARK_GROUND;
+            if (c != '\\') {
+                m->state = PA_MARK_ESC;
+                i--;
+            }
+            break;
+        }
+    }
+
+    m->offset += i;
+    return i;
+}
+
+uint16_t pa_marks_pause(PaMarkScanner *m, uint32_t *length)
+{
+    if (m->pending) {
+        // The PROMPT that goes with the COMMAND_END just reported
+        m->pending = 0;
+        m->phase = PA_MARK_PROMPT;
+        return pa_marks_report(m, PAIRADMIN_EVENT_PROMPT, PAIRADMIN_MARKS_FINGERPRINT, m->prompt_line,
+                               PAIRADMIN_EXIT_UNKNOWN, 0, length);
+    }
+    if (m->integrated || m->state != PA_MARK_GROUND || m->fingerprint_len == 0 ||
+        m->tail_len < m->fingerprint_len || m->line_start == m->prompt_line ||
+        memcmp(m->tail + m->tail_len - m->fingerprint_len, m->fingerprint, m->fingerprint_len) != 0) {
+        return 0;
+    }
+
+    m->prompt_line = m->line_start;
+    if (m->phase == PA_MARK_RUNNING) {
+        // The command's output runs up to its prompt line
+        m->pending = 1;
+        m->phase = PA_MARK_IDLE;
+        return pa_marks_report(m, PAIRADMIN_EVENT_COMMAND_END, PAIRADMIN_MARKS_FINGERPRINT, m->line_start,
+                               PAIRADMIN_EXIT_UNKNOWN, 0, length);
+    }
+    m->phase = PA_MARK_PROMPT;
+    return pa_marks_report(m, PAIRADMIN_EVENT_PROMPT, PAIRADMIN_MARKS_FINGERPRINT, m->line_start,
+                           PAIRADMIN_EXIT_UNKNOWN, 0, length);
+}
+
+uint16_t pa_marks_submit(PaMarkScanner *m, uint32_t *length)
+{
+    if (m->phase != PA_MARK_PROMPT) {
+        return 0;
+    }
+    m->command_offset = m->offset;
+    if (m->integrated) {
+        // The shell's own C will say where its output starts; this is
+        // where it ends should D come without one
+        m->phase = PA_MARK_SUBMITTED;
+        return 0;
+    }
+    m->phase = PA_MARK_RUNNING;
+    return pa_marks_report(m, PAIRADMIN_EVENT_COMMAND_START, PAIRADMIN_MARKS_FINGERPRINT, m->offset,
+                           PAIRADMIN_EXIT_UNKNOWN, 0, length);
+}
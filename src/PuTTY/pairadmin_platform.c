@@ -0,0 +1,916 @@
+// Platform helpers for the PairAdmin native layer
+//
+// Time, aligned allocation, worker threads, wakers, the terminal
+// window and connections to an audit collector. Everything that differs between the Windows build and the
+// development build on Linux/macOS lives here so the other translation
+// units stay free of #ifdefs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+// Before pairadmin.h: <windows.h> alone would pull in the old winsock.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <malloc.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+// ------------------------------------------------------------
+// Time
+// ------------------------------------------------------------
+
+uint64_t pa_now_us(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000u +
+           (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000u / (uint64_t)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+#endif
+}
+
+uint64_t pa_ticks(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return (uint64_t)now.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+uint64_t pa_ticks_ns(uint64_t ticks)
+{
+#ifdef _WIN32
+    // Nanoseconds per tick in 16.16 fixed point; exact for the usual 10 MHz
+    static uint64_t scale;
+
+    if (scale == 0) {
+        LARGE_INTEGER freq;
+
+        QueryPerformanceFrequency(&freq);
+        scale = (1000000000ull << 16) / (uint64_t)freq.QuadPart;
+    }
+    return (ticks * scale) >> 16;
+#else
+    return ticks;
+#endif
+}
+
+uint64_t pa_wall_time_us(void)
+{
+#ifdef _WIN32
+    FILETIME ft;
+    ULARGE_INTEGER t;
+
+    // 100 ns ticks since 1601-01-01
+    GetSystemTimePreciseAsFileTime(&ft);
+    t.LowPart = ft.dwLowDateTime;
+    t.HighPart = ft.dwHighDateTime;
+    return t.QuadPart / 10u - 11644473600000000ull;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+#endif
+}
+
+void pa_sleep_us(uint64_t us)
+{
+#ifdef _WIN32
+    // Sleep() has millisecond granularity; never spin
+    Sleep(us < 1000 ? 1 : (DWORD)(us / 1000));
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)(us / 1000000u);
+    ts.tv_nsec = (long)(us % 1000000u) * 1000;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+void pa_thread_yield(void)
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+// ------------------------------------------------------------
+// Files
+// ------------------------------------------------------------
+
+unsigned long pa_process_id(void)
+{
+#ifdef _WIN32
+    return (unsigned long)GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+int pa_temp_dir(char *buf, size_t cap)
+{
+#ifdef _WIN32
+    char dir[MAX_PATH + 1];
+    DWORD len = GetTempPathA(sizeof(dir), dir);
+
+    if (len == 0 || len > MAX_PATH) {
+        return -1;
+    }
+    // GetTempPathA() keeps the trailing backslash
+    dir[len - 1] = '\0';
+#else
+    const char *dir = getenv("TMPDIR");
+
+    if (!dir || !*dir) {
+        dir = "/tmp";
+    }
+#endif
+    if (strlen(dir) >= cap) {
+        return -1;
+    }
+    strcpy(buf, dir);
+    return 0;
+}
+
+int pa_temp_file_path(char *buf, size_t cap, const char *prefix, const char *ext)
+{
+    char dir[PA_PATH_MAX];
+    int n;
+
+    if (pa_temp_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    n = snprintf(buf, cap, "%s" PA_PATH_SEP "%s-%lu.%s", dir, prefix, pa_process_id(), ext);
+    return (n < 0 || (size_t)n >= cap) ? -1 : 0;
+}
+
+int pa_dir_exists(const char *path)
+{
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path);
+
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+int pa_file_map_create(PaFileMap *map, const char *path, size_t size)
+{
+#ifdef _WIN32
+    LARGE_INTEGER length;
+
+    map->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    length.QuadPart = (LONGLONG)size;
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READWRITE,
+                                      (DWORD)(length.QuadPart >> 32), (DWORD)length.QuadPart, NULL);
+    map->base = map->mapping ? MapViewOfFile(map->mapping, FILE_MAP_WRITE, 0, 0, size) : NULL;
+    if (!map->base) {
+        if (map->mapping) {
+            CloseHandle(map->mapping);
+        }
+        CloseHandle(map->file);
+        DeleteFileA(path);
+        return -1;
+    }
+#else
+    map->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (map->fd < 0) {
+        return -1;
+    }
+    if (ftruncate(map->fd, (off_t)size) != 0) {
+        close(map->fd);
+        unlink(path);
+        return -1;
+    }
+    map->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+    if (map->base == MAP_FAILED) {
+        map->base = NULL;
+        close(map->fd);
+        unlink(path);
+        return -1;
+    }
+#endif
+    map->size = size;
+    return 0;
+}
+
+void pa_file_map_close(PaFileMap *map, size_t keep)
+{
+#ifdef _WIN32
+    LARGE_INTEGER length;
+#endif
+
+    if (!map->base) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(map->base);
+    CloseHandle(map->mapping);
+    length.QuadPart = (LONGLONG)keep;
+    if (SetFilePointerEx(map->file, length, NULL, FILE_BEGIN)) {
+        SetEndOfFile(map->file);
+    }
+    CloseHandle(map->file);
+#else
+    munmap(map->base, map->size);
+    if (ftruncate(map->fd, (off_t)keep) != 0) {
+        // The file keeps its full size; readers go by the header
+    }
+    close(map->fd);
+#endif
+    map->base = NULL;
+}
+
+// ------------------------------------------------------------
+// Memory
+// ------------------------------------------------------------
+
+void *pa_aligned_alloc(size_t size)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, PA_CACHE_LINE);
+#else
+    void *p = NULL;
+    if (posix_memalign(&p, PA_CACHE_LINE, size) != 0) {
+        return NULL;
+    }
+    return p;
+#endif
+}
+
+void pa_aligned_free(void *p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// ------------------------------------------------------------
+// Threads
+// ------------------------------------------------------------
+
+typedef struct PaThreadStart {
+    PaThreadFn fn;
+    void *arg;
+} PaThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI pa_thread_trampoline(LPVOID param)
+#else
+static void *pa_thread_trampoline(void *param)
+#endif
+{
+    PaThreadStart start = *(PaThreadStart *)param;
+
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+int pa_thread_start(PaThread *thread, PaThreadFn fn, void *arg)
+{
+    PaThreadStart *start = (PaThreadStart *)malloc(sizeof(PaThreadStart));
+
+    if (!start) {
+        return -1;
+    }
+    start->fn = fn;
+    start->arg = arg;
+
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, pa_thread_trampoline, start, 0, NULL);
+    if (!thread->handle) {
+        free(start);
+        return -1;
+    }
+#else
+    if (pthread_create(&thread->handle, NULL, pa_thread_trampoline, start) != 0) {
+        free(start);
+        return -1;
+    }
+#endif
+    thread->running = 1;
+    return 0;
+}
+
+void pa_thread_join(PaThread *thread)
+{
+    if (!thread->running) {
+        return;
+    }
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    thread->running = 0;
+}
+
+// One key for the process; only the stats slots need it
+static void (*volatile pa_exit_fn)(void *) = NULL;
+
+#ifdef _WIN32
+static INIT_ONCE pa_exit_once = INIT_ONCE_STATIC_INIT;
+static DWORD pa_exit_index = FLS_OUT_OF_INDEXES;
+
+static VOID WINAPI pa_exit_run(PVOID arg)
+{
+    if (arg) {
+        pa_exit_fn(arg);
+    }
+}
+
+// The callback must not outlive the DLL
+static void pa_exit_free(void)
+{
+    FlsFree(pa_exit_index);
+}
+
+static BOOL CALLBACK pa_exit_init(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+    (void)once;
+    (void)param;
+    (void)context;
+    pa_exit_index = FlsAlloc(pa_exit_run);
+    if (pa_exit_index != FLS_OUT_OF_INDEXES) {
+        atexit(pa_exit_free);
+    }
+    return TRUE;
+}
+
+int pa_thread_on_exit(void (*fn)(void *), void *arg)
+{
+    pa_exit_fn = fn;
+    InitOnceExecuteOnce(&pa_exit_once, pa_exit_init, NULL, NULL);
+    if (pa_exit_index == FLS_OUT_OF_INDEXES) {
+        return -1;
+    }
+    return FlsSetValue(pa_exit_index, arg) ? 0 : -1;
+}
+#else
+static pthread_once_t pa_exit_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pa_exit_key;
+static int pa_exit_ready = 0;
+
+static void pa_exit_run(void *arg)
+{
+    pa_exit_fn(arg);
+}
+
+static void pa_exit_init(void)
+{
+    pa_exit_ready = pthread_key_create(&pa_exit_key, pa_exit_run) == 0;
+}
+
+int pa_thread_on_exit(void (*fn)(void *), void *arg)
+{
+    pa_exit_fn = fn;
+    pthread_once(&pa_exit_once, pa_exit_init);
+    if (!pa_exit_ready) {
+        return -1;
+    }
+    return pthread_setspecific(pa_exit_key, arg) == 0 ? 0 : -1;
+}
+#endif
+
+// ------------------------------------------------------------
+// Wakers
+// ------------------------------------------------------------
+
+int pa_waker_create(PaWaker *waker, const char *name)
+{
+#ifdef _WIN32
+    waker->event = CreateEventA(NULL, FALSE, FALSE, name);
+    return waker->event ? 0 : -1;
+#elif defined(__linux__)
+    (void)name;
+    waker->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    waker->write_fd = waker->fd;
+    return waker->fd >= 0 ? 0 : -1;
+#else
+    int fds[2];
+    int i;
+
+    (void)name;
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    waker->fd = fds[0];
+    waker->write_fd = fds[1];
+    return 0;
+#endif
+}
+
+void pa_waker_destroy(PaWaker *waker)
+{
+#ifdef _WIN32
+    if (waker->event) {
+        CloseHandle(waker->event);
+        waker->event = NULL;
+    }
+#else
+    if (waker->write_fd != waker->fd) {
+        close(waker->write_fd);
+    }
+    close(waker->fd);
+    waker->fd = waker->write_fd = -1;
+#endif
+}
+
+void pa_waker_signal(PaWaker *waker)
+{
+#ifdef _WIN32
+    SetEvent(waker->event);
+#else
+    uint64_t one = 1;
+
+    // An eventfd takes a counter increment, a pipe any byte. EAGAIN
+    // means it is signalled already.
+    if (write(waker->write_fd, &one, waker->write_fd == waker->fd ? sizeof(one) : 1) < 0) {
+    }
+#endif
+}
+
+int pa_waker_wait(PaWaker *waker, uint64_t timeout_us)
+{
+#ifdef _WIN32
+    DWORD ms = INFINITE;
+
+    if (timeout_us != PA_WAIT_FOREVER) {
+        uint64_t rounded = (timeout_us + 999) / 1000;
+        ms = rounded < INFINITE ? (DWORD)rounded : INFINITE - 1;
+    }
+    return WaitForSingleObject(waker->event, ms) == WAIT_OBJECT_0;
+#else
+    struct pollfd pfd;
+    unsigned char drain[64];
+    int ms = -1;
+
+    if (timeout_us != PA_WAIT_FOREVER) {
+        uint64_t rounded = (timeout_us + 999) / 1000;
+        ms = rounded < INT_MAX ? (int)rounded : INT_MAX;
+    }
+    pfd.fd = waker->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, ms) <= 0) {
+        // Timed out, or interrupted: the caller re-checks either way
+        return 0;
+    }
+    // Reset: one read zeroes an eventfd, a pipe empties in a few
+    while (read(waker->fd, drain, sizeof(drain)) > 0) {
+    }
+    return 1;
+#endif
+}
+
+intptr_t pa_waker_handle(const PaWaker *waker)
+{
+#ifdef _WIN32
+    return (intptr_t)waker->event;
+#else
+    return (intptr_t)waker->fd;
+#endif
+}
+
+// ------------------------------------------------------------
+// Terminal window
+// ------------------------------------------------------------
+
+int pa_window_embed(void *window, void *parent)
+{
+#ifdef _WIN32
+    HWND hwnd = (HWND)window;
+    LONG_PTR style = GetWindowLongPtr(hwnd, GWL_STYLE);
+
+    // A child has no frame of its own; the host draws the pane around it
+    style &= ~(LONG_PTR)(WS_POPUP | WS_CAPTION | WS_THICKFRAME | WS_SYSMENU |
+                         WS_MINIMIZEBOX | WS_MAXIMIZEBOX);
+    SetWindowLongPtr(hwnd, GWL_STYLE, style | WS_CHILD);
+    if (!SetParent(hwnd, (HWND)parent)) {
+        return -1;
+    }
+    SetWindowPos(hwnd, NULL, 0, 0, 0, 0,
+                 SWP_NOMOVE | SWP_NOSIZE | SWP_NOZORDER | SWP_NOACTIVATE | SWP_FRAMECHANGED);
+    ShowWindow(hwnd, SW_SHOWNA);
+    return 0;
+#else
+    (void)window;
+    (void)parent;
+    return 0;
+#endif
+}
+
+int pa_window_move(void *window, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+#ifdef _WIN32
+    // On the owning thread WM_SIZE, and PuTTY's term_size(), run inside
+    return SetWindowPos((HWND)window, NULL, x, y, width, height,
+                        SWP_NOZORDER | SWP_NOOWNERZORDER | SWP_NOACTIVATE) ? 0 : -1;
+#else
+    (void)window;
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+    return 0;
+#endif
+}
+
+// ------------------------------------------------------------
+// Connections
+// ------------------------------------------------------------
+
+#ifdef _WIN32
+#define PA_CONN_INVALID ((uintptr_t)INVALID_SOCKET)
+#else
+#define PA_CONN_INVALID (-1)
+#if defined(MSG_NOSIGNAL)
+#define PA_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define PA_SEND_FLAGS 0
+#endif
+#endif
+
+// Wait until fd can be read (or, with write set, written) for up to
+// timeout_ms. Returns 1 when it can, 0 on timeout, -1 on failure.
+#ifdef _WIN32
+static int pa_conn_wait(SOCKET sock, int write, uint32_t timeout_ms)
+{
+    fd_set set;
+    fd_set errors;
+    struct timeval tv;
+    int n;
+
+    FD_ZERO(&set);
+    FD_ZERO(&errors);
+    FD_SET(sock, &set);
+    FD_SET(sock, &errors);
+    tv.tv_sec = (long)(timeout_ms / 1000);
+    tv.tv_usec = (long)(timeout_ms % 1000) * 1000;
+    // A failed connect is reported in the exception set
+    n = select(0, write ? NULL : &set, write ? &set : NULL, &errors, &tv);
+    if (n < 0 || FD_ISSET(sock, &errors)) {
+        return -1;
+    }
+    return n > 0;
+}
+#else
+static int pa_conn_wait(int fd, int write, uint32_t timeout_ms)
+{
+    struct pollfd p;
+    int n;
+
+    p.fd = fd;
+    p.events = write ? POLLOUT : POLLIN;
+    p.revents = 0;
+    do {
+        n = poll(&p, 1, (int)timeout_ms);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -1;
+    }
+    return n > 0;
+}
+#endif
+
+static int pa_conn_open_tcp(PaConn *conn, const char *address, uint32_t timeout_ms)
+{
+    char host[256];
+    const char *colon = strrchr(address, ':');
+    const char *start = address;
+    size_t length;
+    struct addrinfo hints;
+    struct addrinfo *list = NULL;
+    struct addrinfo *ai;
+
+    // host:port, with [brackets] around an IPv6 address
+    if (!colon || colon == address || !colon[1]) {
+        return -1;
+    }
+    length = (size_t)(colon - address);
+    if (address[0] == '[' && colon[-1] == ']') {
+        start++;
+        length -= 2;
+    }
+    if (length >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, start, length);
+    host[length] = '\0';
+
+#ifdef _WIN32
+    {
+        WSADATA wsa;
+
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+            return -1;
+        }
+    }
+#endif
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, colon + 1, &hints, &list) != 0) {
+        list = NULL;
+    }
+
+    for (ai = list; ai; ai = ai->ai_next) {
+#ifdef _WIN32
+        SOCKET sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        u_long nonblocking = 1;
+        int result;
+
+        if (sock == INVALID_SOCKET) {
+            continue;
+        }
+        ioctlsocket(sock, FIONBIO, &nonblocking);
+        result = connect(sock, ai->ai_addr, (int)ai->ai_addrlen);
+        if (result != 0 && WSAGetLastError() == WSAEWOULDBLOCK) {
+            result = pa_conn_wait(sock, 1, timeout_ms) == 1 ? 0 : -1;
+        }
+        if (result != 0) {
+            closesocket(sock);
+            continue;
+        }
+        nonblocking = 0;
+        ioctlsocket(sock, FIONBIO, &nonblocking);
+        conn->sock = (uintptr_t)sock;
+#else
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        int flags;
+        int result;
+
+        if (fd < 0) {
+            continue;
+        }
+        flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        result = connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (result != 0 && errno == EINPROGRESS) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+
+            result = pa_conn_wait(fd, 1, timeout_ms) == 1 &&
+                     getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0 ? 0 : -1;
+        }
+        if (result != 0) {
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, flags);
+#if defined(SO_NOSIGPIPE)
+        {
+            int on = 1;
+
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+        }
+#endif
+        conn->fd = fd;
+#endif
+        freeaddrinfo(list);
+        return 0;
+    }
+
+    if (list) {
+        freeaddrinfo(list);
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return -1;
+}
+
+static int pa_conn_open_pipe(PaConn *conn, const char *address, uint32_t timeout_ms)
+{
+#ifdef _WIN32
+    HANDLE pipe = CreateFileA(address, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+
+    // Every instance busy: wait for the server to offer another once
+    if (pipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY &&
+        WaitNamedPipeA(address, timeout_ms)) {
+        pipe = CreateFileA(address, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    }
+    if (pipe == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    conn->pipe = pipe;
+    return 0;
+#else
+    struct sockaddr_un addr;
+    int fd;
+
+    (void)timeout_ms;
+    if (strlen(address) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, address);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+#if defined(SO_NOSIGPIPE)
+    {
+        int on = 1;
+
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+    conn->fd = fd;
+    return 0;
+#endif
+}
+
+int pa_conn_open(PaConn *conn, int pipe, const char *address, uint32_t timeout_ms)
+{
+#ifdef _WIN32
+    conn->sock = PA_CONN_INVALID;
+    conn->pipe = INVALID_HANDLE_VALUE;
+#else
+    conn->fd = PA_CONN_INVALID;
+#endif
+    if (!address || !*address) {
+        return -1;
+    }
+    return pipe ? pa_conn_open_pipe(conn, address, timeout_ms)
+                : pa_conn_open_tcp(conn, address, timeout_ms);
+}
+
+int pa_conn_send(PaConn *conn, const void *data, size_t len, uint32_t timeout_ms)
+{
+    uint64_t deadline = pa_now_us() + (uint64_t)timeout_ms * 1000;
+    const char *p = (const char *)data;
+
+    while (len > 0) {
+        int chunk = len > (1u << 30) ? (1 << 30) : (int)len;
+        uint64_t now = pa_now_us();
+        uint32_t left;
+        int sent;
+
+        // The send timeout bounds one call; a peer taking a little at a
+        // time would otherwise stretch the whole send without end
+        if (now >= deadline) {
+            return -1;
+        }
+        left = (uint32_t)((deadline - now + 999) / 1000);
+
+#ifdef _WIN32
+        if (conn->pipe != INVALID_HANDLE_VALUE) {
+            DWORD written = 0;
+
+            sent = WriteFile(conn->pipe, p, (DWORD)chunk, &written, NULL) ? (int)written : -1;
+        } else {
+            DWORD send_timeout = left;
+
+            setsockopt((SOCKET)conn->sock, SOL_SOCKET, SO_SNDTIMEO, (const char *)&send_timeout,
+                       sizeof(send_timeout));
+            sent = send((SOCKET)conn->sock, p, chunk, 0);
+        }
+#else
+        {
+            struct timeval tv;
+
+            tv.tv_sec = (time_t)(left / 1000);
+            tv.tv_usec = (suseconds_t)(left % 1000) * 1000;
+            setsockopt(conn->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        }
+        sent = (int)send(conn->fd, p, (size_t)chunk, PA_SEND_FLAGS);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        // Includes the send timeout running out
+        if (sent <= 0) {
+            return -1;
+        }
+        p += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+int pa_conn_recv(PaConn *conn, void *buf, size_t cap, uint32_t timeout_ms)
+{
+    int n;
+
+#ifdef _WIN32
+    if (conn->pipe != INVALID_HANDLE_VALUE) {
+        uint64_t deadline = pa_now_us() + (uint64_t)timeout_ms * 1000;
+        DWORD available = 0;
+        DWORD read = 0;
+
+        // Pipes have nothing like select(); look, then wait a little
+        for (;;) {
+            if (!PeekNamedPipe(conn->pipe, NULL, 0, NULL, &available, NULL)) {
+                return -1;
+            }
+            if (available > 0 || pa_now_us() >= deadline) {
+                break;
+            }
+            Sleep(1);
+        }
+        if (available == 0) {
+            return 0;
+        }
+        if (!ReadFile(conn->pipe, buf, available < cap ? available : (DWORD)cap, &read, NULL)) {
+            return -1;
+        }
+        return (int)read;
+    }
+    n = pa_conn_wait((SOCKET)conn->sock, 0, timeout_ms);
+    if (n <= 0) {
+        return n;
+    }
+    n = recv((SOCKET)conn->sock, (char *)buf, (int)cap, 0);
+#else
+    n = pa_conn_wait(conn->fd, 0, timeout_ms);
+    if (n <= 0) {
+        return n;
+    }
+    do {
+        n = (int)recv(conn->fd, buf, cap, 0);
+    } while (n < 0 && errno == EINTR);
+#endif
+    // Readable but nothing read: the peer has closed
+    return n > 0 ? n : -1;
+}
+
+void pa_conn_close(PaConn *conn)
+{
+#ifdef _WIN32
+    if (conn->pipe != INVALID_HANDLE_VALUE) {
+        CloseHandle(conn->pipe);
+        conn->pipe = INVALID_HANDLE_VALUE;
+    }
+    if (conn->sock != PA_CONN_INVALID) {
+        closesocket((SOCKET)conn->sock);
+        conn->sock = PA_CONN_INVALID;
+        WSACleanup();
+    }
+#else
+    if (conn->fd != PA_CONN_INVALID) {
+        close(conn->fd);
+        conn->fd = PA_CONN_INVALID;
+    }
+#endif
+}
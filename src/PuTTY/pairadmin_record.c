@@ -0,0 +1,319 @@
+// Trace recording and replay for PairAdmin
+//
+// A recorder taps the event stream where it leaves the hooks, after
+// redaction and escape filtering, so a trace holds exactly what the
+// callback or ring consumer saw. Records are a varint time delta, the
+// event type, a varint length and the payload; a keystroke echo costs
+// three to five bytes of framing. Replay pushes a trace back through the same
+// delivery path, at its original pacing or as fast as possible, so the
+// managed pipeline can be load-tested on real traffic shapes with no
+// SSH server.
+//
+// Writers from several session threads serialize on a spin lock and
+// append to a 64 KB buffer; only a full buffer costs the hook an
+// fwrite.
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#define PA_RECORD_BUFFER 65536
+
+// Longest varint of a uint64_t
+#define PA_VARINT_MAX 10
+
+// Sleep rather than spin while more than this remains before an event
+#define PA_REPLAY_SLEEP_US 2000
+
+typedef struct PaRecorder {
+    FILE *file;
+    uint64_t last_us;
+    size_t used;
+    unsigned char buffer[PA_RECORD_BUFFER];
+} PaRecorder;
+
+volatile uint32_t pa_recording = 0;
+
+static PaRecorder *pa_recorder = NULL;
+static volatile uint32_t pa_record_lock_word = 0;
+static volatile uint32_t pa_replay_cancelled = 0;
+
+static void pa_record_lock(void)
+{
+    while (!pa_atomic_cas_u32(&pa_record_lock_word, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_record_unlock(void)
+{
+    pa_store_release_u32(&pa_record_lock_word, 0);
+}
+
+static size_t pa_varint_put(unsigned char *out, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+static void pa_put_u32(unsigned char *out, uint32_t v)
+{
+    out[0] = (unsigned char)v;
+    out[1] = (unsigned char)(v >> 8);
+    out[2] = (unsigned char)(v >> 16);
+    out[3] = (unsigned char)(v >> 24);
+}
+
+static void pa_put_u64(unsigned char *out, uint64_t v)
+{
+    pa_put_u32(out, (uint32_t)v);
+    pa_put_u32(out + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t pa_get_u32(const unsigned char *in)
+{
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static void pa_record_flush(PaRecorder *r)
+{
+    if (r->used) {
+        fwrite(r->buffer, 1, r->used, r->file);
+        r->used = 0;
+    }
+}
+
+// ------------------------------------------------------------
+// Recording
+// ------------------------------------------------------------
+
+void pa_record_event(PairAdminEventType event, const void *data, size_t len)
+{
+    unsigned char header[2 * PA_VARINT_MAX + 1];
+    size_t n;
+    uint64_t now;
+    PaRecorder *r;
+
+    pa_record_lock();
+    r = pa_recorder;
+    if (!r) {
+        pa_record_unlock();
+        return;
+    }
+
+    now = pa_now_us();
+    n = pa_varint_put(header, now - r->last_us);
+    header[n++] = (unsigned char)event;
+    n += pa_varint_put(header + n, len);
+    r->last_us = now;
+
+    if (r->used + n + len > PA_RECORD_BUFFER) {
+        pa_record_flush(r);
+    }
+    memcpy(r->buffer + r->used, header, n);
+    r->used += n;
+    if (len > PA_RECORD_BUFFER - r->used) {
+        pa_record_flush(r);
+        fwrite(data, 1, len, r->file);
+    } else {
+        memcpy(r->buffer + r->used, data, len);
+        r->used += len;
+    }
+    pa_record_unlock();
+}
+
+int pairadmin_record_start(const char *path)
+{
+    unsigned char header[PAIRADMIN_TRACE_HEADER_SIZE];
+    PaRecorder *r;
+
+    if (!path) {
+        return -1;
+    }
+    r = (PaRecorder *)malloc(sizeof(PaRecorder));
+    if (!r) {
+        return -1;
+    }
+    r->file = fopen(path, "wb");
+    if (!r->file) {
+        free(r);
+        return -1;
+    }
+    r->used = 0;
+    r->last_us = pa_now_us();
+
+    memcpy(header, PAIRADMIN_TRACE_MAGIC, 8);
+    pa_put_u32(header + 8, PAIRADMIN_TRACE_VERSION);
+    pa_put_u32(header + 12, 0);
+    pa_put_u64(header + 16, pa_wall_time_us());
+    fwrite(header, 1, sizeof(header), r->file);
+
+    pairadmin_record_stop();
+    pa_record_lock();
+    pa_recorder = r;
+    pa_store_release_u32(&pa_recording, 1);
+    pa_record_unlock();
+    return 0;
+}
+
+void pairadmin_record_stop(void)
+{
+    PaRecorder *r;
+
+    pa_record_lock();
+    r = pa_recorder;
+    pa_recorder = NULL;
+    pa_store_release_u32(&pa_recording, 0);
+    pa_record_unlock();
+
+    if (r) {
+        pa_record_flush(r);
+        fclose(r->file);
+        free(r);
+    }
+}
+
+// ------------------------------------------------------------
+// Replay
+// ------------------------------------------------------------
+
+// 0, or -1 at the end of the file or inside a truncated varint
+static int pa_varint_get(FILE *f, uint64_t *v)
+{
+    uint64_t result = 0;
+    int shift = 0;
+    int c;
+
+    do {
+        c = fgetc(f);
+        if (c == EOF || shift > 63) {
+            return -1;
+        }
+        result |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    *v = result;
+    return 0;
+}
+
+static void pa_replay_wait(uint64_t due_us)
+{
+    for (;;) {
+        uint64_t now = pa_now_us();
+
+        if (now >= due_us || pa_load_acquire_u32(&pa_replay_cancelled)) {
+            return;
+        }
+        if (due_us - now > PA_REPLAY_SLEEP_US) {
+            pa_sleep_us(due_us - now - PA_REPLAY_SLEEP_US / 2);
+        } else {
+            pa_thread_yield();
+        }
+    }
+}
+
+// The ring reads type 0 as padding, so one bad byte would corrupt it for
+// good: walk the whole file before delivering anything. Returns 0 if
+// every whole record has a known type, -1 otherwise.
+static int pa_replay_check(FILE *f)
+{
+    for (;;) {
+        uint64_t delta;
+        uint64_t length;
+        int event;
+
+        if (pa_varint_get(f, &delta) != 0 || (event = fgetc(f)) == EOF ||
+            pa_varint_get(f, &length) != 0) {
+            return 0;
+        }
+        if (event == 0 || event >= PAIRADMIN_EVENT_TYPE_COUNT) {
+            return -1;
+        }
+        if (length > (uint64_t)LONG_MAX || fseek(f, (long)length, SEEK_CUR) != 0) {
+            return 0;
+        }
+    }
+}
+
+int64_t pairadmin_replay(const char *path, double speed)
+{
+    unsigned char header[PAIRADMIN_TRACE_HEADER_SIZE];
+    unsigned char *payload = NULL;
+    size_t capacity = 0;
+    uint64_t trace_us = 0;
+    uint64_t started;
+    int64_t delivered = 0;
+    FILE *f;
+
+    if (!path || speed < 0) {
+        return -1;
+    }
+    f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+        memcmp(header, PAIRADMIN_TRACE_MAGIC, 8) != 0 ||
+        pa_get_u32(header + 8) != PAIRADMIN_TRACE_VERSION ||
+        pa_replay_check(f) != 0 || fseek(f, PAIRADMIN_TRACE_HEADER_SIZE, SEEK_SET) != 0) {
+        fclose(f);
+        return -1;
+    }
+
+    pa_store_release_u32(&pa_replay_cancelled, 0);
+    started = pa_now_us();
+    while (!pa_load_acquire_u32(&pa_replay_cancelled)) {
+        uint64_t delta;
+        uint64_t length;
+        int event;
+
+        // A trace cut short by a crash ends at its last whole record
+        if (pa_varint_get(f, &delta) != 0 || (event = fgetc(f)) == EOF ||
+            pa_varint_get(f, &length) != 0 || length > (uint64_t)(size_t)-1 / 2) {
+            break;
+        }
+        // Rewritten since the check
+        if (event == 0 || event >= PAIRADMIN_EVENT_TYPE_COUNT) {
+            delivered = -1;
+            break;
+        }
+        if (length > capacity) {
+            unsigned char *grown = (unsigned char *)realloc(payload, (size_t)length);
+
+            if (!grown) {
+                break;
+            }
+            payload = grown;
+            capacity = (size_t)length;
+        }
+        if (length && fread(payload, 1, (size_t)length, f) != (size_t)length) {
+            break;
+        }
+
+        trace_us += delta;
+        if (speed > 0) {
+            pa_replay_wait(started + (uint64_t)((double)trace_us / speed));
+        }
+        pa_dispatch_raw((PairAdminEventType)event, payload, (size_t)length);
+        delivered++;
+    }
+
+    free(payload);
+    fclose(f);
+    return delivered;
+}
+
+void pairadmin_replay_cancel(void)
+{
+    pa_store_release_u32(&pa_replay_cancelled, 1);
+}
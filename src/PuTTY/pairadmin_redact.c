@@ -0,0 +1,557 @@
+// Streaming redaction of secrets for PairAdmin
+//
+// The keywords that introduce a secret (key armour, token prefixes,
+// password assignments and prompts) are compiled once into a single
+// Aho-Corasick automaton, flattened to a DFA over byte classes, so the
+// hook makes one table lookup per byte whatever the rule count. When a
+// keyword completes, its rule's value matcher takes over: it lets the
+// separator through, then masks the value with '*'.
+//
+// Keywords stay visible; only values are masked. Value bytes that are
+// not yet known to be a secret (a token shorter than its minimum so
+// far) are held back, also across fragments, and released masked or
+// as they were once the next byte decides, or as they were when the
+// session ends first. The hold is one byte short of the rule's minimum
+// at most, 39 bytes for github_pat_, well inside PA_REDACT_HOLD.
+//
+// Input typed at a password prompt is masked up to the end of the line,
+// since the terminal does not echo it and no value appears in the
+// output to match.
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#define PA_REDACT_MAX_STATES 512
+#define PA_REDACT_MAX_CLASSES 64
+
+// How a value is introduced after its keyword
+enum {
+    PA_REDACT_SEP_NONE = 0,     // Value follows directly:  AKIA...
+    PA_REDACT_SEP_SPACES,       // One or more blanks:      Bearer ...
+    PA_REDACT_SEP_ASSIGN,       // [ident] [blanks] : or =: password = ...
+    PA_REDACT_SEP_PROMPT        // Anything up to ':':      password for bob:
+};
+
+// Value byte classes (bits of pa_redact_value)
+enum {
+    PA_REDACT_VALUE_UPPER = 0x01,    // A-Z 0-9
+    PA_REDACT_VALUE_ALNUM = 0x02,    // A-Z a-z 0-9
+    PA_REDACT_VALUE_TOKEN = 0x04,    // A-Z a-z 0-9 - _
+    PA_REDACT_VALUE_JWT = 0x08,      // A-Z a-z 0-9 - _ .
+    PA_REDACT_VALUE_BEARER = 0x10,   // A-Z a-z 0-9 - . _ ~ + / =
+    PA_REDACT_VALUE_WORD = 0x20,     // Any byte but blanks and controls
+    PA_REDACT_VALUE_ARMOUR = 0x40    // Any byte up to the closing '-'
+};
+
+// Candidate phases
+enum {
+    PA_REDACT_TAIL = 1,         // Keyword tail of an ASSIGN or PROMPT rule
+    PA_REDACT_BEFORE,           // Blanks before the separator
+    PA_REDACT_AFTER,            // Blanks after the separator
+    PA_REDACT_VALUE
+};
+
+// What a byte is to the candidate
+enum {
+    PA_REDACT_END = 0,          // Not part of it: the candidate is over
+    PA_REDACT_PASS,             // Separator, sent as it is
+    PA_REDACT_HELD,             // Value, held until it is known to be one
+    PA_REDACT_MASK              // Value, masked
+};
+
+typedef struct PaRedactRule {
+    const char *keyword;        // Matched case-insensitively
+    uint8_t group;              // PAIRADMIN_REDACT_*
+    uint8_t sep;
+    uint8_t value;
+    uint8_t min;                // Value bytes before it counts as a secret
+    uint16_t max;               // Value bytes masked at most, 0 for no limit
+} PaRedactRule;
+
+static const PaRedactRule pa_redact_rules_table[] = {
+    { "BEGIN PRIVATE KEY-----",           PAIRADMIN_REDACT_PRIVATE_KEYS, PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ARMOUR, 1,  0 },
+    { "BEGIN RSA PRIVATE KEY-----",       PAIRADMIN_REDACT_PRIVATE_KEYS, PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ARMOUR, 1,  0 },
+    { "BEGIN EC PRIVATE KEY-----",        PAIRADMIN_REDACT_PRIVATE_KEYS, PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ARMOUR, 1,  0 },
+    { "BEGIN DSA PRIVATE KEY-----",       PAIRADMIN_REDACT_PRIVATE_KEYS, PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ARMOUR, 1,  0 },
+    { "BEGIN OPENSSH PRIVATE KEY-----",   PAIRADMIN_REDACT_PRIVATE_KEYS, PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ARMOUR, 1,  0 },
+    { "BEGIN ENCRYPTED PRIVATE KEY-----", PAIRADMIN_REDACT_PRIVATE_KEYS, PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ARMOUR, 1,  0 },
+    { "BEGIN PGP PRIVATE KEY BLOCK-----", PAIRADMIN_REDACT_PRIVATE_KEYS, PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ARMOUR, 1,  0 },
+
+    { "AKIA",                             PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_UPPER,  16, 16 },
+    { "ASIA",                             PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_UPPER,  16, 16 },
+    { "ghp_",                             PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ALNUM,  36, 36 },
+    { "gho_",                             PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ALNUM,  36, 36 },
+    { "ghu_",                             PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ALNUM,  36, 36 },
+    { "ghs_",                             PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ALNUM,  36, 36 },
+    { "ghr_",                             PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ALNUM,  36, 36 },
+    { "github_pat_",                      PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_TOKEN,  40, 0 },
+    { "AIza",                             PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_TOKEN,  35, 35 },
+    { "sk-",                              PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_TOKEN,  32, 0 },
+    { "sk_live_",                         PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ALNUM,  24, 0 },
+    { "sk_test_",                         PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ALNUM,  24, 0 },
+    { "rk_live_",                         PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_ALNUM,  24, 0 },
+    { "xoxb-",                            PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_TOKEN,  10, 0 },
+    { "xoxp-",                            PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_TOKEN,  10, 0 },
+    { "eyJ",                              PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_NONE,   PA_REDACT_VALUE_JWT,    32, 0 },
+    { "bearer",                           PAIRADMIN_REDACT_TOKENS,       PA_REDACT_SEP_SPACES, PA_REDACT_VALUE_BEARER, 8,  0 },
+
+    { "password",                         PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_ASSIGN, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "passwd",                           PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_ASSIGN, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "passphrase",                       PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_ASSIGN, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "secret",                           PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_ASSIGN, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "token",                            PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_ASSIGN, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "api_key",                          PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_ASSIGN, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "apikey",                           PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_ASSIGN, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "api-key",                          PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_ASSIGN, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "password for ",                    PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_PROMPT, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "passphrase for ",                  PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_PROMPT, PA_REDACT_VALUE_WORD,   1,  0 },
+    { "'s password",                      PAIRADMIN_REDACT_PASSWORDS,    PA_REDACT_SEP_PROMPT, PA_REDACT_VALUE_WORD,   1,  0 }
+};
+
+#define PA_REDACT_RULE_COUNT (sizeof(pa_redact_rules_table) / sizeof(pa_redact_rules_table[0]))
+
+// Longest keyword tail an ASSIGN rule accepts (password_hint, tokens...)
+#define PA_REDACT_ASSIGN_TAIL 32
+
+// Longest text between a PROMPT keyword and its ':'
+#define PA_REDACT_PROMPT_TAIL 128
+
+// Built once by pa_redact_build(), read-only afterwards
+static struct {
+    uint32_t classes;
+    unsigned char byte_class[256];
+    uint16_t next[PA_REDACT_MAX_STATES][PA_REDACT_MAX_CLASSES];
+    uint8_t rule[PA_REDACT_MAX_STATES];         // Rule + 1 ending here, or 0
+} pa_redact_dfa;
+
+static unsigned char pa_redact_value[256];
+
+// Serialises the one-time build
+static volatile uint32_t pa_redact_lock = 0;
+static volatile uint32_t pa_redact_ready = 0;
+static volatile uint32_t pa_redact_enabled = PAIRADMIN_REDACT_OFF;
+
+// ------------------------------------------------------------
+// Automaton construction
+// ------------------------------------------------------------
+
+static unsigned char pa_redact_fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+static int pa_is_alnum(unsigned char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static void pa_redact_build_values(void)
+{
+    unsigned c;
+
+    for (c = 0; c < 256; c++) {
+        unsigned char v = 0;
+
+        if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z')) {
+            v |= PA_REDACT_VALUE_UPPER;
+        }
+        if (pa_is_alnum((unsigned char)c)) {
+            v |= PA_REDACT_VALUE_ALNUM | PA_REDACT_VALUE_TOKEN | PA_REDACT_VALUE_JWT |
+                 PA_REDACT_VALUE_BEARER;
+        }
+        if (c == '-' || c == '_') {
+            v |= PA_REDACT_VALUE_TOKEN | PA_REDACT_VALUE_JWT | PA_REDACT_VALUE_BEARER;
+        }
+        if (c == '.') {
+            v |= PA_REDACT_VALUE_JWT | PA_REDACT_VALUE_BEARER;
+        }
+        if (c == '~' || c == '+' || c == '/' || c == '=') {
+            v |= PA_REDACT_VALUE_BEARER;
+        }
+        if (c > ' ' && c != 0x7f) {
+            v |= PA_REDACT_VALUE_WORD;
+        }
+        if (c != '-' && c != 0x1b) {
+            v |= PA_REDACT_VALUE_ARMOUR;
+        }
+        pa_redact_value[c] = v;
+    }
+}
+
+// Trie of the folded keywords, then failure links in breadth-first
+// order, folding each state's missing transitions into the DFA
+static void pa_redact_build(void)
+{
+    static uint16_t trie[PA_REDACT_MAX_STATES][PA_REDACT_MAX_CLASSES];
+    static uint16_t fail[PA_REDACT_MAX_STATES];
+    static uint16_t queue[PA_REDACT_MAX_STATES];
+    uint32_t states = 1;
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    uint32_t i;
+    uint32_t k;
+    unsigned c;
+
+    memset(&pa_redact_dfa, 0, sizeof(pa_redact_dfa));
+    memset(trie, 0, sizeof(trie));
+    pa_redact_build_values();
+
+    // Class 0 is every byte no keyword uses
+    pa_redact_dfa.classes = 1;
+    for (i = 0; i < PA_REDACT_RULE_COUNT; i++) {
+        const unsigned char *p = (const unsigned char *)pa_redact_rules_table[i].keyword;
+
+        for (; *p; p++) {
+            unsigned char f = pa_redact_fold(*p);
+
+            if (pa_redact_dfa.byte_class[f] == 0) {
+                pa_redact_dfa.byte_class[f] = (unsigned char)pa_redact_dfa.classes++;
+            }
+        }
+    }
+    for (c = 'A'; c <= 'Z'; c++) {
+        pa_redact_dfa.byte_class[c] = pa_redact_dfa.byte_class[pa_redact_fold((unsigned char)c)];
+    }
+
+    for (i = 0; i < PA_REDACT_RULE_COUNT; i++) {
+        const unsigned char *p = (const unsigned char *)pa_redact_rules_table[i].keyword;
+        uint32_t s = 0;
+
+        for (; *p; p++) {
+            uint32_t cls = pa_redact_dfa.byte_class[*p];
+
+            if (!trie[s][cls]) {
+                trie[s][cls] = (uint16_t)states++;
+            }
+            s = trie[s][cls];
+        }
+        if (!pa_redact_dfa.rule[s]) {
+            pa_redact_dfa.rule[s] = (uint8_t)(i + 1);
+        }
+    }
+
+    for (k = 1; k < pa_redact_dfa.classes; k++) {
+        uint16_t s = trie[0][k];
+
+        pa_redact_dfa.next[0][k] = s;
+        if (s) {
+            fail[s] = 0;
+            queue[tail++] = s;
+        }
+    }
+    while (head < tail) {
+        uint16_t s = queue[head++];
+
+        // Keywords that end inside a longer one still match
+        if (!pa_redact_dfa.rule[s]) {
+            pa_redact_dfa.rule[s] = pa_redact_dfa.rule[fail[s]];
+        }
+        for (k = 0; k < pa_redact_dfa.classes; k++) {
+            uint16_t t = trie[s][k];
+
+            if (k != 0 && t) {
+                fail[t] = pa_redact_dfa.next[fail[s]][k];
+                pa_redact_dfa.next[s][k] = t;
+                queue[tail++] = t;
+            } else {
+                pa_redact_dfa.next[s][k] = pa_redact_dfa.next[fail[s]][k];
+            }
+        }
+    }
+}
+
+int pairadmin_set_redaction(uint32_t rules)
+{
+    if (rules & ~(uint32_t)PAIRADMIN_REDACT_ALL) {
+        return -1;
+    }
+
+    if (rules && !pa_load_acquire_u32(&pa_redact_ready)) {
+        while (!pa_atomic_cas_u32(&pa_redact_lock, 0, 1)) {
+            pa_thread_yield();
+        }
+        if (!pa_redact_ready) {
+            pa_redact_build();
+            pa_store_release_u32(&pa_redact_ready, 1);
+        }
+        pa_store_release_u32(&pa_redact_lock, 0);
+    }
+
+    pa_store_release_u32(&pa_redact_enabled, rules);
+    return 0;
+}
+
+uint32_t pairadmin_get_redaction(void)
+{
+    return pa_load_acquire_u32(&pa_redact_enabled);
+}
+
+int pa_redact_built(void)
+{
+    return pa_load_acquire_u32(&pa_redact_ready) != 0;
+}
+
+// ------------------------------------------------------------
+// Hook path
+// ------------------------------------------------------------
+
+static int pa_redact_blank(unsigned char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// The value bytes start
+static int pa_redact_begin(const PaRedactRule *rule, PaRedactStream *st, unsigned char c)
+{
+    if (!(pa_redact_value[c] & rule->value)) {
+        return PA_REDACT_END;
+    }
+    st->phase = PA_REDACT_VALUE;
+    st->count = 1;
+    return st->count < rule->min ? PA_REDACT_HELD : PA_REDACT_MASK;
+}
+
+static int pa_redact_step(const PaRedactRule *rule, PaRedactStream *st, unsigned char c)
+{
+    switch (st->phase) {
+    case PA_REDACT_TAIL:
+        if (rule->sep == PA_REDACT_SEP_PROMPT) {
+            if (c == ':') {
+                st->phase = PA_REDACT_AFTER;
+                return PA_REDACT_PASS;
+            }
+            if (c >= ' ' && c != 0x7f && st->sep++ < PA_REDACT_PROMPT_TAIL) {
+                return PA_REDACT_PASS;
+            }
+            return PA_REDACT_END;
+        }
+        if ((pa_is_alnum(c) || c == '_' || c == '-') && st->sep++ < PA_REDACT_ASSIGN_TAIL) {
+            return PA_REDACT_PASS;
+        }
+        // The byte after the tail is the first one before the separator
+        st->phase = PA_REDACT_BEFORE;
+        // Fall through
+
+    case PA_REDACT_BEFORE:
+        if (pa_redact_blank(c)) {
+            st->sep++;
+            return PA_REDACT_PASS;
+        }
+        if (rule->sep == PA_REDACT_SEP_SPACES) {
+            return st->sep ? pa_redact_begin(rule, st, c) : PA_REDACT_END;
+        }
+        if (c == ':' || c == '=') {
+            st->phase = PA_REDACT_AFTER;
+            return PA_REDACT_PASS;
+        }
+        return PA_REDACT_END;
+
+    case PA_REDACT_AFTER:
+        if (pa_redact_blank(c)) {
+            return PA_REDACT_PASS;
+        }
+        return pa_redact_begin(rule, st, c);
+
+    case PA_REDACT_VALUE:
+        if (!(pa_redact_value[c] & rule->value) || (rule->max && st->count == rule->max)) {
+            return PA_REDACT_END;
+        }
+        st->count++;
+        return st->count < rule->min ? PA_REDACT_HELD : PA_REDACT_MASK;
+    }
+    return PA_REDACT_END;
+}
+
+static void pa_redact_start(PaRedactStream *st, uint32_t rule)
+{
+    uint8_t sep = pa_redact_rules_table[rule].sep;
+
+    st->rule = (uint16_t)(rule + 1);
+    st->phase = sep == PA_REDACT_SEP_NONE ? PA_REDACT_VALUE :
+                sep == PA_REDACT_SEP_SPACES ? PA_REDACT_BEFORE : PA_REDACT_TAIL;
+    st->sep = 0;
+    st->count = 0;
+}
+
+// Masking keeps line breaks, so line counts and the screen layout of
+// what consumers see match the terminal
+static unsigned char *pa_redact_mask(unsigned char *out, const unsigned char *in, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        out[i] = in[i] == '\r' || in[i] == '\n' ? in[i] : '*';
+    }
+    return out + len;
+}
+
+void pa_redact_reset(PaRedactStream *st)
+{
+    memset(st, 0, sizeof(PaRedactStream));
+}
+
+// The output candidate is waiting at a password prompt
+static int pa_redact_at_prompt(const PaRedactStream *output)
+{
+    return output->rule &&
+           pa_redact_rules_table[output->rule - 1].group == PAIRADMIN_REDACT_PASSWORDS &&
+           output->phase == PA_REDACT_AFTER;
+}
+
+// Redact one stream. output is the same producer's output stream when st
+// carries input: a prompt there decides whether typed input is masked.
+static size_t pa_redact_run(PaRedactStream *st, PaRedactStream *output, uint32_t rules,
+                            const void *data, size_t len, void *buffer)
+{
+    const unsigned char *in = (const unsigned char *)data;
+    unsigned char *out = (unsigned char *)buffer;
+    size_t run = 0;             // Start of the bytes not yet copied out
+    size_t i;
+
+    if (rules != st->active) {
+        // Held bytes were never confirmed as a secret
+        memcpy(out, st->hold, st->held);
+        out += st->held;
+        pa_redact_reset(st);
+        st->active = rules;
+    }
+    if (!rules) {
+        memcpy(out, in, len);
+        return (size_t)(out - (unsigned char *)buffer) + len;
+    }
+
+    if (output && pa_redact_at_prompt(output)) {
+        st->masking = 1;
+    }
+
+    for (i = 0; i < len; i++) {
+        unsigned char c;
+        uint32_t match;
+        int step;
+
+        if (!st->rule && !st->masking) {
+            // Plain text: only the automaton runs, up to a keyword's end
+            uint32_t state = st->state;
+
+            while (i < len) {
+                state = pa_redact_dfa.next[state][pa_redact_dfa.byte_class[in[i]]];
+                if (pa_redact_dfa.rule[state]) {
+                    break;
+                }
+                i++;
+            }
+            st->state = (uint16_t)state;
+            if (i == len) {
+                break;
+            }
+        } else {
+            c = in[i];
+            st->state = pa_redact_dfa.next[st->state][pa_redact_dfa.byte_class[c]];
+
+            if (st->masking) {
+                memcpy(out, in + run, i - run);
+                out += i - run;
+                run = i + 1;
+                if (c == '\r' || c == '\n' || c == 0x03) {
+                    // Line entered or interrupted: the prompt is answered
+                    st->masking = 0;
+                    output->rule = 0;
+                    *out++ = c;
+                } else {
+                    *out++ = '*';
+                }
+                continue;
+            }
+
+            step = pa_redact_step(&pa_redact_rules_table[st->rule - 1], st, c);
+            if (step == PA_REDACT_HELD) {
+                memcpy(out, in + run, i - run);
+                out += i - run;
+                run = i + 1;
+                st->hold[st->held++] = c;
+                continue;
+            }
+            if (step == PA_REDACT_MASK) {
+                memcpy(out, in + run, i - run);
+                out += i - run;
+                run = i + 1;
+                out = pa_redact_mask(out, st->hold, st->held);
+                out = pa_redact_mask(out, &c, 1);
+                st->held = 0;
+                continue;
+            }
+            if (step == PA_REDACT_PASS) {
+                continue;
+            }
+
+            // Over; unconfirmed bytes go out as they were, ahead of this one
+            memcpy(out, in + run, i - run);
+            out += i - run;
+            run = i;
+            memcpy(out, st->hold, st->held);
+            out += st->held;
+            st->held = 0;
+            st->rule = 0;
+        }
+
+        match = pa_redact_dfa.rule[st->state];
+        if (match && (pa_redact_rules_table[match - 1].group & rules)) {
+            pa_redact_start(st, match - 1);
+        }
+    }
+
+    memcpy(out, in + run, len - run);
+    out += len - run;
+    return (size_t)(out - (unsigned char *)buffer);
+}
+
+size_t pa_redact(PaRedactor *r, PairAdminEventType event, const void *data, size_t len, void *out)
+{
+    uint32_t rules = pa_load_acquire_u32(&pa_redact_enabled);
+
+    if (event == PAIRADMIN_EVENT_INPUT) {
+        return pa_redact_run(&r->input, &r->output, rules, data, len, out);
+    }
+    return pa_redact_run(&r->output, NULL, rules, data, len, out);
+}
+
+size_t pa_redact_text(const void *data, size_t len, void *out)
+{
+    PaRedactStream st;
+    size_t n;
+
+    memset(&st, 0, sizeof(st));
+    st.active = pa_load_acquire_u32(&pa_redact_enabled);
+    n = pa_redact_run(&st, NULL, st.active, data, len, out);
+
+    // Nothing follows to confirm what is still held
+    memcpy((unsigned char *)out + n, st.hold, st.held);
+    return n + st.held;
+}
+
+size_t pa_redact_flush(PaRedactStream *st, void *out)
+{
+    uint32_t active = st->active;
+    size_t held = st->held;
+
+    // Never confirmed as a secret, so released as it was
+    memcpy(out, st->hold, held);
+    pa_redact_reset(st);
+    st->active = active;
+    return held;
+}
+
+int pa_redact_answering(const PaRedactor *r)
+{
+    return r->input.masking || pa_redact_at_prompt(&r->output);
+}
+
+int pa_redact_wanted(const PaRedactor *r, PairAdminEventType event)
+{
+    const PaRedactStream *st = event == PAIRADMIN_EVENT_INPUT ? &r->input : &r->output;
+
+    return (event == PAIRADMIN_EVENT_OUTPUT || event == PAIRADMIN_EVENT_INPUT) &&
+           (pa_load_acquire_u32(&pa_redact_enabled) || st->active);
+}
@@ -0,0 +1,106 @@
+// Named shared-memory backing for the PairAdmin event ring
+//
+// The mapping holds a PairAdminRegionHeader followed by the data area,
+// the same layout pa_ring_create() uses on the heap, so the producer
+// code in pairadmin.c does not care where the ring lives.
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+PaRing *pa_region_create(size_t capacity)
+{
+    PaRing *ring;
+    size_t size;
+    void *block;
+    char wake_name[sizeof(ring->name) + 8];
+
+    capacity = pa_ring_capacity(capacity);
+    size = sizeof(PairAdminRegionHeader) + capacity;
+
+    ring = (PaRing *)pa_aligned_alloc(sizeof(PaRing));
+    if (!ring) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(PaRing));
+
+#ifdef _WIN32
+    snprintf(ring->name, sizeof(ring->name), "Local\\PairAdminEvents-%lu",
+             (unsigned long)GetCurrentProcessId());
+
+    ring->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                       (DWORD)((uint64_t)size >> 32), (DWORD)size,
+                                       ring->name);
+    if (!ring->mapping) {
+        pa_aligned_free(ring);
+        return NULL;
+    }
+
+    block = MapViewOfFile(ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!block) {
+        CloseHandle(ring->mapping);
+        pa_aligned_free(ring);
+        return NULL;
+    }
+#else
+    snprintf(ring->name, sizeof(ring->name), "/pairadmin-events-%ld", (long)getpid());
+
+    ring->fd = shm_open(ring->name, O_CREAT | O_RDWR, 0600);
+    if (ring->fd < 0) {
+        pa_aligned_free(ring);
+        return NULL;
+    }
+
+    if (ftruncate(ring->fd, (off_t)size) != 0 ||
+        (block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0)) == MAP_FAILED) {
+        close(ring->fd);
+        shm_unlink(ring->name);
+        pa_aligned_free(ring);
+        return NULL;
+    }
+#endif
+
+    // Named after the mapping, so a consumer elsewhere can wait on it too
+    snprintf(wake_name, sizeof(wake_name), "%s" PAIRADMIN_EVENT_WAKE_SUFFIX, ring->name);
+    if (pa_waker_create(&ring->waker, wake_name) != 0) {
+#ifdef _WIN32
+        UnmapViewOfFile(block);
+        CloseHandle(ring->mapping);
+#else
+        munmap(block, size);
+        close(ring->fd);
+        shm_unlink(ring->name);
+#endif
+        pa_aligned_free(ring);
+        return NULL;
+    }
+
+    ring->block = block;
+    ring->block_size = size;
+    ring->shared = 1;
+    pa_ring_layout(ring, block, capacity);
+    return ring;
+}
+
+void pa_region_destroy(PaRing *ring)
+{
+    pa_waker_destroy(&ring->waker);
+#ifdef _WIN32
+    UnmapViewOfFile(ring->block);
+    CloseHandle(ring->mapping);
+#else
+    munmap(ring->block, ring->block_size);
+    close(ring->fd);
+    shm_unlink(ring->name);
+#endif
+    pa_aligned_free(ring);
+}
@@ -0,0 +1,342 @@
+// Single-pass chunk scanner for PairAdmin line statistics
+//
+// Counts newlines, ESC bytes and non-ASCII bytes and finds the last
+// newline in one pass, 32 (AVX2) or 16 (SSE2, NEON) bytes at a time, so
+// the managed side no longer walks every char of every fragment. The
+// kernel is picked per call from pa_cpu_features(), not from compiler
+// flags: the vector kernels are compiled for their instruction set
+// alone and only run on a CPU that has it.
+//
+// Also the UTF-8 checks of the hook path. Terminal output is mostly
+// ASCII, so validation skips ASCII a vector (or, in plain C, a word) at
+// a time and only walks the multi-byte stretches byte by byte; SSE2 has
+// no byte shuffle for a lookup-table validator, and those stretches are
+// short.
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PA_SCAN_X86 1
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#include <arm_neon.h>
+#define PA_SCAN_NEON 1
+#endif
+
+// MSVC emits any intrinsic whatever /arch says; GCC and Clang need the
+// function to be compiled for the instruction set
+#if defined(PA_SCAN_X86) && !defined(_MSC_VER)
+#define PA_TARGET_SSE2 __attribute__((target("sse2")))
+#define PA_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PA_TARGET_SSE2
+#define PA_TARGET_AVX2
+#endif
+
+// Fold one block's match masks into the running totals
+PA_INLINE void pa_scan_block(PairAdminChunkInfo *info, size_t offset,
+                             uint32_t nl, uint32_t esc, uint32_t high)
+{
+    if (nl) {
+        info->newlines += pa_popcount32(nl);
+        info->last_newline = (int64_t)(offset + pa_highest_bit32(nl));
+    }
+    info->escapes += pa_popcount32(esc);
+    info->non_ascii += pa_popcount32(high);
+}
+
+// ------------------------------------------------------------
+// Kernels
+//
+// pa_ascii_run_*() return how many leading bytes they found to be
+// ASCII, in whole vectors; the caller looks at the rest byte by byte.
+// pa_scan_*() fold whole vectors from offset i on into info and return
+// the offset they stopped at; pairadmin_scan_chunk() does the tail.
+// ------------------------------------------------------------
+
+// Eight bytes at a time, for CPUs without a vector unit we use
+static size_t pa_ascii_run_word(const unsigned char *p, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+
+        memcpy(&w, p + i, 8);
+        if (w & 0x8080808080808080ull) {
+            break;
+        }
+    }
+    return i;
+}
+
+#if defined(PA_SCAN_X86)
+
+PA_TARGET_SSE2 static size_t pa_ascii_run_sse2(const unsigned char *p, size_t len)
+{
+    size_t i = 0;
+
+    while (i + 16 <= len && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i)))) {
+        i += 16;
+    }
+    return i;
+}
+
+PA_TARGET_AVX2 static size_t pa_ascii_run_avx2(const unsigned char *p, size_t len)
+{
+    size_t i = 0;
+
+    while (i + 32 <= len && !_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(p + i)))) {
+        i += 32;
+    }
+    while (i + 16 <= len && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i)))) {
+        i += 16;
+    }
+    return i;
+}
+
+PA_TARGET_SSE2 static size_t pa_scan_sse2(const unsigned char *p, size_t i, size_t len,
+                                          PairAdminChunkInfo *info)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i escape = _mm_set1_epi8(0x1b);
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        pa_scan_block(info, i,
+                      (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)),
+                      (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, escape)),
+                      (uint32_t)_mm_movemask_epi8(v));
+    }
+    return i;
+}
+
+PA_TARGET_AVX2 static size_t pa_scan_avx2(const unsigned char *p, size_t i, size_t len,
+                                          PairAdminChunkInfo *info)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i escape = _mm256_set1_epi8(0x1b);
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        pa_scan_block(info, i,
+                      (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)),
+                      (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, escape)),
+                      (uint32_t)_mm256_movemask_epi8(v));
+    }
+    return i;
+}
+
+#elif defined(PA_SCAN_NEON)
+
+static size_t pa_ascii_run_neon(const unsigned char *p, size_t len)
+{
+    size_t i = 0;
+
+    while (i + 16 <= len && vmaxvq_u8(vld1q_u8(p + i)) < 0x80) {
+        i += 16;
+    }
+    return i;
+}
+
+// NEON has no movemask: lanes are counted by summing 0/1 bytes, and the
+// last newline of a block that has one is found by looking back
+static size_t pa_scan_neon(const unsigned char *p, size_t i, size_t len, PairAdminChunkInfo *info)
+{
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    const uint8x16_t escape = vdupq_n_u8(0x1b);
+    const uint8x16_t one = vdupq_n_u8(1);
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint32_t nl = vaddvq_u8(vandq_u8(vceqq_u8(v, newline), one));
+
+        if (nl) {
+            size_t k = 16;
+
+            while (p[i + --k] != '\n') {
+            }
+            info->newlines += nl;
+            info->last_newline = (int64_t)(i + k);
+        }
+        info->escapes += vaddvq_u8(vandq_u8(vceqq_u8(v, escape), one));
+        info->non_ascii += vaddvq_u8(vshrq_n_u8(v, 7));
+    }
+    return i;
+}
+
+#endif
+
+static size_t pa_ascii_run(uint32_t cpu, const unsigned char *p, size_t len)
+{
+#if defined(PA_SCAN_X86)
+    if (cpu & PAIRADMIN_CPU_AVX2) {
+        return pa_ascii_run_avx2(p, len);
+    }
+    if (cpu & PAIRADMIN_CPU_SSE2) {
+        return pa_ascii_run_sse2(p, len);
+    }
+#elif defined(PA_SCAN_NEON)
+    if (cpu & PAIRADMIN_CPU_NEON) {
+        return pa_ascii_run_neon(p, len);
+    }
+#endif
+    (void)cpu;
+    return pa_ascii_run_word(p, len);
+}
+
+// ------------------------------------------------------------
+// UTF-8
+// ------------------------------------------------------------
+
+// Length of a sequence starting with lead and the allowed range of its
+// second byte (RFC 3629: no overlongs, surrogates or code points past
+// U+10FFFF); 0 for a byte that cannot start one
+static size_t pa_utf8_lead(unsigned char lead, unsigned char *lo, unsigned char *hi)
+{
+    *lo = 0x80;
+    *hi = 0xbf;
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        return 2;
+    }
+    if (lead >= 0xe0 && lead <= 0xef) {
+        if (lead == 0xe0) {
+            *lo = 0xa0;
+        } else if (lead == 0xed) {
+            *hi = 0x9f;
+        }
+        return 3;
+    }
+    if (lead >= 0xf0 && lead <= 0xf4) {
+        if (lead == 0xf0) {
+            *lo = 0x90;
+        } else if (lead == 0xf4) {
+            *hi = 0x8f;
+        }
+        return 4;
+    }
+    return 0;
+}
+
+// Bytes of p[0..avail) that are a well-formed prefix of the sequence p
+// starts, up to its full length
+static size_t pa_utf8_prefix(const unsigned char *p, size_t avail, size_t *need)
+{
+    unsigned char lo;
+    unsigned char hi;
+    size_t n = pa_utf8_lead(p[0], &lo, &hi);
+    size_t k;
+
+    *need = n;
+    if (n == 0) {
+        return 0;
+    }
+    for (k = 1; k < n && k < avail; k++) {
+        if (k == 1 ? p[k] < lo || p[k] > hi : (p[k] & 0xc0) != 0x80) {
+            return k;
+        }
+    }
+    return k;
+}
+
+size_t pa_utf8_boundary(const unsigned char *p, size_t len)
+{
+    size_t back;
+
+    for (back = 1; back <= 3 && back <= len; back++) {
+        unsigned char c = p[len - back];
+        size_t need;
+
+        if ((c & 0xc0) == 0x80) {
+            continue;
+        }
+        // A lead byte whose sequence is cut short by the end, and not
+        // broken before it
+        if (c >= 0xc0 && pa_utf8_prefix(p + len - back, back, &need) == back && need > back) {
+            return len - back;
+        }
+        break;
+    }
+    return len;
+}
+
+uint32_t pa_utf8_flags(const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint32_t cpu = pa_cpu_features();
+    uint32_t flags = PAIRADMIN_TEXT_ASCII;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t need;
+
+        i += pa_ascii_run(cpu, p + i, len - i);
+        if (i == len) {
+            break;
+        }
+        if (p[i] < 0x80) {
+            i++;
+            continue;
+        }
+        flags = 0;
+        if (pa_utf8_prefix(p + i, len - i, &need) != need || need == 0) {
+            return 0;
+        }
+        i += need;
+    }
+    return flags | PAIRADMIN_TEXT_UTF8;
+}
+
+// ------------------------------------------------------------
+// Chunk scanner
+// ------------------------------------------------------------
+
+void pairadmin_scan_chunk(const void *data, size_t len, PairAdminChunkInfo *info)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i = 0;
+
+    if (!info) {
+        return;
+    }
+    memset(info, 0, sizeof(*info));
+    info->last_newline = -1;
+    if (!data) {
+        return;
+    }
+
+#if defined(PA_SCAN_X86)
+    {
+        uint32_t cpu = pa_cpu_features();
+
+        if (cpu & PAIRADMIN_CPU_AVX2) {
+            i = pa_scan_avx2(p, i, len, info);
+        }
+        if (cpu & PAIRADMIN_CPU_SSE2) {
+            i = pa_scan_sse2(p, i, len, info);
+        }
+    }
+#elif defined(PA_SCAN_NEON)
+    if (pa_cpu_features() & PAIRADMIN_CPU_NEON) {
+        i = pa_scan_neon(p, i, len, info);
+    }
+#endif
+
+    for (; i < len; i++) {
+        unsigned char c = p[i];
+
+        if (c == '\n') {
+            info->newlines++;
+            info->last_newline = (int64_t)i;
+        } else if (c == 0x1b) {
+            info->escapes++;
+        } else if (c & 0x80) {
+            info->non_ascii++;
+        }
+    }
+
+    info->flags = info->non_ascii ? pa_utf8_flags(p, len) : PAIRADMIN_TEXT_ASCII | PAIRADMIN_TEXT_UTF8;
+}
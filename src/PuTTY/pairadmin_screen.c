@@ -0,0 +1,960 @@
+// Virtual screen model for PairAdmin
+//
+// Full-screen programs (top, vim, less) redraw the same cells over and
+// over, so the output stream of a few minutes of top is megabytes that
+// all say the same thing. This keeps a grid of what the terminal shows,
+// fed from the same OUTPUT bytes as the capture store, so the consumer
+// can ask for the screen as it is now, or for the rows that changed
+// since the last time it looked, instead of replaying the redraws.
+//
+// The interpreter covers what shells and curses programs actually send:
+// printable UTF-8 with wide characters, C0 controls, cursor movement,
+// erase and insert/delete of characters and lines, scroll regions,
+// saved cursors and the alternate screen. Attributes and colours are
+// parsed and dropped; other sequences are skipped whole. Every row
+// carries the generation in which it last changed, one generation per
+// output fragment that changed anything.
+//
+// The producer holds the screen's spin lock for one fragment at a time
+// and readers for one copy, both a few microseconds at terminal sizes.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#define PA_SCREEN_PARAMS 16
+
+// Second cell of a double-width character
+#define PA_SCREEN_WIDE_TAIL 0xffffffffu
+
+#define PA_SCREEN_REPLACEMENT 0xfffdu
+
+typedef enum {
+    PA_SCREEN_GROUND = 0,
+    PA_SCREEN_ESC,
+    PA_SCREEN_CSI,
+    PA_SCREEN_STRING,           // OSC, DCS, SOS, PM, APC: skipped to BEL/ST
+    PA_SCREEN_STRING_ESC,
+    PA_SCREEN_SKIP_ONE          // Charset designation and ESC # final byte
+} PaScreenState;
+
+struct PaScreen {
+    volatile uint32_t lock;
+
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t *grid[2];          // Main and alternate screen, rows * cols
+    uint64_t *row_generation;   // Per visible row
+    int alternate;
+    uint64_t generation;        // Last completed
+    int changed;                // During a fragment: generation + 1 is in use
+
+    // Cursor
+    uint32_t x;
+    uint32_t y;
+    int wrap_pending;           // At the last column, about to wrap
+    uint32_t saved_x;
+    uint32_t saved_y;
+    uint32_t top;               // Scroll region, inclusive
+    uint32_t bottom;
+    uint32_t last;              // Last character printed, for REP
+
+    // Parser
+    PaScreenState state;
+    uint32_t params[PA_SCREEN_PARAMS];
+    uint32_t nparams;
+    int marker;                 // '?', '>', '<', '=' or 0
+    int intermediate;
+    uint32_t code_point;
+    uint32_t need;              // Continuation bytes still expected
+};
+
+static volatile uint32_t pa_screen_slots_lock = 0;
+
+static void pa_screen_lock(volatile uint32_t *lock)
+{
+    while (!pa_atomic_cas_u32(lock, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_screen_unlock(volatile uint32_t *lock)
+{
+    pa_store_release_u32(lock, 0);
+}
+
+// ------------------------------------------------------------
+// Grid operations
+// ------------------------------------------------------------
+
+PA_INLINE uint32_t *pa_screen_row(PaScreen *s, uint32_t y)
+{
+    return s->grid[s->alternate] + (size_t)y * s->cols;
+}
+
+static void pa_screen_touch(PaScreen *s, uint32_t from, uint32_t to)
+{
+    uint32_t y;
+
+    for (y = from; y <= to && y < s->rows; y++) {
+        s->row_generation[y] = s->generation + 1;
+    }
+    s->changed = 1;
+}
+
+static void pa_screen_blank(PaScreen *s, uint32_t y, uint32_t from, uint32_t to)
+{
+    if (from < to) {
+        memset(pa_screen_row(s, y) + from, 0, (size_t)(to - from) * sizeof(uint32_t));
+        pa_screen_touch(s, y, y);
+    }
+}
+
+static void pa_screen_blank_rows(PaScreen *s, uint32_t from, uint32_t to)
+{
+    uint32_t y;
+
+    for (y = from; y < to; y++) {
+        pa_screen_blank(s, y, 0, s->cols);
+    }
+}
+
+// Move rows top..bottom up by n, blanking n at the bottom
+static void pa_screen_scroll_up(PaScreen *s, uint32_t top, uint32_t bottom, uint32_t n)
+{
+    uint32_t span = bottom - top + 1;
+
+    if (n > span) {
+        n = span;
+    }
+    if (n < span) {
+        memmove(pa_screen_row(s, top), pa_screen_row(s, top + n),
+                (size_t)(span - n) * s->cols * sizeof(uint32_t));
+    }
+    pa_screen_blank_rows(s, bottom + 1 - n, bottom + 1);
+    pa_screen_touch(s, top, bottom);
+}
+
+static void pa_screen_scroll_down(PaScreen *s, uint32_t top, uint32_t bottom, uint32_t n)
+{
+    uint32_t span = bottom - top + 1;
+
+    if (n > span) {
+        n = span;
+    }
+    if (n < span) {
+        memmove(pa_screen_row(s, top + n), pa_screen_row(s, top),
+                (size_t)(span - n) * s->cols * sizeof(uint32_t));
+    }
+    pa_screen_blank_rows(s, top, top + n);
+    pa_screen_touch(s, top, bottom);
+}
+
+static void pa_screen_line_feed(PaScreen *s)
+{
+    if (s->y == s->bottom) {
+        pa_screen_scroll_up(s, s->top, s->bottom, 1);
+    } else if (s->y + 1 < s->rows) {
+        s->y++;
+    }
+}
+
+static void pa_screen_reverse_index(PaScreen *s)
+{
+    if (s->y == s->top) {
+        pa_screen_scroll_down(s, s->top, s->bottom, 1);
+    } else if (s->y > 0) {
+        s->y--;
+    }
+}
+
+static void pa_screen_move(PaScreen *s, int64_t x, int64_t y)
+{
+    s->x = x < 0 ? 0 : x >= s->cols ? s->cols - 1 : (uint32_t)x;
+    s->y = y < 0 ? 0 : y >= s->rows ? s->rows - 1 : (uint32_t)y;
+    s->wrap_pending = 0;
+}
+
+static void pa_screen_switch(PaScreen *s, int alternate)
+{
+    if (s->alternate != alternate) {
+        s->alternate = alternate;
+        pa_screen_touch(s, 0, s->rows - 1);
+    }
+}
+
+static void pa_screen_reset(PaScreen *s)
+{
+    s->alternate = 1;
+    pa_screen_blank_rows(s, 0, s->rows);
+    s->alternate = 0;
+    pa_screen_blank_rows(s, 0, s->rows);
+    s->top = 0;
+    s->bottom = s->rows - 1;
+    s->saved_x = 0;
+    s->saved_y = 0;
+    pa_screen_move(s, 0, 0);
+}
+
+// ------------------------------------------------------------
+// Characters
+// ------------------------------------------------------------
+
+static int pa_screen_zero_width(uint32_t c)
+{
+    return (c >= 0x0300 && c <= 0x036f) || (c >= 0x200b && c <= 0x200f) ||
+           (c >= 0xfe00 && c <= 0xfe0f) || (c >= 0x20d0 && c <= 0x20ff);
+}
+
+// East Asian wide and fullwidth blocks, plus emoji
+static int pa_screen_wide(uint32_t c)
+{
+    return (c >= 0x1100 && c <= 0x115f) || (c >= 0x2e80 && c <= 0x303e) ||
+           (c >= 0x3041 && c <= 0x33ff) || (c >= 0x3400 && c <= 0x4dbf) ||
+           (c >= 0x4e00 && c <= 0x9fff) || (c >= 0xa000 && c <= 0xa4cf) ||
+           (c >= 0xac00 && c <= 0xd7a3) || (c >= 0xf900 && c <= 0xfaff) ||
+           (c >= 0xfe30 && c <= 0xfe4f) || (c >= 0xff00 && c <= 0xff60) ||
+           (c >= 0xffe0 && c <= 0xffe6) || (c >= 0x1f300 && c <= 0x1f64f) ||
+           (c >= 0x1f900 && c <= 0x1f9ff) || (c >= 0x20000 && c <= 0x3fffd);
+}
+
+static void pa_screen_print(PaScreen *s, uint32_t c)
+{
+    uint32_t width;
+    uint32_t *row;
+
+    if (pa_screen_zero_width(c)) {
+        return;
+    }
+    width = pa_screen_wide(c) && s->cols > 1 ? 2 : 1;
+
+    if (s->wrap_pending || s->x + width > s->cols) {
+        s->x = 0;
+        s->wrap_pending = 0;
+        pa_screen_line_feed(s);
+    }
+    row = pa_screen_row(s, s->y);
+    row[s->x] = c;
+    if (width == 2) {
+        row[s->x + 1] = PA_SCREEN_WIDE_TAIL;
+    }
+    pa_screen_touch(s, s->y, s->y);
+    s->last = c;
+
+    if (s->x + width >= s->cols) {
+        s->x = s->cols - 1;
+        s->wrap_pending = 1;
+    } else {
+        s->x += width;
+    }
+}
+
+static void pa_screen_control(PaScreen *s, unsigned char c)
+{
+    switch (c) {
+    case '\b':
+        if (s->x > 0) {
+            s->x--;
+        }
+        s->wrap_pending = 0;
+        break;
+    case '\t':
+        pa_screen_move(s, ((int64_t)s->x / 8 + 1) * 8, s->y);
+        break;
+    case '\n':
+    case '\v':
+    case '\f':
+        pa_screen_line_feed(s);
+        break;
+    case '\r':
+        s->x = 0;
+        s->wrap_pending = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+// ------------------------------------------------------------
+// Escape sequences
+// ------------------------------------------------------------
+
+PA_INLINE uint32_t pa_screen_param(const PaScreen *s, uint32_t i, uint32_t fallback)
+{
+    return i < s->nparams && s->params[i] ? s->params[i] : fallback;
+}
+
+static void pa_screen_mode(PaScreen *s, int set)
+{
+    uint32_t i;
+
+    if (s->marker != '?') {
+        return;
+    }
+    for (i = 0; i < s->nparams; i++) {
+        switch (s->params[i]) {
+        case 1049:
+            if (set) {
+                s->saved_x = s->x;
+                s->saved_y = s->y;
+                pa_screen_switch(s, 1);
+                pa_screen_blank_rows(s, 0, s->rows);
+            } else {
+                pa_screen_switch(s, 0);
+                pa_screen_move(s, s->saved_x, s->saved_y);
+            }
+            break;
+        case 47:
+        case 1047:
+            if (!set && s->params[i] == 1047 && s->alternate) {
+                pa_screen_blank_rows(s, 0, s->rows);
+            }
+            pa_screen_switch(s, set);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void pa_screen_csi(PaScreen *s, unsigned char final)
+{
+    uint32_t n = pa_screen_param(s, 0, 1);
+    uint32_t *row = pa_screen_row(s, s->y);
+    uint32_t i;
+
+    if (s->intermediate) {
+        return;
+    }
+    if (s->marker && final != 'h' && final != 'l') {
+        return;
+    }
+
+    switch (final) {
+    case 'A':
+        pa_screen_move(s, s->x, (int64_t)s->y - n);
+        break;
+    case 'B':
+    case 'e':
+        pa_screen_move(s, s->x, (int64_t)s->y + n);
+        break;
+    case 'C':
+    case 'a':
+        pa_screen_move(s, (int64_t)s->x + n, s->y);
+        break;
+    case 'D':
+        pa_screen_move(s, (int64_t)s->x - n, s->y);
+        break;
+    case 'E':
+        pa_screen_move(s, 0, (int64_t)s->y + n);
+        break;
+    case 'F':
+        pa_screen_move(s, 0, (int64_t)s->y - n);
+        break;
+    case 'G':
+    case '`':
+        pa_screen_move(s, (int64_t)n - 1, s->y);
+        break;
+    case 'd':
+        pa_screen_move(s, s->x, (int64_t)n - 1);
+        break;
+    case 'H':
+    case 'f':
+        pa_screen_move(s, (int64_t)pa_screen_param(s, 1, 1) - 1, (int64_t)n - 1);
+        break;
+    case 'J':
+        switch (pa_screen_param(s, 0, 0)) {
+        case 0:
+            pa_screen_blank(s, s->y, s->x, s->cols);
+            pa_screen_blank_rows(s, s->y + 1, s->rows);
+            break;
+        case 1:
+            pa_screen_blank_rows(s, 0, s->y);
+            pa_screen_blank(s, s->y, 0, s->x + 1);
+            break;
+        default:
+            pa_screen_blank_rows(s, 0, s->rows);
+            break;
+        }
+        break;
+    case 'K':
+        switch (pa_screen_param(s, 0, 0)) {
+        case 0:
+            pa_screen_blank(s, s->y, s->x, s->cols);
+            break;
+        case 1:
+            pa_screen_blank(s, s->y, 0, s->x + 1);
+            break;
+        default:
+            pa_screen_blank(s, s->y, 0, s->cols);
+            break;
+        }
+        break;
+    case '@':
+        n = n < s->cols - s->x ? n : s->cols - s->x;
+        memmove(row + s->x + n, row + s->x, (size_t)(s->cols - s->x - n) * sizeof(uint32_t));
+        pa_screen_blank(s, s->y, s->x, s->x + n);
+        break;
+    case 'P':
+        n = n < s->cols - s->x ? n : s->cols - s->x;
+        memmove(row + s->x, row + s->x + n, (size_t)(s->cols - s->x - n) * sizeof(uint32_t));
+        pa_screen_blank(s, s->y, s->cols - n, s->cols);
+        break;
+    case 'X':
+        pa_screen_blank(s, s->y, s->x, n < s->cols - s->x ? s->x + n : s->cols);
+        break;
+    case 'L':
+        if (s->y >= s->top && s->y <= s->bottom) {
+            pa_screen_scroll_down(s, s->y, s->bottom, n);
+            s->x = 0;
+        }
+        break;
+    case 'M':
+        if (s->y >= s->top && s->y <= s->bottom) {
+            pa_screen_scroll_up(s, s->y, s->bottom, n);
+            s->x = 0;
+        }
+        break;
+    case 'S':
+        pa_screen_scroll_up(s, s->top, s->bottom, n);
+        break;
+    case 'T':
+        pa_screen_scroll_down(s, s->top, s->bottom, n);
+        break;
+    case 'b':
+        for (i = 0; i < n && i < s->cols * s->rows && s->last; i++) {
+            pa_screen_print(s, s->last);
+        }
+        break;
+    case 'r': {
+        uint32_t top = pa_screen_param(s, 0, 1) - 1;
+        uint32_t bottom = pa_screen_param(s, 1, s->rows) - 1;
+
+        if (bottom >= s->rows) {
+            bottom = s->rows - 1;
+        }
+        if (top < bottom) {
+            s->top = top;
+            s->bottom = bottom;
+        } else {
+            s->top = 0;
+            s->bottom = s->rows - 1;
+        }
+        pa_screen_move(s, 0, 0);
+        break;
+    }
+    case 's':
+        s->saved_x = s->x;
+        s->saved_y = s->y;
+        break;
+    case 'u':
+        pa_screen_move(s, s->saved_x, s->saved_y);
+        break;
+    case 'h':
+    case 'l':
+        pa_screen_mode(s, final == 'h');
+        break;
+    default:
+        // SGR and everything else that doesn't move text
+        break;
+    }
+}
+
+static void pa_screen_esc(PaScreen *s, unsigned char c)
+{
+    s->state = PA_SCREEN_GROUND;
+    switch (c) {
+    case '[':
+        s->state = PA_SCREEN_CSI;
+        s->nparams = 0;
+        s->marker = 0;
+        s->intermediate = 0;
+        break;
+    case ']':
+    case 'P':
+    case 'X':
+    case '^':
+    case '_':
+        s->state = PA_SCREEN_STRING;
+        break;
+    case '(':
+    case ')':
+    case '*':
+    case '+':
+    case '#':
+        s->state = PA_SCREEN_SKIP_ONE;
+        break;
+    case '7':
+        s->saved_x = s->x;
+        s->saved_y = s->y;
+        break;
+    case '8':
+        pa_screen_move(s, s->saved_x, s->saved_y);
+        break;
+    case 'D':
+        pa_screen_line_feed(s);
+        break;
+    case 'E':
+        s->x = 0;
+        s->wrap_pending = 0;
+        pa_screen_line_feed(s);
+        break;
+    case 'M':
+        pa_screen_reverse_index(s);
+        break;
+    case 'c':
+        pa_screen_reset(s);
+        break;
+    case 0x1b:
+        s->state = PA_SCREEN_ESC;
+        break;
+    default:
+        break;
+    }
+}
+
+static void pa_screen_csi_byte(PaScreen *s, unsigned char c)
+{
+    if (c >= '0' && c <= '9') {
+        if (s->nparams == 0) {
+            s->nparams = 1;
+            s->params[0] = 0;
+        }
+        if (s->nparams <= PA_SCREEN_PARAMS) {
+            uint32_t *p = &s->params[s->nparams - 1];
+
+            *p = *p < 100000 ? *p * 10 + (uint32_t)(c - '0') : *p;
+        }
+    } else if (c == ';' || c == ':') {
+        if (s->nparams == 0) {
+            s->nparams = 1;
+            s->params[0] = 0;
+        }
+        if (s->nparams < PA_SCREEN_PARAMS) {
+            s->params[s->nparams++] = 0;
+        } else {
+            s->nparams = PA_SCREEN_PARAMS + 1;
+        }
+    } else if (c >= '<' && c <= '?') {
+        s->marker = c;
+    } else if (c >= 0x20 && c <= 0x2f) {
+        s->intermediate = c;
+    } else if (c >= 0x40 && c <= 0x7e) {
+        if (s->nparams > PA_SCREEN_PARAMS) {
+            s->nparams = PA_SCREEN_PARAMS;
+        }
+        s->state = PA_SCREEN_GROUND;
+        pa_screen_csi(s, c);
+    } else if (c == 0x1b) {
+        s->state = PA_SCREEN_ESC;
+    } else if (c < 0x20) {
+        // Controls inside a sequence still take effect
+        pa_screen_control(s, c);
+    }
+}
+
+static void pa_screen_ground(PaScreen *s, unsigned char c)
+{
+    if (s->need) {
+        if ((c & 0xc0) == 0x80) {
+            s->code_point = (s->code_point << 6) | (c & 0x3f);
+            if (--s->need == 0) {
+                pa_screen_print(s, s->code_point);
+            }
+            return;
+        }
+        s->need = 0;
+        pa_screen_print(s, PA_SCREEN_REPLACEMENT);
+    }
+
+    if (c == 0x1b) {
+        s->state = PA_SCREEN_ESC;
+    } else if (c < 0x20) {
+        pa_screen_control(s, c);
+    } else if (c < 0x7f) {
+        pa_screen_print(s, c);
+    } else if (c >= 0xc2 && c <= 0xdf) {
+        s->code_point = c & 0x1f;
+        s->need = 1;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        s->code_point = c & 0x0f;
+        s->need = 2;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        s->code_point = c & 0x07;
+        s->need = 3;
+    } else if (c != 0x7f) {
+        pa_screen_print(s, PA_SCREEN_REPLACEMENT);
+    }
+}
+
+void pa_screen_feed(PaScreen *screen, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i;
+
+    pa_screen_lock(&screen->lock);
+    for (i = 0; i < len; i++) {
+        unsigned char c = p[i];
+
+        switch (screen->state) {
+        case PA_SCREEN_GROUND:
+            pa_screen_ground(screen, c);
+            break;
+        case PA_SCREEN_ESC:
+            pa_screen_esc(screen, c);
+            break;
+        case PA_SCREEN_CSI:
+            pa_screen_csi_byte(screen, c);
+            break;
+        case PA_SCREEN_STRING:
+            if (c == 0x07) {
+                screen->state = PA_SCREEN_GROUND;
+            } else if (c == 0x1b) {
+                screen->state = PA_SCREEN_STRING_ESC;
+            }
+            break;
+        case PA_SCREEN_STRING_ESC:
+            // ESC \ ends the string; any other ESC starts a new sequence
+            if (c == '\\') {
+                screen->state = PA_SCREEN_GROUND;
+            } else {
+                pa_screen_esc(screen, c);
+            }
+            break;
+        case PA_SCREEN_SKIP_ONE:
+            screen->state = PA_SCREEN_GROUND;
+            break;
+        }
+    }
+    if (screen->changed) {
+        screen->generation++;
+        screen->changed = 0;
+    }
+    pa_screen_unlock(&screen->lock);
+}
+
+// ------------------------------------------------------------
+// Lifetime
+// ------------------------------------------------------------
+
+static uint32_t pa_screen_clamp(uint32_t v, uint32_t fallback, uint32_t max)
+{
+    if (v == 0) {
+        return fallback;
+    }
+    return v > max ? max : v;
+}
+
+static void pa_screen_free(PaScreen *s)
+{
+    if (s) {
+        free(s->grid[0]);
+        free(s->grid[1]);
+        free(s->row_generation);
+        free(s);
+    }
+}
+
+// Both grids and the row generations for cols x rows, blank
+static int pa_screen_alloc_grids(uint32_t cols, uint32_t rows, uint32_t **main_grid,
+                                 uint32_t **alternate_grid, uint64_t **row_generation)
+{
+    size_t cells = (size_t)cols * rows;
+
+    *main_grid = (uint32_t *)calloc(cells, sizeof(uint32_t));
+    *alternate_grid = (uint32_t *)calloc(cells, sizeof(uint32_t));
+    *row_generation = (uint64_t *)calloc(rows, sizeof(uint64_t));
+    if (!*main_grid || !*alternate_grid || !*row_generation) {
+        free(*main_grid);
+        free(*alternate_grid);
+        free(*row_generation);
+        return -1;
+    }
+    return 0;
+}
+
+int pairadmin_screen_open(PairAdminSession *session, uint32_t cols, uint32_t rows)
+{
+    PaScreen *volatile *slot = pa_session_screen_slot(session);
+    PaScreen *s;
+
+    pa_screen_lock(&pa_screen_slots_lock);
+    if (*slot) {
+        pa_screen_unlock(&pa_screen_slots_lock);
+        return 0;
+    }
+
+    s = (PaScreen *)calloc(1, sizeof(PaScreen));
+    if (!s) {
+        pa_screen_unlock(&pa_screen_slots_lock);
+        return -1;
+    }
+    s->cols = pa_screen_clamp(cols, PAIRADMIN_SCREEN_DEFAULT_COLS, PAIRADMIN_SCREEN_MAX_COLS);
+    s->rows = pa_screen_clamp(rows, PAIRADMIN_SCREEN_DEFAULT_ROWS, PAIRADMIN_SCREEN_MAX_ROWS);
+    if (pa_screen_alloc_grids(s->cols, s->rows, &s->grid[0], &s->grid[1], &s->row_generation) != 0) {
+        free(s);
+        pa_screen_unlock(&pa_screen_slots_lock);
+        return -1;
+    }
+    s->bottom = s->rows - 1;
+
+    pa_store_release_ptr((void *volatile *)slot, s);
+    pa_screen_unlock(&pa_screen_slots_lock);
+    return 0;
+}
+
+void pairadmin_screen_close(PairAdminSession *session)
+{
+    PaScreen *volatile *slot = pa_session_screen_slot(session);
+    PaScreen *s;
+
+    pa_screen_lock(&pa_screen_slots_lock);
+    s = (PaScreen *)pa_atomic_xchg_ptr((void *volatile *)slot, NULL);
+    pa_screen_unlock(&pa_screen_slots_lock);
+
+    if (s) {
+        // The hooks and readers use the screen inside an epoch section
+        pa_epoch_synchronize();
+        pa_screen_free(s);
+    }
+}
+
+int pairadmin_screen_resize(PairAdminSession *session, uint32_t cols, uint32_t rows)
+{
+    PaScreen *volatile *slot = pa_session_screen_slot(session);
+    uint32_t *grids[2];
+    uint64_t *row_generation;
+    uint32_t epoch;
+    PaScreen *s;
+    int result = -1;
+
+    cols = pa_screen_clamp(cols, PAIRADMIN_SCREEN_DEFAULT_COLS, PAIRADMIN_SCREEN_MAX_COLS);
+    rows = pa_screen_clamp(rows, PAIRADMIN_SCREEN_DEFAULT_ROWS, PAIRADMIN_SCREEN_MAX_ROWS);
+    if (pa_screen_alloc_grids(cols, rows, &grids[0], &grids[1], &row_generation) != 0) {
+        return -1;
+    }
+
+    epoch = pa_epoch_enter();
+    s = (PaScreen *)pa_load_acquire_ptr((void *const volatile *)slot);
+    if (s) {
+        uint32_t keep_cols;
+        uint32_t keep_rows;
+        uint32_t g;
+        uint32_t y;
+
+        pa_screen_lock(&s->lock);
+        // Keep the rows nearest the cursor, as terminals do when shrinking
+        keep_cols = cols < s->cols ? cols : s->cols;
+        keep_rows = rows < s->rows ? rows : s->rows;
+        {
+            uint32_t first = s->y >= keep_rows ? s->y + 1 - keep_rows : 0;
+
+            for (g = 0; g < 2; g++) {
+                for (y = 0; y < keep_rows; y++) {
+                    memcpy(grids[g] + (size_t)y * cols, s->grid[g] + (size_t)(first + y) * s->cols,
+                           keep_cols * sizeof(uint32_t));
+                }
+                free(s->grid[g]);
+                s->grid[g] = grids[g];
+            }
+            s->y -= first;
+        }
+        free(s->row_generation);
+        s->row_generation = row_generation;
+        s->cols = cols;
+        s->rows = rows;
+        s->top = 0;
+        s->bottom = rows - 1;
+        pa_screen_move(s, s->x, s->y);
+        pa_screen_touch(s, 0, rows - 1);
+        s->generation++;
+        s->changed = 0;
+        pa_screen_unlock(&s->lock);
+        result = 0;
+    }
+    pa_epoch_exit(epoch);
+
+    if (result != 0) {
+        free(grids[0]);
+        free(grids[1]);
+        free(row_generation);
+    }
+    return result;
+}
+
+// ------------------------------------------------------------
+// Readers
+// ------------------------------------------------------------
+
+static size_t pa_utf8_put(unsigned char *out, uint32_t c)
+{
+    if (c < 0x80) {
+        out[0] = (unsigned char)c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = (unsigned char)(0xc0 | (c >> 6));
+        out[1] = (unsigned char)(0x80 | (c & 0x3f));
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = (unsigned char)(0xe0 | (c >> 12));
+        out[1] = (unsigned char)(0x80 | ((c >> 6) & 0x3f));
+        out[2] = (unsigned char)(0x80 | (c & 0x3f));
+        return 3;
+    }
+    out[0] = (unsigned char)(0xf0 | (c >> 18));
+    out[1] = (unsigned char)(0x80 | ((c >> 12) & 0x3f));
+    out[2] = (unsigned char)(0x80 | ((c >> 6) & 0x3f));
+    out[3] = (unsigned char)(0x80 | (c & 0x3f));
+    return 4;
+}
+
+// Cells up to the last non-blank one
+static uint32_t pa_screen_row_width(const PaScreen *s, const uint32_t *row)
+{
+    uint32_t width = s->cols;
+
+    (void)s;
+    while (width > 0 && (row[width - 1] == 0 || row[width - 1] == ' ')) {
+        width--;
+    }
+    return width;
+}
+
+// Encode row y into out, which holds at least cols * 4 bytes
+static size_t pa_screen_row_text(PaScreen *s, uint32_t y, unsigned char *out)
+{
+    const uint32_t *row = pa_screen_row(s, y);
+    uint32_t width = pa_screen_row_width(s, row);
+    size_t n = 0;
+    uint32_t x;
+
+    for (x = 0; x < width; x++) {
+        if (row[x] != PA_SCREEN_WIDE_TAIL) {
+            n += pa_utf8_put(out + n, row[x] ? row[x] : ' ');
+        }
+    }
+    return n;
+}
+
+static void pa_screen_info(const PaScreen *s, PairAdminScreenInfo *info)
+{
+    if (info) {
+        info->cols = s->cols;
+        info->rows = s->rows;
+        info->cursor_col = s->x;
+        info->cursor_row = s->y;
+        info->generation = s->generation;
+        info->flags = s->alternate ? PAIRADMIN_SCREEN_ALTERNATE : 0;
+        info->reserved = 0;
+    }
+}
+
+size_t pairadmin_get_screen_snapshot(PairAdminSession *session, char *buf, size_t cap,
+                                     PairAdminScreenInfo *info)
+{
+    PaScreen *volatile *slot = pa_session_screen_slot(session);
+    unsigned char *out = (unsigned char *)buf;
+    size_t written = 0;
+    uint32_t epoch;
+    PaScreen *s;
+
+    if (info) {
+        memset(info, 0, sizeof(*info));
+    }
+
+    epoch = pa_epoch_enter();
+    s = (PaScreen *)pa_load_acquire_ptr((void *const volatile *)slot);
+    if (s) {
+        uint32_t last;
+        uint32_t y;
+
+        pa_screen_lock(&s->lock);
+        // Blank rows below both the text and the cursor are left out
+        last = s->y;
+        for (y = s->rows; y > s->y + 1; y--) {
+            if (pa_screen_row_width(s, pa_screen_row(s, y - 1)) > 0) {
+                last = y - 1;
+                break;
+            }
+        }
+        for (y = 0; y <= last && out; y++) {
+            unsigned char row[PAIRADMIN_SCREEN_MAX_COLS * 4];
+            size_t n = pa_screen_row_text(s, y, row);
+
+            // Whole rows only
+            if (n + 1 > cap - written) {
+                break;
+            }
+            memcpy(out + written, row, n);
+            written += n;
+            out[written++] = '\n';
+        }
+        pa_screen_info(s, info);
+        pa_screen_unlock(&s->lock);
+    }
+    pa_epoch_exit(epoch);
+    return written;
+}
+
+int32_t pairadmin_get_screen_changes(PairAdminSession *session, uint64_t since, void *buf,
+                                     size_t cap, size_t *written, PairAdminScreenInfo *info)
+{
+    PaScreen *volatile *slot = pa_session_screen_slot(session);
+    unsigned char *out = (unsigned char *)buf;
+    int32_t count = -1;
+    size_t used = 0;
+    uint32_t epoch;
+    PaScreen *s;
+
+    if (info) {
+        memset(info, 0, sizeof(*info));
+    }
+
+    epoch = pa_epoch_enter();
+    s = (PaScreen *)pa_load_acquire_ptr((void *const volatile *)slot);
+    if (s) {
+        size_t needed = 0;
+        uint32_t y;
+
+        pa_screen_lock(&s->lock);
+        count = 0;
+        for (y = 0; y < s->rows; y++) {
+            PairAdminScreenRow hdr;
+            unsigned char text[PAIRADMIN_SCREEN_MAX_COLS * 4];
+
+            // Rows never written are still generation 0
+            if (since > 0 && s->row_generation[y] <= since) {
+                continue;
+            }
+            hdr.row = y;
+            hdr.length = (uint32_t)pa_screen_row_text(s, y, text);
+            needed += PAIRADMIN_SCREEN_ROW_SIZE(hdr.length);
+            if (count < 0 || !out || needed > cap) {
+                // Keep counting what it would take
+                count = -1;
+                continue;
+            }
+            memcpy(out + used, &hdr, sizeof(hdr));
+            memcpy(out + used + sizeof(hdr), text, hdr.length);
+            memset(out + used + sizeof(hdr) + hdr.length, 0,
+                   PAIRADMIN_SCREEN_ROW_SIZE(hdr.length) - sizeof(hdr) - hdr.length);
+            used += PAIRADMIN_SCREEN_ROW_SIZE(hdr.length);
+            count++;
+        }
+        if (count < 0) {
+            used = needed;
+        }
+        pa_screen_info(s, info);
+        pa_screen_unlock(&s->lock);
+    }
+    pa_epoch_exit(epoch);
+
+    if (written) {
+        *written = used;
+    }
+    return count;
+}
@@ -0,0 +1,1298 @@
+// Session lifecycle for PairAdmin
+//
+// Every session has a session thread that owns its PuTTY event loop for
+// as long as the session exists. The exported lifecycle calls only post
+// a command to it and return, so a slow DNS lookup or SSH handshake never
+// blocks the caller (the WPF UI thread). The session thread reports what
+// happened as Connected/Disconnected/Error events; since PuTTY runs on
+// it, those share the hooks' single-producer path into the ring.
+//
+// pairadmin_init() and friends drive the process-wide session, which
+// uses pairadmin_callback and the shared ring. Sessions from
+// pairadmin_session_create() each add their own ring and a delivery
+// thread that feeds their own callback, so many terminals can share one
+// process without sharing a producer or a consumer.
+//
+// Neither thread polls. Without a connection the session thread sleeps
+// until a command is posted, and a delivery thread sleeps on its ring
+// until records arrive, so idle sessions cost next to nothing.
+//
+// The session thread also owns the terminal window. Embedding and
+// resize requests from the UI thread are recorded and applied here,
+// between two passes of the backend's event loop, the bounds no more
+// than once per PAIRADMIN_EMBED_FRAME_US.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+// Longest the backend event loop runs before commands are checked again
+#define PA_SESSION_RUN_MS 10
+
+// Records handed to the callback per delivery pass
+#define PA_SESSION_DRAIN_RECORDS 256
+
+// Holds a record the arena has no block for
+#define PA_SESSION_BUFFER PAIRADMIN_READ_BUFFER_MIN
+
+#define PA_SESSION_HOST_MAX 256
+#define PA_SESSION_USER_MAX 128
+#define PA_SESSION_ERROR_MAX 256
+#define PA_SESSION_PATH_MAX 512
+
+// Timestamp and session prefix plus the longest message logged (an
+// error or the host name), with room to spare
+#define PA_SESSION_LOG_LINE (64 + PA_SESSION_HOST_MAX + PA_SESSION_ERROR_MAX)
+
+typedef enum {
+    PA_SESSION_NONE = 0,
+    PA_SESSION_CONNECT,
+    PA_SESSION_DISCONNECT,
+    PA_SESSION_SHUTDOWN
+} PaSessionCommand;
+
+// Embedding requests not yet applied to the window
+#define PA_EMBED_PARENT 0x1
+#define PA_EMBED_BOUNDS 0x2
+
+typedef struct PaSessionTarget {
+    char host[PA_SESSION_HOST_MAX];
+    char user[PA_SESSION_USER_MAX];
+    int port;
+} PaSessionTarget;
+
+struct PairAdminSession {
+    uint32_t id;
+
+    // Guards the fields up to state
+    volatile uint32_t mutex;
+    int running;
+    void *parent;
+    PaSessionCommand command;
+    PaSessionTarget target;
+    char error[PA_SESSION_ERROR_MAX];
+    void *embed_parent;
+    int32_t bounds[4];          // x, y, width, height
+    int has_bounds;
+    uint32_t embed_pending;     // PA_EMBED_*
+
+    // Read without the lock by the state accessors
+    volatile uint32_t state;
+    void *volatile hwnd;
+
+    // Signalled with the lock held when a command is posted
+    PaWaker wake;
+
+    // Session thread only
+    PaThread worker;
+    PairAdminSessionBackend backend;
+    char label[PA_SESSION_HOST_MAX + 8];
+    void *window;               // hwnd as last announced
+    void *window_parent;        // What it was embedded in, or NULL
+    int32_t window_bounds[4];   // Bounds last applied to it
+    uint64_t window_moved_us;
+
+    // Own delivery; ring is NULL for the process-wide session
+    PairAdminSessionCallback callback;
+    void *user;
+    PaRing *ring;
+    PaVtFilter vt;              // Session thread: it is the ring's producer
+    PaThread delivery;
+    volatile uint32_t stop;
+    unsigned char *buffer;
+
+    // Delivery thread: blocks for records the callback may retain, the
+    // record taken from the ring but not yet committed, and the one
+    // the callback is looking at
+    PaArena arena;
+    PairAdminEventHeader *pending;
+    int pending_owned;
+    PairAdminEventHeader *current;
+    int current_state;
+
+    // Written by the delivery thread
+    volatile uint64_t events;
+    volatile uint64_t bytes;
+
+    // Capture store, or NULL; used by the producer inside an epoch section
+    PaCapture *volatile capture;
+
+    // Screen model, or NULL; likewise
+    PaScreen *volatile screen;
+
+    // Command digests, or NULL; likewise
+    PaDigest *volatile digest;
+
+    // Producer only, like vt
+    PaRedactor redact;
+    PaLineEditor line;
+    PaMarkScanner marks;
+};
+
+// Guards the backend, the log and the session count
+static volatile uint32_t pa_sessions_mutex = 0;
+
+static PairAdminSessionBackend pa_session_backend;
+static int pa_session_has_backend = 0;
+static uint32_t pa_session_ids = 0;
+static uint32_t pa_session_count = 0;
+
+// Shared by all sessions; named while any session is running and
+// created with its first line
+static FILE *pa_session_log_file = NULL;
+static int pa_session_log_users = 0;
+static int pa_session_log_tried = 0;
+static uint64_t pa_session_started_us = 0;
+static char pa_session_log_path[PA_SESSION_PATH_MAX];
+
+static PairAdminSession pa_default_session;
+
+// The session whose thread this is
+static PA_THREAD_LOCAL PairAdminSession *pa_session_self = NULL;
+
+static void pa_spin_lock(volatile uint32_t *lock)
+{
+    while (!pa_atomic_cas_u32(lock, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_spin_unlock(volatile uint32_t *lock)
+{
+    pa_store_release_u32(lock, 0);
+}
+
+static PairAdminState pa_session_get(PairAdminSession *s)
+{
+    return (PairAdminState)(int32_t)pa_load_acquire_u32(&s->state);
+}
+
+static void pa_session_set(PairAdminSession *s, PairAdminState state)
+{
+    if (pa_trace_on(PA_TRACE_SESSION)) {
+        pa_trace_session(s->id, (int32_t)pa_load_acquire_u32(&s->state), (int32_t)state);
+    }
+    pa_store_release_u32(&s->state, (uint32_t)(int32_t)state);
+}
+
+// Caller holds s->mutex
+static void pa_session_set_error(PairAdminSession *s, const char *message)
+{
+    snprintf(s->error, sizeof(s->error), "%s", message);
+}
+
+// ------------------------------------------------------------
+// Session log
+// ------------------------------------------------------------
+
+// Caller holds pa_sessions_mutex
+static FILE *pa_session_log_open(void)
+{
+    if (pa_session_log_users > 0 && !pa_session_log_tried) {
+        pa_session_log_tried = 1;
+        if (pa_session_log_path[0]) {
+            pa_session_log_file = fopen(pa_session_log_path, "a");
+        }
+        if (!pa_session_log_file) {
+            pa_session_log_path[0] = '\0';
+        }
+    }
+    return pa_session_log_file;
+}
+
+// Lines from several session threads go out whole: each is formatted
+// and written in one call under the lock that also opens and closes
+// the file
+static void pa_session_log(PairAdminSession *s, const char *fmt, ...)
+{
+    char line[PA_SESSION_LOG_LINE];
+    uint64_t elapsed;
+    size_t used;
+    va_list ap;
+    FILE *f;
+
+    pa_spin_lock(&pa_sessions_mutex);
+    f = pa_session_log_open();
+    if (f) {
+        elapsed = pa_now_us() - pa_session_started_us;
+        used = (size_t)snprintf(line, sizeof(line), "[%6lu.%03lu] #%u ",
+                                (unsigned long)(elapsed / 1000000u),
+                                (unsigned long)(elapsed / 1000u % 1000u), (unsigned)s->id);
+        // Longer messages are cut short, keeping room for the newline
+        va_start(ap, fmt);
+        vsnprintf(line + used, sizeof(line) - used - 1, fmt, ap);
+        va_end(ap);
+        used += strlen(line + used);
+        line[used++] = '\n';
+        line[used] = '\0';
+        fputs(line, f);
+        fflush(f);
+    }
+    pa_spin_unlock(&pa_sessions_mutex);
+}
+
+// Whether the log file exists yet
+static int pa_session_log_opened(void)
+{
+    int opened;
+
+    pa_spin_lock(&pa_sessions_mutex);
+    opened = pa_session_log_file != NULL;
+    pa_spin_unlock(&pa_sessions_mutex);
+    return opened;
+}
+
+static void pa_session_log_acquire(void)
+{
+    pa_spin_lock(&pa_sessions_mutex);
+    if (pa_session_log_users++ == 0) {
+        pa_session_started_us = pa_now_us();
+        pa_session_log_tried = 0;
+        if (pa_temp_file_path(pa_session_log_path, sizeof(pa_session_log_path),
+                              "pairadmin", "log") != 0) {
+            pa_session_log_path[0] = '\0';
+        }
+    }
+    pa_spin_unlock(&pa_sessions_mutex);
+}
+
+static void pa_session_log_release(void)
+{
+    pa_spin_lock(&pa_sessions_mutex);
+    if (--pa_session_log_users == 0 && pa_session_log_file) {
+        fclose(pa_session_log_file);
+        pa_session_log_file = NULL;
+    }
+    pa_spin_unlock(&pa_sessions_mutex);
+}
+
+// ------------------------------------------------------------
+// Session thread
+// ------------------------------------------------------------
+
+PaCapture *volatile *pa_session_capture_slot(PairAdminSession *session)
+{
+    return &(session ? session : &pa_default_session)->capture;
+}
+
+static void pa_session_capture(PairAdminSession *s, PairAdminEventType event,
+                               const void *data, size_t len)
+{
+    uint32_t epoch = pa_epoch_enter();
+    PaCapture *capture = (PaCapture *)pa_load_acquire_ptr((void *const volatile *)&s->capture);
+
+    if (capture) {
+        pa_capture_append(capture, event, data, len);
+    }
+    pa_epoch_exit(epoch);
+}
+
+PaScreen *volatile *pa_session_screen_slot(PairAdminSession *session)
+{
+    return &(session ? session : &pa_default_session)->screen;
+}
+
+static void pa_session_screen(PairAdminSession *s, const void *data, size_t len)
+{
+    uint32_t epoch = pa_epoch_enter();
+    PaScreen *screen = (PaScreen *)pa_load_acquire_ptr((void *const volatile *)&s->screen);
+
+    if (screen) {
+        pa_screen_feed(screen, data, len);
+    }
+    pa_epoch_exit(epoch);
+}
+
+PaDigest *volatile *pa_session_digest_slot(PairAdminSession *session)
+{
+    return &(session ? session : &pa_default_session)->digest;
+}
+
+static void pa_session_digest(PairAdminSession *s, PairAdminEventType event,
+                              const void *data, size_t len)
+{
+    uint32_t epoch = pa_epoch_enter();
+    PaDigest *digest = (PaDigest *)pa_load_acquire_ptr((void *const volatile *)&s->digest);
+
+    if (digest) {
+        pa_digest_feed(digest, event, data, len);
+    }
+    pa_epoch_exit(epoch);
+}
+
+static void pa_session_forward(PairAdminSession *owner, PairAdminEventType event,
+                               const void *data, size_t len)
+{
+    // Checked without the epoch first so the hooks pay nothing when
+    // capture is off
+    if (owner->capture && (event == PAIRADMIN_EVENT_OUTPUT || event == PAIRADMIN_EVENT_INPUT)) {
+        pa_session_capture(owner, event, data, len);
+    }
+    if (owner->screen && event == PAIRADMIN_EVENT_OUTPUT) {
+        pa_session_screen(owner, data, len);
+    }
+    if (owner->digest && (event == PAIRADMIN_EVENT_OUTPUT || event == PAIRADMIN_EVENT_COMMAND ||
+                          event == PAIRADMIN_EVENT_COMMAND_START || event == PAIRADMIN_EVENT_COMMAND_END)) {
+        pa_session_digest(owner, event, data, len);
+    }
+
+    if (owner->ring) {
+        pa_dispatch_ring(owner->ring, &owner->vt, event, data, len);
+        return;
+    }
+    pa_dispatch(event, data, len);
+}
+
+// Whatever a session ends with goes out before it is reported, and the
+// next one starts without a half-matched secret
+static void pa_session_redact_flush(PairAdminSession *owner)
+{
+    size_t n;
+
+    n = pa_redact_flush(&owner->redact.output, owner->redact.scratch);
+    if (n > 0) {
+        pa_session_forward(owner, PAIRADMIN_EVENT_OUTPUT, owner->redact.scratch, n);
+    }
+    n = pa_redact_flush(&owner->redact.input, owner->redact.scratch);
+    if (n > 0) {
+        pa_session_forward(owner, PAIRADMIN_EVENT_INPUT, owner->redact.scratch, n);
+    }
+}
+
+static void pa_session_redact(PairAdminSession *owner, PairAdminEventType event,
+                              const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+
+    if (event == PAIRADMIN_EVENT_CONNECTED || event == PAIRADMIN_EVENT_DISCONNECTED ||
+        event == PAIRADMIN_EVENT_ERROR) {
+        pa_session_redact_flush(owner);
+    }
+    if (!data || !pa_redact_wanted(&owner->redact, event)) {
+        pa_session_forward(owner, event, data, len);
+        return;
+    }
+
+    // Redacted before anything else sees it, the capture store included
+    while (len > 0) {
+        size_t chunk = len > PAIRADMIN_MAX_PAYLOAD ? PAIRADMIN_MAX_PAYLOAD : len;
+        size_t n = pa_redact(&owner->redact, event, p, chunk, owner->redact.scratch);
+
+        if (n > 0) {
+            pa_session_forward(owner, event, owner->redact.scratch, n);
+        }
+        p += chunk;
+        len -= chunk;
+    }
+}
+
+static void pa_session_command(PairAdminSession *owner, uint32_t flags, uint32_t denied)
+{
+    PaLineEditor *ed = &owner->line;
+    PairAdminCommandInfo info;
+
+    info.flags = flags;
+    info.denied = denied;
+    info.length = (uint32_t)pa_redact_text(ed->text, ed->length, ed->event + sizeof(info));
+    info.reserved = 0;
+    memcpy(ed->event, &info, sizeof(info));
+    pa_session_forward(owner, PAIRADMIN_EVENT_COMMAND, ed->event, sizeof(info) + info.length);
+}
+
+// Output goes out in pieces that end at each shell mark, every piece
+// followed by its mark; the fingerprint is looked for once the fragment
+// is through
+static void pa_session_output(PairAdminSession *owner, const void *data, size_t len)
+{
+    PaMarkScanner *m = &owner->marks;
+    const unsigned char *p = (const unsigned char *)data;
+    uint32_t length;
+    uint16_t type;
+
+    if (!data || !pa_marks_begin(m)) {
+        m->offset += data ? len : 0;
+        pa_session_redact(owner, PAIRADMIN_EVENT_OUTPUT, data, len);
+        return;
+    }
+
+    while (len > 0) {
+        size_t n = pa_marks_output(m, p, len, &type, &length);
+
+        pa_session_redact(owner, PAIRADMIN_EVENT_OUTPUT, p, n);
+        if (type) {
+            pa_session_forward(owner, (PairAdminEventType)type, m->event, length);
+        }
+        p += n;
+        len -= n;
+    }
+    while ((type = pa_marks_pause(m, &length)) != 0) {
+        pa_session_forward(owner, (PairAdminEventType)type, m->event, length);
+    }
+}
+
+// Input goes out in pieces that end at each Enter, every piece followed
+// by the command line it submitted. Returns the bytes ldisc may send.
+static size_t pa_session_input(PairAdminSession *owner, const void *data, size_t len, int checked)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t start = 0;
+    size_t pos = 0;
+
+    if (!data) {
+        return 0;
+    }
+
+    while (pos < len) {
+        uint32_t denied;
+        uint32_t flags;
+        int answering;
+        int done;
+
+        pos += pa_line_feed(&owner->line, p + pos, len - pos, &done);
+        if (!done) {
+            break;
+        }
+
+        // Asked before the Enter goes through, which ends the answer
+        answering = pa_redact_answering(&owner->redact);
+        flags = pa_line_check(&owner->line, checked, &denied);
+
+        if (flags & PAIRADMIN_COMMAND_BLOCKED) {
+            // The shell never sees this Enter: the line stays as typed
+            owner->line.cr = 0;
+            pa_session_redact(owner, PAIRADMIN_EVENT_INPUT, p + start, pos - 1 - start);
+            pa_session_command(owner, flags, denied);
+            return pos - 1;
+        }
+
+        pa_session_redact(owner, PAIRADMIN_EVENT_INPUT, p + start, pos - start);
+        // An empty line recalled from history still runs something
+        if (!answering && (owner->line.length > 0 || (flags & PAIRADMIN_COMMAND_INEXACT))) {
+            uint32_t length;
+            uint16_t type;
+
+            pa_session_command(owner, flags, denied);
+            if (pa_marks_begin(&owner->marks) && (type = pa_marks_submit(&owner->marks, &length)) != 0) {
+                pa_session_forward(owner, (PairAdminEventType)type, owner->marks.event, length);
+            }
+        }
+        pa_line_clear(&owner->line);
+        start = pos;
+    }
+
+    if (start < len) {
+        pa_session_redact(owner, PAIRADMIN_EVENT_INPUT, p + start, len - start);
+    }
+    return len;
+}
+
+static PairAdminSession *pa_session_owner(void)
+{
+    PairAdminSession *s = pa_session_self;
+
+    return s && s->ring ? s : &pa_default_session;
+}
+
+void pa_session_route(PairAdminEventType event, const void *data, size_t len)
+{
+    if (event == PAIRADMIN_EVENT_INPUT) {
+        pa_session_input(pa_session_owner(), data, len, 0);
+        return;
+    }
+    if (event == PAIRADMIN_EVENT_OUTPUT) {
+        pa_session_output(pa_session_owner(), data, len);
+        return;
+    }
+    pa_session_redact(pa_session_owner(), event, data, len);
+}
+
+size_t pa_session_route_checked(const void *data, size_t len)
+{
+    return pa_session_input(pa_session_owner(), data, len, 1);
+}
+
+static void pa_session_emit(PairAdminSession *s, PairAdminEventType event, const char *text)
+{
+    pa_session_log(s, "event %d: %s", (int)event, text);
+    pa_session_route(event, text, strlen(text));
+}
+
+static const char *pa_session_backend_error(PairAdminSession *s, const char *fallback)
+{
+    const char *message = s->backend.error ? s->backend.error(s->backend.ctx) : NULL;
+
+    return message && *message ? message : fallback;
+}
+
+static void pa_session_fail(PairAdminSession *s, const char *message)
+{
+    pa_spin_lock(&s->mutex);
+    pa_session_set_error(s, message);
+    pa_session_set(s, PAIRADMIN_STATE_ERROR);
+    pa_spin_unlock(&s->mutex);
+    pa_session_emit(s, PAIRADMIN_EVENT_ERROR, message);
+}
+
+static int pa_session_open(PairAdminSession *s)
+{
+    PaSessionTarget target;
+    void *parent;
+
+    pa_spin_lock(&pa_sessions_mutex);
+    s->backend = pa_session_backend;
+    pa_spin_unlock(&pa_sessions_mutex);
+
+    pa_spin_lock(&s->mutex);
+    target = s->target;
+    parent = s->parent;
+    pa_spin_unlock(&s->mutex);
+
+    pa_session_log(s, "connecting to %s:%d", target.host, target.port);
+    if (s->backend.open(s->backend.ctx, parent, target.host, target.port,
+                        target.user[0] ? target.user : NULL) != 0) {
+        pa_session_fail(s, pa_session_backend_error(s, "Connection failed"));
+        return 0;
+    }
+
+    snprintf(s->label, sizeof(s->label), "%s:%d", target.host, target.port);
+    return 1;
+}
+
+// The backend reported CONNECTED or CLOSED. A disconnect the caller
+// already asked for takes precedence over either.
+static void pa_session_progress(PairAdminSession *s, int result, int *active)
+{
+    PairAdminState state;
+    const char *message;
+
+    pa_spin_lock(&s->mutex);
+    state = pa_session_get(s);
+    if (result == PAIRADMIN_BACKEND_CONNECTED) {
+        if (state == PAIRADMIN_STATE_CONNECTING) {
+            pa_session_set(s, PAIRADMIN_STATE_CONNECTED);
+            pa_spin_unlock(&s->mutex);
+            pa_session_emit(s, PAIRADMIN_EVENT_CONNECTED, s->label);
+            return;
+        }
+        pa_spin_unlock(&s->mutex);
+        return;
+    }
+    pa_spin_unlock(&s->mutex);
+
+    s->backend.close(s->backend.ctx);
+    *active = 0;
+
+    if (state == PAIRADMIN_STATE_CONNECTED) {
+        message = pa_session_backend_error(s, "Connection closed");
+        pa_spin_lock(&s->mutex);
+        pa_session_set(s, PAIRADMIN_STATE_READY);
+        pa_spin_unlock(&s->mutex);
+        pa_session_emit(s, PAIRADMIN_EVENT_DISCONNECTED, message);
+    } else if (state == PAIRADMIN_STATE_CONNECTING) {
+        pa_session_fail(s, pa_session_backend_error(s, "Connection failed"));
+    }
+}
+
+static void pa_session_close(PairAdminSession *s, int *active, const char *reason)
+{
+    if (*active) {
+        s->backend.close(s->backend.ctx);
+        *active = 0;
+    }
+    pa_spin_lock(&s->mutex);
+    pa_session_set(s, PAIRADMIN_STATE_READY);
+    pa_spin_unlock(&s->mutex);
+    pa_session_emit(s, PAIRADMIN_EVENT_DISCONNECTED, reason);
+}
+
+// Apply embedding requests to the terminal window, and announce a new
+// window once it has them. Returns how long deferred bounds must still
+// wait, in microseconds, or 0 if nothing is deferred.
+static uint64_t pa_session_window(PairAdminSession *s)
+{
+    void *hwnd = pa_load_acquire_ptr((void *const volatile *)&s->hwnd);
+    int changed = hwnd != s->window;
+    uint64_t now = pa_now_us();
+    uint64_t wait = 0;
+    uint32_t pending;
+    void *parent;
+    int32_t bounds[4];
+    int has_bounds;
+
+    pa_spin_lock(&s->mutex);
+    pending = hwnd ? s->embed_pending : 0;
+    if (changed) {
+        // A new window takes everything at once
+        pending = PA_EMBED_PARENT | PA_EMBED_BOUNDS;
+    } else if ((pending & PA_EMBED_BOUNDS) && now - s->window_moved_us < PAIRADMIN_EMBED_FRAME_US) {
+        // Moved within this frame already: later requests replace this one
+        wait = PAIRADMIN_EMBED_FRAME_US - (now - s->window_moved_us);
+        pending &= ~(uint32_t)PA_EMBED_BOUNDS;
+    }
+    if (hwnd) {
+        s->embed_pending &= ~pending;
+    }
+    parent = s->embed_parent;
+    memcpy(bounds, s->bounds, sizeof(bounds));
+    has_bounds = s->has_bounds;
+    pa_spin_unlock(&s->mutex);
+
+    if (!hwnd) {
+        s->window_parent = NULL;
+        memset(s->window_bounds, 0, sizeof(s->window_bounds));
+    } else {
+        if (changed) {
+            s->window_parent = NULL;
+            memset(s->window_bounds, 0, sizeof(s->window_bounds));
+        }
+        if ((pending & PA_EMBED_PARENT) && parent && parent != s->window_parent &&
+            pa_window_embed(hwnd, parent) == 0) {
+            s->window_parent = parent;
+        }
+        if ((pending & PA_EMBED_BOUNDS) && has_bounds &&
+            memcmp(bounds, s->window_bounds, sizeof(bounds)) != 0 &&
+            pa_window_move(hwnd, bounds[0], bounds[1], bounds[2], bounds[3]) == 0) {
+            memcpy(s->window_bounds, bounds, sizeof(bounds));
+            s->window_moved_us = now;
+        }
+    }
+
+    if (changed) {
+        PairAdminWindowInfo info;
+
+        s->window = hwnd;
+        info.hwnd = (uint64_t)(uintptr_t)hwnd;
+        info.parent = (uint64_t)(uintptr_t)s->window_parent;
+        info.x = s->window_bounds[0];
+        info.y = s->window_bounds[1];
+        info.width = s->window_bounds[2];
+        info.height = s->window_bounds[3];
+        pa_session_log(s, "window %p in %p", hwnd, s->window_parent);
+        pa_session_route(PAIRADMIN_EVENT_WINDOW, &info, sizeof(info));
+    }
+    return wait;
+}
+
+static void pa_session_thread(void *arg)
+{
+    PairAdminSession *s = (PairAdminSession *)arg;
+    uint64_t wait = 0;
+    int active = 0;
+
+    pa_session_self = s;
+
+    for (;;) {
+        PaSessionCommand command;
+
+        pa_spin_lock(&s->mutex);
+        command = s->command;
+        s->command = PA_SESSION_NONE;
+        pa_spin_unlock(&s->mutex);
+
+        switch (command) {
+        case PA_SESSION_CONNECT:
+            active = pa_session_open(s);
+            break;
+        case PA_SESSION_DISCONNECT:
+            pa_session_close(s, &active, "Disconnected");
+            break;
+        case PA_SESSION_SHUTDOWN:
+            if (active) {
+                pa_session_close(s, &active, "Session shut down");
+            }
+            pa_session_window(s);
+            pa_session_self = NULL;
+            return;
+        default:
+            break;
+        }
+        wait = pa_session_window(s);
+
+        if (active) {
+            // Come back in time for deferred bounds
+            uint32_t run_ms = wait && wait < PA_SESSION_RUN_MS * 1000u ?
+                (uint32_t)((wait + 999) / 1000) : PA_SESSION_RUN_MS;
+            int result = s->backend.run(s->backend.ctx, run_ms);
+
+            if (result != PAIRADMIN_BACKEND_PENDING) {
+                pa_session_progress(s, result, &active);
+            }
+        } else {
+            pa_waker_wait(&s->wake, wait ? wait : PA_WAIT_FOREVER);
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// Delivery thread (sessions with their own ring)
+// ------------------------------------------------------------
+
+// Values of current_state while the callback runs
+#define PA_SESSION_HELD_SPARE 0     // In s->buffer, can't be retained
+#define PA_SESSION_HELD_BLOCK 1     // In an arena block
+#define PA_SESSION_HELD_RETAINED 2  // Retained by the callback
+
+// Hand the pending record, committed by now, to the callback
+static void pa_session_hand_over(PairAdminSession *s)
+{
+    PairAdminEventHeader *record = s->pending;
+    uint32_t length;
+    uint64_t start;
+
+    if (!record) {
+        return;
+    }
+    length = record->length;
+    s->pending = NULL;
+    s->current = record;
+    s->current_state = s->pending_owned ? PA_SESSION_HELD_BLOCK : PA_SESSION_HELD_SPARE;
+
+    start = pa_span_begin(PA_STATS_CALLBACK, length);
+    s->callback(s->id, (PairAdminEventType)record->type, record + 1, length, s->user);
+    pa_span_end(PA_STATS_CALLBACK, length, start);
+
+    if (s->current_state == PA_SESSION_HELD_BLOCK) {
+        pa_arena_recycle(&s->arena, record);
+    }
+    s->current = NULL;
+    pa_store_release_u64(&s->events, s->events + 1);
+    pa_store_release_u64(&s->bytes, s->bytes + length);
+}
+
+// Copy a record out of the ring. It is only delivered once the ring has
+// released it, at the next record or the end of the pass.
+static void pa_session_take(const PairAdminEventHeader *hdr, const void *payload, void *ctx)
+{
+    PairAdminSession *s = (PairAdminSession *)ctx;
+    PairAdminEventHeader *record;
+
+    pa_session_hand_over(s);
+    if (hdr->length > PAIRADMIN_MAX_PAYLOAD) {
+        // Torn by a concurrent reclaim; the commit fails
+        return;
+    }
+
+    record = (PairAdminEventHeader *)pa_arena_alloc(&s->arena, sizeof(*hdr) + hdr->length);
+    s->pending_owned = record != NULL;
+    if (!record) {
+        record = (PairAdminEventHeader *)s->buffer;
+    }
+    memcpy(record, hdr, sizeof(*hdr));
+    memcpy(record + 1, payload, hdr->length);
+    s->pending = record;
+}
+
+static void pa_session_untake(void *ctx)
+{
+    PairAdminSession *s = (PairAdminSession *)ctx;
+
+    if (s->pending && s->pending_owned) {
+        pa_arena_recycle(&s->arena, s->pending);
+    }
+    s->pending = NULL;
+}
+
+static size_t pa_session_deliver(PairAdminSession *s)
+{
+    size_t handled = pa_ring_drain(s->ring, pa_session_take, pa_session_untake, s,
+                                   PA_SESSION_DRAIN_RECORDS);
+
+    pa_session_hand_over(s);
+    return handled;
+}
+
+static void pa_session_delivery_thread(void *arg)
+{
+    PairAdminSession *s = (PairAdminSession *)arg;
+
+    while (!pa_load_acquire_u32(&s->stop)) {
+        if (pa_session_deliver(s) == 0) {
+            pa_ring_await(s->ring, PA_WAIT_FOREVER);
+        }
+    }
+
+    // The session thread has exited: whatever is left is final
+    while (pa_session_deliver(s) > 0) {
+    }
+}
+
+// ------------------------------------------------------------
+// Start and stop
+// ------------------------------------------------------------
+
+static int pa_session_start(PairAdminSession *s, void *parent_hwnd)
+{
+    pa_trace_register();
+    pa_spin_lock(&s->mutex);
+    if (s->running) {
+        pa_spin_unlock(&s->mutex);
+        return 0;
+    }
+    s->running = 1;
+    s->parent = parent_hwnd;
+    s->error[0] = '\0';
+    pa_session_set(s, PAIRADMIN_STATE_INITIALIZING);
+    pa_spin_unlock(&s->mutex);
+
+    // Nothing is written, so the log file is not created, until there
+    // is something to say
+    pa_session_log_acquire();
+
+    s->stop = 0;
+    if (pa_waker_create(&s->wake, NULL) != 0) {
+        goto fail;
+    }
+    if (s->ring && pa_thread_start(&s->delivery, pa_session_delivery_thread, s) != 0) {
+        goto fail_wake;
+    }
+    if (pa_thread_start(&s->worker, pa_session_thread, s) != 0) {
+        if (s->ring) {
+            pa_store_release_u32(&s->stop, 1);
+            pa_ring_wake(s->ring);
+            pa_thread_join(&s->delivery);
+        }
+        goto fail_wake;
+    }
+
+    pa_session_set(s, PAIRADMIN_STATE_READY);
+    return 0;
+
+fail_wake:
+    pa_waker_destroy(&s->wake);
+fail:
+    pa_session_log_release();
+    pa_spin_lock(&s->mutex);
+    pa_session_set_error(s, "Failed to start the session thread");
+    s->running = 0;
+    pa_session_set(s, PAIRADMIN_STATE_NOT_INITIALIZED);
+    pa_spin_unlock(&s->mutex);
+    return -1;
+}
+
+static void pa_session_stop(PairAdminSession *s)
+{
+    pa_spin_lock(&s->mutex);
+    if (!s->running || pa_session_get(s) == PAIRADMIN_STATE_INITIALIZING) {
+        pa_spin_unlock(&s->mutex);
+        return;
+    }
+    s->running = 0;
+    s->command = PA_SESSION_SHUTDOWN;
+    pa_waker_signal(&s->wake);
+    pa_spin_unlock(&s->mutex);
+
+    pa_thread_join(&s->worker);
+    if (s->ring) {
+        pa_store_release_u32(&s->stop, 1);
+        pa_ring_wake(s->ring);
+        pa_thread_join(&s->delivery);
+    }
+    if (pa_session_log_opened()) {
+        // Not worth creating the log for
+        pa_session_log(s, "shut down");
+    }
+    pa_session_log_release();
+
+    // Under the lock: whoever posts a command signals with it held
+    pa_spin_lock(&s->mutex);
+    s->command = PA_SESSION_NONE;
+    s->hwnd = NULL;
+    s->window = NULL;
+    s->window_parent = NULL;
+    memset(s->window_bounds, 0, sizeof(s->window_bounds));
+    pa_waker_destroy(&s->wake);
+    pa_session_set(s, PAIRADMIN_STATE_NOT_INITIALIZED);
+    pa_spin_unlock(&s->mutex);
+}
+
+static int pa_session_connect(PairAdminSession *s, const char *hostname, int port,
+                              const char *username)
+{
+    const char *error = NULL;
+    PairAdminState state;
+    int has_backend;
+
+    pa_spin_lock(&pa_sessions_mutex);
+    has_backend = pa_session_has_backend;
+    pa_spin_unlock(&pa_sessions_mutex);
+
+    pa_spin_lock(&s->mutex);
+    state = pa_session_get(s);
+    if (state != PAIRADMIN_STATE_READY && state != PAIRADMIN_STATE_ERROR) {
+        error = state == PAIRADMIN_STATE_NOT_INITIALIZED || state == PAIRADMIN_STATE_INITIALIZING ?
+            "Not initialized" : "A session is already active";
+    } else if (s->command != PA_SESSION_NONE) {
+        error = "A session is already active";
+    } else if (!has_backend) {
+        error = "No session backend registered";
+    } else if (!hostname || !*hostname || strlen(hostname) >= PA_SESSION_HOST_MAX) {
+        error = "Invalid host name";
+    } else if (port < 1 || port > 65535) {
+        error = "Invalid port";
+    } else if (username && strlen(username) >= PA_SESSION_USER_MAX) {
+        error = "Invalid user name";
+    }
+    if (error) {
+        pa_session_set_error(s, error);
+        pa_spin_unlock(&s->mutex);
+        return -1;
+    }
+
+    snprintf(s->target.host, sizeof(s->target.host), "%s", hostname);
+    snprintf(s->target.user, sizeof(s->target.user), "%s", username ? username : "");
+    s->target.port = port;
+    s->error[0] = '\0';
+    s->command = PA_SESSION_CONNECT;
+    pa_waker_signal(&s->wake);
+    pa_session_set(s, PAIRADMIN_STATE_CONNECTING);
+    pa_spin_unlock(&s->mutex);
+    return 0;
+}
+
+static void pa_session_disconnect(PairAdminSession *s)
+{
+    PairAdminState state;
+
+    pa_spin_lock(&s->mutex);
+    state = pa_session_get(s);
+    if (state == PAIRADMIN_STATE_CONNECTING || state == PAIRADMIN_STATE_CONNECTED) {
+        // Replaces a connect the session thread has not picked up yet
+        s->command = PA_SESSION_DISCONNECT;
+        pa_waker_signal(&s->wake);
+        pa_session_set(s, PAIRADMIN_STATE_DISCONNECTING);
+    }
+    pa_spin_unlock(&s->mutex);
+}
+
+// Record a request and let the session thread know if it is idle; it
+// is not waiting on the waker while connected, and picks requests up
+// after the current pass of the event loop
+static void pa_session_request(PairAdminSession *s, uint32_t pending)
+{
+    PairAdminState state = pa_session_get(s);
+
+    s->embed_pending |= pending;
+    if (state != PAIRADMIN_STATE_NOT_INITIALIZED && state != PAIRADMIN_STATE_INITIALIZING) {
+        pa_waker_signal(&s->wake);
+    }
+}
+
+static int pa_session_embed(PairAdminSession *s, void *parent)
+{
+    pa_spin_lock(&s->mutex);
+    // The next connection's window is created there to begin with
+    s->parent = parent;
+    s->embed_parent = parent;
+    pa_session_request(s, PA_EMBED_PARENT);
+    pa_spin_unlock(&s->mutex);
+    return 0;
+}
+
+static int pa_session_set_bounds(PairAdminSession *s, int32_t x, int32_t y,
+                                 int32_t width, int32_t height)
+{
+    if (width < 0 || height < 0) {
+        return -1;
+    }
+
+    pa_spin_lock(&s->mutex);
+    s->bounds[0] = x;
+    s->bounds[1] = y;
+    s->bounds[2] = width;
+    s->bounds[3] = height;
+    s->has_bounds = 1;
+    pa_session_request(s, PA_EMBED_BOUNDS);
+    pa_spin_unlock(&s->mutex);
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Process-wide session
+// ------------------------------------------------------------
+
+int pairadmin_set_session_backend(const PairAdminSessionBackend *backend)
+{
+    if (backend && (!backend->open || !backend->run || !backend->close)) {
+        return -1;
+    }
+
+    pa_spin_lock(&pa_sessions_mutex);
+    if (backend) {
+        pa_session_backend = *backend;
+    }
+    pa_session_has_backend = backend != NULL;
+    pa_spin_unlock(&pa_sessions_mutex);
+    return 0;
+}
+
+int pairadmin_init(void *parent_hwnd)
+{
+    return pa_session_start(&pa_default_session, parent_hwnd);
+}
+
+int pairadmin_connect(const char *hostname, int port, const char *username)
+{
+    return pa_session_connect(&pa_default_session, hostname, port, username);
+}
+
+void pairadmin_disconnect(void)
+{
+    pa_session_disconnect(&pa_default_session);
+}
+
+int pairadmin_is_connected(void)
+{
+    return pa_session_get(&pa_default_session) == PAIRADMIN_STATE_CONNECTED;
+}
+
+PairAdminState pairadmin_get_state(void)
+{
+    return pa_session_get(&pa_default_session);
+}
+
+const char *pairadmin_get_error(void)
+{
+    return pa_default_session.error;
+}
+
+int pairadmin_shutdown(void)
+{
+    pa_session_stop(&pa_default_session);
+    return 0;
+}
+
+const char *pairadmin_get_log_path(void)
+{
+    return pa_session_log_path;
+}
+
+int pairadmin_get_capabilities(PairAdminCapabilities *caps)
+{
+    uint32_t epoch;
+    PaCapture *capture;
+
+    if (!caps) {
+        return -1;
+    }
+    memset(caps, 0, sizeof(*caps));
+    caps->api_version = PAIRADMIN_API_VERSION;
+#ifdef _WIN32
+    caps->features = PAIRADMIN_FEATURE_EMBED | PAIRADMIN_FEATURE_TRACE;
+#endif
+    caps->cpu = pa_cpu_features();
+    caps->max_sessions = PAIRADMIN_MAX_SESSIONS;
+    caps->max_subscribers = PAIRADMIN_MAX_SUBSCRIBERS;
+    caps->ring_default_size = PAIRADMIN_RING_DEFAULT_SIZE;
+
+    pa_spin_lock(&pa_sessions_mutex);
+    if (pa_session_has_backend) {
+        caps->features |= PAIRADMIN_FEATURE_BACKEND;
+    }
+    if (pa_session_log_file) {
+        caps->loaded |= PAIRADMIN_LOADED_LOG;
+    }
+    pa_spin_unlock(&pa_sessions_mutex);
+
+    if (pa_session_get(&pa_default_session) != PAIRADMIN_STATE_NOT_INITIALIZED) {
+        caps->loaded |= PAIRADMIN_LOADED_SESSION;
+    }
+    if (pa_current_ring()) {
+        caps->loaded |= PAIRADMIN_LOADED_RING;
+    }
+    if (pa_redact_built()) {
+        caps->loaded |= PAIRADMIN_LOADED_REDACTION;
+    }
+
+    // The store may be closing; the epoch keeps it alive while we look
+    epoch = pa_epoch_enter();
+    capture = (PaCapture *)pa_load_acquire_ptr((void *const volatile *)&pa_default_session.capture);
+    if (capture) {
+        caps->loaded |= PAIRADMIN_LOADED_CAPTURE;
+        if (pa_capture_mapped(capture)) {
+            caps->loaded |= PAIRADMIN_LOADED_SEGMENTS;
+        }
+    }
+    pa_epoch_exit(epoch);
+    return 0;
+}
+
+int pairadmin_embed(void *parent)
+{
+    return pa_session_embed(&pa_default_session, parent);
+}
+
+int pairadmin_set_bounds(int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    return pa_session_set_bounds(&pa_default_session, x, y, width, height);
+}
+
+void *pairadmin_get_terminal_hwnd(void)
+{
+    return pairadmin_session_get_hwnd(&pa_default_session);
+}
+
+// ------------------------------------------------------------
+// Per-session handles
+// ------------------------------------------------------------
+
+PairAdminSession *pairadmin_session_create(PairAdminSessionCallback callback, void *user,
+                                           void *parent_hwnd, size_t ring_capacity)
+{
+    PairAdminSession *s;
+
+    if (!callback) {
+        return NULL;
+    }
+
+    pa_spin_lock(&pa_sessions_mutex);
+    if (pa_session_count == PAIRADMIN_MAX_SESSIONS) {
+        pa_spin_unlock(&pa_sessions_mutex);
+        return NULL;
+    }
+    pa_session_count++;
+    pa_spin_unlock(&pa_sessions_mutex);
+
+    s = (PairAdminSession *)calloc(1, sizeof(PairAdminSession));
+    if (!s) {
+        goto fail;
+    }
+    s->callback = callback;
+    s->user = user;
+    s->buffer = (unsigned char *)malloc(PA_SESSION_BUFFER);
+    s->ring = pa_ring_create_owned(ring_capacity ? ring_capacity : PAIRADMIN_RING_DEFAULT_SIZE);
+    if (!s->buffer || !s->ring || pa_arena_init(&s->arena, s->ring->capacity) != 0) {
+        goto fail;
+    }
+
+    pa_spin_lock(&pa_sessions_mutex);
+    s->id = ++pa_session_ids;
+    pa_spin_unlock(&pa_sessions_mutex);
+
+    if (pa_session_start(s, parent_hwnd) != 0) {
+        goto fail;
+    }
+    return s;
+
+fail:
+    if (s) {
+        pa_arena_destroy(&s->arena);
+        pa_ring_destroy(s->ring);
+        free(s->buffer);
+        free(s);
+    }
+    pa_spin_lock(&pa_sessions_mutex);
+    pa_session_count--;
+    pa_spin_unlock(&pa_sessions_mutex);
+    return NULL;
+}
+
+void pairadmin_session_destroy(PairAdminSession *session)
+{
+    if (!session) {
+        return;
+    }
+    pa_session_stop(session);
+    pairadmin_capture_close(session);
+    pairadmin_screen_close(session);
+    pairadmin_digest_close(session);
+
+    pa_arena_destroy(&session->arena);
+    pa_ring_destroy(session->ring);
+    free(session->buffer);
+    free(session);
+
+    pa_spin_lock(&pa_sessions_mutex);
+    pa_session_count--;
+    pa_spin_unlock(&pa_sessions_mutex);
+}
+
+const PairAdminEventHeader *pairadmin_session_retain(PairAdminSession *session)
+{
+    if (!session || !session->current || session->current_state == PA_SESSION_HELD_SPARE) {
+        return NULL;
+    }
+    session->current_state = PA_SESSION_HELD_RETAINED;
+    return session->current;
+}
+
+void pairadmin_session_release(PairAdminSession *session, const PairAdminEventHeader *record)
+{
+    if (session && record) {
+        pa_arena_free(&session->arena, (void *)record);
+    }
+}
+
+uint32_t pairadmin_session_get_id(const PairAdminSession *session)
+{
+    return session ? session->id : 0;
+}
+
+int pairadmin_session_connect(PairAdminSession *session, const char *hostname,
+                              int port, const char *username)
+{
+    return session ? pa_session_connect(session, hostname, port, username) : -1;
+}
+
+void pairadmin_session_disconnect(PairAdminSession *session)
+{
+    if (session) {
+        pa_session_disconnect(session);
+    }
+}
+
+PairAdminState pairadmin_session_get_state(PairAdminSession *session)
+{
+    return session ? pa_session_get(session) : PAIRADMIN_STATE_NOT_INITIALIZED;
+}
+
+const char *pairadmin_session_get_error(PairAdminSession *session)
+{
+    return session ? session->error : "";
+}
+
+void pairadmin_session_get_stats(PairAdminSession *session, PairAdminSessionStats *stats)
+{
+    if (!stats) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    if (!session || !session->ring) {
+        return;
+    }
+    stats->events = pa_load_acquire_u64(&session->events);
+    stats->bytes = pa_load_acquire_u64(&session->bytes);
+    stats->dropped_events = session->ring->dropped_records;
+    stats->dropped_bytes = session->ring->dropped_bytes;
+}
+
+void pairadmin_session_set_hwnd(PairAdminSession *session, void *hwnd)
+{
+    if (session) {
+        pa_store_release_ptr((void *volatile *)&session->hwnd, hwnd);
+    }
+}
+
+void *pairadmin_session_get_hwnd(PairAdminSession *session)
+{
+    return session ? pa_load_acquire_ptr((void *const volatile *)&session->hwnd) : NULL;
+}
+
+int pairadmin_session_embed(PairAdminSession *session, void *parent)
+{
+    return session ? pa_session_embed(session, parent) : -1;
+}
+
+int pairadmin_session_set_bounds(PairAdminSession *session, int32_t x, int32_t y,
+                                 int32_t width, int32_t height)
+{
+    return session ? pa_session_set_bounds(session, x, y, width, height) : -1;
+}
+
+PairAdminSession *pairadmin_session_current(void)
+{
+    return pa_session_self;
+}
@@ -0,0 +1,239 @@
+// Hot-path statistics for PairAdmin
+//
+// Every thread that runs a hook or a callback gets a cache-line aligned
+// slot of its own on first use and updates it with plain stores, so the
+// counters cost PuTTY's thread two clock reads and a few adds per call
+// and never bounce a line between cores. pairadmin_get_stats() sums the
+// slots. A thread's slot goes back to the table when it exits, its
+// counts folded into a retired total, so thread churn does not use the
+// table up. Threads beyond the table while it is full share its last
+// slot, which is then updated with interlocked operations instead.
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+// Session, delivery, subscriber and batch threads plus PuTTY's own
+#define PA_STATS_SLOTS 128
+
+typedef struct PaHookCounters {
+    volatile uint64_t calls;
+    volatile uint64_t bytes;
+    volatile uint64_t total_ns;
+    volatile uint64_t max_ns;
+    volatile uint64_t histogram[PAIRADMIN_STATS_BUCKETS];
+} PaHookCounters;
+
+typedef struct PaStatsSlot {
+    PA_ALIGN(PA_CACHE_LINE) PaHookCounters kinds[PA_STATS_KINDS];
+    volatile uint64_t ring_high_water;
+    struct PaStatsSlot *next_free;      // Under pa_stats_lock
+} PaStatsSlot;
+
+static PaStatsSlot pa_stats_slots[PA_STATS_SLOTS];
+static volatile uint32_t pa_stats_threads = 0;
+
+// Slots handed out so far, the shared one aside; those given back wait
+// on the free list
+static volatile uint32_t pa_stats_claimed = 0;
+static PaStatsSlot *pa_stats_free = NULL;
+static volatile uint32_t pa_stats_lock = 0;
+
+// What threads that have exited counted; interlocked, like the shared slot
+static PaStatsSlot pa_stats_retired;
+
+static PA_THREAD_LOCAL PaStatsSlot *pa_stats_mine = NULL;
+
+#define PA_STATS_SHARED (&pa_stats_slots[PA_STATS_SLOTS - 1])
+
+static void pa_stats_lock_acquire(void)
+{
+    while (!pa_atomic_cas_u32(&pa_stats_lock, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_stats_lock_release(void)
+{
+    pa_store_release_u32(&pa_stats_lock, 0);
+}
+
+static void pa_stats_add(volatile uint64_t *p, uint64_t v)
+{
+    uint64_t old;
+
+    do {
+        old = *p;
+    } while (!pa_atomic_cas_u64(p, old, old + v));
+}
+
+static void pa_stats_max(volatile uint64_t *p, uint64_t v)
+{
+    uint64_t old;
+
+    do {
+        old = *p;
+    } while (v > old && !pa_atomic_cas_u64(p, old, v));
+}
+
+// Runs as the owning thread exits: move its counts to the retired total
+// (a snapshot taken meanwhile may miss them for a moment) and give the
+// slot back
+static void pa_stats_release(void *arg)
+{
+    PaStatsSlot *slot = (PaStatsSlot *)arg;
+    uint32_t kind;
+    uint32_t k;
+
+    for (kind = 0; kind < PA_STATS_KINDS; kind++) {
+        PaHookCounters *c = &slot->kinds[kind];
+        PaHookCounters *r = &pa_stats_retired.kinds[kind];
+        uint64_t v;
+
+        v = c->calls, c->calls = 0, pa_stats_add(&r->calls, v);
+        v = c->bytes, c->bytes = 0, pa_stats_add(&r->bytes, v);
+        v = c->total_ns, c->total_ns = 0, pa_stats_add(&r->total_ns, v);
+        v = c->max_ns, c->max_ns = 0, pa_stats_max(&r->max_ns, v);
+        for (k = 0; k < PAIRADMIN_STATS_BUCKETS; k++) {
+            v = c->histogram[k], c->histogram[k] = 0, pa_stats_add(&r->histogram[k], v);
+        }
+    }
+    pa_stats_max(&pa_stats_retired.ring_high_water, slot->ring_high_water);
+    slot->ring_high_water = 0;
+
+    pa_stats_lock_acquire();
+    slot->next_free = pa_stats_free;
+    pa_stats_free = slot;
+    pa_stats_lock_release();
+    pa_stats_mine = NULL;
+}
+
+static PaStatsSlot *pa_stats_slot(void)
+{
+    PaStatsSlot *slot = pa_stats_mine;
+
+    if (!slot) {
+        uint32_t claimed;
+
+        pa_stats_lock_acquire();
+        slot = pa_stats_free;
+        claimed = pa_stats_claimed;
+        if (slot) {
+            pa_stats_free = slot->next_free;
+        } else if (claimed < PA_STATS_SLOTS - 1) {
+            slot = &pa_stats_slots[claimed];
+            pa_store_release_u32(&pa_stats_claimed, claimed + 1);
+        } else {
+            slot = PA_STATS_SHARED;
+        }
+        pa_stats_lock_release();
+
+        // Without an exit hook the slot simply stays taken
+        if (slot != PA_STATS_SHARED) {
+            pa_thread_on_exit(pa_stats_release, slot);
+        }
+        pa_atomic_inc_u32(&pa_stats_threads);
+        pa_stats_mine = slot;
+    }
+    return slot;
+}
+
+static uint32_t pa_stats_bucket(uint64_t ns)
+{
+    uint64_t v = ns >> 7;
+
+    if (v == 0) {
+        return 0;
+    }
+    if (v >> 32) {
+        return PAIRADMIN_STATS_BUCKETS - 1;
+    }
+    v = pa_highest_bit32((uint32_t)v);
+    return v < PAIRADMIN_STATS_BUCKETS ? (uint32_t)v : PAIRADMIN_STATS_BUCKETS - 1;
+}
+
+void pa_stats_record(PaStatsKind kind, size_t bytes, uint64_t ticks)
+{
+    PaStatsSlot *slot = pa_stats_slot();
+    PaHookCounters *c = &slot->kinds[kind];
+    uint64_t ns = pa_ticks_ns(ticks);
+
+    if (slot == PA_STATS_SHARED) {
+        pa_stats_add(&c->calls, 1);
+        pa_stats_add(&c->bytes, bytes);
+        pa_stats_add(&c->total_ns, ns);
+        pa_stats_add(&c->histogram[pa_stats_bucket(ns)], 1);
+        pa_stats_max(&c->max_ns, ns);
+        return;
+    }
+
+    c->calls++;
+    c->bytes += bytes;
+    c->total_ns += ns;
+    c->histogram[pa_stats_bucket(ns)]++;
+    if (ns > c->max_ns) {
+        c->max_ns = ns;
+    }
+}
+
+void pa_stats_ring_fill(uint64_t bytes)
+{
+    PaStatsSlot *slot = pa_stats_slot();
+
+    if (slot == PA_STATS_SHARED) {
+        pa_stats_max(&slot->ring_high_water, bytes);
+    } else if (bytes > slot->ring_high_water) {
+        slot->ring_high_water = bytes;
+    }
+}
+
+static void pa_stats_sum(PairAdminHookStats *out, const PaHookCounters *c)
+{
+    uint64_t max = c->max_ns;
+    uint32_t k;
+
+    out->calls += c->calls;
+    out->bytes += c->bytes;
+    out->total_ns += c->total_ns;
+    if (max > out->max_ns) {
+        out->max_ns = max;
+    }
+    for (k = 0; k < PAIRADMIN_STATS_BUCKETS; k++) {
+        out->histogram[k] += c->histogram[k];
+    }
+}
+
+static void pa_stats_sum_slot(PairAdminStats *stats, const PaStatsSlot *slot)
+{
+    uint64_t fill = slot->ring_high_water;
+
+    pa_stats_sum(&stats->output, &slot->kinds[PA_STATS_OUTPUT]);
+    pa_stats_sum(&stats->input, &slot->kinds[PA_STATS_INPUT]);
+    pa_stats_sum(&stats->callback, &slot->kinds[PA_STATS_CALLBACK]);
+    if (fill > stats->ring_high_water) {
+        stats->ring_high_water = fill;
+    }
+}
+
+void pairadmin_get_stats(PairAdminStats *stats)
+{
+    uint32_t claimed;
+    uint32_t i;
+
+    if (!stats) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    // Slots are handed out in order; free ones are all zero
+    claimed = pa_load_acquire_u32(&pa_stats_claimed);
+    for (i = 0; i < claimed; i++) {
+        pa_stats_sum_slot(stats, &pa_stats_slots[i]);
+    }
+    pa_stats_sum_slot(stats, PA_STATS_SHARED);
+    pa_stats_sum_slot(stats, &pa_stats_retired);
+    stats->threads = pa_load_acquire_u32(&pa_stats_threads);
+    stats->batch_mode = pa_batch_mode();
+    stats->batch_switches = pa_batch_switches();
+}
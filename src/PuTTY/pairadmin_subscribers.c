@@ -0,0 +1,270 @@
+// Multi-subscriber fan-out for PairAdmin
+//
+// Audit logging, context capture and validation each want the event
+// stream, at very different speeds. Every subscriber gets its own cursor
+// into the event ring and its own delivery thread, so a slow one only
+// loses its own backlog: it never holds back the producer, the primary
+// consumer or the other subscribers.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+// Poll interval while there is nothing new for a subscriber
+#define PA_SUBSCRIBER_IDLE_US 1000
+
+// Records copied out of the ring per pass
+#define PA_SUBSCRIBER_BUFFER (4 * PAIRADMIN_READ_BUFFER_MIN)
+
+typedef struct PaSubscriber {
+    PairAdminSubscriberCallback callback;
+    void *user;
+    uint32_t mask;
+    PaThread thread;
+    volatile uint32_t stop;
+
+    // Delivery thread only
+    uint64_t ring_id;
+    uint64_t cursor;
+    unsigned char *buffer;
+
+    // Written by the delivery thread, read by pairadmin_get_subscriber_dropped()
+    volatile uint64_t dropped_bytes;
+} PaSubscriber;
+
+static PaSubscriber *pa_subscribers[PAIRADMIN_MAX_SUBSCRIBERS];
+static size_t pa_subscriber_count = 0;
+
+// Set while the ring in use was opened by the registry
+static int pa_subscribers_own_ring = 0;
+
+// Readers other than subscribers keeping that ring open (the exporter)
+static size_t pa_subscriber_holds = 0;
+
+// Serialises add/remove; taken before pairadmin_control, never inside
+// it, and never held while waiting for a delivery thread
+static volatile uint32_t pa_subscribers_lock = 0;
+
+static void pa_registry_lock(void)
+{
+    while (!pa_atomic_cas_u32(&pa_subscribers_lock, 0, 1)) {
+        pa_thread_yield();
+    }
+}
+
+static void pa_registry_unlock(void)
+{
+    pa_store_release_u32(&pa_subscribers_lock, 0);
+}
+
+// Start from the current head of a ring the subscriber has not seen yet
+static void pa_subscriber_bind(PaSubscriber *s, PaRing *ring)
+{
+    s->ring_id = ring->id;
+    s->cursor = pa_load_acquire_u64(&ring->ctl->head);
+}
+
+static void pa_subscriber_deliver(PaSubscriber *s, size_t length)
+{
+    const unsigned char *p = s->buffer;
+    const unsigned char *end = p + length;
+
+    while (p < end) {
+        const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)p;
+        uint64_t start = pa_span_begin(PA_STATS_CALLBACK, hdr->length);
+
+        s->callback((PairAdminEventType)hdr->type, hdr + 1, hdr->length, s->user);
+        pa_span_end(PA_STATS_CALLBACK, hdr->length, start);
+        p += PAIRADMIN_RECORD_SIZE(hdr->length);
+    }
+}
+
+static void pa_subscriber_thread(void *arg)
+{
+    PaSubscriber *s = (PaSubscriber *)arg;
+
+    while (!pa_load_acquire_u32(&s->stop)) {
+        size_t length = 0;
+        uint64_t lost = 0;
+        PaRing *ring;
+        uint32_t slot;
+
+        // The copy runs inside an epoch section so the ring cannot be
+        // closed under it; callbacks run outside, on the private copy
+        slot = pa_epoch_enter();
+        ring = pa_current_ring();
+        if (ring) {
+            if (ring->id != s->ring_id) {
+                pa_subscriber_bind(s, ring);
+            }
+            length = pa_ring_peek(ring, &s->cursor, s->mask,
+                                  s->buffer, PA_SUBSCRIBER_BUFFER, &lost);
+        }
+        pa_epoch_exit(slot);
+
+        if (lost) {
+            pa_store_release_u64(&s->dropped_bytes, s->dropped_bytes + lost);
+        }
+        if (length == 0) {
+            pa_sleep_us(PA_SUBSCRIBER_IDLE_US);
+            continue;
+        }
+        pa_subscriber_deliver(s, length);
+    }
+}
+
+static void pa_subscriber_free(PaSubscriber *s)
+{
+    free(s->buffer);
+    free(s);
+}
+
+// Caller holds the registry lock. Close the ring the registry opened
+// once nobody reads it, unless a primary consumer has taken it over.
+static void pa_subscribers_release_ring(void)
+{
+    PaRing *ring;
+
+    if (pa_subscriber_count == 0 && pa_subscriber_holds == 0 && pa_subscribers_own_ring) {
+        pa_subscribers_own_ring = 0;
+        ring = pa_current_ring();
+        if (ring && pa_load_acquire_u32(&ring->reclaim)) {
+            pairadmin_ring_close();
+        }
+    }
+}
+
+int pairadmin_add_subscriber(PairAdminSubscriberCallback callback, void *user, uint32_t event_mask)
+{
+    PaSubscriber *s;
+    PaRing *ring;
+    uint32_t epoch;
+    int opened;
+    int slot;
+
+    if (!callback || !event_mask) {
+        return -1;
+    }
+
+    pa_registry_lock();
+
+    for (slot = 0; slot < PAIRADMIN_MAX_SUBSCRIBERS && pa_subscribers[slot]; slot++) {
+    }
+    if (slot == PAIRADMIN_MAX_SUBSCRIBERS) {
+        pa_registry_unlock();
+        return -1;
+    }
+
+    s = (PaSubscriber *)calloc(1, sizeof(PaSubscriber));
+    if (!s || !(s->buffer = (unsigned char *)malloc(PA_SUBSCRIBER_BUFFER))) {
+        free(s);
+        pa_registry_unlock();
+        return -1;
+    }
+    s->callback = callback;
+    s->user = user;
+    s->mask = event_mask;
+
+    opened = pa_ring_open_reclaiming();
+    if (opened < 0) {
+        pa_subscriber_free(s);
+        pa_registry_unlock();
+        return -1;
+    }
+    if (opened) {
+        pa_subscribers_own_ring = 1;
+    }
+
+    // Bind now so every event after this call returns is delivered
+    epoch = pa_epoch_enter();
+    ring = pa_current_ring();
+    if (ring) {
+        pa_subscriber_bind(s, ring);
+    }
+    pa_epoch_exit(epoch);
+
+    if (pa_thread_start(&s->thread, pa_subscriber_thread, s) != 0) {
+        pa_subscriber_free(s);
+        pa_registry_unlock();
+        return -1;
+    }
+
+    pa_subscribers[slot] = s;
+    pa_subscriber_count++;
+    pa_registry_unlock();
+    return slot + 1;
+}
+
+void pairadmin_remove_subscriber(int id)
+{
+    PaSubscriber *s;
+
+    if (id < 1 || id > PAIRADMIN_MAX_SUBSCRIBERS) {
+        return;
+    }
+
+    pa_registry_lock();
+    s = pa_subscribers[id - 1];
+    if (!s) {
+        pa_registry_unlock();
+        return;
+    }
+    pa_subscribers[id - 1] = NULL;
+    pa_store_release_u32(&s->stop, 1);
+    pa_registry_unlock();
+
+    // Joined outside the lock: the callback may still be running and is
+    // free to call pairadmin_get_subscriber_dropped() meanwhile. The
+    // subscriber still counts until then, so the ring stays open for it.
+    pa_thread_join(&s->thread);
+    pa_subscriber_free(s);
+
+    pa_registry_lock();
+    pa_subscriber_count--;
+    pa_subscribers_release_ring();
+    pa_registry_unlock();
+}
+
+uint64_t pairadmin_get_subscriber_dropped(int id)
+{
+    uint64_t dropped = 0;
+    PaSubscriber *s;
+
+    if (id < 1 || id > PAIRADMIN_MAX_SUBSCRIBERS) {
+        return 0;
+    }
+
+    pa_registry_lock();
+    s = pa_subscribers[id - 1];
+    if (s) {
+        dropped = pa_load_acquire_u64(&s->dropped_bytes);
+    }
+    pa_registry_unlock();
+    return dropped;
+}
+
+int pa_subscribers_hold(void)
+{
+    int opened;
+
+    pa_registry_lock();
+    opened = pa_ring_open_reclaiming();
+    if (opened >= 0) {
+        if (opened) {
+            pa_subscribers_own_ring = 1;
+        }
+        pa_subscriber_holds++;
+    }
+    pa_registry_unlock();
+    return opened < 0 ? -1 : 0;
+}
+
+void pa_subscribers_unhold(void)
+{
+    pa_registry_lock();
+    pa_subscriber_holds--;
+    pa_subscribers_release_ring();
+    pa_registry_unlock();
+}
@@ -0,0 +1,172 @@
+// ETW TraceLogging provider for PairAdmin
+//
+// Timeline counterpart of pairadmin_get_stats(): hook and callback
+// enter/exit pairs, ring overflow, batch flushes and session state
+// changes, for correlating terminal stalls with the managed side in
+// WPA. The provider is registered as "PairAdmin-PuTTY"; its GUID is the
+// one EventSource-style tools derive from that name, so
+// `wpr`/`tracelog` can enable it as *PairAdmin-PuTTY.
+//
+// Nobody listening costs one load and branch per site: the enable
+// callback folds the aggregate level and keywords of all listeners into
+// pa_trace_keywords, which the inline checks in pairadmin_internal.h
+// test before calling in here. Off Windows everything is a no-op.
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#ifdef _WIN32
+
+#include <stdlib.h>
+#include <TraceLoggingProvider.h>
+#include <winmeta.h>
+
+// {7061ac67-d030-5591-377b-df20b76b7ea4}
+TRACELOGGING_DEFINE_PROVIDER(pa_trace_provider, "PairAdmin-PuTTY",
+    (0x7061ac67, 0xd030, 0x5591, 0x37, 0x7b, 0xdf, 0x20, 0xb7, 0x6b, 0x7e, 0xa4));
+
+volatile uint32_t pa_trace_keywords = 0;
+
+// 0 unregistered, 1 registering, 2 registered
+static volatile uint32_t pa_trace_state = 0;
+
+static const char *const pa_trace_kind_names[PA_STATS_KINDS] = {"Output", "Input", "Callback"};
+
+static uint32_t pa_trace_current_session(void)
+{
+    PairAdminSession *s = pairadmin_session_current();
+
+    return s ? pairadmin_session_get_id(s) : 0;
+}
+
+static void NTAPI pa_trace_enable(LPCGUID source, ULONG control, UCHAR level, ULONGLONG any,
+                                  ULONGLONG all, PEVENT_FILTER_DESCRIPTOR filter, PVOID context)
+{
+    uint32_t keywords = 0;
+
+    (void)source;
+    (void)control;
+    (void)level;
+    (void)any;
+    (void)all;
+    (void)filter;
+    (void)context;
+
+    // The provider already holds the aggregate of every listener here
+    if (TraceLoggingProviderEnabled(pa_trace_provider, WINEVENT_LEVEL_VERBOSE, PA_TRACE_HOOKS)) {
+        keywords |= PA_TRACE_HOOKS;
+    }
+    if (TraceLoggingProviderEnabled(pa_trace_provider, WINEVENT_LEVEL_VERBOSE, PA_TRACE_CALLBACKS)) {
+        keywords |= PA_TRACE_CALLBACKS;
+    }
+    if (TraceLoggingProviderEnabled(pa_trace_provider, WINEVENT_LEVEL_WARNING, PA_TRACE_RING)) {
+        keywords |= PA_TRACE_RING;
+    }
+    if (TraceLoggingProviderEnabled(pa_trace_provider, WINEVENT_LEVEL_VERBOSE, PA_TRACE_BATCH)) {
+        keywords |= PA_TRACE_BATCH;
+    }
+    if (TraceLoggingProviderEnabled(pa_trace_provider, WINEVENT_LEVEL_INFO, PA_TRACE_SESSION)) {
+        keywords |= PA_TRACE_SESSION;
+    }
+    pa_store_release_u32(&pa_trace_keywords, keywords);
+}
+
+static void pa_trace_unregister(void)
+{
+    pa_store_release_u32(&pa_trace_keywords, 0);
+    TraceLoggingUnregister(pa_trace_provider);
+}
+
+void pa_trace_register(void)
+{
+    if (pa_load_acquire_u32(&pa_trace_state) == 2 || !pa_atomic_cas_u32(&pa_trace_state, 0, 1)) {
+        return;
+    }
+    if (SUCCEEDED(TraceLoggingRegisterEx(pa_trace_provider, pa_trace_enable, NULL))) {
+        // Runs as the DLL unloads, before the callback's code goes away
+        atexit(pa_trace_unregister);
+    }
+    pa_store_release_u32(&pa_trace_state, 2);
+}
+
+void pa_trace_enter(PaStatsKind kind, size_t bytes)
+{
+    if (kind == PA_STATS_CALLBACK) {
+        TraceLoggingWrite(pa_trace_provider, "CallbackEnter",
+                          TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                          TraceLoggingKeyword(PA_TRACE_CALLBACKS),
+                          TraceLoggingOpcode(WINEVENT_OPCODE_START),
+                          TraceLoggingUInt64((uint64_t)bytes, "Bytes"));
+        return;
+    }
+    TraceLoggingWrite(pa_trace_provider, "HookEnter",
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingKeyword(PA_TRACE_HOOKS),
+                      TraceLoggingOpcode(WINEVENT_OPCODE_START),
+                      TraceLoggingString(pa_trace_kind_names[kind], "Hook"),
+                      TraceLoggingUInt32(pa_trace_current_session(), "Session"),
+                      TraceLoggingUInt64((uint64_t)bytes, "Bytes"));
+}
+
+void pa_trace_exit(PaStatsKind kind, size_t bytes, uint64_t ticks)
+{
+    uint64_t ns = pa_ticks_ns(ticks);
+
+    if (kind == PA_STATS_CALLBACK) {
+        TraceLoggingWrite(pa_trace_provider, "CallbackExit",
+                          TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                          TraceLoggingKeyword(PA_TRACE_CALLBACKS),
+                          TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+                          TraceLoggingUInt64((uint64_t)bytes, "Bytes"),
+                          TraceLoggingUInt64(ns, "DurationNs"));
+        return;
+    }
+    TraceLoggingWrite(pa_trace_provider, "HookExit",
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingKeyword(PA_TRACE_HOOKS),
+                      TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+                      TraceLoggingString(pa_trace_kind_names[kind], "Hook"),
+                      TraceLoggingUInt32(pa_trace_current_session(), "Session"),
+                      TraceLoggingUInt64((uint64_t)bytes, "Bytes"),
+                      TraceLoggingUInt64(ns, "DurationNs"));
+}
+
+void pa_trace_overflow(uint64_t ring_id, uint32_t policy, uint64_t records, uint64_t bytes)
+{
+    TraceLoggingWrite(pa_trace_provider, "RingOverflow",
+                      TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+                      TraceLoggingKeyword(PA_TRACE_RING),
+                      TraceLoggingUInt64(ring_id, "Ring"),
+                      TraceLoggingUInt32(policy, "Policy"),
+                      TraceLoggingUInt64(records, "Records"),
+                      TraceLoggingUInt64(bytes, "Bytes"));
+}
+
+void pa_trace_batch(uint32_t event, size_t bytes, size_t fragments, uint64_t age_us)
+{
+    TraceLoggingWrite(pa_trace_provider, "BatchFlush",
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingKeyword(PA_TRACE_BATCH),
+                      TraceLoggingUInt32(event, "Event"),
+                      TraceLoggingUInt64((uint64_t)bytes, "Bytes"),
+                      TraceLoggingUInt64((uint64_t)fragments, "Fragments"),
+                      TraceLoggingUInt64(age_us, "AgeUs"));
+}
+
+void pa_trace_session(uint32_t session, int32_t from, int32_t to)
+{
+    TraceLoggingWrite(pa_trace_provider, "SessionState",
+                      TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+                      TraceLoggingKeyword(PA_TRACE_SESSION),
+                      TraceLoggingUInt32(session, "Session"),
+                      TraceLoggingInt32(from, "From"),
+                      TraceLoggingInt32(to, "To"));
+}
+
+#else
+
+void pa_trace_register(void)
+{
+}
+
+#endif
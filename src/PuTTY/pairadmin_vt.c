@@ -0,0 +1,167 @@
+// Streaming ANSI/VT escape stripper for PairAdmin
+//
+// A cut-down DEC/ECMA-48 parser (after Paul Williams' state diagram)
+// that only needs to know where sequences end, not what they mean.
+// State is kept in PaVtParser between calls, so a sequence split
+// across term_data() fragments is still removed completely.
+//
+// Ground-state bytes are classified through a 256-entry table; runs of
+// plain text are copied with memcpy rather than byte by byte.
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+enum {
+    PA_VT_GROUND = 0,
+    PA_VT_ESCAPE,
+    PA_VT_ESCAPE_INTERMEDIATE,
+    PA_VT_CSI,
+    PA_VT_OSC,
+    PA_VT_STRING,      // DCS, SOS, PM, APC: skipped up to ST
+    PA_VT_STRING_ESC   // ESC seen inside OSC/STRING, ST if followed by '\'
+};
+
+// Ground-state byte classes
+enum {
+    PA_VT_TEXT = 0,    // copied to the output
+    PA_VT_DROP,        // C0 control or DEL, removed
+    PA_VT_ESC          // starts a sequence
+};
+
+static const unsigned char pa_vt_class[256] = {
+    // 0x00 - 0x1f: keep TAB and LF, drop the other C0 controls
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1,
+    // 0x20 - 0x7e printable, 0x7f DEL
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+    // 0x80 - 0xff: UTF-8 lead/continuation bytes pass through untouched
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+void pa_vt_reset(PaVtParser *vt)
+{
+    vt->state = PA_VT_GROUND;
+}
+
+// ESC <byte>: decide what kind of sequence this is
+static unsigned char pa_vt_after_escape(unsigned char c)
+{
+    switch (c) {
+    case '[':
+        return PA_VT_CSI;
+    case ']':
+        return PA_VT_OSC;
+    case 'P': case 'X': case '^': case '_':
+        return PA_VT_STRING;
+    case 0x1b:
+        return PA_VT_ESCAPE;
+    default:
+        if (c >= 0x20 && c <= 0x2f) {
+            return PA_VT_ESCAPE_INTERMEDIATE;
+        }
+        // Final byte, or a C0 control executed mid-sequence (ignored)
+        return c < 0x20 ? PA_VT_ESCAPE : PA_VT_GROUND;
+    }
+}
+
+size_t pa_vt_strip(PaVtParser *vt, const void *in, size_t len, void *out)
+{
+    const unsigned char *src = (const unsigned char *)in;
+    const unsigned char *end = src + len;
+    unsigned char *dst = (unsigned char *)out;
+    unsigned char state = vt->state;
+
+    while (src < end) {
+        unsigned char c;
+
+        if (state == PA_VT_GROUND) {
+            const unsigned char *run = src;
+
+            while (src < end && pa_vt_class[*src] == PA_VT_TEXT) {
+                src++;
+            }
+            if (src > run) {
+                memcpy(dst, run, (size_t)(src - run));
+                dst += src - run;
+            }
+            if (src == end) {
+                break;
+            }
+            if (pa_vt_class[*src++] == PA_VT_ESC) {
+                state = PA_VT_ESCAPE;
+            }
+            continue;
+        }
+
+        c = *src++;
+
+        // CAN and SUB abort any sequence
+        if (c == 0x18 || c == 0x1a) {
+            state = PA_VT_GROUND;
+            continue;
+        }
+
+        switch (state) {
+        case PA_VT_ESCAPE:
+            state = pa_vt_after_escape(c);
+            break;
+
+        case PA_VT_ESCAPE_INTERMEDIATE:
+            if (c == 0x1b) {
+                state = PA_VT_ESCAPE;
+            } else if (c >= 0x30 && c <= 0x7e) {
+                state = PA_VT_GROUND;
+            }
+            break;
+
+        case PA_VT_CSI:
+            // Parameters and intermediates are 0x20-0x3f, final is 0x40-0x7e
+            if (c == 0x1b) {
+                state = PA_VT_ESCAPE;
+            } else if (c >= 0x40 && c <= 0x7e) {
+                state = PA_VT_GROUND;
+            }
+            break;
+
+        case PA_VT_OSC:
+            if (c == 0x07) {
+                state = PA_VT_GROUND;
+            } else if (c == 0x1b) {
+                state = PA_VT_STRING_ESC;
+            }
+            break;
+
+        case PA_VT_STRING:
+            if (c == 0x1b) {
+                state = PA_VT_STRING_ESC;
+            }
+            break;
+
+        case PA_VT_STRING_ESC:
+            // ESC \ is ST; any other ESC sequence also ends the string
+            state = c == '\\' ? PA_VT_GROUND : pa_vt_after_escape(c);
+            break;
+
+        default:
+            state = PA_VT_GROUND;
+            break;
+        }
+    }
+
+    vt->state = state;
+    return (size_t)(dst - (unsigned char *)out);
+}
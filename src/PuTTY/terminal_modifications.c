@@ -23,9 +23,16 @@ void term_data(Terminal *term, const char *data, size_t len)
 // PairAdmin modification: Add terminal output hook
 // This callback notifies PairAdmin when terminal output is generated
 #ifdef PAIRADMIN_INTEGRATION
-    if (pairadmin_callback) {
-        pairadmin_callback(PAIRADMIN_EVENT_OUTPUT, data, len);
-    }
+    pairadmin_hook_output(data, len);
+#endif // PAIRADMIN_INTEGRATION
+
+/* END MODIFICATION */
+
+/* MODIFIED CODE - Add this at the end of term_size(), so the native
+   screen model (pairadmin_screen_open) keeps PuTTY's geometry:
+
+#ifdef PAIRADMIN_INTEGRATION
+    pairadmin_screen_resize(pairadmin_session_current(), newcols, newrows);
 #endif // PAIRADMIN_INTEGRATION
 
 /* END MODIFICATION */
@@ -45,8 +52,12 @@ void term_data(Terminal *term, const char *data, size_t len)
  * features like error detection, command suggestions, and audit logging.
  *
  * Performance Impact:
- * - Minimal overhead (single function call per terminal output)
- * - No buffering or data copying
+ * - Minimal overhead (single function call per terminal output); the
+ *   time actually spent is reported by pairadmin_get_stats()
+ * - With the event ring open (pairadmin_ring_open) the hook only copies
+ *   the bytes into a lock-free ring and returns; the consumer drains it
+ *   on its own thread via pairadmin_read_events()
+ * - Without the ring the callback runs synchronously on PuTTY's thread
  * - No modification to PuTTY's rendering logic
  *
  * Testing:
@@ -0,0 +1,123 @@
+// Batch delivery tests for PairAdmin
+//
+// Registers a batch callback and checks that fragments arrive coalesced
+// with their index, that stopping delivers what was queued, and that
+// stopping returns promptly while output keeps arriving faster than a
+// slow callback can take it.
+//
+//   pairadmin_batch_test
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+#include "pairadmin_test.h"
+
+#define TEST_WAIT_US 5000000
+
+static char test_data[256];
+static volatile uint32_t test_length = 0;
+static volatile uint32_t test_fragments = 0;
+static volatile uint32_t test_batches = 0;
+static volatile uint64_t test_callback_us = 0;
+
+static void test_callback(PairAdminEventType event, const void *data, size_t len,
+                          const PairAdminBatchEntry *index, size_t count,
+                          const PairAdminChunkInfo *info)
+{
+    (void)info;
+    if (event == PAIRADMIN_EVENT_OUTPUT && test_length + len < sizeof(test_data)) {
+        memcpy(test_data + test_length, data, len);
+        CHECK(index[count - 1].offset + index[count - 1].length == len);
+        pa_store_release_u32(&test_length, test_length + (uint32_t)len);
+        pa_store_release_u32(&test_fragments, test_fragments + (uint32_t)count);
+    }
+    pa_store_release_u32(&test_batches, test_batches + 1);
+    if (test_callback_us) {
+        pa_sleep_us(test_callback_us);
+    }
+}
+
+static void test_reset(void)
+{
+    memset(test_data, 0, sizeof(test_data));
+    test_length = 0;
+    test_fragments = 0;
+    test_batches = 0;
+    test_callback_us = 0;
+}
+
+static void test_coalesce(void)
+{
+    uint64_t end = pa_now_us() + TEST_WAIT_US;
+
+    test_reset();
+    CHECK(pairadmin_set_batch_callback(test_callback, 0, 50000) == 0);
+    pairadmin_hook_output("one ", 4);
+    pairadmin_hook_output("two ", 4);
+    pairadmin_hook_output("three", 5);
+    while (pa_load_acquire_u32(&test_length) < 13 && pa_now_us() < end) {
+        pa_sleep_us(1000);
+    }
+    CHECK(strcmp(test_data, "one two three") == 0);
+    CHECK(test_fragments == 3);
+    CHECK(test_batches == 1);
+    CHECK(pairadmin_set_batch_callback(NULL, 0, 0) == 0);
+}
+
+// Held longer than the test takes, so only the stop delivers it
+static void test_stop_flushes(void)
+{
+    test_reset();
+    CHECK(pairadmin_set_batch_callback(test_callback, 0, 10000000) == 0);
+    pairadmin_hook_output("held", 4);
+    pa_sleep_us(20000);
+    CHECK(test_batches == 0);
+    CHECK(pairadmin_set_batch_callback(NULL, 0, 0) == 0);
+    CHECK(strcmp(test_data, "held") == 0);
+}
+
+static volatile uint32_t test_producing = 0;
+
+static void test_producer(void *arg)
+{
+    static const char chunk[1024] = {'x'};
+    uint64_t end = pa_now_us() + 4 * TEST_WAIT_US;
+
+    (void)arg;
+    while (pa_load_acquire_u32(&test_producing) && pa_now_us() < end) {
+        pairadmin_hook_output(chunk, sizeof(chunk));
+    }
+}
+
+static void test_stop_under_load(void)
+{
+    PaThread producer;
+    uint64_t start;
+    uint64_t took;
+
+    test_reset();
+    test_callback_us = 2000;
+    CHECK(pairadmin_set_batch_callback(test_callback, 0, 0) == 0);
+    test_producing = 1;
+    CHECK(pa_thread_start(&producer, test_producer, NULL) == 0);
+    pa_sleep_us(200000);
+
+    start = pa_now_us();
+    CHECK(pairadmin_set_batch_callback(NULL, 0, 0) == 0);
+    took = pa_now_us() - start;
+    pa_store_release_u32(&test_producing, 0);
+    pa_thread_join(&producer);
+
+    // A full ring at one 64 KB batch per 2 ms is well under a second
+    CHECK(took < 2000000);
+    CHECK(test_batches > 0);
+}
+
+int main(void)
+{
+    test_coalesce();
+    test_stop_flushes();
+    test_stop_under_load();
+    return test_finish("pairadmin_batch_test");
+}
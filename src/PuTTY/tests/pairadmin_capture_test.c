@@ -0,0 +1,498 @@
+// Capture store tests for PairAdmin
+//
+// Sends output across several text segments and reads it back by line:
+// pairadmin_log_read_range() and pairadmin_get_last_lines() give every
+// line whole across segment rolls, the open line included, and lines
+// too long to carry over are split where their segment filled.
+//
+// Captures a few segments of numbered output lines and reads them back
+// through an export: every archive walked from its trailer, every block
+// decompressed on its own, and the frames put together again give the
+// output exactly as it was sent; a block reached through the index
+// alone starts a line that pairadmin_log_read_range() returns the same.
+// Where FIFOs exist, an export held up writing must not hold up
+// pairadmin_capture_close(), and still completes afterwards.
+//
+//   pairadmin_capture_test
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+#include "pairadmin_test.h"
+
+#define TEST_SEGMENT (1u << 20)
+#define TEST_LINES 80000
+#define TEST_CHUNK 4000
+#define TEST_EXPORT "pairadmin_capture_test.export"
+#define TEST_FIFO "pairadmin_capture_test.fifo"
+#define TEST_WAIT_US 5000000
+
+// Longest line the line store carries over to the next text segment
+#define TEST_CARRY_MAX (TEST_SEGMENT / 4)
+
+// Everything sent, in order
+static char *test_sent;
+static size_t test_sent_length;
+
+// Line i: its number, then letters that vary enough to compress unevenly
+static size_t test_line(uint32_t i, char *out)
+{
+    uint32_t x = i * 2654435761u;
+    size_t n = (size_t)sprintf(out, "%07u ", (unsigned)i);
+    uint32_t k;
+
+    for (k = 0; k < 20 + (i % 50); k++) {
+        x = x * 1103515245u + 12345u;
+        out[n++] = (char)('a' + (x >> 16) % 26);
+    }
+    out[n++] = '\n';
+    return n;
+}
+
+// Line i of len bytes, newline included
+static void test_long_line(uint32_t i, size_t len, char *out)
+{
+    size_t k = (size_t)sprintf(out, "%07u ", (unsigned)i);
+
+    for (; k < len - 1; k++) {
+        out[k] = (char)('a' + (i + k) % 26);
+    }
+    out[len - 1] = '\n';
+}
+
+static void test_output(const char *data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i += TEST_CHUNK) {
+        pairadmin_hook_output(data + i, len - i < TEST_CHUNK ? len - i : TEST_CHUNK);
+    }
+}
+
+static void test_send(uint32_t lines)
+{
+    size_t i;
+
+    test_sent = (char *)malloc((size_t)lines * 96);
+    test_sent_length = 0;
+    for (i = 0; i < lines; i++) {
+        test_sent_length += test_line((uint32_t)i, test_sent + test_sent_length);
+    }
+    test_output(test_sent, test_sent_length);
+}
+
+static void test_file_path(uint32_t segment, const char *ext, char *path, size_t cap)
+{
+    snprintf(path, cap, "pairadmin-%lu-%u-%04u.%s", pa_process_id(),
+             (unsigned)pairadmin_session_get_id(NULL), (unsigned)segment, ext);
+}
+
+static int test_file_exists(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+
+    if (f) {
+        fclose(f);
+    }
+    return f != NULL;
+}
+
+static unsigned char *test_read_file(FILE *f, size_t *size)
+{
+    size_t cap = 1u << 20;
+    unsigned char *data = (unsigned char *)malloc(cap);
+    size_t n;
+
+    *size = 0;
+    while (data && (n = fread(data + *size, 1, cap - *size, f)) > 0) {
+        *size += n;
+        if (*size == cap) {
+            cap *= 2;
+            data = (unsigned char *)realloc(data, cap);
+        }
+    }
+    return data;
+}
+
+// Decompress one block into out; its raw size, or -1
+static int64_t test_block(const unsigned char *archive, const PairAdminCaptureBlock *block, unsigned char *out)
+{
+    if (block->compressed == block->raw) {
+        memcpy(out, archive + block->offset, block->raw);
+        return block->raw;
+    }
+    return pairadmin_capture_decompress(archive + block->offset, block->compressed, out,
+                                        PAIRADMIN_ARCHIVE_BLOCK);
+}
+
+// Walk an export from its end and put the output back together from
+// the frames of every block. Returns the number of archives, or -1.
+static int test_unpack(const unsigned char *data, size_t size, char *out, size_t *out_length)
+{
+    const unsigned char *starts[64];
+    unsigned char *raw = (unsigned char *)malloc(PAIRADMIN_ARCHIVE_BLOCK);
+    int archives = 0;
+    size_t end = size;
+    int a;
+
+    *out_length = 0;
+    while (end > 0) {
+        PairAdminCaptureArchive trailer;
+
+        if (end < sizeof(trailer) || archives == 64) {
+            free(raw);
+            return -1;
+        }
+        memcpy(&trailer, data + end - sizeof(trailer), sizeof(trailer));
+        if (trailer.magic != PAIRADMIN_ARCHIVE_MAGIC || trailer.archive_bytes > end ||
+            (trailer.archive_bytes & 7) != 0) {
+            free(raw);
+            return -1;
+        }
+        end -= (size_t)trailer.archive_bytes;
+        starts[archives++] = data + end;
+    }
+
+    // Oldest first
+    for (a = archives - 1; a >= 0; a--) {
+        const unsigned char *archive = starts[a];
+        const unsigned char *next = a > 0 ? starts[a - 1] : data + size;
+        PairAdminCaptureArchive trailer;
+        const PairAdminCaptureBlock *index;
+        uint64_t raw_bytes = 0;
+        uint32_t b;
+
+        memcpy(&trailer, next - sizeof(trailer), sizeof(trailer));
+        CHECK(trailer.sequence == (uint64_t)(archives - 1 - a));
+        index = (const PairAdminCaptureBlock *)(archive + trailer.index_offset);
+
+        for (b = 0; b < trailer.block_count; b++) {
+            int64_t n = test_block(archive, &index[b], raw);
+            int64_t pos = 0;
+
+            CHECK(n == (int64_t)index[b].raw);
+            CHECK(b == 0 || index[b].timestamp_us >= index[b - 1].timestamp_us);
+            if (n != (int64_t)index[b].raw) {
+                free(raw);
+                return -1;
+            }
+            while (pos < n) {
+                const PairAdminCaptureFrame *frame = (const PairAdminCaptureFrame *)(raw + pos);
+
+                CHECK(frame->type == PAIRADMIN_EVENT_OUTPUT);
+                if (pos == 0) {
+                    CHECK(frame->timestamp_us == index[b].timestamp_us);
+                }
+                memcpy(out + *out_length, frame + 1, frame->length);
+                *out_length += frame->length;
+                pos += (int64_t)PAIRADMIN_CAPTURE_FRAME_SIZE(frame->length);
+            }
+            CHECK(pos == n);
+            raw_bytes += (uint64_t)n;
+        }
+        CHECK(raw_bytes == trailer.raw_bytes);
+    }
+    free(raw);
+    return archives;
+}
+
+// Seek to a block through the index alone and find the line it holds
+// the start of in the line store
+static void test_seek(const unsigned char *data, size_t size)
+{
+    PairAdminCaptureArchive trailer;
+    const unsigned char *archive;
+    const PairAdminCaptureBlock *index;
+    unsigned char *raw = (unsigned char *)malloc(PAIRADMIN_ARCHIVE_BLOCK);
+    const PairAdminCaptureFrame *frame = (const PairAdminCaptureFrame *)raw;
+    const char *text = (const char *)(frame + 1);
+    const char *nl;
+    char want[128];
+    char got[128];
+    uint32_t lines = 0;
+    unsigned number;
+    size_t len;
+
+    // The oldest archive, a full segment, and its middle block
+    do {
+        memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+        size -= (size_t)trailer.archive_bytes;
+    } while (size > 0);
+    archive = data;
+    index = (const PairAdminCaptureBlock *)(archive + trailer.index_offset);
+    CHECK(trailer.block_count > 2);
+    CHECK(test_block(archive, &index[trailer.block_count / 2], raw) > 0);
+
+    nl = (const char *)memchr(text, '\n', frame->length);
+    CHECK(nl != NULL && sscanf(nl + 1, "%7u", &number) == 1);
+    len = test_line(number, want);
+    CHECK(memcmp(nl + 1, want, 8) == 0);
+
+    CHECK(pairadmin_log_read_range(NULL, number, 1, got, sizeof(got), &lines) == len);
+    CHECK(lines == 1 && memcmp(got, want, len) == 0);
+    free(raw);
+}
+
+// Lines of 1000 bytes over three text segments, then an open line
+static void test_line_rolls(void)
+{
+    static PairAdminLineSpan spans[3000];
+    size_t cap = 4 * TEST_SEGMENT;
+    char *buf = (char *)malloc(cap);
+    uint32_t lines = 0;
+    uint32_t count;
+    uint32_t i;
+
+    test_sent = (char *)malloc(cap);
+    for (i = 0; i < 3000; i++) {
+        test_long_line(i, 1000, test_sent + (size_t)i * 1000);
+    }
+    test_sent_length = 3000 * 1000;
+    test_output(test_sent, test_sent_length);
+    CHECK(pairadmin_log_line_count(NULL) == 3000);
+
+    // All of it at once, and line by line
+    CHECK(pairadmin_log_read_range(NULL, 0, 3000, buf, cap, &lines) == test_sent_length);
+    CHECK(lines == 3000 && memcmp(buf, test_sent, test_sent_length) == 0);
+    for (i = 0; i < 3000; i++) {
+        if (pairadmin_log_read_range(NULL, i, 1, buf, cap, &lines) != 1000 || lines != 1 ||
+            memcmp(buf, test_sent + (size_t)i * 1000, 1000) != 0) {
+            fprintf(stderr, "line %u\n", (unsigned)i);
+            CHECK(0);
+            break;
+        }
+    }
+
+    // Whole lines that fit, or the first cut to cap
+    CHECK(pairadmin_log_read_range(NULL, 1040, 3, buf, 2500, &lines) == 2000 && lines == 2);
+    CHECK(pairadmin_log_read_range(NULL, 1040, 3, buf, 300, &lines) == 300 && lines == 1);
+    CHECK(memcmp(buf, test_sent + 1040 * 1000, 300) == 0);
+    CHECK(pairadmin_log_read_range(NULL, 3001, 1, buf, cap, &lines) == 0 && lines == 0);
+
+    // Newest lines, oldest first, without their newlines
+    count = pairadmin_get_last_lines(NULL, 3000, spans);
+    CHECK(count == 3000);
+    for (i = 0; i < count; i++) {
+        if (spans[i].length != 999 || spans[i].flags != 0 ||
+            memcmp(spans[i].data, test_sent + (size_t)i * 1000, 999) != 0) {
+            fprintf(stderr, "span %u\n", (unsigned)i);
+            CHECK(0);
+            break;
+        }
+    }
+
+    // The open line comes last, flagged, and reads as it is so far
+    pairadmin_hook_output("partial", 7);
+    CHECK(pairadmin_log_line_count(NULL) == 3000);
+    count = pairadmin_get_last_lines(NULL, 2, spans);
+    CHECK(count == 2);
+    CHECK(spans[0].length == 999 && memcmp(spans[0].data, test_sent + 2999 * 1000, 999) == 0);
+    CHECK(spans[1].length == 7 && spans[1].flags == PAIRADMIN_LINE_OPEN);
+    CHECK(memcmp(spans[1].data, "partial", 7) == 0);
+    CHECK(pairadmin_log_read_range(NULL, 3000, 1, buf, cap, &lines) == 7 && lines == 1);
+
+    pairadmin_hook_output(" done\r\n", 7);
+    CHECK(pairadmin_log_line_count(NULL) == 3001);
+    count = pairadmin_get_last_lines(NULL, 1, spans);
+    CHECK(count == 1 && spans[0].flags == 0 && spans[0].length == 12);
+    CHECK(memcmp(spans[0].data, "partial done", 12) == 0);
+
+    free(buf);
+    free(test_sent);
+    test_sent = NULL;
+}
+
+// Lines up to a quarter segment stay whole across rolls; a line longer
+// than a segment comes back in pieces, only the last with its newline
+static void test_line_split(void)
+{
+    size_t cap = 4 * TEST_SEGMENT;
+    char *line = (char *)malloc(cap);
+    char *buf = (char *)malloc(cap);
+    uint64_t first = pairadmin_log_line_count(NULL);
+    uint64_t count;
+    size_t joined = 0;
+    size_t len = (size_t)TEST_SEGMENT * 5 / 2;
+    uint32_t lines = 0;
+    uint32_t i;
+
+    for (i = 0; i < 12; i++) {
+        test_long_line(i, TEST_CARRY_MAX, line);
+        test_output(line, TEST_CARRY_MAX);
+        CHECK(pairadmin_log_read_range(NULL, first + i, 1, buf, cap, &lines) == TEST_CARRY_MAX);
+        CHECK(lines == 1 && memcmp(buf, line, TEST_CARRY_MAX) == 0);
+    }
+    CHECK(pairadmin_log_line_count(NULL) == first + 12);
+    first += 12;
+
+    test_long_line(99, len, line);
+    test_output(line, len);
+    count = pairadmin_log_line_count(NULL) - first;
+    CHECK(count >= 3);
+    for (i = 0; i < count; i++) {
+        size_t n = pairadmin_log_read_range(NULL, first + i, 1, buf, cap, &lines);
+
+        CHECK(n > 0 && n <= TEST_SEGMENT && lines == 1);
+        CHECK((buf[n - 1] == '\n') == (i + 1 == count));
+        CHECK(joined + n <= len && memcmp(buf, line + joined, n) == 0);
+        joined += n;
+    }
+    CHECK(joined == len);
+
+    free(buf);
+    free(line);
+}
+
+static void test_round_trip(void)
+{
+    char path[PA_PATH_MAX];
+    unsigned char *data;
+    char *unpacked;
+    size_t length;
+    size_t size;
+    uint64_t end;
+    FILE *f;
+    int64_t written;
+
+    test_send(TEST_LINES);
+    CHECK(test_sent_length > 3 * TEST_SEGMENT);
+    CHECK(pairadmin_log_line_count(NULL) == TEST_LINES);
+
+    // Full segments are archived in the background; the last is
+    // compressed by the export itself
+    test_file_path(1, "pacapz", path, sizeof(path));
+    end = pa_now_us() + TEST_WAIT_US;
+    while (!test_file_exists(path) && pa_now_us() < end) {
+        pa_sleep_us(10000);
+    }
+    CHECK(test_file_exists(path));
+
+    written = pairadmin_capture_export(NULL, TEST_EXPORT);
+    CHECK(written > 0 && (uint64_t)written < test_sent_length);
+    f = fopen(TEST_EXPORT, "rb");
+    CHECK(f != NULL);
+    if (!f) {
+        return;
+    }
+    data = test_read_file(f, &size);
+    fclose(f);
+    CHECK((int64_t)size == written);
+
+    unpacked = (char *)malloc(test_sent_length + 1);
+    CHECK(test_unpack(data, size, unpacked, &length) >= 4);
+    CHECK(length == test_sent_length && memcmp(unpacked, test_sent, length) == 0);
+    test_seek(data, size);
+
+    free(unpacked);
+    free(data);
+    remove(TEST_EXPORT);
+}
+
+#ifndef _WIN32
+
+static volatile int64_t test_exported;
+static volatile uint32_t test_closed;
+
+static void test_export_thread(void *arg)
+{
+    (void)arg;
+    // Opening a FIFO for writing waits for a reader
+    test_exported = pairadmin_capture_export(NULL, TEST_FIFO);
+}
+
+static void test_close_thread(void *arg)
+{
+    (void)arg;
+    pairadmin_capture_close(NULL);
+    pa_store_release_u32(&test_closed, 1);
+}
+
+static void test_close_during_export(void)
+{
+    PaThread exporter;
+    PaThread closer;
+    unsigned char *data;
+    char *unpacked;
+    size_t length;
+    size_t size;
+    uint64_t end;
+    FILE *f;
+
+    remove(TEST_FIFO);
+    CHECK(mkfifo(TEST_FIFO, 0600) == 0);
+    CHECK(pa_thread_start(&exporter, test_export_thread, NULL) == 0);
+    pa_sleep_us(100000);
+
+    // The export is stuck on I/O: close returns all the same
+    CHECK(pa_thread_start(&closer, test_close_thread, NULL) == 0);
+    end = pa_now_us() + 2000000;
+    while (!pa_load_acquire_u32(&test_closed) && pa_now_us() < end) {
+        pa_sleep_us(1000);
+    }
+    CHECK(pa_load_acquire_u32(&test_closed));
+    CHECK(pairadmin_log_line_count(NULL) == 0);
+
+    // ...and the export still writes the whole store
+    f = fopen(TEST_FIFO, "rb");
+    CHECK(f != NULL);
+    if (f) {
+        data = test_read_file(f, &size);
+        fclose(f);
+        pa_thread_join(&exporter);
+        CHECK(test_exported == (int64_t)size);
+
+        unpacked = (char *)malloc(test_sent_length + 1);
+        CHECK(test_unpack(data, size, unpacked, &length) >= 4);
+        CHECK(length == test_sent_length && memcmp(unpacked, test_sent, length) == 0);
+        free(unpacked);
+        free(data);
+    }
+    pa_thread_join(&closer);
+    remove(TEST_FIFO);
+}
+
+#endif
+
+// Archives stay on disk after close
+static void test_remove_files(void)
+{
+    char path[PA_PATH_MAX];
+    uint32_t i;
+
+    for (i = 0; i < 32; i++) {
+        test_file_path(i, "pacapz", path, sizeof(path));
+        remove(path);
+        test_file_path(i, "pacap", path, sizeof(path));
+        remove(path);
+    }
+}
+
+int main(void)
+{
+    if (pairadmin_capture_open(NULL, ".", TEST_SEGMENT) != 0) {
+        fprintf(stderr, "cannot open the capture store\n");
+        return 1;
+    }
+    test_line_rolls();
+    test_line_split();
+    pairadmin_capture_close(NULL);
+    test_remove_files();
+
+    CHECK(pairadmin_capture_open(NULL, ".", TEST_SEGMENT) == 0);
+    test_round_trip();
+#ifndef _WIN32
+    test_close_during_export();
+#else
+    pairadmin_capture_close(NULL);
+#endif
+    test_remove_files();
+
+    free(test_sent);
+    return test_finish("pairadmin_capture_test");
+}
@@ -0,0 +1,414 @@
+// Audit export tests for PairAdmin
+//
+// Runs the exporter against a collector on a loopback socket. The
+// collector acknowledges only the first batch, then drops the
+// connection and forgets the rest, as a collector restarting would:
+// after the reconnect the exporter must resend from the acknowledged
+// offset, and the collector must end up with every record, in order,
+// without a gap. A second collector takes the hello and then never
+// reads, so the exporter's sends block: pairadmin_export_stop() must
+// still return within about one send timeout.
+//
+//   pairadmin_export_test
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET TestSocket;
+#define test_close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+typedef int TestSocket;
+#define test_close_socket close
+#endif
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+#include "pairadmin_test.h"
+
+#define TEST_WAIT_US 10000000
+
+// The exporter's send timeout, and what stop may take beyond it
+#define TEST_SEND_TIMEOUT_US 5000000
+#define TEST_STOP_SLACK_US 2000000
+
+#define TEST_STREAM_MAX (1u << 20)
+#define TEST_TEXT_MAX (1u << 16)
+
+// Default batch_bytes
+#define TEST_BATCH_MAX (64u * 1024)
+
+typedef struct TestCollector {
+    TestSocket listener;
+    int stall;                  // Take the hello, then never read
+    PaThread thread;
+
+    volatile uint32_t connections;
+    volatile uint32_t drop;     // Set by the test: drop the connection now
+    volatile uint32_t stop;
+    volatile uint32_t gap;      // A batch started past what was held
+    volatile uint64_t received; // End of the newest batch received
+    volatile uint64_t held;     // Stream bytes kept
+    uint64_t first_acked;       // End of the first batch, the only one acked before the drop
+    uint64_t hello_oldest[2];   // oldest_offset of each hello
+
+    unsigned char stream[TEST_STREAM_MAX];
+} TestCollector;
+
+static TestCollector test_collector;
+static unsigned char test_buffer[4 * PAIRADMIN_READ_BUFFER_MIN];
+
+static void test_receive_timeout(TestSocket s, uint32_t ms)
+{
+#ifdef _WIN32
+    DWORD timeout = ms;
+#else
+    struct timeval timeout;
+
+    timeout.tv_sec = (time_t)(ms / 1000);
+    timeout.tv_usec = (suseconds_t)(ms % 1000) * 1000;
+#endif
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+}
+
+// Read exactly len bytes, giving up when the connection ends or the
+// test asks for a drop or a stop
+static int test_read(TestCollector *c, TestSocket s, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+
+    while (len > 0) {
+        int n;
+
+        if (pa_load_acquire_u32(&c->drop) || pa_load_acquire_u32(&c->stop)) {
+            return -1;
+        }
+        n = (int)recv(s, p, (int)len, 0);
+        if (n == 0) {
+            return -1;
+        }
+        if (n < 0) {
+            continue;           // Receive timeout: look at the flags again
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void test_ack(TestSocket s, uint64_t offset)
+{
+    PairAdminExportAck ack;
+
+    memset(&ack, 0, sizeof(ack));
+    ack.magic = PAIRADMIN_EXPORT_ACK_MAGIC;
+    ack.offset = offset;
+    send(s, (const char *)&ack, (int)sizeof(ack), 0);
+}
+
+// Keep the part of a batch past what is held
+static void test_apply(TestCollector *c, const PairAdminExportBatch *batch, const unsigned char *stored)
+{
+    static unsigned char raw[TEST_BATCH_MAX];
+    uint64_t end = batch->offset + batch->raw_bytes;
+
+    if (batch->offset > c->held) {
+        pa_store_release_u32(&c->gap, 1);
+        return;
+    }
+    if (end <= c->held || end > TEST_STREAM_MAX) {
+        return;
+    }
+    if (batch->flags & PAIRADMIN_EXPORT_BATCH_COMPRESSED) {
+        if (pairadmin_capture_decompress(stored, batch->stored_bytes, raw, sizeof(raw)) !=
+            (int64_t)batch->raw_bytes) {
+            pa_store_release_u32(&c->gap, 1);
+            return;
+        }
+        stored = raw;
+    }
+    memcpy(c->stream + c->held, stored + (c->held - batch->offset), (size_t)(end - c->held));
+    pa_store_release_u64(&c->held, end);
+}
+
+static void test_collector_thread(void *arg)
+{
+    TestCollector *c = (TestCollector *)arg;
+    static unsigned char stored[TEST_BATCH_MAX];
+
+    while (!pa_load_acquire_u32(&c->stop)) {
+        PairAdminExportHello hello;
+        PairAdminExportBatch batch;
+        TestSocket s = accept(c->listener, NULL, NULL);
+        uint32_t n = c->connections;
+
+#ifdef _WIN32
+        if (s == INVALID_SOCKET) {
+#else
+        if (s < 0) {
+#endif
+            continue;           // Accept timeout
+        }
+        test_receive_timeout(s, 20);
+        if (test_read(c, s, &hello, sizeof(hello)) != 0 || hello.magic != PAIRADMIN_EXPORT_HELLO_MAGIC) {
+            test_close_socket(s);
+            continue;
+        }
+        if (n < 2) {
+            c->hello_oldest[n] = hello.oldest_offset;
+        }
+        pa_store_release_u32(&c->connections, n + 1);
+        test_ack(s, c->held);
+
+        if (c->stall) {
+            while (!pa_load_acquire_u32(&c->stop)) {
+                pa_sleep_us(1000);
+            }
+        }
+
+        while (test_read(c, s, &batch, sizeof(batch)) == 0 && batch.magic == PAIRADMIN_EXPORT_BATCH_MAGIC &&
+               batch.stored_bytes <= sizeof(stored) &&
+               test_read(c, s, stored, batch.stored_bytes) == 0) {
+            test_apply(c, &batch, stored);
+            pa_store_release_u64(&c->received, batch.offset + batch.raw_bytes);
+            // First connection: only the first batch is made safe
+            if (n > 0 || c->first_acked == 0) {
+                if (n == 0) {
+                    c->first_acked = c->held;
+                }
+                test_ack(s, c->held);
+            }
+        }
+
+        if (pa_load_acquire_u32(&c->drop)) {
+            // Restarted: only what was acknowledged survived
+            pa_store_release_u64(&c->held, c->first_acked);
+            pa_store_release_u32(&c->drop, 0);
+        }
+        test_close_socket(s);
+    }
+}
+
+// Listen on a loopback port; the address to give the exporter
+static int test_collector_start(TestCollector *c, int stall, char *address, size_t cap)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int small = 4096;
+
+    memset(c, 0, sizeof(*c));
+    c->stall = stall;
+    c->listener = socket(AF_INET, SOCK_STREAM, 0);
+    // A stalled collector's window fills after a few KB
+    if (stall) {
+        setsockopt(c->listener, SOL_SOCKET, SO_RCVBUF, (const char *)&small, sizeof(small));
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(c->listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(c->listener, 4) != 0 ||
+        getsockname(c->listener, (struct sockaddr *)&addr, &len) != 0) {
+        test_close_socket(c->listener);
+        return -1;
+    }
+    test_receive_timeout(c->listener, 20);
+    snprintf(address, cap, "127.0.0.1:%u", (unsigned)ntohs(addr.sin_port));
+    return pa_thread_start(&c->thread, test_collector_thread, c);
+}
+
+static void test_collector_stop(TestCollector *c)
+{
+    pa_store_release_u32(&c->stop, 1);
+    pa_thread_join(&c->thread);
+    test_close_socket(c->listener);
+}
+
+static int test_wait(volatile uint64_t *value, uint64_t want)
+{
+    uint64_t end = pa_now_us() + TEST_WAIT_US;
+
+    while (pa_load_acquire_u64(value) < want && pa_now_us() < end) {
+        pa_sleep_us(1000);
+    }
+    return pa_load_acquire_u64(value) >= want;
+}
+
+// Until the collector has acknowledged everything batched
+static int test_wait_acked(void)
+{
+    uint64_t end = pa_now_us() + TEST_WAIT_US;
+    PairAdminExportStats stats;
+
+    do {
+        pairadmin_export_get_stats(&stats);
+        if (stats.next_offset > 0 && stats.acked_offset == stats.next_offset) {
+            return 1;
+        }
+        pa_sleep_us(1000);
+    } while (pa_now_us() < end);
+    return 0;
+}
+
+// OUTPUT payloads of the collected records, concatenated
+static size_t test_collected_text(const TestCollector *c, char *text, size_t cap)
+{
+    size_t length = 0;
+    size_t i;
+
+    for (i = 0; i + sizeof(PairAdminEventHeader) <= c->held;) {
+        const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(c->stream + i);
+
+        if (hdr->type == PAIRADMIN_EVENT_OUTPUT && length + hdr->length <= cap) {
+            memcpy(text + length, hdr + 1, hdr->length);
+            length += hdr->length;
+        }
+        i += PAIRADMIN_RECORD_SIZE(hdr->length);
+    }
+    return length;
+}
+
+// Lines first..last-1, each its own event, in bursts that each make a batch
+static size_t test_send_lines(uint32_t first, uint32_t last, char *sent, size_t length)
+{
+    uint32_t i;
+
+    for (i = first; i < last; i++) {
+        int n = sprintf(sent + length, "line %u of the audited session\r\n", (unsigned)i);
+
+        pairadmin_hook_output(sent + length, (size_t)n);
+        length += (size_t)n;
+        if (i % 20 == 19) {
+            pa_sleep_us(20000);
+        }
+    }
+    return length;
+}
+
+static void test_resume(void)
+{
+    static char sent[TEST_TEXT_MAX];
+    static char got[TEST_TEXT_MAX];
+    TestCollector *c = &test_collector;
+    PairAdminExportConfig config;
+    PairAdminExportStats stats;
+    char address[64];
+    size_t length;
+
+    CHECK(test_collector_start(c, 0, address, sizeof(address)) == 0);
+    memset(&config, 0, sizeof(config));
+    config.transport = PAIRADMIN_EXPORT_TCP;
+    config.address = address;
+    config.flush_ms = 5;
+    CHECK(pairadmin_export_start(&config) == 0);
+
+    // Everything reaches the collector; only the first batch is acked
+    length = test_send_lines(0, 200, sent, 0);
+    pa_sleep_us(50000);
+    pairadmin_export_get_stats(&stats);
+    CHECK(test_wait(&c->received, stats.next_offset));
+    CHECK(c->first_acked > 0 && c->first_acked < stats.next_offset);
+    pairadmin_export_get_stats(&stats);
+    CHECK(stats.acked_offset == c->first_acked);
+    CHECK(stats.connects == 1);
+
+    // The collector restarts, keeping only the first batch, while more
+    // output arrives
+    pa_store_release_u32(&c->drop, 1);
+    length = test_send_lines(200, 400, sent, length);
+    pa_sleep_us(50000);
+
+    pairadmin_export_get_stats(&stats);
+    CHECK(test_wait(&c->held, stats.next_offset));
+    CHECK(c->connections == 2);
+    // The hello offers everything not acknowledged
+    CHECK(c->hello_oldest[1] == c->first_acked);
+    CHECK(!c->gap);
+    CHECK(test_wait_acked());
+
+    pairadmin_export_stop();
+    pairadmin_export_get_stats(&stats);
+    CHECK(stats.connects == 2);
+    CHECK(stats.acked_offset == stats.next_offset && c->held == stats.next_offset);
+    CHECK(stats.dropped_bytes == 0 && stats.lost_bytes == 0);
+    CHECK(test_collected_text(c, got, sizeof(got)) == length && memcmp(got, sent, length) == 0);
+
+    test_collector_stop(c);
+}
+
+static void test_stop_while_blocked(void)
+{
+    static char chunk[PAIRADMIN_MAX_PAYLOAD];
+    TestCollector *c = &test_collector;
+    PairAdminExportConfig config;
+    PairAdminExportStats stats;
+    char address[64];
+    uint64_t end = pa_now_us() + TEST_WAIT_US;
+    uint64_t sent = 0;
+    uint64_t still = 0;
+    uint64_t started;
+
+    memset(chunk, 'x', sizeof(chunk));
+    CHECK(test_collector_start(c, 1, address, sizeof(address)) == 0);
+    memset(&config, 0, sizeof(config));
+    config.transport = PAIRADMIN_EXPORT_TCP;
+    config.flags = PAIRADMIN_EXPORT_UNCOMPRESSED;
+    config.address = address;
+    config.flush_ms = 5;
+    CHECK(pairadmin_export_start(&config) == 0);
+
+    // Output until nothing more goes out for a while: a send is stuck
+    while (pa_now_us() < end) {
+        uint32_t i;
+
+        for (i = 0; i < 16; i++) {
+            pairadmin_hook_output(chunk, sizeof(chunk));
+        }
+        // The application's reader keeps the ring from filling up
+        while (pairadmin_read_events(test_buffer, sizeof(test_buffer)) > 0) {
+        }
+        pa_sleep_us(10000);
+        pairadmin_export_get_stats(&stats);
+        if (stats.sent_bytes == 0 || stats.sent_bytes != sent) {
+            sent = stats.sent_bytes;
+            still = pa_now_us();
+        } else if (pa_now_us() - still > 300000) {
+            break;
+        }
+    }
+    CHECK(c->connections == 1);
+    CHECK(stats.sent_bytes > 0 && stats.buffered_bytes > 0);
+
+    started = pa_now_us();
+    pairadmin_export_stop();
+    CHECK(pa_now_us() - started < TEST_SEND_TIMEOUT_US + TEST_STOP_SLACK_US);
+    pairadmin_export_get_stats(&stats);
+    CHECK(!stats.running && !stats.connected);
+
+    test_collector_stop(c);
+}
+
+int main(void)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    if (pairadmin_ring_open(0) != 0) {
+        fprintf(stderr, "cannot open the event ring\n");
+        return 1;
+    }
+
+    test_resume();
+    test_stop_while_blocked();
+
+    pairadmin_ring_close();
+    return test_finish("pairadmin_export_test");
+}
@@ -0,0 +1,265 @@
+// Command line tests for PairAdmin
+//
+// Types keys through the input hook into the event ring and checks the
+// COMMAND events that come out: the line editor's keys (backspace,
+// Ctrl-U, Ctrl-W, cursor keys, paste), and the denylist reporting and
+// blocking command names however the shell would have them quoted.
+//
+//   pairadmin_line_test
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_test.h"
+
+static unsigned char test_buffer[4 * PAIRADMIN_READ_BUFFER_MIN];
+
+// The last COMMAND event, how many there were, and the INPUT text
+static PairAdminCommandInfo test_info;
+static char test_command[PAIRADMIN_COMMAND_MAX + 1];
+static char test_input[256];
+static int test_commands;
+
+static void test_drain(void)
+{
+    size_t input = 0;
+    size_t n;
+
+    memset(&test_info, 0, sizeof(test_info));
+    memset(test_command, 0, sizeof(test_command));
+    memset(test_input, 0, sizeof(test_input));
+    test_commands = 0;
+    while ((n = pairadmin_read_events(test_buffer, sizeof(test_buffer))) > 0) {
+        size_t i;
+
+        for (i = 0; i < n;) {
+            const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(test_buffer + i);
+            const unsigned char *payload = (const unsigned char *)(hdr + 1);
+
+            if (hdr->type == PAIRADMIN_EVENT_COMMAND && hdr->length >= sizeof(test_info)) {
+                memcpy(&test_info, payload, sizeof(test_info));
+                memcpy(test_command, payload + sizeof(test_info), test_info.length);
+                test_command[test_info.length] = '\0';
+                test_commands++;
+            } else if (hdr->type == PAIRADMIN_EVENT_INPUT && input + hdr->length < sizeof(test_input)) {
+                memcpy(test_input + input, payload, hdr->length);
+                input += hdr->length;
+            }
+            i += PAIRADMIN_RECORD_SIZE(hdr->length);
+        }
+    }
+}
+
+// Keys one at a time, as ldisc passes typing on
+static void test_type(const char *keys)
+{
+    size_t i;
+
+    for (i = 0; keys[i]; i++) {
+        pairadmin_hook_input(keys + i, 1);
+    }
+}
+
+// Typed keys give exactly `want` with flags `flags`
+static void test_typed(const char *keys, const char *want, uint32_t flags)
+{
+    test_type(keys);
+    test_drain();
+    if (strcmp(test_command, want) != 0 || test_info.flags != flags) {
+        fprintf(stderr, "typed \"%s\": got \"%s\" flags 0x%x\n", keys, test_command, (unsigned)test_info.flags);
+    }
+    CHECK(test_commands == 1);
+    CHECK(strcmp(test_command, want) == 0);
+    CHECK(test_info.flags == flags);
+}
+
+static void test_editor(void)
+{
+    test_typed("lsx\x7f -l\r", "ls -l", 0);
+    test_typed("lsx\x08 -l\r", "ls -l", 0);
+    test_typed("garbage\x15" "echo hi\r", "echo hi", 0);
+    test_typed("echo one two\x17three\r", "echo one three", 0);
+    test_typed("echo one two  \x17three\r", "echo one three", 0);
+    test_typed("echo \xc3\xa9\x7f" "e\r", "echo e", 0);
+    test_typed("rm -rf /\x03ls\r", "ls", 0);
+    test_typed("ls\r\n", "ls", 0);
+
+    // Keys only the shell interprets
+    test_typed("ls\x1b[D\x1b[Dx\r", "lsx", PAIRADMIN_COMMAND_INEXACT);
+    test_typed("\x1bOA\r", "", PAIRADMIN_COMMAND_INEXACT);
+    test_typed("\x1b[A\r", "", PAIRADMIN_COMMAND_INEXACT);
+    test_typed("ls /us\t\r", "ls /us", PAIRADMIN_COMMAND_INEXACT);
+    test_typed("ls\x1b" "b\r", "ls", PAIRADMIN_COMMAND_INEXACT);
+
+    // An empty line runs nothing
+    test_type("\r");
+    test_drain();
+    CHECK(test_commands == 0);
+    CHECK(strcmp(test_input, "\r") == 0);
+}
+
+static void test_paste(void)
+{
+    static const char burst[] = "echo pasted line\r";
+    static const char bracketed[] = "\x1b[200~echo a\r\necho b\x1b[201~\r";
+
+    // The same keys typed one by one are not a paste
+    test_typed(burst, "echo pasted line", 0);
+
+    pairadmin_hook_input(burst, strlen(burst));
+    test_drain();
+    CHECK(test_commands == 1);
+    CHECK(strcmp(test_command, "echo pasted line") == 0);
+    CHECK(test_info.flags == PAIRADMIN_COMMAND_PASTED);
+
+    // Short bursts are keys ldisc sent together
+    pairadmin_hook_input("ls\r", 3);
+    test_drain();
+    CHECK(test_info.flags == 0);
+
+    // Bracketed paste keeps its line breaks until Enter is typed
+    pairadmin_hook_input(bracketed, strlen(bracketed));
+    test_drain();
+    CHECK(test_commands == 1);
+    CHECK(strcmp(test_command, "echo a\necho b") == 0);
+    CHECK(test_info.flags == PAIRADMIN_COMMAND_PASTED);
+
+    // Several lines in one event each give a command
+    pairadmin_hook_input("ls\rpwd\r", 7);
+    test_drain();
+    CHECK(test_commands == 2);
+    CHECK(strcmp(test_command, "pwd") == 0);
+}
+
+static const char *const test_denylist[] = { "rm", "shutdown" };
+
+// Lines running rm or shutdown, however it is spelled
+static const char *const test_denied[] = {
+    "rm -rf /",
+    "RM -rf /",
+    "\\rm -rf /",
+    "r\\m -rf /",
+    "'rm' -rf /",
+    "r''m -rf /",
+    "\"r\"m -rf /",
+    "'r'\"m\" -rf /",
+    "$'rm' -rf /",
+    "$\"rm\" -rf /",
+    "/bin/rm -rf /",
+    "'/bin/'rm -rf /",
+    "sudo -u root rm -rf /",
+    "sudo \"rm\" -rf /",
+    "FOO=1 rm -rf /",
+    "ls; r''m -rf /",
+    "ls && sh''utdown now",
+    "echo \"$(rm -rf /)\""
+};
+
+// Lines that only mention it
+static const char *const test_allowed[] = {
+    "echo rm",
+    "rmdir x",
+    "'rm x'",
+    "ls $'rm'",
+    "echo 'a; rm -rf /'"
+};
+
+static void test_denylist_report(void)
+{
+    size_t i;
+
+    CHECK(pairadmin_set_command_denylist(test_denylist, 2, PAIRADMIN_DENY_REPORT) == 0);
+
+    for (i = 0; i < sizeof(test_denied) / sizeof(test_denied[0]); i++) {
+        char line[64];
+        size_t len = strlen(test_denied[i]);
+
+        memcpy(line, test_denied[i], len);
+        line[len++] = '\r';
+        // Reported, never withheld
+        CHECK(pairadmin_hook_input_checked(line, len) == len);
+        test_drain();
+        if (!(test_info.flags & PAIRADMIN_COMMAND_DENIED)) {
+            fprintf(stderr, "not denied: %s\n", test_denied[i]);
+        }
+        CHECK(test_commands == 1);
+        CHECK((test_info.flags & PAIRADMIN_COMMAND_DENIED) != 0);
+        CHECK((test_info.flags & PAIRADMIN_COMMAND_BLOCKED) == 0);
+        CHECK(test_info.denied == (strstr(test_denied[i], "utdown") ? 2u : 1u));
+    }
+
+    for (i = 0; i < sizeof(test_allowed) / sizeof(test_allowed[0]); i++) {
+        char line[64];
+        size_t len = strlen(test_allowed[i]);
+
+        memcpy(line, test_allowed[i], len);
+        line[len++] = '\r';
+        CHECK(pairadmin_hook_input_checked(line, len) == len);
+        test_drain();
+        if (test_info.flags & PAIRADMIN_COMMAND_DENIED) {
+            fprintf(stderr, "denied: %s\n", test_allowed[i]);
+        }
+        CHECK(test_commands == 1);
+        CHECK((test_info.flags & PAIRADMIN_COMMAND_DENIED) == 0);
+        CHECK(test_info.denied == 0);
+    }
+}
+
+static void test_denylist_block(void)
+{
+    static const char line[] = "r''m -rf /\rls\r";
+    size_t len = strlen(line);
+    size_t sent;
+
+    CHECK(pairadmin_set_command_denylist(test_denylist, 2, PAIRADMIN_DENY_BLOCK) == 0);
+
+    // The Enter and everything after it are withheld; sent in one
+    // event, the line is also taken for a paste
+    sent = pairadmin_hook_input_checked(line, len);
+    CHECK(sent == strlen("r''m -rf /"));
+    test_drain();
+    CHECK(test_commands == 1);
+    CHECK(strcmp(test_input, "r''m -rf /") == 0);
+    CHECK(strcmp(test_command, "r''m -rf /") == 0);
+    CHECK(test_info.flags == (PAIRADMIN_COMMAND_PASTED | PAIRADMIN_COMMAND_DENIED |
+                              PAIRADMIN_COMMAND_BLOCKED));
+    CHECK(test_info.denied == 1);
+
+    // The line stays as typed: pressing Enter again is withheld again,
+    // clearing it lets the next command through
+    CHECK(pairadmin_hook_input_checked("\r", 1) == 0);
+    test_drain();
+    CHECK(test_commands == 1 && (test_info.flags & PAIRADMIN_COMMAND_BLOCKED));
+    CHECK(pairadmin_hook_input_checked("\x15ls\r", 4) == 4);
+    test_drain();
+    CHECK(test_commands == 1);
+    CHECK(strcmp(test_command, "ls") == 0);
+    CHECK(test_info.flags == 0);
+
+    // The unchecked hook cannot hold anything back: reported only
+    pairadmin_hook_input("$'rm' x\r", 8);
+    test_drain();
+    CHECK(test_info.flags == PAIRADMIN_COMMAND_DENIED);
+
+    // Off: nothing is looked up
+    CHECK(pairadmin_set_command_denylist(NULL, 0, PAIRADMIN_DENY_OFF) == 0);
+    CHECK(pairadmin_hook_input_checked("rm x\r", 5) == 5);
+    test_drain();
+    CHECK(test_info.flags == 0 && test_info.denied == 0);
+}
+
+int main(void)
+{
+    if (pairadmin_ring_open(0) != 0) {
+        fprintf(stderr, "cannot open the event ring\n");
+        return 1;
+    }
+
+    test_editor();
+    test_paste();
+    test_denylist_report();
+    test_denylist_block();
+
+    pairadmin_ring_close();
+    return test_finish("pairadmin_line_test");
+}
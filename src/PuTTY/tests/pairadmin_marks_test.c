@@ -0,0 +1,112 @@
+// Shell mark tests for PairAdmin
+//
+// Feeds shell integration sequences through the output hook into the
+// event ring and checks the marks that come out: a DIRECTORY for every
+// OSC 7, flagged when it repeats the last one, PROMPT for OSC 133;A,
+// and sequences split across hook calls found all the same.
+//
+//   pairadmin_marks_test
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_test.h"
+
+#define TEST_MARKS_MAX 16
+
+typedef struct TestMark {
+    unsigned type;
+    uint16_t flags;
+    char path[64];
+} TestMark;
+
+static unsigned char test_buffer[4 * PAIRADMIN_READ_BUFFER_MIN];
+static TestMark test_marks[TEST_MARKS_MAX];
+
+static void test_output(const char *text)
+{
+    pairadmin_hook_output(text, strlen(text));
+}
+
+// Read everything queued and keep the marks; returns how many there were
+static int test_drain(void)
+{
+    int count = 0;
+    size_t n;
+
+    memset(test_marks, 0, sizeof(test_marks));
+    while ((n = pairadmin_read_events(test_buffer, sizeof(test_buffer))) > 0) {
+        size_t i;
+
+        for (i = 0; i < n;) {
+            const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(test_buffer + i);
+
+            if (hdr->type >= PAIRADMIN_EVENT_PROMPT && hdr->type <= PAIRADMIN_EVENT_DIRECTORY &&
+                count < TEST_MARKS_MAX) {
+                PairAdminMarkInfo info;
+
+                memcpy(&info, hdr + 1, sizeof(info));
+                test_marks[count].type = hdr->type;
+                test_marks[count].flags = info.flags;
+                if (info.length < sizeof(test_marks[count].path)) {
+                    memcpy(test_marks[count].path, (const unsigned char *)(hdr + 1) + sizeof(info), info.length);
+                }
+                count++;
+            }
+            i += PAIRADMIN_RECORD_SIZE(hdr->length);
+        }
+    }
+    return count;
+}
+
+// A shell reports its directory before every prompt, moved or not
+static void test_directory_every_prompt(void)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        test_output("\x1b]7;file://host/home/user\x07\x1b]133;A\x07user@host:~$ ");
+    }
+    CHECK(test_drain() == 6);
+    for (i = 0; i < 3; i++) {
+        CHECK(test_marks[2 * i].type == PAIRADMIN_EVENT_DIRECTORY);
+        CHECK(strcmp(test_marks[2 * i].path, "/home/user") == 0);
+        CHECK(test_marks[2 * i].flags == (i ? PAIRADMIN_MARK_UNCHANGED : 0));
+        CHECK(test_marks[2 * i + 1].type == PAIRADMIN_EVENT_PROMPT);
+    }
+
+    // A move is reported without the flag
+    test_output("\x1b]7;file://host/tmp%20dir\x1b\\\x1b]133;A\x07$ ");
+    CHECK(test_drain() == 2);
+    CHECK(test_marks[0].type == PAIRADMIN_EVENT_DIRECTORY && test_marks[0].flags == 0);
+    CHECK(strcmp(test_marks[0].path, "/tmp dir") == 0);
+}
+
+// The same sequences, cut at every awkward place
+static void test_split_sequences(void)
+{
+    test_output("\x1b");
+    test_output("]7;file://host/v");
+    test_output("ar\x1b");
+    test_output("\\\x1b]13");
+    test_output("3;A");
+    test_output("\x07$ ");
+    CHECK(test_drain() == 2);
+    CHECK(test_marks[0].type == PAIRADMIN_EVENT_DIRECTORY && strcmp(test_marks[0].path, "/var") == 0);
+    CHECK(test_marks[1].type == PAIRADMIN_EVENT_PROMPT);
+}
+
+int main(void)
+{
+    if (pairadmin_ring_open(0) != 0 || pairadmin_set_shell_marks(PAIRADMIN_MARKS_SHELL, NULL) != 0) {
+        fprintf(stderr, "cannot set up the event ring\n");
+        return 1;
+    }
+
+    test_directory_every_prompt();
+    test_split_sequences();
+
+    pairadmin_set_shell_marks(PAIRADMIN_MARKS_OFF, NULL);
+    pairadmin_ring_close();
+    return test_finish("pairadmin_marks_test");
+}
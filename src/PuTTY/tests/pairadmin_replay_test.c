@@ -0,0 +1,117 @@
+// Replay tests for PairAdmin
+//
+// Feeds hand-built traces through pairadmin_replay() into the event
+// ring and checks what comes out: whole files are delivered, files
+// holding an unknown event type are rejected before any of their
+// events reach the ring, and the ring still works afterwards.
+//
+//   pairadmin_replay_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_test.h"
+
+#define TEST_TRACE "pairadmin_replay_test.patrace"
+
+static unsigned char test_buffer[4 * PAIRADMIN_READ_BUFFER_MIN];
+
+// Write a trace of one-byte-delta events; types[i] carries payloads[i]
+static int test_write_trace(const unsigned char *types, const char *const *payloads, size_t count)
+{
+    unsigned char header[PAIRADMIN_TRACE_HEADER_SIZE] = {0};
+    FILE *f = fopen(TEST_TRACE, "wb");
+    size_t i;
+
+    if (!f) {
+        return -1;
+    }
+    memcpy(header, PAIRADMIN_TRACE_MAGIC, 8);
+    header[8] = PAIRADMIN_TRACE_VERSION;
+    fwrite(header, 1, sizeof(header), f);
+    for (i = 0; i < count; i++) {
+        size_t len = strlen(payloads[i]);
+
+        fputc(1, f);
+        fputc(types[i], f);
+        fputc((int)len, f);
+        fwrite(payloads[i], 1, len, f);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+// Read everything queued; returns the number of records and copies the
+// type and payload of the first two
+static int test_drain(unsigned types[2], char payloads[2][32])
+{
+    int records = 0;
+    size_t n;
+
+    while ((n = pairadmin_read_events(test_buffer, sizeof(test_buffer))) > 0) {
+        size_t i;
+
+        for (i = 0; i < n;) {
+            const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(test_buffer + i);
+
+            if (records < 2 && hdr->length < 32) {
+                types[records] = hdr->type;
+                memcpy(payloads[records], hdr + 1, hdr->length);
+                payloads[records][hdr->length] = '\0';
+            }
+            records++;
+            i += PAIRADMIN_RECORD_SIZE(hdr->length);
+        }
+    }
+    return records;
+}
+
+static void test_valid_trace(void)
+{
+    static const unsigned char types[] = {PAIRADMIN_EVENT_OUTPUT, PAIRADMIN_EVENT_INPUT};
+    static const char *const payloads[] = {"abc", "ls\r"};
+    unsigned got_types[2] = {0, 0};
+    char got[2][32] = {"", ""};
+
+    CHECK(test_write_trace(types, payloads, 2) == 0);
+    CHECK(pairadmin_replay(TEST_TRACE, 0) == 2);
+    CHECK(test_drain(got_types, got) == 2);
+    CHECK(got_types[0] == PAIRADMIN_EVENT_OUTPUT && strcmp(got[0], "abc") == 0);
+    CHECK(got_types[1] == PAIRADMIN_EVENT_INPUT && strcmp(got[1], "ls\r") == 0);
+}
+
+static void test_rejected_type(unsigned char bad)
+{
+    const unsigned char types[] = {PAIRADMIN_EVENT_OUTPUT, bad, PAIRADMIN_EVENT_OUTPUT};
+    static const char *const payloads[] = {"before", "bad", "after"};
+    unsigned got_types[2] = {0, 0};
+    char got[2][32] = {"", ""};
+
+    CHECK(test_write_trace(types, payloads, 3) == 0);
+    CHECK(pairadmin_replay(TEST_TRACE, 0) == -1);
+    CHECK(test_drain(got_types, got) == 0);
+
+    // The ring is intact: a live event comes out alone and whole
+    pairadmin_hook_output("xyz", 3);
+    CHECK(test_drain(got_types, got) == 1);
+    CHECK(got_types[0] == PAIRADMIN_EVENT_OUTPUT && strcmp(got[0], "xyz") == 0);
+}
+
+int main(void)
+{
+    if (pairadmin_ring_open(0) != 0) {
+        fprintf(stderr, "cannot open the event ring\n");
+        return 1;
+    }
+
+    test_valid_trace();
+    test_rejected_type(0);
+    test_rejected_type(PAIRADMIN_EVENT_TYPE_COUNT);
+    test_rejected_type(99);
+    test_valid_trace();
+
+    pairadmin_ring_close();
+    remove(TEST_TRACE);
+    return test_finish("pairadmin_replay_test");
+}
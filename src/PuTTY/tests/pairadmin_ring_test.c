@@ -0,0 +1,257 @@
+// Event ring overflow tests for PairAdmin
+//
+// Fills the ring from the output hook under each overflow policy and
+// checks what the consumer gets: which records survive, that every
+// lost record is accounted for by a GAP marker and the dropped
+// counters, that sustained DROP_OLDEST overflow does not put a marker
+// ahead of every record, and that BLOCK_WITH_TIMEOUT both waits for a
+// live consumer and gives up on a stalled one.
+//
+//   pairadmin_ring_test
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+#include "pairadmin_test.h"
+
+// Payload per record; a record takes 1 KB of the ring, which holds 128
+#define TEST_PAYLOAD (1024 - sizeof(PairAdminEventHeader))
+#define TEST_CAPACITY (128 * 1024)
+
+typedef struct TestTally {
+    uint64_t records;           // Data records read
+    uint64_t gaps;              // GAP markers read
+    uint64_t gap_records;       // Records they report lost
+    uint64_t gap_bytes;
+    uint64_t next_sequence;
+    int sequence_ok;            // Sequence numbers only ever rise
+    char text[8];               // Start of the last data record
+} TestTally;
+
+static unsigned char test_buffer[4 * PAIRADMIN_READ_BUFFER_MIN];
+static unsigned char test_payload[TEST_PAYLOAD];
+
+static void test_write(void)
+{
+    pairadmin_hook_output(test_payload, sizeof(test_payload));
+}
+
+static void test_tally_init(TestTally *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->sequence_ok = 1;
+}
+
+// Read up to cap bytes of records (everything queued if cap is 0)
+static void test_read(TestTally *t, size_t cap)
+{
+    size_t n;
+
+    do {
+        size_t i;
+
+        n = pairadmin_read_events(test_buffer, cap ? cap : sizeof(test_buffer));
+        for (i = 0; i < n;) {
+            const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(test_buffer + i);
+
+            if (hdr->sequence < t->next_sequence) {
+                t->sequence_ok = 0;
+            }
+            t->next_sequence = hdr->sequence + 1;
+            if (hdr->type == PAIRADMIN_EVENT_GAP) {
+                PairAdminGapInfo gap;
+
+                memcpy(&gap, hdr + 1, sizeof(gap));
+                t->gaps++;
+                t->gap_records += gap.records;
+                t->gap_bytes += gap.bytes;
+            } else {
+                size_t keep = hdr->length < sizeof(t->text) - 1 ? hdr->length : sizeof(t->text) - 1;
+
+                memcpy(t->text, hdr + 1, keep);
+                t->text[keep] = '\0';
+                t->records++;
+            }
+            i += PAIRADMIN_RECORD_SIZE(hdr->length);
+        }
+    } while (n > 0 && cap == 0);
+}
+
+// Fresh ring, so the counters start at zero
+static int test_open(PairAdminOverflowPolicy policy, uint32_t timeout_us)
+{
+    pairadmin_ring_close();
+    if (pairadmin_set_overflow_policy(policy, timeout_us) != 0 || pairadmin_ring_open(TEST_CAPACITY) != 0) {
+        fprintf(stderr, "cannot open the event ring\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void test_drop_newest(void)
+{
+    TestTally t;
+    int i;
+
+    test_tally_init(&t);
+    if (test_open(PAIRADMIN_OVERFLOW_DROP_NEWEST, 0) != 0) {
+        test_failures++;
+        return;
+    }
+    for (i = 0; i < 300; i++) {
+        test_write();
+    }
+    test_read(&t, 0);
+    CHECK(t.records > 0 && t.records < 300);
+    CHECK(t.gaps == 0);
+    CHECK(pairadmin_get_dropped_events() == 300 - t.records);
+
+    // The marker goes ahead of the next record that fits
+    test_write();
+    test_read(&t, 0);
+    CHECK(t.gaps == 1);
+    CHECK(t.gap_records == pairadmin_get_dropped_events());
+    CHECK(t.gap_bytes == t.gap_records * TEST_PAYLOAD);
+    CHECK(t.records + t.gap_records == 301);
+    CHECK(t.sequence_ok);
+}
+
+static void test_drop_oldest(void)
+{
+    TestTally t;
+    int i;
+
+    test_tally_init(&t);
+    if (test_open(PAIRADMIN_OVERFLOW_DROP_OLDEST, 0) != 0) {
+        test_failures++;
+        return;
+    }
+
+    // A consumer that keeps falling behind: the ring never empties
+    for (i = 0; i < 3000; i++) {
+        test_payload[0] = (unsigned char)('a' + i % 26);
+        test_write();
+        if (i % 10 == 9) {
+            test_read(&t, 4096);
+        }
+    }
+    test_read(&t, 0);
+    test_write();
+    test_read(&t, 0);
+
+    CHECK(pairadmin_get_dropped_events() > 0);
+    CHECK(t.gap_records == pairadmin_get_dropped_events());
+    CHECK(t.gap_bytes == pairadmin_get_dropped_bytes());
+    CHECK(t.records + t.gap_records == 3001);
+
+    // At most one marker per time the consumer made room, not one per record
+    CHECK(t.gaps > 0 && t.gaps <= 300 + 1);
+    CHECK(t.gaps * 5 < t.records);
+
+    // The newest records survive
+    CHECK(t.text[0] == (char)('a' + 2999 % 26));
+    CHECK(t.sequence_ok);
+    test_payload[0] = 0;
+}
+
+static void test_coalesce(void)
+{
+    TestTally t;
+    int i;
+
+    test_tally_init(&t);
+    if (test_open(PAIRADMIN_OVERFLOW_COALESCE, 0) != 0) {
+        test_failures++;
+        return;
+    }
+    for (i = 0; i < 300; i++) {
+        test_write();
+    }
+    pairadmin_hook_output("xy", 2);
+    pairadmin_hook_output("z", 1);
+
+    // Writes merged into the pending record keep the newest bytes
+    test_read(&t, 0);
+    pairadmin_hook_output("w", 1);
+    test_read(&t, 0);
+    CHECK(strcmp(t.text, "w") == 0);
+    CHECK(t.gap_bytes == pairadmin_get_dropped_bytes());
+    CHECK(t.gap_records == pairadmin_get_dropped_events());
+    CHECK(t.records + t.gap_records < 303);
+    CHECK(t.sequence_ok);
+}
+
+static volatile uint32_t test_consuming = 0;
+
+static void test_consumer(void *arg)
+{
+    TestTally *t = (TestTally *)arg;
+
+    while (pa_load_acquire_u32(&test_consuming)) {
+        pa_sleep_us(200);
+        test_read(t, 8192);
+    }
+    test_read(t, 0);
+}
+
+static void test_block_with_timeout(void)
+{
+    TestTally t;
+    PaThread consumer;
+    uint64_t start;
+    int i;
+
+    // A live consumer, however slow, loses nothing
+    test_tally_init(&t);
+    if (test_open(PAIRADMIN_OVERFLOW_BLOCK_WITH_TIMEOUT, 1000000) != 0) {
+        test_failures++;
+        return;
+    }
+    test_consuming = 1;
+    CHECK(pa_thread_start(&consumer, test_consumer, &t) == 0);
+    for (i = 0; i < 1000; i++) {
+        test_write();
+    }
+    pa_store_release_u32(&test_consuming, 0);
+    pa_thread_join(&consumer);
+    CHECK(t.records == 1000 && t.gaps == 0);
+    CHECK(pairadmin_get_dropped_events() == 0);
+
+    // A stalled one costs one timeout, then writes drop at once
+    test_tally_init(&t);
+    if (test_open(PAIRADMIN_OVERFLOW_BLOCK_WITH_TIMEOUT, 20000) != 0) {
+        test_failures++;
+        return;
+    }
+    for (i = 0; i < 128; i++) {
+        test_write();
+    }
+    start = pa_now_us();
+    test_write();
+    CHECK(pa_now_us() - start >= 20000);
+    start = pa_now_us();
+    for (i = 0; i < 10; i++) {
+        test_write();
+    }
+    CHECK(pa_now_us() - start < 20000);
+
+    test_read(&t, 0);
+    test_write();
+    test_read(&t, 0);
+    CHECK(t.gaps == 1);
+    CHECK(t.gap_records == pairadmin_get_dropped_events());
+    CHECK(t.records + t.gap_records == 140);
+}
+
+int main(void)
+{
+    test_drop_newest();
+    test_drop_oldest();
+    test_coalesce();
+    test_block_with_timeout();
+
+    pairadmin_ring_close();
+    pairadmin_set_overflow_policy(PAIRADMIN_OVERFLOW_DROP_NEWEST, 0);
+    return test_finish("pairadmin_ring_test");
+}
@@ -0,0 +1,202 @@
+// Screen model tests for PairAdmin
+//
+// Feeds a curses-style redraw holding cursor movement, erases, deleted
+// characters, skipped strings and wide UTF-8 through the output hook,
+// whole and cut into fragments at every point, and checks that the
+// snapshot is the same however it was split. Then follows the row
+// generations: only the rows a fragment touched come back as changes,
+// a fragment that changes nothing leaves the generation alone, and the
+// alternate screen gives the main one back as it was.
+//
+//   pairadmin_screen_test
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_test.h"
+
+#define TEST_COLS 20
+#define TEST_ROWS 5
+
+static char test_snapshot[4096];
+static unsigned char test_changes[4096];
+
+static const char test_redraw[] =
+    "\x1b[H\x1b[2J"
+    "top - 12:00:01\r\n"
+    "\x1b]0;user@host\x07"
+    "\x1b[1;31mCPU\x1b[0m 5%\r\n"
+    "\xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x8e\x89 \xc3\xa9\r\n"
+    "\x1b[5;1Hbottom"
+    "\x1b[2;5H\x1b[K"
+    "\x1b[1;7H\x1b[2P"
+    "\x1b[4;3Hmid\x1bPq#0;2;0\x1b\\!";
+
+static const char test_screen[] =
+    "top - :00:01\n"
+    "CPU\n"
+    "\xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x8e\x89 \xc3\xa9\n"
+    "  mid!\n"
+    "bottom\n";
+
+static void test_write(const char *text)
+{
+    pairadmin_hook_output(text, strlen(text));
+}
+
+static size_t test_snap(PairAdminScreenInfo *info)
+{
+    size_t n = pairadmin_get_screen_snapshot(NULL, test_snapshot, sizeof(test_snapshot) - 1, info);
+
+    test_snapshot[n] = '\0';
+    return n;
+}
+
+static void test_reopen(void)
+{
+    pairadmin_screen_close(NULL);
+    CHECK(pairadmin_screen_open(NULL, TEST_COLS, TEST_ROWS) == 0);
+}
+
+static void test_expect(const char *what, size_t at)
+{
+    PairAdminScreenInfo info;
+
+    test_snap(&info);
+    if (strcmp(test_snapshot, test_screen) != 0) {
+        fprintf(stderr, "%s %u: got \"%s\"\n", what, (unsigned)at, test_snapshot);
+    }
+    CHECK(strcmp(test_snapshot, test_screen) == 0);
+    CHECK(info.cursor_row == 3 && info.cursor_col == 6);
+}
+
+static void test_fragments(void)
+{
+    size_t len = strlen(test_redraw);
+    size_t step;
+    size_t cut;
+
+    for (step = 1; step <= 8; step++) {
+        size_t i;
+
+        test_reopen();
+        for (i = 0; i < len; i += step) {
+            pairadmin_hook_output(test_redraw + i, len - i < step ? len - i : step);
+        }
+        test_expect("step", step);
+    }
+
+    for (cut = 1; cut < len; cut++) {
+        test_reopen();
+        pairadmin_hook_output(test_redraw, cut);
+        pairadmin_hook_output(test_redraw + cut, len - cut);
+        test_expect("cut", cut);
+    }
+}
+
+// Rows changed after since, as "row:text" lines
+static int32_t test_diff(uint64_t since, char *out, size_t cap)
+{
+    size_t written = 0;
+    size_t used = 0;
+    size_t at = 0;
+    int32_t rows;
+    int32_t i;
+
+    rows = pairadmin_get_screen_changes(NULL, since, test_changes, sizeof(test_changes), &written, NULL);
+    out[0] = '\0';
+    for (i = 0; i < rows; i++) {
+        const PairAdminScreenRow *row = (const PairAdminScreenRow *)(test_changes + used);
+        int n = snprintf(out + at, cap - at, "%u:%.*s\n", (unsigned)row->row, (int)row->length,
+                         (const char *)(row + 1));
+
+        at += (size_t)n;
+        used += PAIRADMIN_SCREEN_ROW_SIZE(row->length);
+    }
+    CHECK(rows < 0 || used == written);
+    return rows;
+}
+
+static void test_generations(void)
+{
+    PairAdminScreenInfo info;
+    uint64_t generation;
+    size_t written = 0;
+    char diff[1024];
+
+    test_reopen();
+
+    // Since 0 is the whole screen, blank rows included
+    CHECK(test_diff(0, diff, sizeof(diff)) == TEST_ROWS);
+    CHECK(strcmp(diff, "0:\n1:\n2:\n3:\n4:\n") == 0);
+
+    test_write("one\r\ntwo\r\nthree");
+    test_snap(&info);
+    generation = info.generation;
+    CHECK(generation == 1);
+    CHECK(test_diff(generation, diff, sizeof(diff)) == 0);
+
+    // Attributes and cursor moves alone change no row
+    test_write("\x1b[1m\x1b[H\x1b[0m");
+    test_snap(&info);
+    CHECK(info.generation == generation);
+
+    // One row rewritten, with the sequence split across two fragments
+    test_write("\x1b[2;");
+    test_write("4H!");
+    CHECK(test_diff(generation, diff, sizeof(diff)) == 1);
+    CHECK(strcmp(diff, "1:two!\n") == 0);
+    test_snap(&info);
+    CHECK(info.generation == generation + 1);
+    generation = info.generation;
+
+    // A scroll region moves only the rows inside it
+    test_write("\x1b[2;3r\x1b[3;1H\n");
+    CHECK(test_diff(generation, diff, sizeof(diff)) == 2);
+    CHECK(strcmp(diff, "1:three\n2:\n") == 0);
+    test_write("\x1b[r");
+
+    // Too small a buffer reports what it would take
+    CHECK(pairadmin_get_screen_changes(NULL, 0, test_changes, 8, &written, NULL) == -1);
+    CHECK(written == PAIRADMIN_SCREEN_ROW_SIZE(3) + PAIRADMIN_SCREEN_ROW_SIZE(5) +
+                         3 * PAIRADMIN_SCREEN_ROW_SIZE(0));
+}
+
+static void test_alternate(void)
+{
+    PairAdminScreenInfo before;
+    PairAdminScreenInfo info;
+    char main_screen[sizeof(test_snapshot)];
+
+    test_reopen();
+    test_write("$ vim notes\r\n");
+    test_snap(&before);
+    memcpy(main_screen, test_snapshot, sizeof(main_screen));
+
+    test_write("\x1b[?1049h\x1b[H~\r\n~\x1b[1;1Hhello");
+    test_snap(&info);
+    CHECK(info.flags == PAIRADMIN_SCREEN_ALTERNATE);
+    CHECK(strcmp(test_snapshot, "hello\n~\n") == 0);
+
+    test_write("\x1b[?1049");
+    test_write("l");
+    test_snap(&info);
+    CHECK(info.flags == 0);
+    CHECK(strcmp(test_snapshot, main_screen) == 0);
+    CHECK(info.cursor_row == before.cursor_row && info.cursor_col == before.cursor_col);
+}
+
+int main(void)
+{
+    test_fragments();
+    test_generations();
+    test_alternate();
+
+    pairadmin_screen_close(NULL);
+
+    // Without a model there is nothing to read
+    CHECK(test_snap(NULL) == 0);
+    CHECK(pairadmin_get_screen_changes(NULL, 0, test_changes, sizeof(test_changes), NULL, NULL) == -1);
+
+    return test_finish("pairadmin_screen_test");
+}
@@ -0,0 +1,345 @@
+// Session lifecycle tests for PairAdmin
+//
+// Drives per-session handles through a scripted backend: create,
+// connect, output and input from the session thread, disconnect, a
+// second disconnect that must do nothing, a connection the far end
+// closes, one that is refused, and destroy while connected. Destroying
+// while the delivery thread is inside a slow callback must wait for it
+// and still deliver everything queued, the shutdown last. The
+// process-wide session must take init and shutdown twice.
+//
+//   pairadmin_session_test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+#include "pairadmin_test.h"
+
+#define TEST_WAIT_US 5000000
+#define TEST_TICKS 200
+#define TEST_TYPES 16
+
+// ------------------------------------------------------------
+// Scripted backend
+// ------------------------------------------------------------
+
+typedef struct TestBackend {
+    volatile uint32_t opens;
+    volatile uint32_t closes;
+    volatile uint32_t refuse;       // open() fails
+    volatile uint32_t hang_up;      // run() reports the far end closed
+    volatile uint32_t say;          // run() sends one output and one input
+    volatile uint32_t ticking;      // run() sends a line each pass
+    volatile uint32_t ticks;
+    int connected;
+    const char *error;
+} TestBackend;
+
+static TestBackend test_backend;
+
+static int test_open(void *ctx, void *parent_hwnd, const char *host, int port, const char *user)
+{
+    TestBackend *b = (TestBackend *)ctx;
+
+    (void)parent_hwnd;
+    (void)host;
+    (void)port;
+    (void)user;
+    pa_atomic_inc_u32(&b->opens);
+    if (pa_load_acquire_u32(&b->refuse)) {
+        b->error = "Connection refused";
+        return -1;
+    }
+    b->connected = 0;
+    b->error = NULL;
+    return 0;
+}
+
+static int test_run(void *ctx, uint32_t timeout_ms)
+{
+    TestBackend *b = (TestBackend *)ctx;
+
+    (void)timeout_ms;
+    if (!b->connected) {
+        b->connected = 1;
+        return PAIRADMIN_BACKEND_CONNECTED;
+    }
+    if (pa_load_acquire_u32(&b->hang_up)) {
+        b->error = "Connection reset by peer";
+        return PAIRADMIN_BACKEND_CLOSED;
+    }
+    if (pa_load_acquire_u32(&b->say)) {
+        pairadmin_hook_output("hello\r\n", 7);
+        pairadmin_hook_input("ls\r", 3);
+        pa_store_release_u32(&b->say, 0);
+    }
+    if (pa_load_acquire_u32(&b->ticking) && b->ticks < TEST_TICKS) {
+        pairadmin_hook_output("tick\n", 5);
+        pa_store_release_u32(&b->ticks, b->ticks + 1);
+    }
+    pa_sleep_us(1000);
+    return PAIRADMIN_BACKEND_PENDING;
+}
+
+static void test_close(void *ctx)
+{
+    pa_atomic_inc_u32(&((TestBackend *)ctx)->closes);
+}
+
+static const char *test_error(void *ctx)
+{
+    return ((TestBackend *)ctx)->error;
+}
+
+// ------------------------------------------------------------
+// What a session's callback saw
+// ------------------------------------------------------------
+
+typedef struct TestLog {
+    uint32_t id;
+    volatile uint32_t seen[TEST_TYPES];
+    volatile uint32_t events;
+    uint32_t last;                  // Type of the last event
+    char text[64];                  // Payload of the last lifecycle event
+    char output[64];                // First OUTPUT and INPUT payloads
+    char input[64];
+    volatile uint32_t outputs;
+    uint64_t block_us;              // The first OUTPUT sleeps this long
+    volatile uint32_t inside;
+} TestLog;
+
+static void test_copy(char *to, size_t cap, const void *data, size_t len)
+{
+    len = len < cap - 1 ? len : cap - 1;
+    memcpy(to, data, len);
+    to[len] = '\0';
+}
+
+static void test_callback(uint32_t session_id, PairAdminEventType event, const void *data, size_t len,
+                          void *user)
+{
+    TestLog *log = (TestLog *)user;
+
+    pa_store_release_u32(&log->inside, 1);
+    CHECK(session_id == log->id);
+
+    switch (event) {
+    case PAIRADMIN_EVENT_OUTPUT:
+        if (log->outputs++ == 0) {
+            test_copy(log->output, sizeof(log->output), data, len);
+            if (log->block_us) {
+                pa_sleep_us(log->block_us);
+            }
+        }
+        break;
+    case PAIRADMIN_EVENT_INPUT:
+        test_copy(log->input, sizeof(log->input), data, len);
+        break;
+    case PAIRADMIN_EVENT_CONNECTED:
+    case PAIRADMIN_EVENT_DISCONNECTED:
+    case PAIRADMIN_EVENT_ERROR:
+        test_copy(log->text, sizeof(log->text), data, len);
+        break;
+    default:
+        break;
+    }
+    log->last = (uint32_t)event;
+    if ((uint32_t)event < TEST_TYPES) {
+        pa_store_release_u32(&log->seen[event], log->seen[event] + 1);
+    }
+    pa_store_release_u32(&log->events, log->events + 1);
+    pa_store_release_u32(&log->inside, 0);
+}
+
+static void test_reset(TestLog *log)
+{
+    PairAdminSessionBackend backend;
+
+    memset(log, 0, sizeof(*log));
+    memset(&test_backend, 0, sizeof(test_backend));
+    backend.ctx = &test_backend;
+    backend.open = test_open;
+    backend.run = test_run;
+    backend.close = test_close;
+    backend.error = test_error;
+    CHECK(pairadmin_set_session_backend(&backend) == 0);
+}
+
+static PairAdminSession *test_create(TestLog *log)
+{
+    PairAdminSession *s = pairadmin_session_create(test_callback, log, NULL, 0);
+
+    CHECK(s != NULL);
+    if (s) {
+        log->id = pairadmin_session_get_id(s);
+    }
+    return s;
+}
+
+// Wait until the callback has seen n events of this type
+static int test_wait(TestLog *log, PairAdminEventType event, uint32_t n)
+{
+    uint64_t end = pa_now_us() + TEST_WAIT_US;
+
+    while (pa_load_acquire_u32(&log->seen[event]) < n) {
+        if (pa_now_us() > end) {
+            fprintf(stderr, "no event %d after %u\n", (int)event, (unsigned)log->seen[event]);
+            return 0;
+        }
+        pa_sleep_us(1000);
+    }
+    return 1;
+}
+
+// ------------------------------------------------------------
+// Tests
+// ------------------------------------------------------------
+
+static void test_lifecycle(void)
+{
+    PairAdminSessionStats stats;
+    PairAdminSession *s;
+    TestLog log;
+
+    test_reset(&log);
+    s = test_create(&log);
+    if (!s) {
+        return;
+    }
+    CHECK(log.id >= 1);
+    CHECK(pairadmin_session_get_state(s) == PAIRADMIN_STATE_READY);
+
+    CHECK(pairadmin_session_connect(s, "example.org", 22, "admin") == 0);
+    CHECK(test_wait(&log, PAIRADMIN_EVENT_CONNECTED, 1));
+    CHECK(pairadmin_session_get_state(s) == PAIRADMIN_STATE_CONNECTED);
+    CHECK(strcmp(log.text, "example.org:22") == 0);
+    CHECK(pairadmin_session_connect(s, "example.org", 22, NULL) == -1);
+    CHECK(strcmp(pairadmin_session_get_error(s), "A session is already active") == 0);
+
+    // Hooks called on the session thread reach this session's callback
+    pa_store_release_u32(&test_backend.say, 1);
+    CHECK(test_wait(&log, PAIRADMIN_EVENT_COMMAND, 1));
+    CHECK(strcmp(log.output, "hello\r\n") == 0);
+    CHECK(strcmp(log.input, "ls\r") == 0);
+
+    pairadmin_session_disconnect(s);
+    CHECK(test_wait(&log, PAIRADMIN_EVENT_DISCONNECTED, 1));
+    CHECK(pairadmin_session_get_state(s) == PAIRADMIN_STATE_READY);
+    CHECK(strcmp(log.text, "Disconnected") == 0);
+    CHECK(test_backend.closes == 1);
+
+    // Closing what is closed already does nothing
+    pairadmin_session_disconnect(s);
+    pa_sleep_us(50000);
+    CHECK(log.seen[PAIRADMIN_EVENT_DISCONNECTED] == 1);
+    CHECK(test_backend.closes == 1);
+    CHECK(pairadmin_session_get_state(s) == PAIRADMIN_STATE_READY);
+
+    pairadmin_session_get_stats(s, &stats);
+    CHECK(stats.events == log.events && stats.dropped_events == 0);
+
+    // Connected again, then destroyed: the shutdown is the last event
+    CHECK(pairadmin_session_connect(s, "example.org", 2222, NULL) == 0);
+    CHECK(test_wait(&log, PAIRADMIN_EVENT_CONNECTED, 2));
+    pairadmin_session_destroy(s);
+    CHECK(test_backend.opens == 2 && test_backend.closes == 2);
+    CHECK(log.last == PAIRADMIN_EVENT_DISCONNECTED);
+    CHECK(strcmp(log.text, "Session shut down") == 0);
+}
+
+static void test_remote_close(void)
+{
+    PairAdminSession *s;
+    TestLog log;
+
+    test_reset(&log);
+    s = test_create(&log);
+    if (!s) {
+        return;
+    }
+
+    test_backend.refuse = 1;
+    CHECK(pairadmin_session_connect(s, "example.org", 22, NULL) == 0);
+    CHECK(test_wait(&log, PAIRADMIN_EVENT_ERROR, 1));
+    CHECK(strcmp(log.text, "Connection refused") == 0);
+    CHECK(pairadmin_session_get_state(s) == PAIRADMIN_STATE_ERROR);
+    CHECK(test_backend.closes == 0);
+
+    // A failed session can be retried
+    pa_store_release_u32(&test_backend.refuse, 0);
+    CHECK(pairadmin_session_connect(s, "example.org", 22, NULL) == 0);
+    CHECK(test_wait(&log, PAIRADMIN_EVENT_CONNECTED, 1));
+
+    pa_store_release_u32(&test_backend.hang_up, 1);
+    CHECK(test_wait(&log, PAIRADMIN_EVENT_DISCONNECTED, 1));
+    CHECK(strcmp(log.text, "Connection reset by peer") == 0);
+    CHECK(pairadmin_session_get_state(s) == PAIRADMIN_STATE_READY);
+
+    // Neither a disconnect nor destroy closes it a second time
+    pairadmin_session_disconnect(s);
+    pairadmin_session_destroy(s);
+    CHECK(test_backend.closes == 1);
+    CHECK(log.seen[PAIRADMIN_EVENT_DISCONNECTED] == 1);
+}
+
+static void test_destroy_in_callback(void)
+{
+    PairAdminSession *s;
+    uint64_t end;
+    TestLog log;
+
+    test_reset(&log);
+    log.block_us = 300000;
+    s = test_create(&log);
+    if (!s) {
+        return;
+    }
+
+    CHECK(pairadmin_session_connect(s, "example.org", 22, NULL) == 0);
+    CHECK(test_wait(&log, PAIRADMIN_EVENT_CONNECTED, 1));
+    pa_store_release_u32(&test_backend.ticking, 1);
+
+    // Destroyed while the first output's callback sleeps, with more
+    // output queued behind it
+    end = pa_now_us() + TEST_WAIT_US;
+    while ((log.outputs == 0 || pa_load_acquire_u32(&test_backend.ticks) < 10) && pa_now_us() < end) {
+        pa_sleep_us(1000);
+    }
+    CHECK(pa_load_acquire_u32(&log.inside) == 1);
+    pairadmin_session_destroy(s);
+
+    CHECK(log.inside == 0);
+    CHECK(test_backend.ticks >= 10);
+    CHECK(log.outputs == test_backend.ticks);
+    CHECK(log.last == PAIRADMIN_EVENT_DISCONNECTED);
+    CHECK(test_backend.closes == 1);
+}
+
+static void test_process_wide(void)
+{
+    CHECK(pairadmin_init(NULL) == 0);
+    CHECK(pairadmin_init(NULL) == 0);
+    CHECK(pairadmin_get_state() == PAIRADMIN_STATE_READY);
+    CHECK(pairadmin_shutdown() == 0);
+    CHECK(pairadmin_shutdown() == 0);
+    CHECK(pairadmin_get_state() == PAIRADMIN_STATE_NOT_INITIALIZED);
+    CHECK(pairadmin_connect("example.org", 22, NULL) == -1);
+}
+
+int main(void)
+{
+    CHECK(pairadmin_session_create(NULL, NULL, NULL, 0) == NULL);
+    pairadmin_session_destroy(NULL);
+
+    test_lifecycle();
+    test_remote_close();
+    test_destroy_in_callback();
+    test_process_wide();
+
+    if (pairadmin_get_log_path()[0]) {
+        remove(pairadmin_get_log_path());
+    }
+    return test_finish("pairadmin_session_test");
+}
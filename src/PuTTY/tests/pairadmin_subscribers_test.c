@@ -0,0 +1,128 @@
+// Subscriber tests for PairAdmin
+//
+// Adds subscribers to the event ring and checks delivery, and that
+// removing one returns while its callback is still running, including
+// when that callback reads its own dropped count.
+//
+//   pairadmin_subscribers_test
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+#include "pairadmin_test.h"
+
+#define TEST_WAIT_US 5000000
+
+typedef struct TestSubscriber {
+    volatile uint32_t calls;
+    volatile uint32_t inside;
+    volatile int id;
+    int read_dropped;           // Poll pairadmin_get_subscriber_dropped() while inside
+    char last[32];
+} TestSubscriber;
+
+static void test_callback(PairAdminEventType event, const void *data, size_t len, void *user)
+{
+    TestSubscriber *t = (TestSubscriber *)user;
+    uint64_t end;
+
+    (void)event;
+    if (len < sizeof(t->last)) {
+        memcpy(t->last, data, len);
+        t->last[len] = '\0';
+    }
+    pa_store_release_u32(&t->inside, 1);
+    if (t->read_dropped) {
+        // Long enough for the remove below to start while we are here
+        end = pa_now_us() + 100000;
+        while (pa_now_us() < end) {
+            (void)pairadmin_get_subscriber_dropped(t->id);
+        }
+    }
+    pa_store_release_u32(&t->calls, t->calls + 1);
+}
+
+static int test_wait(volatile uint32_t *flag)
+{
+    uint64_t end = pa_now_us() + TEST_WAIT_US;
+
+    while (!pa_load_acquire_u32(flag)) {
+        if (pa_now_us() > end) {
+            return 0;
+        }
+        pa_sleep_us(1000);
+    }
+    return 1;
+}
+
+static void test_delivery(void)
+{
+    TestSubscriber t;
+    int id;
+
+    memset(&t, 0, sizeof(t));
+    id = pairadmin_add_subscriber(test_callback, &t, 1u << PAIRADMIN_EVENT_OUTPUT);
+    CHECK(id > 0);
+
+    pairadmin_hook_input("ignored", 7);
+    pairadmin_hook_output("hello", 5);
+    CHECK(test_wait(&t.calls));
+    pairadmin_remove_subscriber(id);
+    CHECK(t.calls == 1 && strcmp(t.last, "hello") == 0);
+    CHECK(pairadmin_get_subscriber_dropped(id) == 0);
+
+    // Removing again, or an id never handed out, is a no-op
+    pairadmin_remove_subscriber(id);
+    pairadmin_remove_subscriber(PAIRADMIN_MAX_SUBSCRIBERS + 1);
+}
+
+static void test_remove_while_reading_dropped(void)
+{
+    TestSubscriber t;
+    uint32_t calls;
+
+    memset(&t, 0, sizeof(t));
+    t.read_dropped = 1;
+    t.id = pairadmin_add_subscriber(test_callback, &t, 1u << PAIRADMIN_EVENT_OUTPUT);
+    CHECK(t.id > 0);
+
+    pairadmin_hook_output("slow", 4);
+    CHECK(test_wait(&t.inside));
+    pairadmin_remove_subscriber(t.id);
+
+    // The callback finished before remove returned and is not called again
+    calls = t.calls;
+    CHECK(calls == 1);
+    pairadmin_hook_output("late", 4);
+    pa_sleep_us(20000);
+    CHECK(t.calls == calls);
+}
+
+static void test_slots_reused(void)
+{
+    TestSubscriber t;
+    int ids[PAIRADMIN_MAX_SUBSCRIBERS];
+    int i;
+
+    memset(&t, 0, sizeof(t));
+    for (i = 0; i < PAIRADMIN_MAX_SUBSCRIBERS; i++) {
+        ids[i] = pairadmin_add_subscriber(test_callback, &t, 1u << PAIRADMIN_EVENT_OUTPUT);
+        CHECK(ids[i] > 0);
+    }
+    CHECK(pairadmin_add_subscriber(test_callback, &t, 1u << PAIRADMIN_EVENT_OUTPUT) == -1);
+    pairadmin_remove_subscriber(ids[0]);
+    ids[0] = pairadmin_add_subscriber(test_callback, &t, 1u << PAIRADMIN_EVENT_OUTPUT);
+    CHECK(ids[0] > 0);
+    for (i = 0; i < PAIRADMIN_MAX_SUBSCRIBERS; i++) {
+        pairadmin_remove_subscriber(ids[i]);
+    }
+}
+
+int main(void)
+{
+    test_delivery();
+    test_remove_while_reading_dropped();
+    test_slots_reused();
+    return test_finish("pairadmin_subscribers_test");
+}
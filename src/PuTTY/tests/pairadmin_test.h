@@ -0,0 +1,31 @@
+// Shared helpers for the PairAdmin tests
+//
+// Each test is a plain executable run by ctest: CHECK() records a
+// failure and carries on, test_finish() reports and picks the exit code.
+
+#ifndef PAIRADMIN_TEST_H
+#define PAIRADMIN_TEST_H
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                               \
+        }                                                                  \
+    } while (0)
+
+static int test_finish(const char *name)
+{
+    if (test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif // PAIRADMIN_TEST_H
@@ -0,0 +1,192 @@
+// UTF-8 boundary tests for PairAdmin
+//
+// Feeds output holding two-, three- and four-byte characters through
+// the output hook, cut at every byte, and checks the OUTPUT records
+// that come out: none ends inside a character, each is flagged as
+// well-formed UTF-8, and together they are the output as it was sent.
+// A character still incomplete when the session ends goes out as it is
+// ahead of the session event, broken bytes are never held, and payloads
+// too large for one record are cut between characters.
+//
+//   pairadmin_utf8_test
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+#include "pairadmin_test.h"
+
+#define TEST_TEXT_MAX (64 * 1024)
+
+static unsigned char test_buffer[4 * PAIRADMIN_READ_BUFFER_MIN];
+
+// Payloads of one event type, concatenated, and what the records were
+static char test_text[TEST_TEXT_MAX];
+static size_t test_length;
+static unsigned test_types[8];
+static unsigned test_flags[8];
+static int test_records;
+static int test_unflagged;      // Records of that type without PAIRADMIN_TEXT_UTF8
+
+static void test_drain(PairAdminEventType want)
+{
+    size_t n;
+
+    test_length = 0;
+    test_records = 0;
+    test_unflagged = 0;
+    while ((n = pairadmin_read_events(test_buffer, sizeof(test_buffer))) > 0) {
+        size_t i;
+
+        for (i = 0; i < n;) {
+            const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(test_buffer + i);
+
+            if (test_records < 8) {
+                test_types[test_records] = hdr->type;
+                test_flags[test_records] = hdr->flags;
+            }
+            test_records++;
+            if (hdr->type == (uint16_t)want) {
+                if (!(hdr->flags & PAIRADMIN_TEXT_UTF8)) {
+                    test_unflagged++;
+                }
+                if (test_length + hdr->length <= sizeof(test_text)) {
+                    memcpy(test_text + test_length, hdr + 1, hdr->length);
+                    test_length += hdr->length;
+                }
+            }
+            i += PAIRADMIN_RECORD_SIZE(hdr->length);
+        }
+    }
+}
+
+static const char test_mixed[] =
+    "h\xc3\xa9llo \xe2\x86\x92 \xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x8e\x89 end\n";
+
+// Every record well-formed, all of them together the text
+static void test_check(const char *want, size_t len, const char *what, size_t at)
+{
+    if (test_length != len || memcmp(test_text, want, len) != 0 || test_unflagged) {
+        fprintf(stderr, "%s %u: %u bytes, %d unflagged\n", what, (unsigned)at, (unsigned)test_length,
+                test_unflagged);
+    }
+    CHECK(test_length == len && memcmp(test_text, want, len) == 0);
+    CHECK(test_unflagged == 0);
+}
+
+static void test_splits(void)
+{
+    size_t len = strlen(test_mixed);
+    size_t step;
+    size_t cut;
+
+    for (cut = 1; cut < len; cut++) {
+        pairadmin_hook_output(test_mixed, cut);
+        pairadmin_hook_output(test_mixed + cut, len - cut);
+        test_drain(PAIRADMIN_EVENT_OUTPUT);
+        test_check(test_mixed, len, "cut", cut);
+    }
+
+    // A byte at a time: the four-byte character is held over three calls
+    for (step = 1; step <= 5; step++) {
+        size_t i;
+
+        for (i = 0; i < len; i += step) {
+            pairadmin_hook_output(test_mixed + i, len - i < step ? len - i : step);
+        }
+        test_drain(PAIRADMIN_EVENT_OUTPUT);
+        test_check(test_mixed, len, "step", step);
+    }
+
+    // Through the escape filter the text stays whole as well
+    pairadmin_set_vt_filter(PAIRADMIN_VT_REPLACE);
+    for (cut = 1; cut < 12; cut++) {
+        static const char in[] = "\xe6\x97\xa5\x1b[1m\xf0\x9f\x8e\x89\x1b[0m\xc3\xa9";
+        static const char out[] = "\xe6\x97\xa5\xf0\x9f\x8e\x89\xc3\xa9";
+
+        pairadmin_hook_output(in, cut);
+        pairadmin_hook_output(in + cut, strlen(in) - cut);
+        test_drain(PAIRADMIN_EVENT_OUTPUT_TEXT);
+        test_check(out, strlen(out), "text cut", cut);
+    }
+    pairadmin_set_vt_filter(PAIRADMIN_VT_OFF);
+}
+
+static void test_flags_reported(void)
+{
+    pairadmin_hook_output("plain\n", 6);
+    test_drain(PAIRADMIN_EVENT_OUTPUT);
+    CHECK(test_records == 1 && test_flags[0] == (PAIRADMIN_TEXT_ASCII | PAIRADMIN_TEXT_UTF8));
+
+    pairadmin_hook_output("caf\xc3\xa9\n", 6);
+    test_drain(PAIRADMIN_EVENT_OUTPUT);
+    CHECK(test_records == 1 && test_flags[0] == PAIRADMIN_TEXT_UTF8);
+
+    // Broken sequences are passed on at once, not held, and flagged
+    pairadmin_hook_output("ab\xe2\x82", 4);
+    pairadmin_hook_output("x\n", 2);
+    test_drain(PAIRADMIN_EVENT_OUTPUT);
+    CHECK(test_length == 6 && memcmp(test_text, "ab\xe2\x82x\n", 6) == 0);
+    CHECK(test_records == 2 && test_flags[1] == 0);
+
+    pairadmin_hook_output("\xff\xfe", 2);
+    test_drain(PAIRADMIN_EVENT_OUTPUT);
+    CHECK(test_records == 1 && test_length == 2 && test_flags[0] == 0);
+}
+
+// The session ends inside a character: its bytes go out before the event
+static void test_flush_on_session_end(void)
+{
+    pairadmin_hook_output("abc\xf0\x9f", 5);
+    test_drain(PAIRADMIN_EVENT_OUTPUT);
+    CHECK(test_length == 3 && memcmp(test_text, "abc", 3) == 0);
+
+    pa_session_route(PAIRADMIN_EVENT_DISCONNECTED, "closed", 6);
+    test_drain(PAIRADMIN_EVENT_OUTPUT);
+    CHECK(test_records == 2);
+    CHECK(test_types[0] == PAIRADMIN_EVENT_OUTPUT && test_types[1] == PAIRADMIN_EVENT_DISCONNECTED);
+    CHECK(test_length == 2 && memcmp(test_text, "\xf0\x9f", 2) == 0);
+    CHECK(test_flags[0] == 0);
+
+    // Nothing is left over for the next connection
+    pa_session_route(PAIRADMIN_EVENT_CONNECTED, "open", 4);
+    pairadmin_hook_output("\xc3\xa9", 2);
+    test_drain(PAIRADMIN_EVENT_OUTPUT);
+    CHECK(test_length == 2 && memcmp(test_text, "\xc3\xa9", 2) == 0 && test_unflagged == 0);
+}
+
+// More than one record's worth in one call: cut between characters
+static void test_large_payload(void)
+{
+    static char big[3 * 6000 + 1];
+    size_t len;
+    size_t i;
+
+    big[0] = 'a';
+    for (i = 0; i < 6000; i++) {
+        memcpy(big + 1 + 3 * i, "\xe2\x82\xac", 3);
+    }
+    len = 1 + 3 * 6000;
+    CHECK(len > PAIRADMIN_MAX_PAYLOAD);
+
+    pairadmin_hook_output(big, len);
+    test_drain(PAIRADMIN_EVENT_OUTPUT);
+    CHECK(test_records == 2);
+    test_check(big, len, "large", len);
+}
+
+int main(void)
+{
+    if (pairadmin_ring_open(0) != 0) {
+        fprintf(stderr, "cannot open the event ring\n");
+        return 1;
+    }
+
+    test_splits();
+    test_flags_reported();
+    test_flush_on_session_end();
+    test_large_payload();
+
+    pairadmin_ring_close();
+    return test_finish("pairadmin_utf8_test");
+}
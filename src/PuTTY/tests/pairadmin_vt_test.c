@@ -0,0 +1,170 @@
+// Escape filter tests for PairAdmin
+//
+// Feeds terminal output holding CSI, OSC, DCS and other sequences
+// through the output hook with the filter on, whole and cut into
+// fragments at every point, and checks the OUTPUT_TEXT that comes out:
+// the same text however the sequences were split, raw OUTPUT untouched
+// alongside it, and nothing of OUTPUT in replace mode.
+//
+//   pairadmin_vt_test
+
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_test.h"
+
+#define TEST_TEXT_MAX 512
+
+static unsigned char test_buffer[4 * PAIRADMIN_READ_BUFFER_MIN];
+
+// Payloads of OUTPUT and of OUTPUT_TEXT, each concatenated
+static char test_raw[TEST_TEXT_MAX];
+static char test_text[TEST_TEXT_MAX];
+static size_t test_raw_length;
+static size_t test_text_length;
+
+static void test_drain(void)
+{
+    size_t n;
+
+    test_raw_length = 0;
+    test_text_length = 0;
+    while ((n = pairadmin_read_events(test_buffer, sizeof(test_buffer))) > 0) {
+        size_t i;
+
+        for (i = 0; i < n;) {
+            const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(test_buffer + i);
+
+            if (hdr->type == PAIRADMIN_EVENT_OUTPUT && test_raw_length + hdr->length < TEST_TEXT_MAX) {
+                memcpy(test_raw + test_raw_length, hdr + 1, hdr->length);
+                test_raw_length += hdr->length;
+            } else if (hdr->type == PAIRADMIN_EVENT_OUTPUT_TEXT &&
+                       test_text_length + hdr->length < TEST_TEXT_MAX) {
+                memcpy(test_text + test_text_length, hdr + 1, hdr->length);
+                test_text_length += hdr->length;
+            }
+            i += PAIRADMIN_RECORD_SIZE(hdr->length);
+        }
+    }
+    test_raw[test_raw_length] = '\0';
+    test_text[test_text_length] = '\0';
+}
+
+typedef struct TestCase {
+    const char *in;
+    const char *out;
+} TestCase;
+
+static const TestCase test_cases[] = {
+    // CSI: colours, cursor movement, private modes
+    { "\x1b[1;31mred\x1b[0m plain\r\n",
+      "red plain\n" },
+    { "\x1b[2J\x1b[H\x1b[?25lhidden\x1b[?25h\n",
+      "hidden\n" },
+    // OSC ended by BEL and by ST
+    { "\x1b]0;title\x07text\x1b]2;other title\x1b\\ more\n",
+      "text more\n" },
+    // DCS, APC and PM strings up to ST
+    { "a\x1bPq#0;2;0;0;0\x1b\\b\x1b_apc\x1b\\c\x1b^pm\x1b\\d\n",
+      "abcd\n" },
+    // Charset designation, keypad mode and a lone ESC final
+    { "\x1b(B\x1b=x\x1b" "7y\x1b" "8z\n",
+      "xyz\n" },
+    // CAN aborts a sequence; C0 controls other than TAB and LF go
+    { "\x1b[12\x18" "ok\t\x07\x08\x7f!\n",
+      "ok\t!\n" },
+    // UTF-8 text passes through
+    { "\x1b[32m\xc3\xa9t\xc3\xa9\x1b[0m \xe2\x9c\x93\n",
+      "\xc3\xa9t\xc3\xa9 \xe2\x9c\x93\n" }
+};
+
+// Output in fragments of `step` bytes (0 for one piece)
+static void test_output(const char *text, size_t step)
+{
+    size_t len = strlen(text);
+    size_t i;
+
+    if (step == 0) {
+        step = len;
+    }
+    for (i = 0; i < len; i += step) {
+        pairadmin_hook_output(text + i, len - i < step ? len - i : step);
+    }
+}
+
+static void test_fragments(void)
+{
+    size_t i;
+    size_t step;
+    size_t cut;
+
+    pairadmin_set_vt_filter(PAIRADMIN_VT_REPLACE);
+    for (i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+        const char *in = test_cases[i].in;
+        size_t len = strlen(in);
+
+        // Whole, and cut every 1..7 bytes
+        for (step = 0; step <= 7; step++) {
+            test_output(in, step);
+            test_drain();
+            if (strcmp(test_text, test_cases[i].out) != 0) {
+                fprintf(stderr, "case %u step %u: got \"%s\"\n", (unsigned)i, (unsigned)step, test_text);
+            }
+            CHECK(strcmp(test_text, test_cases[i].out) == 0);
+            CHECK(test_raw_length == 0);
+        }
+
+        // In two pieces, cut at every byte
+        for (cut = 1; cut < len; cut++) {
+            pairadmin_hook_output(in, cut);
+            pairadmin_hook_output(in + cut, len - cut);
+            test_drain();
+            if (strcmp(test_text, test_cases[i].out) != 0) {
+                fprintf(stderr, "case %u cut %u: got \"%s\"\n", (unsigned)i, (unsigned)cut, test_text);
+            }
+            CHECK(strcmp(test_text, test_cases[i].out) == 0);
+        }
+    }
+}
+
+static void test_modes(void)
+{
+    static const char in[] = "\x1b[1mbold\x1b[0m\n";
+
+    // Alongside: raw OUTPUT untouched, then the text
+    pairadmin_set_vt_filter(PAIRADMIN_VT_ALONGSIDE);
+    test_output(in, 3);
+    test_drain();
+    CHECK(strcmp(test_raw, in) == 0);
+    CHECK(strcmp(test_text, "bold\n") == 0);
+
+    // Off: raw only
+    pairadmin_set_vt_filter(PAIRADMIN_VT_OFF);
+    test_output(in, 0);
+    test_drain();
+    CHECK(strcmp(test_raw, in) == 0);
+    CHECK(test_text_length == 0);
+
+    // A sequence left open when the mode changes does not swallow what
+    // follows: the parser starts again from the ground state
+    pairadmin_set_vt_filter(PAIRADMIN_VT_REPLACE);
+    pairadmin_hook_output("x\x1b]0;never ended", 16);
+    pairadmin_set_vt_filter(PAIRADMIN_VT_ALONGSIDE);
+    pairadmin_hook_output("visible\n", 8);
+    test_drain();
+    CHECK(strcmp(test_text, "xvisible\n") == 0);
+}
+
+int main(void)
+{
+    if (pairadmin_ring_open(0) != 0) {
+        fprintf(stderr, "cannot open the event ring\n");
+        return 1;
+    }
+
+    test_fragments();
+    test_modes();
+
+    pairadmin_ring_close();
+    return test_finish("pairadmin_vt_test");
+}
@@ -0,0 +1,254 @@
+// Replay a recorded PairAdmin trace
+//
+// Feeds a trace written by pairadmin_record_start() back through
+// pairadmin_replay(), into a counting callback or through the event
+// ring to a consumer thread, at the recorded pacing or as fast as
+// possible, and reports what was delivered and what the callbacks cost.
+// --dump lists the records instead of delivering them.
+//
+//   pairadmin_replay [--speed X | --fast] [--ring] [--slow-us N] [--dump] TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairadmin.h"
+#include "pairadmin_internal.h"
+
+#define REPLAY_EVENT_TYPES 16
+
+static uint64_t replay_events[REPLAY_EVENT_TYPES];
+static uint64_t replay_bytes[REPLAY_EVENT_TYPES];
+static uint32_t replay_slow_us = 0;
+
+static const char *replay_event_name(unsigned type)
+{
+    static const char *const names[] = {
+        "?", "OUTPUT", "INPUT", "CONNECTED", "DISCONNECTED", "ERROR", "OUTPUT_TEXT", "GAP", "COMMAND",
+        "PROMPT", "CMD_START", "CMD_END", "DIRECTORY",
+    };
+
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
+
+static void replay_count(unsigned type, size_t len)
+{
+    type = type < REPLAY_EVENT_TYPES ? type : 0;
+    replay_events[type]++;
+    replay_bytes[type] += len;
+    if (replay_slow_us) {
+        uint64_t until = pa_now_us() + replay_slow_us;
+
+        while (pa_now_us() < until) {
+        }
+    }
+}
+
+static void replay_callback(PairAdminEventType event, const void *data, size_t len)
+{
+    (void)data;
+    replay_count((unsigned)event, len);
+}
+
+typedef struct ReplayConsumer {
+    PaThread thread;
+    volatile uint32_t stop;
+    unsigned char *buffer;
+} ReplayConsumer;
+
+static void replay_consumer_thread(void *arg)
+{
+    ReplayConsumer *c = (ReplayConsumer *)arg;
+
+    for (;;) {
+        size_t n = pairadmin_read_events(c->buffer, 4 * PAIRADMIN_READ_BUFFER_MIN);
+        size_t off = 0;
+
+        if (n == 0) {
+            if (pa_load_acquire_u32(&c->stop)) {
+                break;
+            }
+            pa_thread_yield();
+            continue;
+        }
+        while (off < n) {
+            const PairAdminEventHeader *hdr = (const PairAdminEventHeader *)(c->buffer + off);
+
+            replay_count(hdr->type, hdr->length);
+            off += PAIRADMIN_RECORD_SIZE(hdr->length);
+        }
+    }
+}
+
+static int replay_varint(FILE *f, uint64_t *v)
+{
+    uint64_t result = 0;
+    int shift = 0;
+    int c;
+
+    do {
+        c = fgetc(f);
+        if (c == EOF || shift > 63) {
+            return -1;
+        }
+        result |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    *v = result;
+    return 0;
+}
+
+// One line per record: offset in ms, type, length and a printable preview
+static int replay_dump(const char *path)
+{
+    unsigned char header[PAIRADMIN_TRACE_HEADER_SIZE];
+    unsigned char preview[48];
+    uint64_t at_us = 0;
+    uint64_t records = 0;
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+        memcmp(header, PAIRADMIN_TRACE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s is not a PairAdmin trace\n", path);
+        fclose(f);
+        return 1;
+    }
+
+    for (;;) {
+        uint64_t delta;
+        uint64_t length;
+        size_t shown;
+        size_t i;
+        int type;
+
+        if (replay_varint(f, &delta) != 0 || (type = fgetc(f)) == EOF || replay_varint(f, &length) != 0) {
+            break;
+        }
+        shown = length < sizeof(preview) ? (size_t)length : sizeof(preview);
+        if (fread(preview, 1, shown, f) != shown ||
+            (length > shown && fseek(f, (long)(length - shown), SEEK_CUR) != 0)) {
+            break;
+        }
+        for (i = 0; i < shown; i++) {
+            if (preview[i] < 0x20 || preview[i] >= 0x7f) {
+                preview[i] = '.';
+            }
+        }
+        at_us += delta;
+        printf("%12.3f ms  %-12s %8lu  %.*s\n", (double)at_us / 1000.0, replay_event_name((unsigned)type),
+               (unsigned long)length, (int)shown, (const char *)preview);
+        records++;
+    }
+    fclose(f);
+    printf("%lu records over %.3f s\n", (unsigned long)records, (double)at_us / 1000000.0);
+    return 0;
+}
+
+static void replay_report(int64_t delivered, uint64_t elapsed_us)
+{
+    PairAdminStats stats;
+    uint64_t bytes = 0;
+    unsigned type;
+
+    printf("%-12s %10s %12s\n", "event", "records", "bytes");
+    for (type = 0; type < REPLAY_EVENT_TYPES; type++) {
+        if (replay_events[type]) {
+            printf("%-12s %10lu %12lu\n", replay_event_name(type), (unsigned long)replay_events[type],
+                   (unsigned long)replay_bytes[type]);
+            bytes += replay_bytes[type];
+        }
+    }
+    printf("%ld events replayed in %.3f s (%.1f MB/s)\n", (long)delivered, (double)elapsed_us / 1000000.0,
+           elapsed_us ? (double)bytes / (double)elapsed_us : 0.0);
+
+    pairadmin_get_stats(&stats);
+    if (stats.callback.calls) {
+        printf("callbacks: %lu, mean %lu ns, max %lu ns\n", (unsigned long)stats.callback.calls,
+               (unsigned long)(stats.callback.total_ns / stats.callback.calls),
+               (unsigned long)stats.callback.max_ns);
+    }
+    if (stats.ring_high_water) {
+        printf("ring high-water mark: %lu bytes, %lu records dropped\n", (unsigned long)stats.ring_high_water,
+               (unsigned long)pairadmin_get_dropped_events());
+    }
+}
+
+static void replay_usage(void)
+{
+    fprintf(stderr, "usage: pairadmin_replay [--speed X | --fast] [--ring] [--slow-us N] [--dump] TRACE\n");
+}
+
+int main(int argc, char **argv)
+{
+    ReplayConsumer consumer;
+    const char *path = NULL;
+    double speed = 1.0;
+    int ring = 0;
+    int dump = 0;
+    uint64_t started;
+    int64_t delivered;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fast") == 0) {
+            speed = 0.0;
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--ring") == 0) {
+            ring = 1;
+        } else if (strcmp(argv[i], "--slow-us") == 0 && i + 1 < argc) {
+            replay_slow_us = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dump") == 0) {
+            dump = 1;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            replay_usage();
+            return 2;
+        }
+    }
+    if (!path || speed < 0) {
+        replay_usage();
+        return 2;
+    }
+    if (dump) {
+        return replay_dump(path);
+    }
+
+    memset(&consumer, 0, sizeof(consumer));
+    if (ring) {
+        consumer.buffer = (unsigned char *)malloc(4 * PAIRADMIN_READ_BUFFER_MIN);
+        if (!consumer.buffer || pairadmin_ring_open(0) != 0 ||
+            pa_thread_start(&consumer.thread, replay_consumer_thread, &consumer) != 0) {
+            fprintf(stderr, "cannot open the event ring\n");
+            return 1;
+        }
+    } else {
+        pairadmin_set_callback(replay_callback);
+    }
+
+    started = pa_now_us();
+    delivered = pairadmin_replay(path, speed);
+    if (ring) {
+        pa_store_release_u32(&consumer.stop, 1);
+        pa_thread_join(&consumer.thread);
+    }
+
+    if (delivered < 0) {
+        fprintf(stderr, "%s is not a readable PairAdmin trace\n", path);
+        return 1;
+    }
+    replay_report(delivered, pa_now_us() - started);
+
+    if (ring) {
+        pairadmin_ring_close();
+        free(consumer.buffer);
+    } else {
+        pairadmin_set_callback(NULL);
+    }
+    return 0;
+}
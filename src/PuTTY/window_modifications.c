@@ -58,6 +58,18 @@ HWND putty_get_terminal_hwnd(void)
  *   - SetWindowPos(): Position child window
  *   - Resize child: Synchronize sizes
  *   - Focus management: Transfer focus to child
+ *
+ * Embedding through the DLL:
+ * - pairadmin_embed(parent) and pairadmin_set_bounds(x, y, w, h) may be
+ *   called from PairAdmin's UI thread at any time, before or after the
+ *   window exists. The session thread, which owns hwnd_terminal, applies
+ *   them between two passes of the message loop, so SetParent() and
+ *   SetWindowPos() never wait on a cross-thread SendMessage.
+ * - Bounds are applied at most once per PAIRADMIN_EMBED_FRAME_US; a drag
+ *   that resizes the host 200 times a second reaches WM_SIZE, and hence
+ *   term_size() and the SSH window-change request, about 60 times.
+ * - PAIRADMIN_EVENT_WINDOW reports each new terminal window, so the host
+ *   does not need to poll putty_get_terminal_hwnd() after reconnecting.
  *   - Cleanup: Destroy child when parent is destroyed
  *
  * Performance Impact:
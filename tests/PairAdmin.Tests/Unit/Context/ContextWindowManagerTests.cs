@@ -0,0 +1,77 @@
+using PairAdmin.DataStructures;
+
+namespace PairAdmin.Tests.Unit.Context;
+
+/// <summary>
+/// Unit tests for ContextWindowManager digest context
+/// </summary>
+public class ContextWindowManagerTests
+{
+    private readonly ContextWindowManager _manager;
+    private IReadOnlyList<CommandDigest> _digests = Array.Empty<CommandDigest>();
+
+    public ContextWindowManagerTests()
+    {
+        var logger = new TestLogger<ContextWindowManager>();
+        _manager = new ContextWindowManager(new Mock<IContextProvider>().Object, new ContextSizePolicy(), logger);
+        _manager.SetCommandDigestSource(_ => _digests);
+    }
+
+    private static CommandDigest Digest(ulong sequence, string command, int lines, int exitCode = 0)
+    {
+        return new CommandDigest
+        {
+            Sequence = sequence,
+            CommandLine = command,
+            HeadLines = Enumerable.Range(0, lines).Select(i => $"{command} output line {i:D4}").ToList(),
+            TotalLines = lines,
+            ExitCode = exitCode
+        };
+    }
+
+    [Fact]
+    public void GetDigestContext_AllFit_KeepsEveryDigestInOrder()
+    {
+        // Arrange
+        _digests = new[] { Digest(1, "pwd", 1), Digest(2, "ls", 2) };
+
+        // Act
+        var result = _manager.GetDigestContext(1000);
+
+        // Assert
+        result.WasTruncated.Should().BeFalse();
+        result.TruncatedContext.IndexOf("$ pwd").Should().BeLessThan(result.TruncatedContext.IndexOf("$ ls"));
+    }
+
+    [Fact]
+    public void GetDigestContext_LargeMiddleDigest_KeepsSmallerOlderOnes()
+    {
+        // Arrange
+        _digests = new[] { Digest(1, "pwd", 1), Digest(2, "find", 200), Digest(3, "ls", 2) };
+
+        // Act
+        var result = _manager.GetDigestContext(100);
+
+        // Assert
+        result.WasTruncated.Should().BeTrue();
+        result.TruncatedContext.Should().Contain("$ ls").And.Contain("$ pwd").And.NotContain("$ find");
+        result.TruncatedTokens.Should().BeLessThanOrEqualTo(100);
+    }
+
+    [Fact]
+    public void GetDigestContext_NewestOverBudget_TruncatesIt()
+    {
+        // Arrange
+        _digests = new[] { Digest(1, "pwd", 1), Digest(2, "journalctl", 500, exitCode: 3) };
+
+        // Act
+        var result = _manager.GetDigestContext(100);
+
+        // Assert
+        result.WasTruncated.Should().BeTrue();
+        result.TruncatedContext.Should().StartWith("$ journalctl");
+        result.TruncatedContext.Should().Contain("[... truncated ...]");
+        result.TruncatedContext.Should().EndWith("[exit 3]" + Environment.NewLine);
+        result.TruncatedTokens.Should().BeGreaterThan(0).And.BeLessThanOrEqualTo(100);
+    }
+}
@@ -0,0 +1,51 @@
+namespace PairAdmin.Tests.Unit.Context;
+
+/// <summary>
+/// Unit tests for WorkingDirectoryTracker with shell-reported directories
+/// </summary>
+public class WorkingDirectoryTrackerTests
+{
+    private readonly WorkingDirectoryTracker _tracker;
+
+    public WorkingDirectoryTrackerTests()
+    {
+        var parser = new TerminalPromptParser(new TestLogger<TerminalPromptParser>());
+        _tracker = new WorkingDirectoryTracker(parser, new TestLogger<WorkingDirectoryTracker>());
+    }
+
+    [Fact]
+    public void ParseTerminalOutput_RepeatedPromptsInReportedDirectory_KeepsReport()
+    {
+        // The shell reports before every prompt, including when it has not moved;
+        // the prompts show a shortened path the parser would get wrong
+        for (var i = 0; i < 3; i++)
+        {
+            _tracker.ApplyShellDirectory("/srv/app");
+            _tracker.ParseTerminalOutput("deploy@web:/elsewhere");
+        }
+
+        _tracker.GetCurrentDirectory().Should().Be("/srv/app");
+    }
+
+    [Fact]
+    public void ParseTerminalOutput_PromptWithoutReport_ParsesAgain()
+    {
+        _tracker.ApplyShellDirectory("/srv/app");
+        _tracker.ParseTerminalOutput("deploy@web:/srv/app");
+
+        // ssh to a host whose shell sends no OSC 7
+        _tracker.ParseTerminalOutput("admin@db:/var/lib");
+
+        _tracker.GetCurrentDirectory().Should().Be("/var/lib");
+    }
+
+    [Fact]
+    public void ParseTerminalOutput_OutputBetweenPrompts_DoesNotEndReport()
+    {
+        _tracker.ApplyShellDirectory("/srv/app");
+        _tracker.ParseTerminalOutput("total 12");
+        _tracker.ParseTerminalOutput("deploy@web:/elsewhere");
+
+        _tracker.GetCurrentDirectory().Should().Be("/srv/app");
+    }
+}
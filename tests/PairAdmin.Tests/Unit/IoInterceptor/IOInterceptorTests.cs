@@ -0,0 +1,36 @@
+using PairAdmin.IoInterceptor;
+using PairAdmin.IoInterceptor.Services;
+
+namespace PairAdmin.Tests.Unit.IoInterceptor;
+
+/// <summary>
+/// Unit tests for IOInterceptor argument validation
+/// </summary>
+public class IOInterceptorTests
+{
+    private readonly IOInterceptor _interceptor = new(new TestLogger<IOInterceptor>());
+
+    [Theory]
+    [InlineData(0)]
+    [InlineData(-1)]
+    [InlineData(14)]
+    [InlineData(32)]
+    [InlineData(40)]
+    public void AddNativeSubscriber_UndefinedEventType_Throws(int eventType)
+    {
+        var act = () => _interceptor.AddNativeSubscriber(new[] { 1, eventType }, (_, _) => { });
+
+        act.Should().Throw<ArgumentOutOfRangeException>().WithParameterName("eventTypes");
+    }
+
+    [Theory]
+    [InlineData(0)]
+    [InlineData(14)]
+    [InlineData(32)]
+    public void StartAuditExport_UndefinedEventType_Throws(int eventType)
+    {
+        var act = () => _interceptor.StartAuditExport(NativeExportTransport.Tcp, "localhost:9000", new[] { eventType });
+
+        act.Should().Throw<ArgumentOutOfRangeException>().WithParameterName("eventTypes");
+    }
+}